@@ -22,6 +22,9 @@ start:
     ; Detect memory using E820
     call detect_memory_e820
     
+    ; Copy the boot archive of the userspace programs above 1MB
+    call load_initrd
+    
     ; Setup page tables for identity mapping
     call setup_page_tables
     
@@ -196,6 +199,128 @@ detect_memory_e820:
     pop es
     ret
 
+; Boot archive (layout in include/initrd.h)
+INITRD_LOAD_ADDR equ 0x1400000  ; Where the archive goes (20MB)
+INITRD_INFO      equ 0x8004     ; dword address, dword size (0 = none) for the kernel
+INITRD_BOUNCE    equ 0x1000     ; Segment of the track buffer (0x10000, below the kernel ELF)
+
+; Load /BOOT/INITRD.IMG to INITRD_LOAD_ADDR
+; Sectors are read a track at a time into a buffer below 1MB and copied up
+; with INT 0x15 AH=0x87. Like fat12.asm this assumes the file is contiguous;
+; the kernel checks the archive's checksum before using it. Without an
+; archive (or on a read error) the size stays 0 and programs load from disk.
+load_initrd:
+    push es
+    sti                     ; The floppy BIOS needs IRQ 6
+    mov dword [INITRD_INFO], INITRD_LOAD_ADDR
+    mov dword [INITRD_INFO + 4], 0
+    
+    ; fat12.asm left the first sector of the BOOT folder at 0x9000:0000
+    mov ax, 0x9000
+    mov es, ax
+    xor di, di
+    mov cx, 16
+.find:
+    test byte [es:di + 11], 0x18    ; Skip directories and the volume label
+    jnz .next
+    push cx
+    push di
+    mov si, initrd_filename
+    mov cx, 11
+    repe cmpsb
+    pop di
+    pop cx
+    je .found
+.next:
+    add di, 32
+    loop .find
+    jmp .done
+    
+.found:
+    mov eax, [es:di + 28]   ; File size
+    mov [initrd_size], eax
+    add eax, INITRD_LOAD_ADDR
+    cmp eax, [0x8000]       ; Must end below the highest usable address
+    ja .done
+    mov eax, [initrd_size]
+    add eax, 511
+    shr eax, 9
+    mov [initrd_sectors], ax
+    mov ax, [es:di + 26]    ; First cluster
+    add ax, 31              ; LBA (one sector per cluster, data at LBA 33)
+    mov [initrd_lba], ax
+    mov dword [initrd_dest], INITRD_LOAD_ADDR
+    
+.read_loop:
+    cmp word [initrd_sectors], 0
+    je .loaded
+    
+    ; LBA -> CHS (18 sectors per track, 2 heads)
+    mov ax, [initrd_lba]
+    xor dx, dx
+    mov bx, 18
+    div bx
+    mov cl, dl
+    inc cl                  ; Sector (1-18)
+    mov dh, al
+    and dh, 1               ; Head
+    shr ax, 1
+    mov ch, al              ; Cylinder
+    
+    ; Read to the end of the track, or what is left of the file
+    mov al, 19
+    sub al, cl
+    xor ah, ah
+    cmp ax, [initrd_sectors]
+    jbe .count_ok
+    mov ax, [initrd_sectors]
+.count_ok:
+    mov [initrd_chunk], al
+    mov bx, INITRD_BOUNCE
+    mov es, bx
+    xor bx, bx
+    mov ah, 0x02
+    mov dl, 0               ; First floppy, as in fat12.asm
+    int 0x13
+    jc .error
+    
+    ; Copy the chunk up (descriptor base: 24 bits, then the high byte)
+    mov eax, [initrd_dest]
+    mov [initrd_gdt + 0x1A], ax
+    shr eax, 16
+    mov [initrd_gdt + 0x1C], al
+    mov [initrd_gdt + 0x1F], ah
+    xor cx, cx
+    mov ch, [initrd_chunk]  ; CX = sectors * 256 words
+    push ds
+    pop es
+    mov si, initrd_gdt
+    mov ah, 0x87
+    int 0x15
+    jc .error
+    
+    movzx eax, byte [initrd_chunk]
+    add [initrd_lba], ax
+    sub [initrd_sectors], ax
+    shl eax, 9
+    add [initrd_dest], eax
+    jmp .read_loop
+    
+.loaded:
+    mov eax, [initrd_size]
+    mov [INITRD_INFO + 4], eax
+    mov si, msg_initrd_ok
+    call print_string_16
+    jmp .done
+    
+.error:
+    mov si, msg_initrd_error
+    call print_string_16
+    
+.done:
+    pop es
+    ret
+
 ; Setup identity-mapped page tables
 setup_page_tables:
     ; Clear page table area (4KB * 3 = 12KB)
@@ -252,6 +377,25 @@ error_no_long_mode db 0x0D, 0x0A, 'ERROR: Long mode not supported', 0
 msg_checks_ok db 0x0D, 0x0A, 'CPU checks passed, entering long mode...', 0x0D, 0x0A, 0
 msg_page_tables_ok db 'Page tables setup complete', 0x0D, 0x0A, 0
 msg_entering_pm db 'Entering protected mode...', 0x0D, 0x0A, 0
+msg_initrd_ok db 'Boot archive loaded', 0x0D, 0x0A, 0
+msg_initrd_error db 'Boot archive read failed, programs load from disk', 0x0D, 0x0A, 0
+
+initrd_filename db "INITRD  IMG"
+initrd_size dd 0
+initrd_dest dd 0
+initrd_lba dw 0
+initrd_sectors dw 0
+initrd_chunk db 0
+
+; INT 0x15 AH=0x87 descriptor table: source is the track buffer, the
+; destination base is filled in per chunk
+initrd_gdt:
+    times 16 db 0
+    dw 0xFFFF, 0x0000
+    db 0x01, 0x93, 0x00, 0x00
+    dw 0xFFFF, 0x0000
+    db 0x00, 0x93, 0x00, 0x00
+    times 16 db 0
 
 [bits 32]
 init_pm:
@@ -484,241 +628,15 @@ print_hex:
     pop rax
     ret
 
-; Delay for 64-bit mode
-delay_64:
-    push rcx
-.loop:
-    dec rcx
-    jnz .loop
-    pop rcx
-    ret
-
-; Load kernel from disk and parse ELF
-load_kernel:
-    ; Debug: Show we entered load_kernel
-    push rdi
-    push rsi
-    push rax
-    mov rdi, 0xB8000 + 640
-    mov rsi, msg_in_load_kernel
-    mov ah, 0x0C
-    call print_string_pm
-    pop rax
-    pop rsi
-    pop rdi
-    
-    ; Kernel was already loaded by fat12.asm to 0x20000
-    
-    ; Parse ELF header
-    mov r15, 0x20000        ; R15 = ELF base address (preserve this!)
-    
-    ; Check ELF magic number (0x7F 'E' 'L' 'F')
-    mov eax, [r15]
-    cmp eax, 0x464C457F
-    jne .elf_error
-    
-    ; Get entry point from ELF header (offset 0x18 for 64-bit ELF)
-    mov rax, [r15 + 0x18]
-    mov [kernel_entry], rax
-    
-    ; Get program header offset (offset 0x20)
-    mov rax, [r15 + 0x20]
-    add rax, r15            ; RAX = program header table address
-    
-    ; Get program header entry count (offset 0x38, 2 bytes)
-    movzx rcx, word [r15 + 0x38]
-    
-    ; Get program header entry size (offset 0x36, 2 bytes)
-    movzx rdx, word [r15 + 0x36]
-    
-    ; Save segment count for debugging
-    mov [segment_count], rcx
-    
-    ; Debug: Show segment count
-    push rax
-    push rcx
-    push rdx
-    mov rdi, 0xB8000 + 640
-    mov al, '0'
-    add al, cl          ; Convert count to ASCII (assumes < 10)
-    mov ah, 0x0B        ; Cyan
-    stosw
-    pop rdx
-    pop rcx
-    pop rax
-    
-    ; Initialize loaded segment counter
-    mov qword [segments_loaded], 0
-    
-.load_segments:
-    test rcx, rcx
-    jz .done
-    
-    ; Check if this is a LOAD segment (p_type == 1)
-    cmp dword [rax], 1
-    jne .next_segment
-    
-    ; Increment loaded counter
-    inc qword [segments_loaded]
-    
-    ; Debug: Show we're loading a segment (append to screen)
-    push rax
-    push rcx
-    push rdx
-    push rdi
-    mov rdi, 0xB8000 + 640
-    mov rax, [segments_loaded]
-    shl rax, 1              ; Multiply by 2 (each char is 2 bytes)
-    add rdi, rax            ; Offset by segment count
-    mov al, '*'
-    mov ah, 0x0E
-    stosw
-    pop rdi
-    pop rdx
-    pop rcx
-    pop rax
-    
-    ; Get segment info
-    mov rbx, [rax + 0x08]   ; p_offset - offset in file
-    add rbx, r15            ; RBX = source address (ELF base + offset)
-    mov rdi, [rax + 0x10]   ; p_vaddr - virtual address (destination)
-    mov r8, [rax + 0x20]    ; p_filesz - size in file
-    mov r9, [rax + 0x28]    ; p_memsz - size in memory
-    
-    ; Debug: Show destination and source of first segment only
-    cmp qword [segments_loaded], 1
-    jne .skip_debug
-    push rax
-    push rdi
-    push rbx
-    
-    ; Show destination
-    mov rax, rdi
-    mov rdi, 0xB8000 + 1120  ; Line 7
-    call print_hex
-    
-    ; Show source
-    pop rbx
-    push rbx
-    mov rax, rbx
-    mov rdi, 0xB8000 + 1280  ; Line 8
-    call print_hex
-    
-    pop rbx
-    pop rdi
-    pop rax
-.skip_debug:
-    
-    ; Save destination for debugging (last segment)
-    mov [last_segment_dest], rdi
-    mov [last_segment_size], r8
-    
-    ; Verify source and destination are valid
-    test r8, r8             ; Check if size is non-zero
-    jz .next_segment
-    
-    ; Copy segment to destination
-    ; RDI already contains destination address from line 353
-    ; RBX contains source address
-    ; R8 contains size
-    
-    ; Save copy parameters for verification
-    mov [debug_src], rbx
-    mov [debug_dst], rdi  
-    mov [debug_size], r8
-    
-    ; Save registers that will be modified
-    push rax
-    push rcx
-    push rdx
-    push rsi
-    
-    mov rcx, r8             ; Count
-    mov rsi, rbx            ; Source
-    ; RDI already has destination!
-    
-    rep movsb               ; Copy bytes (modifies RSI, RDI, RCX)
-    
-    ; TODO: Zero out BSS - skipping for now as 4MB takes too long
-    ; Zero out BSS (MemSiz - FileSiz)
-    ; RDI now points right after copied data
-    ; mov rcx, r9             ; MemSiz
-    ; sub rcx, r8             ; MemSiz - FileSiz = BSS size
-    ; jz .no_bss              ; Skip if no BSS
-    ; xor al, al              ; Zero byte
-    ; rep stosb               ; Zero out BSS
-    
-.no_bss:
-    ; Restore registers
-    pop rsi
-    pop rdx
-    pop rcx
-    pop rax
-    
-.next_segment:
-    add rax, rdx            ; Move to next program header
-    dec rcx
-    jmp .load_segments
-    
-.done:
-    ret
-
-.elf_error:
-    mov rdi, 0xB8000 + 320
-    mov rsi, msg_elf_error
-    mov ah, 0x0C            ; Light red on black
-    call print_string_pm
-    cli
-    hlt
-
-; Read sectors from disk using LBA
-; RAX = starting LBA sector
-; RBX = destination address
-; RCX = number of sectors
-read_disk_lba:
-    push rax
-    push rbx
-    push rcx
-    push rdx
-    
-    ; We need to use BIOS interrupts, but we're in long mode
-    ; For simplicity, we'll assume the kernel was already loaded by boot.asm
-    ; In a real implementation, you'd need to either:
-    ; 1. Use ATA PIO mode directly (no BIOS)
-    ; 2. Load everything in boot.asm before switching modes
-    
-    ; For now, just return (kernel should be loaded by updated boot.asm)
-    
-    pop rdx
-    pop rcx
-    pop rbx
-    pop rax
-    ret
-
 ; Data
 msg db 'Hello, World from 64-bit long mode!', 0
 msg_success db 'Successfully booted into x86_64 long mode!', 0
 msg_loading_kernel db 'Loading kernel...', 0
-msg_in_load_kernel db 'In load_kernel', 0
 msg_kernel_loaded db 'Kernel loaded!', 0
 msg_jumping_kernel db 'Jumping to kernel...', 0
-msg_entry_point db 'Entry: ', 0
-msg_copy_src db 'Copy src: ', 0
-msg_copy_dst db 'Copy dst: ', 0
-msg_code_check db 'Code at entry: ', 0
 msg_elf_error db 'ERROR: Invalid ELF file!', 0
 
 kernel_entry dq 0       ; Kernel entry point address
-segment_count dq 0
-segments_loaded dq 0
-last_segment_dest dq 0
-last_segment_size dq 0
-debug_before dq 0
-debug_at dq 0
-debug_after dq 0
-debug_src dq 0
-debug_dst dq 0
-debug_size dq 0
 
 align 16
 ; 32-bit GDT for initial protected mode
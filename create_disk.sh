@@ -22,6 +22,14 @@ mcopy -i disk.img fat12.bin ::/BOOT/FAT12.SYS
 mcopy -i disk.img boot2.bin ::/BOOT/BOOT2.BIN
 mcopy -i disk.img kernel.elf ::/BOOT/KERNEL.ELF
 
+# Boot archive of the programs (built by "make initrd"); boot2 loads it into
+# memory, so it has to be one contiguous file - copy it while the disk is empty
+if [ -f initrd.img ]; then
+    mcopy -i disk.img initrd.img ::/BOOT/INITRD.IMG
+else
+    echo "  No initrd.img - programs will load from disk"
+fi
+
 # Copy userspace programs - copy all .elf files from programs/ root
 echo "Copying userspace programs..."
 for elf_file in programs/*.elf; do
@@ -74,6 +82,9 @@ rm -f "$BPB_TEMP"  # Clean up
 echo -e "\n✓ boot.bin at sector 0 (with BPB preserved)"
 echo "✓ boot2.bin in FAT filesystem as /BOOT2.BIN"
 echo "✓ kernel.elf in FAT filesystem as /KERNEL.ELF"
+if [ -f initrd.img ]; then
+    echo "✓ initrd.img in FAT filesystem as /BOOT/INITRD.IMG"
+fi
 echo "✓ test.sh in FAT filesystem as /TEST.SH"
 echo "✓ story.txt in FAT filesystem as /STORY.TXT"
 
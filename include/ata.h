@@ -12,4 +12,8 @@ int ata_init(void);
 int ata_read_sectors(uint32_t lba, uint8_t sector_count, uint8_t* buffer);
 int ata_write_sectors(uint32_t lba, uint8_t sector_count, const uint8_t* buffer);
 
+// Flush the drive's volatile write cache (FLUSH CACHE EXT on LBA48 drives)
+// Returns: 0 on success, -1 on error or timeout
+int ata_flush_cache(void);
+
 #endif
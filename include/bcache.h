@@ -0,0 +1,39 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// Write-back sector cache
+// Sits between blkdev_read/blkdev_write and a device driver. Small writes
+// are kept dirty in memory and written back at sync points, sorted by LBA
+// and merged into contiguous multi-sector writes. Large transfers bypass
+// the cache (cached copies are kept coherent).
+
+#define BCACHE_BYPASS_SECTORS 64    // Requests this large go straight to the device
+#define BCACHE_MAX_RUN        128   // Sectors per coalesced write-back
+
+typedef struct bcache bcache_t;
+
+// Create a cache holding 'sectors' sectors (rounded up to whole pages)
+// Returns: cache, or NULL if out of memory
+bcache_t* bcache_create(uint32_t sectors);
+
+// Cached read/write on behalf of dev (device I/O goes through dev->read/dev->write)
+// Returns: 0 on success, -1 on error
+int bcache_read(bcache_t* cache, blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer);
+int bcache_write(bcache_t* cache, blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer);
+
+// Read sectors that are not yet cached into the cache (readahead)
+// At most BCACHE_MAX_RUN sectors are fetched; already cached sectors are kept
+// Returns: 0 on success, -1 on error
+int bcache_prefetch(bcache_t* cache, blkdev_t* dev, uint32_t lba, uint32_t count);
+
+// Write every dirty sector back to dev, merging adjacent sectors
+// Returns: 0 on success, -1 on error
+int bcache_writeback(bcache_t* cache, blkdev_t* dev);
+
+// Number of dirty sectors waiting for write-back
+uint32_t bcache_dirty_count(bcache_t* cache);
+
+#endif
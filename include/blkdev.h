@@ -0,0 +1,83 @@
+#ifndef BLKDEV_H
+#define BLKDEV_H
+
+#include <stdint.h>
+#include "iostat.h"
+
+// Block device layer
+// Gives the filesystem drivers one interface over the FDC, ATA and
+// virtio-blk drivers so any of them can back a FAT volume.
+
+#define BLKDEV_SECTOR_SIZE 512
+#define BLKDEV_MAX_DEVICES 8
+#define BLKDEV_WRITEBACK_DELAY_MS 1000  // Idle write-back waits this long after the first write
+
+struct bcache;
+
+typedef struct blkdev {
+    const char* name;       // Short device name ("fd0", "ata0", "vda")
+    uint32_t total_sectors; // Device size in sectors (0 if unknown)
+    
+    // Driver callbacks - buffers must hold count * 512 bytes
+    // Return 0 on success, -1 on error
+    int (*read)(struct blkdev* dev, uint32_t lba, uint32_t count, uint8_t* buffer);
+    int (*write)(struct blkdev* dev, uint32_t lba, uint32_t count, const uint8_t* buffer);
+    int (*flush)(struct blkdev* dev);  // Flush the drive's volatile write cache (optional)
+    
+    void* priv;             // Driver private data
+    struct bcache* cache;   // Write-back cache (NULL = write-through)
+    uint8_t unflushed;      // Written since the last flush
+    uint64_t dirty_since;   // Tick of the first write after the last flush
+    iostat_t stats;         // Request counters and latency histogram
+} blkdev_t;
+
+// Register a device so it can be found by name
+// Returns: 0 on success, -1 if the table is full
+int blkdev_register(blkdev_t* dev);
+
+// Look up a registered device by name
+// Returns: device pointer, or NULL if not found
+blkdev_t* blkdev_find(const char* name);
+
+// Enumerate registered devices (index 0 .. blkdev_count()-1)
+int blkdev_count(void);
+blkdev_t* blkdev_get(int index);
+
+// Read/write sectors through a device
+// Returns: 0 on success, -1 on error
+int blkdev_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer);
+int blkdev_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer);
+
+// Issue a request straight to the driver (no cache), updating dev->stats
+// Used by the cache layers; filesystems should call blkdev_read/blkdev_write
+// Returns: 0 on success, -1 on error
+int blkdev_device_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer);
+int blkdev_device_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer);
+
+// Hint that sectors will be read soon: pull them into the device's cache
+// No-op for devices without a cache
+// Returns: 0 on success, -1 on error
+int blkdev_readahead(blkdev_t* dev, uint32_t lba, uint32_t count);
+
+// Enable a write-back cache of 'sectors' sectors on a device
+// Returns: 0 on success, -1 if out of memory
+int blkdev_enable_cache(blkdev_t* dev, uint32_t sectors);
+
+// Write back cached data and flush the drive's write cache
+// Returns: 0 on success, -1 on error
+int blkdev_sync(blkdev_t* dev);
+
+// Sync every registered device that has unwritten data
+// Returns: 0 on success, -1 if any device failed
+int blkdev_sync_all(void);
+
+// Idle hook: sync devices whose oldest unflushed write is older than
+// BLKDEV_WRITEBACK_DELAY_MS (called while waiting for keyboard input)
+void blkdev_idle(void);
+
+// Time a sequential read of 'sectors' sectors starting at lba and print throughput
+// buffer: scratch space of at least 'sectors' * 512 bytes
+// Returns: throughput in KB/s, or 0 on error
+uint32_t blkdev_benchmark(blkdev_t* dev, uint32_t lba, uint32_t sectors, uint8_t* buffer);
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef DEFRAG_H
+#define DEFRAG_H
+
+#include <stdint.h>
+
+// Online defragmentation report (shared by the kernel and userspace)
+
+// What happened to a file
+#define DEFRAG_MOVED      0     // Relocated into one contiguous run
+#define DEFRAG_CONTIGUOUS 1     // Already one run, left in place
+#define DEFRAG_NO_ROOM    2     // No free run large enough
+#define DEFRAG_BUSY       3     // Open by a program, left alone
+#define DEFRAG_FAILED     4     // Disk error (the file keeps its old clusters)
+
+typedef struct {
+    char path[64];              // Relative to the directory that was defragmented
+    uint8_t status;             // DEFRAG_*
+    uint32_t clusters;
+    uint32_t fragments_before;  // Runs of consecutive clusters
+    uint32_t fragments_after;
+    uint32_t read_us_before;    // Uncached read of the whole file (from the floppy behind a RAM disk)
+    uint32_t read_us_after;
+} defrag_stat_t;
+
+#endif
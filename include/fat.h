@@ -0,0 +1,174 @@
+#ifndef FAT_H
+#define FAT_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// FAT core shared by the FAT12, FAT16 and FAT32 drivers
+// A fat_volume_t describes one mounted volume. Entry width (12, 16 or 32
+// bits) comes from its type tag; FAT sectors are accessed through a
+// set-associative cache of multi-sector windows, and changed sectors are
+// written back to every FAT copy by fat_flush.
+
+typedef enum {
+    FAT_TYPE_12 = 12,
+    FAT_TYPE_16 = 16,
+    FAT_TYPE_32 = 32
+} fat_type_t;
+
+// FAT window cache geometry
+// Window n lives in set n % FAT_CACHE_SETS, so a chain walking through
+// consecutive FAT sectors spreads over all sets. A miss that continues a
+// sequential walk (or a chain crossing into the next window) loads
+// FAT_PREFETCH_WINDOWS windows with one disk request.
+#define FAT_WINDOW_SECTORS   8      // FAT sectors per window
+#define FAT_CACHE_SETS       8
+#define FAT_CACHE_WAYS       4
+#define FAT_WINDOWS          (FAT_CACHE_SETS * FAT_CACHE_WAYS)
+#define FAT_PREFETCH_WINDOWS 4
+
+// Directory entry (same layout on all FAT types)
+typedef struct __attribute__((packed)) {
+    char     filename[8];
+    char     extension[3];
+    uint8_t  attributes;
+    uint8_t  reserved;
+    uint8_t  creation_time_tenths;
+    uint16_t creation_time;
+    uint16_t creation_date;
+    uint16_t last_access_date;
+    uint16_t first_cluster_high;
+    uint16_t last_write_time;
+    uint16_t last_write_date;
+    uint16_t first_cluster_low;
+    uint32_t file_size;
+} fat_dir_entry_t;
+
+#define FAT_ATTR_VOLUME_ID 0x08
+#define FAT_ATTR_DIRECTORY 0x10
+#define FAT_ATTR_ARCHIVE   0x20
+#define FAT_ATTR_LFN       0x0F
+
+typedef struct {
+    uint32_t first;         // First FAT sector (relative to the FAT) held
+    uint32_t last_used;     // LRU stamp
+    uint8_t valid;
+    uint8_t dirty;          // Bit per sector of the window
+    uint8_t* data;          // FAT_WINDOW_SECTORS * 512 bytes
+} fat_window_t;
+
+typedef struct {
+    blkdev_t* disk;
+    fat_type_t type;
+
+    // Geometry (sectors)
+    uint32_t sectors_per_cluster;
+    uint32_t num_fats;
+    uint32_t sectors_per_fat;
+    uint32_t fat_start;
+    uint32_t root_dir_start;    // FAT12/16 fixed root directory
+    uint32_t root_dir_sectors;
+    uint32_t data_start;
+    uint32_t root_cluster;      // FAT32 root directory chain
+    uint32_t cluster_limit;     // One past the last data cluster
+    uint32_t eoc;               // Entries >= eoc end a chain
+
+    // Free space: FAT32 keeps a count and hint in the FSInfo sector; FAT12/16
+    // volumes also get a bitmap (bit set = free) built at mount
+    uint32_t fsinfo_sector;     // 0 if none
+    uint32_t free_count;        // 0xFFFFFFFF if unknown
+    uint32_t next_free;
+    uint8_t fsinfo_dirty;
+    uint8_t* free_map;
+
+    // FAT window cache (set s holds windows[s * FAT_CACHE_WAYS ...])
+    fat_window_t windows[FAT_WINDOWS];
+    uint8_t* staging;           // FAT_PREFETCH_WINDOWS windows, for prefetch reads
+    uint32_t clock;
+    uint32_t dirty_windows;
+    uint64_t dirty_since;       // Tick of the first change after a flush
+    uint32_t last_miss;         // Window number of the last miss (sequential detection)
+    uint32_t window_hits;
+    uint32_t window_misses;
+    uint32_t windows_prefetched;
+} fat_volume_t;
+
+// Read the boot sector and set up a volume; the type is derived from the
+// cluster count as the FAT specification requires
+// Returns: 0 on success, -1 on error
+int fat_mount(fat_volume_t* vol, blkdev_t* dev);
+
+// FAT entry access (values are masked to the entry width)
+uint32_t fat_get_entry(fat_volume_t* vol, uint32_t cluster);
+void fat_set_entry(fat_volume_t* vol, uint32_t cluster, uint32_t value);
+
+// Whether a FAT entry value ends a chain (or is not a valid cluster)
+static inline int fat_is_end(const fat_volume_t* vol, uint32_t value) {
+    return value < 2 || value >= vol->eoc;
+}
+
+// End-of-chain marker for new chains
+static inline uint32_t fat_end_mark(const fat_volume_t* vol) {
+    return vol->type == FAT_TYPE_12 ? 0xFFF : vol->type == FAT_TYPE_16 ? 0xFFFF : 0x0FFFFFFF;
+}
+
+// First sector of a data cluster
+static inline uint32_t fat_cluster_lba(const fat_volume_t* vol, uint32_t cluster) {
+    return vol->data_start + (cluster - 2) * vol->sectors_per_cluster;
+}
+
+// First cluster recorded in a directory entry
+static inline uint32_t fat_entry_cluster(const fat_volume_t* vol, const fat_dir_entry_t* entry) {
+    uint32_t high = vol->type == FAT_TYPE_32 ? entry->first_cluster_high : 0;
+    return (high << 16) | entry->first_cluster_low;
+}
+
+// Whether a cluster is free
+int fat_cluster_free(fat_volume_t* vol, uint32_t cluster);
+
+// Find a free cluster: 'preferred' if it is free (pass the cluster after a
+// file's tail to keep it contiguous), otherwise the next one from the hint
+// Returns: cluster number, or 0 if the volume is full
+uint32_t fat_find_free(fat_volume_t* vol, uint32_t preferred);
+
+// First cluster of a free run of at least 'count' clusters (0 if none found)
+uint32_t fat_find_free_run(fat_volume_t* vol, uint32_t count);
+
+// Free a chain starting at 'cluster'
+void fat_free_chain(fat_volume_t* vol, uint32_t cluster);
+
+// Count the fragments (runs of physically consecutive clusters) of a chain
+// clusters: receives the chain length (may be NULL)
+// Returns: fragments, 0 for an empty chain
+uint32_t fat_chain_fragments(fat_volume_t* vol, uint32_t first_cluster, uint32_t* clusters);
+
+// Write dirty FAT sectors to every FAT copy (and FSInfo on FAT32)
+// Returns: 0 on success, -1 on error
+int fat_flush(fat_volume_t* vol);
+
+// Sectors of a directory (dir_cluster 0 = root): calls fn(sector, ctx) for
+// each sector in order until fn returns nonzero
+// Returns: fn's nonzero result, 0 at the end of the directory, -1 on a read error
+typedef int (*fat_dir_fn)(fat_volume_t* vol, uint32_t sector, const fat_dir_entry_t* entries, void* ctx);
+int fat_dir_walk(fat_volume_t* vol, uint32_t dir_cluster, fat_dir_fn fn, void* ctx);
+
+// Find a packed 8.3 name in a directory (dir_cluster 0 = root)
+// entry/sector/index: receive a copy of the entry and its location (may be NULL)
+// Returns: 0 if found, 1 if not found, -1 on a read error
+int fat_dir_find(fat_volume_t* vol, uint32_t dir_cluster, const char name[11],
+                 fat_dir_entry_t* entry, uint32_t* sector, uint16_t* index);
+
+// Read 'size' bytes from the start of a chain, one request per contiguous run
+// Returns: bytes read, or -1 on error
+int fat_read_chain(fat_volume_t* vol, uint32_t first_cluster, uint8_t* buffer, uint32_t size);
+
+// Convert a filename to the packed, space-padded, uppercase 8.3 form
+void fat_pack_name(const char* filename, char out[11]);
+
+// Convert a directory entry's 8.3 name to "NAME.EXT" (output: 13 bytes)
+void fat_format_name(const fat_dir_entry_t* entry, char* output);
+
+// Print a directory listing (dir_cluster 0 = root)
+int fat_list_dir(fat_volume_t* vol, uint32_t dir_cluster);
+
+#endif
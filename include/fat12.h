@@ -2,29 +2,108 @@
 #define FAT12_H
 
 #include <stdint.h>
+#include "blkdev.h"
+#include "fat.h"
+#include "vfs.h"
+#include "defrag.h"
 
-// FAT12 filesystem driver
+// FAT filesystem driver
+// Originally FAT12-only; volumes are now mounted through the shared FAT core
+// (fat.h), so FAT16 and FAT32 volumes get the same file layer
 
-// Initialize FAT12 filesystem
-int fat12_init(void);
+// Initialize the filesystem on a block device (FAT12, FAT16 or FAT32)
+// This is the boot volume, which the name-based calls below work on
+int fat12_init(blkdev_t* dev);
+
+// Volumes fat12_flush/fat12_idle look after (the boot volume is one of them)
+#define FAT12_MAX_VOLUMES 4
+
+// Mount a further volume (vol must stay allocated while mounted)
+// Returns: 0 on success, -1 on error
+int fat12_mount(fat_volume_t* vol, blkdev_t* dev);
+
+// The volume fat12_init mounted
+fat_volume_t* fat12_boot_volume(void);
+
+// Readahead window limits (sectors)
+#define FAT12_READAHEAD_MIN 8
+#define FAT12_READAHEAD_MAX 128
+
+// Dirty FAT sectors are written back after this long if no close or sync comes first
+#define FAT12_FAT_FLUSH_DELAY_MS 1000
+
+// Extent map size per open file (runs of physically consecutive clusters)
+#define FAT12_MAX_EXTENTS 16
+
+// One run of consecutive clusters
+typedef struct {
+    uint32_t file_cluster;  // Index of the run's first cluster within the file
+    uint32_t start;         // First cluster number on disk
+    uint32_t length;        // Clusters in the run
+} fat12_extent_t;
 
 // File operations
 typedef struct {
-    char name[12];          // 8.3 filename
+    char name[13];          // 8.3 filename ("NAME.EXT")
     uint32_t size;          // File size in bytes
     uint32_t first_cluster; // First cluster number
     uint8_t is_directory;   // 1 if directory, 0 if file
+    uint32_t position;      // Offset of the next fat12_read/fat12_write
+    fat_volume_t* vol;      // Volume the file lives on
+    
+    // Location of the directory entry, so size updates need no directory scan
+    uint32_t dir_cluster;   // Directory holding the entry (0 = root)
+    uint16_t dir_index;     // Entry index within dir_sector
+    uint32_t dir_sector;
+    
+    // Extent map of the cluster chain, built lazily as offsets are mapped
+    // (chain_mapped = 1 once the last extent reaches the end of the chain)
+    fat12_extent_t extents[FAT12_MAX_EXTENTS];
+    uint8_t extent_count;
+    uint8_t chain_mapped;
+    
+    // Sequential readahead state
+    uint32_t ra_next;       // Offset a sequential reader will ask for next
+    uint32_t ra_window;     // Current window in sectors (0 = random access)
+    uint32_t ra_end;        // File offset prefetched up to
 } fat12_file_t;
 
-// Open a file (returns 0 on success, -1 on error)
+// Open a file in the boot volume's root directory (returns 0 on success, -1 on error)
 int fat12_open(const char* filename, fat12_file_t* file);
 
-// Read from a file
+// Open, create or delete a file in any directory of a mounted volume (dir_cluster 0 = root)
+// Returns: 0 on success, -1 on error
+int fat12_open_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, fat12_file_t* file);
+int fat12_create_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, fat12_file_t* file);
+int fat12_delete_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename);
+
+// Remove a file's directory entry but keep its cluster chain, for a file
+// that is still open (the last close frees the chain with fat_free_chain)
+// Returns: 0 on success, -1 on error
+int fat12_remove_entry_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename);
+
+// Read from a file at file->position and advance it
+// Only 'size' bytes of buffer are written (no sector rounding)
+// Returns: bytes read (0 at end of file), or -1 on error
 int fat12_read(fat12_file_t* file, uint8_t* buffer, uint32_t size);
 
-// Write to a file
+// Set the offset of the next read (clamped to the file size)
+void fat12_seek(fat12_file_t* file, uint32_t offset);
+
+// Write to a file at file->position and advance it
+// Clusters are appended as needed and file->size grows past the old end,
+// but the directory entry is only written by fat12_update_entry
+// Returns: bytes written, or -1 on error
 int fat12_write(fat12_file_t* file, const uint8_t* buffer, uint32_t size);
 
+// Shrink a file to new_size bytes and free the clusters it no longer needs
+// (the FAT and directory entry are written by fat12_flush/fat12_update_entry)
+// Returns: 0 on success, -1 if new_size is larger than the file
+int fat12_truncate(fat12_file_t* file, uint32_t new_size);
+
+// Write file->size and file->first_cluster back to the file's directory entry
+int fat12_update_entry(fat12_file_t* file);
+
 // Update file size in directory entry (call after writing)
 int fat12_update_size(const char* filename, uint32_t new_size);
 
@@ -34,15 +113,42 @@ int fat12_create(const char* filename, fat12_file_t* file);
 // Delete a file
 int fat12_delete(const char* filename);
 
+// Sectors copied (and timed) per device request while defragmenting
+#define FAT12_DEFRAG_CHUNK 64
+
+// Move a file's clusters into one contiguous run and fill in 'st' (path is
+// left empty). The file must not be open. The data is copied and synced
+// before the new chain is written to the FAT, the directory entry is switched
+// after that, and only then is the old chain freed, so an interruption at any
+// step leaves the file intact (at worst with leaked clusters).
+// Returns: 0 on success (st->status says what was done), -1 on error
+int fat12_defrag_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, defrag_stat_t* st);
+
+// Defragment every file under a directory (skipping open files), recording
+// up to 'max' reports
+// Returns: files examined (may exceed max), or -1 if path is not a FAT directory
+int fat12_defrag(const char* path, defrag_stat_t* reports, uint32_t max);
+
+// Allocation changes only mark FAT sectors dirty in memory; these write the
+// dirty sectors (and only those) of every mounted volume to every FAT copy
+// Returns: 0 on success, -1 on error
+int fat12_flush(void);
+
+// Flush the FAT if it has been dirty for FAT12_FAT_FLUSH_DELAY_MS (call when idle)
+void fat12_idle(void);
+
+// VFS driver for mounted FAT volumes: vfs_mount(path, &fat12_vfs_ops, vol)
+extern const vfs_ops_t fat12_vfs_ops;
+
 // List files in root directory
 int fat12_list_root(void);
 
 // List files in a specific directory by cluster
-int fat12_list_dir(uint16_t cluster);
+int fat12_list_dir(uint32_t cluster);
 
 // Find a directory entry by name in current directory (0 = root)
 // Returns cluster number of entry, or 0 if not found
 // Sets is_directory to 1 if entry is a directory
-uint16_t fat12_find_entry(uint16_t dir_cluster, const char* name, int* is_directory);
+uint16_t fat12_find_entry(uint32_t dir_cluster, const char* name, int* is_directory);
 
 #endif
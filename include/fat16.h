@@ -2,11 +2,12 @@
 #define FAT16_H
 
 #include <stdint.h>
+#include "blkdev.h"
 
 // FAT16 filesystem driver
 
-// Initialize FAT16 filesystem
-int fat16_init(void);
+// Initialize FAT16 filesystem on a block device
+int fat16_init(blkdev_t* dev);
 
 // File operations
 typedef struct {
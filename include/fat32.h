@@ -2,11 +2,12 @@
 #define FAT32_H
 
 #include <stdint.h>
+#include "blkdev.h"
 
 // FAT32 filesystem driver
 
-// Initialize FAT32 filesystem
-int fat32_init(void);
+// Initialize FAT32 filesystem on a block device
+int fat32_init(blkdev_t* dev);
 
 // File operations
 typedef struct {
@@ -0,0 +1,58 @@
+#ifndef FCNTL_H
+#define FCNTL_H
+
+#include <stdint.h>
+
+// File descriptor flags and types (shared by the kernel and userspace)
+
+// open() flags
+#define O_RDONLY  0x0000
+#define O_WRONLY  0x0001
+#define O_RDWR    0x0002
+#define O_ACCMODE 0x0003
+#define O_CREAT   0x0040    // Create the file if it does not exist
+#define O_TRUNC   0x0200    // Truncate to zero length on open
+#define O_APPEND  0x0400    // Every write goes to the current end of the file
+
+// lseek() origins
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+// fstat() result
+typedef struct {
+    uint32_t size;              // File size in bytes
+    uint32_t position;          // Current offset
+    uint32_t first_cluster;     // First cluster of the data
+    uint8_t  is_directory;
+    uint8_t  flags;             // O_ACCMODE and O_APPEND bits the file was opened with
+} stat_t;
+
+// statfs() result: one mounted filesystem
+typedef struct {
+    char path[32];              // Mount point
+    char type[8];               // Filesystem type ("fat", "tmpfs")
+    uint32_t block_size;        // Allocation unit in bytes (cluster or page)
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    uint32_t files;             // Files stored (0 if the filesystem does not count them)
+    uint64_t bytes_used;        // Bytes of file data (0 if not counted)
+} statfs_t;
+
+// getdents() entry attributes (the FAT attribute bits; other filesystems
+// report DIRENT_DIRECTORY only)
+#define DIRENT_READ_ONLY 0x01
+#define DIRENT_HIDDEN    0x02
+#define DIRENT_SYSTEM    0x04
+#define DIRENT_DIRECTORY 0x10
+#define DIRENT_ARCHIVE   0x20
+
+// getdents() result: fixed-size records packed back to back
+typedef struct __attribute__((packed)) {
+    char     name[32];          // NUL-terminated
+    uint32_t size;              // File size in bytes (0 for directories)
+    uint32_t first_cluster;     // First cluster of the data
+    uint8_t  attributes;        // DIRENT_* bits
+} dirent_t;
+
+#endif
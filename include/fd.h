@@ -0,0 +1,56 @@
+#ifndef FD_H
+#define FD_H
+
+#include <stdint.h>
+#include "fcntl.h"
+#include "vfs.h"
+
+// Per-process file descriptor table and working directory
+// Each descriptor points at an open VFS file object (vfs.h) with its own
+// offset, so reads and writes cost O(request size) no matter where in the
+// file they land.
+
+#define FD_MAX_OPEN      16     // Descriptors per process
+#define FD_MAX_PROCESSES 4      // Nesting depth (shell, program, ...)
+
+// Open a file (paths are relative to the working directory)
+// Returns: descriptor, or -1 on error
+int fd_open(const char* filename, int flags);
+
+// Read/write at the descriptor's offset and advance it
+// Returns: bytes transferred (0 at end of file), or -1 on error
+int fd_read(int fd, uint8_t* buffer, uint32_t size);
+int fd_write(int fd, const uint8_t* buffer, uint32_t size);
+
+// Shrink the file to 'size' bytes, freeing surplus clusters (growing is not supported)
+// Returns: 0 on success, -1 on error
+int fd_truncate(int fd, uint32_t size);
+
+// Move the offset (clamped to [0, size])
+// Returns: new offset, or -1 on error
+int64_t fd_lseek(int fd, int64_t offset, int whence);
+
+// Write back the directory entry if needed and release the descriptor
+// Returns: 0 on success, -1 on error
+int fd_close(int fd);
+
+// Returns: 0 on success, -1 on a bad descriptor
+int fd_fstat(int fd, stat_t* st);
+
+// Read directory entries into 'buffer' as packed dirent_t records (as many
+// whole records as fit in 'size' bytes); lseek(fd, 0, SEEK_SET) rewinds
+// Returns: bytes filled (0 at the end), or -1 on error
+int fd_getdents(int fd, dirent_t* buffer, uint32_t size);
+
+// Switch to a new descriptor table when a program starts (it inherits the
+// working directory), and close everything it left open when it exits
+void fd_process_enter(void);
+void fd_process_exit(void);
+
+// Working directory of the running program (NULL = "/")
+vfs_vnode_t* fd_cwd(void);
+
+// Set the working directory, taking over the caller's reference on 'dir'
+void fd_set_cwd(vfs_vnode_t* dir);
+
+#endif
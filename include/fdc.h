@@ -5,6 +5,9 @@
 
 // Floppy Disk Controller driver for 1.44MB floppy disks
 
+// Sectors per cylinder (18 sectors x 2 heads) - the largest single DMA transfer
+#define FDC_SECTORS_PER_CYLINDER 36
+
 // Detect if FDC is available
 // Returns: 1 if floppy drive detected, 0 if not available
 int fdc_detect(void);
@@ -0,0 +1,74 @@
+#ifndef IMGCACHE_H
+#define IMGCACHE_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+// Resident cache of program images
+// When the loader reads a program from disk, the file bytes of its PT_LOAD
+// segments are kept in pages from the page allocator, so launching it again
+// copies them back to their addresses and clears the BSS without touching
+// the disk. Position-independent programs are cached before relocation, so
+// a relaunch can place them anywhere. Images are keyed by the file's
+// directory, name and size; opening the file for writing or unlinking it
+// drops its image. The cache holds at
+// most a quarter of free memory, evicts the least recently used image to make
+// room, and gives images back when the page allocator runs out.
+
+#define IMGCACHE_MAX_IMAGES   16
+#define IMGCACHE_MAX_SEGMENTS 8
+
+// A loaded segment: filesz bytes at vaddr, then memsz - filesz bytes of BSS
+typedef struct {
+    uint64_t vaddr;
+    uint64_t filesz;
+    uint64_t memsz;
+} imgcache_segment_t;
+
+// A program's addresses as linked; a position-independent one runs at
+// base + these, anything else at base 0
+typedef struct {
+    uint64_t entry;
+    uint64_t low;               // Position-independent: lowest segment page
+    uint64_t span;              // Position-independent: bytes from low to the end of the last page (0 = fixed address)
+    uint64_t dynamic;           // Position-independent: dynamic section (relocations), 0 if none
+    uint32_t segment_count;     // 0 if there were more than IMGCACHE_MAX_SEGMENTS
+    imgcache_segment_t segments[IMGCACHE_MAX_SEGMENTS];
+} imgcache_layout_t;
+
+typedef struct {
+    uint8_t used;
+    vfs_mount_t* mount;
+    uint32_t dir;               // ino of the directory the file is in
+    char name[VFS_NAME_MAX];
+    uint32_t size;              // File size when it was cached
+    uint32_t addr;              // Pages holding the segments' file bytes, back to back
+    uint32_t pages;
+    uint32_t last_used;
+    imgcache_layout_t layout;
+} imgcache_image_t;
+
+// Let the page allocator take images back under memory pressure
+void imgcache_init(void);
+
+// Find the cached image of a file, to see where it has to go
+// Returns: its layout (valid until the next cache call), or NULL if the file
+// has no (current) image
+const imgcache_layout_t* imgcache_layout(vfs_vnode_t* file, uint32_t size);
+
+// Copy the cached image of a file to base + its addresses and clear its BSS
+// Returns: 0, or -1 if the image is gone (e.g. evicted to place it)
+int imgcache_load(vfs_vnode_t* file, uint32_t size, uint64_t base);
+
+// Keep the image of a program that was just loaded from disk at 'base'
+// (before the program ran and before relocation)
+void imgcache_store(vfs_vnode_t* file, uint32_t size, const imgcache_layout_t* layout, uint64_t base);
+
+// Drop the image of a file that is about to change
+void imgcache_forget(vfs_vnode_t* file);
+
+// Free the least recently used images until 'pages' pages came back
+// Returns: pages freed
+uint32_t imgcache_reclaim(uint32_t pages);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+
+// Boot archive of the userspace programs
+// boot2 copies /BOOT/INITRD.IMG to INITRD_LOAD_ADDR before leaving real mode
+// and leaves its address and size at INITRD_INFO_ADDR. The loader looks
+// programs in the root of the boot volume up here before going to the disk,
+// so launching one of them is a memory copy. The archive is a snapshot taken
+// when the disk image was built: writing or removing the program on disk
+// drops its archive copy.
+//
+// Layout (built on the host by tools/mkinitrd):
+//   initrd_header_t
+//   initrd_entry_t[count]
+//   file data, each file starting on an INITRD_ALIGN boundary
+
+#define INITRD_MAGIC      "SANTRD1"     // 8 bytes with the NUL
+#define INITRD_NAME_MAX   16            // Including the NUL
+#define INITRD_MAX_FILES  32
+#define INITRD_ALIGN      16
+#define INITRD_LOAD_ADDR  0x1400000     // 20MB: above the heap, below most pmem use
+#define INITRD_INFO_ADDR  0x8004        // dword address, dword size (0 = none), after boot2's highest address
+
+typedef struct {
+    char magic[8];
+    uint32_t count;             // Entries in the table
+    uint32_t size;              // Whole archive, header included
+    uint32_t checksum;          // Sum of the bytes after the header
+} __attribute__((packed)) initrd_header_t;
+
+typedef struct {
+    char name[INITRD_NAME_MAX]; // Name on the boot volume ("SHELL.ELF", "SEDIT")
+    uint32_t offset;            // From the start of the archive
+    uint32_t size;
+} __attribute__((packed)) initrd_entry_t;
+
+// Check the archive boot2 left in memory and keep its pages from the allocator
+// Call right after pmem_init
+// Returns: number of programs, or -1 if there is no usable archive
+int initrd_init(void);
+
+// Find the archive copy of a program; only paths naming a file in the root of
+// the boot volume ("/HELLO.ELF", or "HELLO.ELF" with "/" as working directory) match
+// Returns: 0 with *data/*size set, or -1 if the archive does not have it
+int initrd_find(const char* path, const uint8_t** data, uint32_t* size);
+
+// Drop the archive copy of a root-directory file that is being changed on disk
+void initrd_forget(const char* name);
+
+#endif
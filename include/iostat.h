@@ -0,0 +1,29 @@
+#ifndef IOSTAT_H
+#define IOSTAT_H
+
+#include <stdint.h>
+
+// Per-device block I/O statistics (shared by the kernel and userspace)
+
+// Latency histogram: bucket i counts requests taking [2^i, 2^(i+1)) microseconds
+// (bucket 0 also holds anything under 1us, the last bucket everything slower)
+#define IOSTAT_HIST_BUCKETS 24
+
+typedef struct {
+    char name[8];                   // Device name
+    uint32_t reads;                 // Requests sent to the driver
+    uint32_t writes;
+    uint32_t read_sectors;
+    uint32_t write_sectors;
+    uint32_t merges;                // Sectors folded into a neighbour's write-back request
+    uint32_t cache_hits;            // Sector lookups served by the block cache
+    uint32_t cache_misses;
+    uint32_t retries;               // Driver-level retries after an error
+    uint32_t seeks;                 // Head movements (floppy)
+    uint32_t spinups;               // Motor spin-ups (floppy)
+    uint32_t errors;                // Failed requests
+    uint64_t busy_us;               // Total time spent in driver requests
+    uint32_t latency[IOSTAT_HIST_BUCKETS];
+} iostat_t;
+
+#endif
@@ -6,11 +6,18 @@
 // Program loader - loads and executes programs from disk
 
 // Load a program from disk into memory
-// filename: name of the program file (e.g. "SHELL.ELF")
+// Programs linked at fixed addresses (ET_EXEC) are loaded there; position-
+// independent ones (ET_DYN) get pages wherever the allocator has room and
+// are relocated, so several can be resident at once
+// filename: path of the program file (e.g. "SHELL.ELF" or "/ata0/HELLO.ELF")
 // load_addr: address to load the program at
 // Returns: entry point address on success, 0 on error
 uint64_t load_program(const char* filename, void* load_addr);
 
+// Free the pages of the most recently loaded program once it has exited
+// (nothing to free for a fixed-address program)
+void unload_program(void);
+
 // Execute a loaded program
 // entry_point: address of the program's entry point
 // program_name: name of the program for logging (can be NULL)
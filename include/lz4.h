@@ -0,0 +1,25 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include <stdint.h>
+
+// LZ4 block decompression
+// A block is a series of sequences: a token (literal count, match length),
+// literal bytes, then a 2-byte offset back into the output and the match
+// length. There is no frame header or checksum around it.
+//
+// Compressed programs: tools/elflz4 (run by programs/Makefile with LZ4=1)
+// replaces the file data of PT_LOAD segments with one LZ4 block each and
+// marks them PT_SANTOS_LZ4; the loader decompresses them straight into place.
+
+// Program header type of a compressed PT_LOAD segment (in the PT_LOOS range)
+// p_filesz: compressed bytes at p_offset
+// p_paddr:  bytes the block decompresses to (the segment's original p_filesz)
+#define PT_SANTOS_LZ4 0x604C5A34
+
+// Decompress one block
+// Returns: bytes written (dst_size for a well-formed segment), or -1 if the
+// block is malformed or would write past dst + dst_size
+int lz4_decompress(const uint8_t* src, uint32_t src_size, uint8_t* dst, uint32_t dst_size);
+
+#endif
@@ -36,6 +36,7 @@ int e820_find_largest_region(uint64_t* start, uint64_t* size);
 // Manages allocation and deallocation of physical pages (4KB each)
 
 typedef struct {
+    uint32_t base;             // Physical address of page 0 (start of managed memory)
     uint8_t* bitmap;           // Bitmap: 1 bit per page (1=used, 0=free)
     uint32_t total_pages;      // Total number of pages available
     uint32_t free_pages;       // Number of free pages
@@ -65,6 +66,17 @@ void pmem_free_page(uint32_t addr);
 // count: number of pages to free
 void pmem_free_pages(uint32_t addr, uint32_t count);
 
+// Reserve pages that already hold data (e.g. the boot archive)
+// addr: physical address of the first page
+// count: number of pages
+// Returns: 0 on success, -1 if a page is outside managed memory or already used
+int pmem_reserve_pages(uint32_t addr, uint32_t count);
+
+// Register a cache that can give pages back: when an allocation finds no
+// room, reclaim(pages) is called once and the allocation retried
+// reclaim: frees what it can and returns the number of pages it freed
+void pmem_set_reclaim(uint32_t (*reclaim)(uint32_t pages));
+
 // Get number of free pages
 uint32_t pmem_get_free_pages(void);
 
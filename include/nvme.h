@@ -0,0 +1,36 @@
+#ifndef NVME_H
+#define NVME_H
+
+#include <stdint.h>
+
+// NVMe driver (PCI class 01:08:02), e.g. QEMU: -drive file=nvme.img,if=none,id=nv0 -device nvme,drive=nv0,serial=santos
+// Uses namespace 1 with 512-byte LBAs. Several I/O submission/completion
+// queue pairs are created; commands are spread across them and each
+// queue's doorbell is rung once per batch.
+
+// Number of I/O queue pairs requested from the controller
+#define NVME_IO_QUEUES 4
+
+// Detect an NVMe controller
+// Returns: 1 if found, 0 if not available
+int nvme_detect(void);
+
+// Reset and enable the controller, identify namespace 1 and create the I/O queues
+// Registers the namespace as block device "nvme0"
+// Returns: 0 on success, -1 on failure
+int nvme_init(void);
+
+// Read sectors from namespace 1
+// buffer: Destination buffer (must be at least count * 512 bytes)
+// Returns: 0 on success, -1 on error
+int nvme_read_sectors(uint32_t lba, uint32_t count, uint8_t* buffer);
+
+// Write sectors to namespace 1
+// Returns: 0 on success, -1 on error
+int nvme_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buffer);
+
+// Flush the volatile write cache of namespace 1
+// Returns: 0 on success, -1 on error
+int nvme_flush(void);
+
+#endif
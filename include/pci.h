@@ -0,0 +1,55 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+
+// PCI configuration space access (mechanism #1, ports 0xCF8/0xCFC)
+
+// Common configuration space offsets
+#define PCI_VENDOR_ID       0x00
+#define PCI_DEVICE_ID       0x02
+#define PCI_COMMAND         0x04
+#define PCI_STATUS          0x06
+#define PCI_PROG_IF         0x09
+#define PCI_SUBCLASS        0x0A
+#define PCI_CLASS           0x0B
+#define PCI_HEADER_TYPE     0x0E
+#define PCI_BAR0            0x10
+#define PCI_INTERRUPT_LINE  0x3C
+
+// Command register bits
+#define PCI_COMMAND_IO          0x0001  // I/O space enable
+#define PCI_COMMAND_MEMORY      0x0002  // Memory space enable
+#define PCI_COMMAND_BUS_MASTER  0x0004  // Bus master (DMA) enable
+
+// A device location on the bus
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t func;
+} pci_device_t;
+
+// Read/write configuration registers
+uint32_t pci_config_read32(pci_device_t dev, uint8_t offset);
+uint16_t pci_config_read16(pci_device_t dev, uint8_t offset);
+uint8_t  pci_config_read8(pci_device_t dev, uint8_t offset);
+void     pci_config_write32(pci_device_t dev, uint8_t offset, uint32_t value);
+void     pci_config_write16(pci_device_t dev, uint8_t offset, uint16_t value);
+
+// Find a device by vendor/device ID
+// Returns: 0 on success (dev filled in), -1 if not found
+int pci_find_device(uint16_t vendor, uint16_t device, pci_device_t* dev);
+
+// Find a device by class/subclass/prog_if (prog_if 0xFF matches any)
+// Returns: 0 on success (dev filled in), -1 if not found
+int pci_find_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if, pci_device_t* dev);
+
+// Read a BAR (base address register), index 0-5
+// Returns the base address with the flag bits masked off; 64-bit memory
+// BARs are combined with the following BAR. is_io is set to 1 for I/O BARs.
+uint64_t pci_read_bar(pci_device_t dev, int index, int* is_io);
+
+// Enable I/O, memory and bus mastering for a device
+void pci_enable_device(pci_device_t dev);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include <stdint.h>
+#include "blkdev.h"
+
+// RAM disk mirror of a (slow) block device
+// The whole backing device is copied into memory up front; reads are served
+// from memory and writes land in memory, marking their burst dirty. Dirty
+// bursts are written back to the backing device by blkdev_sync() - on the
+// sync syscall, or once the system has been idle for a moment.
+
+// Load every sector of 'backing' into memory, 'burst' sectors per device read
+// (one floppy cylinder is a single DMA transfer)
+// Registers the mirror as block device "rd0"
+// Returns: the RAM disk, or NULL if out of memory or the load failed
+blkdev_t* ramdisk_create(blkdev_t* backing, uint32_t burst);
+
+// Device a RAM disk mirrors, e.g. to time reads the way the disk serves them
+// Returns: the backing device, or NULL if 'dev' is not a RAM disk
+blkdev_t* ramdisk_backing(blkdev_t* dev);
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef SANTFS_H
+#define SANTFS_H
+
+#include <stdint.h>
+#include "blkdev.h"
+#include "vfs.h"
+
+// SantOS native filesystem (santfs)
+// Designed for this kernel rather than inherited from DOS:
+//  - files are lists of extents (runs of consecutive blocks), kept in the
+//    inode and, past SANTFS_INLINE_EXTENTS, in a chain of overflow blocks
+//  - directories are B+trees of fixed-size records sorted by name, so a
+//    lookup reads one block per level however large the directory is
+//  - free blocks and free inodes are tracked in bitmaps that the driver
+//    keeps in memory while mounted
+//  - the superblock carries feature flags: a driver refuses volumes with
+//    incompat features it does not know and mounts them read-only for
+//    unknown ro_compat ones
+//
+// Disk layout (in blocks of block_size bytes):
+//   0                    superblock (first 512 bytes)
+//   bitmap_start         free-space bitmap, 1 bit per block (1 = used)
+//   inode_bitmap_start   inode bitmap, 1 bit per inode (1 = used)
+//   inode_start          inode table, SANTFS_INODE_SIZE bytes per inode
+//   data_start ...       file data, extent overflow blocks, B-tree nodes
+//
+// Volumes are made on the host with tools/mkfs_santfs.
+
+#define SANTFS_MAGIC          0x53544E53    // "SNTS"
+#define SANTFS_VERSION        1
+#define SANTFS_MIN_BLOCK_SIZE 1024
+#define SANTFS_MAX_BLOCK_SIZE 4096
+#define SANTFS_MAX_BLOCKS     0x00FFFFFF    // readdir cookies carry a block number in 24 bits
+#define SANTFS_ROOT_INO       1             // Inode 0 is never used
+#define SANTFS_INODE_SIZE     128
+#define SANTFS_INLINE_EXTENTS 8
+#define SANTFS_NAME_MAX       57            // Longest name, without the NUL
+#define SANTFS_BTREE_MAX_DEPTH 8
+#define SANTFS_NODE_MAGIC     0x4E42        // "BN"
+
+// Superblock state
+#define SANTFS_STATE_CLEAN    1             // Everything written back
+#define SANTFS_STATE_DIRTY    2             // Changed since the last sync
+
+// Feature flags
+#define SANTFS_FEATURE_INCOMPAT_EXTENTS    0x0001  // Files are extent lists with overflow blocks
+#define SANTFS_FEATURE_INCOMPAT_BTREE_DIRS 0x0002  // Directories are B+trees of santfs_record_t
+#define SANTFS_FEATURE_RO_COMPAT_SPARSE    0x0001  // Files may have holes (unmapped blocks read as zeros)
+#define SANTFS_FEATURE_COMPAT_LABEL        0x0001  // label[] is set
+
+// What this driver understands
+#define SANTFS_SUPPORTED_INCOMPAT  (SANTFS_FEATURE_INCOMPAT_EXTENTS | SANTFS_FEATURE_INCOMPAT_BTREE_DIRS)
+#define SANTFS_SUPPORTED_RO_COMPAT SANTFS_FEATURE_RO_COMPAT_SPARSE
+
+// Inode types (santfs_inode_t.mode, santfs_record_t.type)
+#define SANTFS_MODE_FILE      1
+#define SANTFS_MODE_DIR       2
+
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t state;             // SANTFS_STATE_*
+    uint32_t block_size;
+    uint32_t total_blocks;
+    uint32_t free_blocks;
+    uint32_t inode_count;
+    uint32_t free_inodes;
+    uint32_t bitmap_start;
+    uint32_t bitmap_blocks;
+    uint32_t inode_bitmap_start;
+    uint32_t inode_bitmap_blocks;
+    uint32_t inode_start;
+    uint32_t inode_blocks;
+    uint32_t data_start;
+    uint32_t feature_compat;
+    uint32_t feature_ro_compat;
+    uint32_t feature_incompat;
+    char label[16];
+} __attribute__((packed)) santfs_super_t;
+
+// A run of consecutive blocks of a file
+typedef struct {
+    uint32_t logical;           // First file block the run holds
+    uint32_t start;             // First disk block
+    uint32_t length;            // Blocks
+} __attribute__((packed)) santfs_extent_t;
+
+typedef struct {
+    uint16_t mode;              // SANTFS_MODE_* (0 = free)
+    uint16_t links;
+    uint32_t size;              // Files: bytes; directories: entries
+    uint32_t blocks;            // Blocks held, overflow and B-tree blocks included
+    uint32_t mtime;             // Reserved (no clock yet)
+    uint32_t root;              // Directories: B-tree root block
+    uint16_t depth;             // Directories: B-tree levels above the leaves
+    uint16_t extent_count;      // Files: extents in use, sorted by logical block
+    uint32_t extent_block;      // Files: first overflow block for extents past the inline ones (0 = none)
+    santfs_extent_t extents[SANTFS_INLINE_EXTENTS];
+    uint32_t reserved;
+} __attribute__((packed)) santfs_inode_t;
+
+// B+tree node: a header and records sorted by name, filling one block
+typedef struct {
+    uint16_t magic;             // SANTFS_NODE_MAGIC
+    uint16_t level;             // 0 = leaf
+    uint16_t count;             // Records in use
+    uint16_t reserved;
+    uint32_t next;              // Leaves: right sibling (0 = last leaf)
+    uint32_t reserved2;
+} __attribute__((packed)) santfs_node_t;
+
+// Leaf records are directory entries. Internal records point at a child
+// whose names are all >= the record's name; the first record of an internal
+// node covers everything below the second, whatever its name says.
+typedef struct {
+    uint32_t ino;               // Leaves: inode; internal nodes: child block
+    uint8_t type;               // Leaves: SANTFS_MODE_* of the inode
+    uint8_t name_len;
+    char name[SANTFS_NAME_MAX + 1];
+} __attribute__((packed)) santfs_record_t;
+
+#define SANTFS_RECORDS_PER_NODE(bs) (((bs) - sizeof(santfs_node_t)) / sizeof(santfs_record_t))
+// Overflow block: extents, then the next overflow block of the chain in the
+// last 4 bytes (0 = end)
+#define SANTFS_EXTENTS_PER_BLOCK(bs) (((bs) - sizeof(uint32_t)) / sizeof(santfs_extent_t))
+#define SANTFS_EXTENT_LINK(bs)       ((bs) - sizeof(uint32_t))
+
+// In-memory copy of an inode that is open
+typedef struct {
+    uint32_t ino;               // 0 = slot free
+    uint16_t refs;              // Open files
+    uint8_t dirty;              // Inode (or overflow extents) changed since written
+    uint8_t orphan;             // Unlinked while open: freed at the last close
+    santfs_inode_t inode;
+    santfs_extent_t* overflow;  // Extents past the inline ones, extents_per_block per chain block (NULL until needed)
+    uint32_t* chain;            // Overflow blocks, in chain order
+    uint32_t chain_length;
+} santfs_open_inode_t;
+
+typedef struct {
+    blkdev_t* dev;
+    santfs_super_t super;
+    uint32_t sectors_per_block;
+    uint32_t records_per_node;
+    uint32_t extents_per_block;
+    uint8_t read_only;          // Unknown ro_compat features
+    uint8_t super_dirty;        // Counts or state to write back
+    uint8_t* block_bitmap;      // bitmap_blocks * block_size bytes
+    uint8_t* inode_bitmap;
+    uint8_t* bitmap_dirty;      // One flag per bitmap block (block bitmap, then inode bitmap)
+    uint32_t block_hint;        // Where the next free-run search starts
+    uint32_t inode_hint;
+    uint8_t* node_buf[2];       // B-tree node scratch (kernel stacks are small)
+    uint8_t* block_buf;         // Partial-block read-modify-write scratch
+    santfs_open_inode_t open[VFS_MAX_FILES];
+} santfs_volume_t;
+
+// Check a block device for a santfs superblock
+// Returns: 1 if it has one, 0 if not
+int santfs_probe(blkdev_t* dev);
+
+// Mount the volume on a device (vol must stay allocated while mounted)
+// Returns: 0 on success, -1 if the device holds no usable santfs volume
+int santfs_mount(santfs_volume_t* vol, blkdev_t* dev);
+
+// VFS driver: vfs_mount(path, &santfs_vfs_ops, vol)
+// vnode->ino is the inode number (0 = the root directory)
+extern const vfs_ops_t santfs_vfs_ops;
+
+#endif
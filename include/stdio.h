@@ -3,6 +3,9 @@
 
 #include <stddef.h>
 #include <stdarg.h>
+#include "iostat.h"
+#include "fcntl.h"
+#include "defrag.h"
 
 // Output functions (already exist in printf.h, but included here for completeness)
 int printf(const char* format, ...);
@@ -26,14 +29,31 @@ void set_color(unsigned char fg, unsigned char bg);  // Set text color
 void set_cursor_pos(unsigned char x, unsigned char y);  // Set cursor position
 
 // Filesystem operations
-int list_dir(void);                         // List root directory
+int list_dir(const char* path);             // List a directory (NULL = working directory)
 int list_dir_cluster(unsigned short cluster);  // List specific directory by cluster
 unsigned short find_entry(unsigned short dir_cluster, const char* name, int* is_directory);  // Find entry in directory
+int chdir(const char* path);                // Change the working directory (0 = ok, -1 = not a directory)
+int getcwd(char* buffer, int size);         // Get the working directory path (0 = ok, -1 = too long)
+int unlink(const char* path);               // Delete a file
+int getdents(int fd, dirent_t* buffer, int size);  // Read entries of a directory opened O_RDONLY, returns bytes filled (0 = end)
 
 // File I/O
 int read_file(const char* filename, char* buffer, int buffer_size);  // Read file contents
 int create_file(const char* filename);  // Create an empty file
 int write_file(const char* filename, const char* buffer, int size);  // Write buffer to file
+int sync(void);  // Write cached disk data back to the drives
+int iostat(int device, iostat_t* stats, int reset);  // Get block device statistics (-1 = no such device)
+int statfs(int mount, statfs_t* st);  // Get size and usage of a mounted filesystem (-1 = no such mount)
+int defrag(const char* path, defrag_stat_t* reports, int max);  // Make files under a directory contiguous, returns files examined (-1 = not FAT)
+
+// File descriptors (flags and stat_t in fcntl.h)
+int open(const char* filename, int flags);  // Open a file, returns descriptor or -1
+int read(int fd, void* buffer, int size);   // Read at the file offset, returns bytes (0 = end of file)
+int write(int fd, const void* buffer, int size);  // Write at the file offset, returns bytes
+long lseek(int fd, long offset, int whence);  // Move the file offset, returns new offset or -1
+int close(int fd);                          // Close a descriptor
+int fstat(int fd, stat_t* st);              // Get size and offset of an open file
+int ftruncate(int fd, long size);           // Shrink an open file, freeing its surplus clusters
 
 // Special key codes (returned by getchar for non-ASCII keys)
 #define KEY_LEFT  0x01
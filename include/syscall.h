@@ -35,14 +35,34 @@
 #define SYSCALL_READ_FILE   33
 #define SYSCALL_CREATE_FILE 34
 #define SYSCALL_WRITE_FILE  35
+#define SYSCALL_SYNC        36
+#define SYSCALL_IOSTAT      37
+#define SYSCALL_DEFRAG      38
+#define SYSCALL_STATFS      39
 
 // System call numbers - Program execution
 #define SYSCALL_EXEC_PROGRAM 40
+#define SYSCALL_EXIT_PROGRAM 41
 
 // System call numbers - VGA buffer management
 #define SYSCALL_SAVE_VGA    50
 #define SYSCALL_RESTORE_VGA 51
 
+// System call numbers - File descriptors
+#define SYSCALL_OPEN        60
+#define SYSCALL_READ        61
+#define SYSCALL_WRITE       62
+#define SYSCALL_LSEEK       63
+#define SYSCALL_CLOSE       64
+#define SYSCALL_FSTAT       65
+#define SYSCALL_FTRUNCATE   66
+
+// System call numbers - Paths
+#define SYSCALL_CHDIR       67
+#define SYSCALL_GETCWD      68
+#define SYSCALL_UNLINK      69
+#define SYSCALL_GETDENTS    70
+
 // System call interface for userspace programs
 int syscall(int num, ...);
 
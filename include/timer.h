@@ -7,6 +7,7 @@
 void timer_init(uint32_t frequency);
 void timer_wait(uint32_t ticks);
 uint64_t timer_get_ticks(void);
+uint64_t timer_get_us(void);  // Microseconds since boot (TSC, calibrated against the PIT)
 void sleep_ms(uint32_t ms);
 
 #endif
@@ -0,0 +1,44 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <stdint.h>
+#include "vfs.h"
+
+// RAM-backed filesystem
+// File data lives in 4KB pages from the physical page allocator, found
+// through a two-level page index, so reads and writes at any offset (and
+// appends in particular) cost O(1) per page and never touch a disk. The
+// filesystem is flat: files sit directly in its root directory.
+
+#define TMPFS_MAX_FILES    64
+#define TMPFS_PAGE_SIZE    4096
+#define TMPFS_INDEX_PAGES  16                       // Index pages per file
+#define TMPFS_PAGES_PER_INDEX (TMPFS_PAGE_SIZE / 4) // Page addresses per index page
+#define TMPFS_MAX_FILE_SIZE ((uint64_t)TMPFS_INDEX_PAGES * TMPFS_PAGES_PER_INDEX * TMPFS_PAGE_SIZE)
+
+typedef struct {
+    uint8_t used;
+    uint8_t unlinked;           // Removed from the directory, kept until the last close
+    uint16_t open_count;
+    char name[VFS_NAME_MAX];
+    uint32_t size;
+    uint32_t pages;             // Data pages allocated
+    uint32_t index[TMPFS_INDEX_PAGES];  // Physical addresses of index pages (0 = none)
+} tmpfs_node_t;
+
+typedef struct {
+    uint32_t page_limit;        // Most data and index pages the instance may hold
+    uint32_t pages_used;
+    uint32_t files;
+    uint64_t bytes;             // Sum of file sizes
+    tmpfs_node_t nodes[TMPFS_MAX_FILES];
+} tmpfs_t;
+
+// Create an empty instance that may use up to 'page_limit' pages
+// Mount it with vfs_mount(path, &tmpfs_vfs_ops, fs)
+// Returns: instance, or NULL if out of memory
+tmpfs_t* tmpfs_create(uint32_t page_limit);
+
+extern const vfs_ops_t tmpfs_vfs_ops;
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include "fcntl.h"
+
+// Virtual filesystem layer
+// Filesystems are mounted into one tree of paths ("/", "/ata0", ...). A path
+// is walked one component at a time through vnodes, which are kept in a hash
+// table keyed by (parent vnode, name) so repeated lookups never reach the
+// filesystem driver. Open files are vfs_file_t objects that the descriptor
+// table (fd.h) points at. Paths without a leading '/' start at the current
+// process's working directory.
+
+#define VFS_MAX_MOUNTS   8
+#define VFS_MAX_VNODES   96     // Cached path components (plus open files and cwds)
+#define VFS_MAX_FILES    32     // Open file objects, all processes together
+#define VFS_HASH_BUCKETS 64
+#define VFS_NAME_MAX     32     // Longest path component, including the NUL
+#define VFS_PATH_MAX     256
+
+typedef struct vfs_mount vfs_mount_t;
+typedef struct vfs_vnode vfs_vnode_t;
+typedef struct vfs_file vfs_file_t;
+
+// One directory entry as returned by a filesystem's readdir
+typedef struct {
+    char name[VFS_NAME_MAX];
+    uint32_t size;
+    uint32_t ino;               // Filesystem's id (FAT: first cluster)
+    uint8_t is_directory;
+    uint8_t attributes;         // DIRENT_* bits (fcntl.h)
+} vfs_dirent_t;
+
+// Filesystem driver operations
+// Lookups are only asked for real names; "." and ".." are handled by the VFS.
+// Functions return 0 on success and -1 on error unless noted.
+typedef struct {
+    const char* name;           // Filesystem type ("fat", ...)
+    uint8_t case_insensitive;   // Names differing only in case are the same file
+
+    // Find 'name' in directory 'dir' and fill in child->ino and child->is_directory
+    // Returns: 0 if found, -1 if not
+    int (*lookup)(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child);
+
+    // Create an empty file 'name' in 'dir', filling in child like lookup
+    int (*create)(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child);
+
+    // Remove file 'name' from 'dir'
+    int (*unlink)(vfs_vnode_t* dir, const char* name);
+
+    // Fill up to 'count' entries of 'dir' starting at *cookie (0 = first) and
+    // advance the cookie past them
+    // Returns: entries filled (fewer than count at the end), or -1 on error
+    int (*readdir)(vfs_vnode_t* dir, uint32_t* cookie, vfs_dirent_t* entries, uint32_t count);
+
+    // Set up file->priv and file->size for a regular file
+    int (*open)(vfs_file_t* file);
+
+    // Transfer at file->position (the VFS advances it)
+    // Returns: bytes transferred (0 at end of file), or -1 on error
+    int (*read)(vfs_file_t* file, uint8_t* buffer, uint32_t size);
+    int (*write)(vfs_file_t* file, const uint8_t* buffer, uint32_t size);
+
+    // Shrink a file to 'size' bytes (not larger than file->size)
+    int (*truncate)(vfs_file_t* file, uint32_t size);
+
+    // Write back the file's metadata and release file->priv
+    int (*close)(vfs_file_t* file);
+
+    // Write back everything the filesystem holds dirty in memory
+    int (*sync)(vfs_mount_t* mount);
+
+    // Fill in the size and usage fields of 'st' (path and type are set by the VFS)
+    int (*statfs)(vfs_mount_t* mount, statfs_t* st);
+} vfs_ops_t;
+
+struct vfs_mount {
+    uint8_t used;
+    char path[VFS_PATH_MAX];    // Where it is mounted ("/" for the root)
+    const vfs_ops_t* ops;
+    void* fs;                   // Filesystem instance (e.g. fat_volume_t*)
+    vfs_vnode_t* root;
+    vfs_vnode_t* covered;       // Directory the mount point is in (NULL for "/")
+};
+
+struct vfs_vnode {
+    uint8_t used;
+    uint8_t hashed;             // In the lookup hash (unlinked vnodes live on unhashed while referenced)
+    uint8_t is_directory;
+    uint16_t refcount;          // Open files, working directories, cached children, mounts
+    uint32_t ino;               // Filesystem's id (FAT: first cluster, 0 = root directory)
+    uint32_t last_used;
+    vfs_mount_t* mount;
+    vfs_vnode_t* parent;        // Directory it was found in (the mount's covered dir for a mount root)
+    vfs_vnode_t* hash_next;
+    char name[VFS_NAME_MAX];
+};
+
+struct vfs_file {
+    uint8_t used;
+    uint16_t flags;             // O_ACCMODE and O_APPEND bits
+    vfs_vnode_t* vnode;
+    uint32_t position;
+    uint32_t size;              // Kept current by the filesystem
+    void* priv;                 // Filesystem's per-file state
+};
+
+// Reset the mount table and caches
+void vfs_init(void);
+
+// Mount a filesystem instance; the root must be mounted first at "/", other
+// mount points appear as directories in their parent
+// Returns: 0 on success, -1 on error
+int vfs_mount(const char* path, const vfs_ops_t* ops, void* fs);
+
+// Enumerate mounts (NULL past the end)
+vfs_mount_t* vfs_get_mount(int index);
+
+// Resolve a path to a vnode (the caller owns one reference)
+// Returns: vnode, or NULL if a component does not exist
+vfs_vnode_t* vfs_resolve(const char* path);
+
+// Find one name in a directory vnode ("." and ".." included)
+// Returns: referenced vnode, or NULL if it does not exist
+vfs_vnode_t* vfs_lookup(vfs_vnode_t* dir, const char* name);
+
+// Take another reference on a vnode / drop one (from vfs_resolve or vfs_retain)
+void vfs_retain(vfs_vnode_t* vnode);
+void vfs_release(vfs_vnode_t* vnode);
+
+// Open a file (O_* flags from fcntl.h); directories open read-only
+// Returns: file object, or NULL on error
+vfs_file_t* vfs_open(const char* path, int flags);
+
+// Read/write at file->position and advance it
+// Returns: bytes transferred (0 at end of file), or -1 on error
+int vfs_read(vfs_file_t* file, uint8_t* buffer, uint32_t size);
+int vfs_write(vfs_file_t* file, const uint8_t* buffer, uint32_t size);
+
+// Shrink a file (growing is not supported)
+// Returns: 0 on success, -1 on error
+int vfs_truncate(vfs_file_t* file, uint32_t size);
+
+// Write back the file's metadata and free the file object
+// Returns: 0 on success, -1 on error
+int vfs_close(vfs_file_t* file);
+
+// Remove a file
+// Returns: 0 on success, -1 on error
+int vfs_unlink(const char* path);
+
+// Directory entries of a vnode: the filesystem's own entries followed by the
+// mount points inside it
+// Returns: entries filled (fewer than count at the end), or -1 on error
+int vfs_readdir(vfs_vnode_t* dir, uint32_t* cookie, vfs_dirent_t* entries, uint32_t count);
+
+// Read the next entries of a directory opened with vfs_open; file->position
+// holds the readdir cookie (0 = first entry)
+// Returns: entries filled (0 at the end), or -1 on error
+int vfs_getdents(vfs_file_t* file, vfs_dirent_t* entries, uint32_t count);
+
+// Print a directory listing
+// Returns: 0 on success, -1 on error
+int vfs_list(const char* path);
+
+// Change the current process's working directory
+// Returns: 0 on success, -1 if the path is not a directory
+int vfs_chdir(const char* path);
+
+// Absolute path of the current working directory
+// Returns: 0 on success, -1 if it does not fit in 'size' bytes
+int vfs_getcwd(char* buffer, uint32_t size);
+
+// Size and usage of the mount at 'index' (see vfs_get_mount)
+// Returns: 0 on success, -1 if there is no such mount
+int vfs_statfs(int index, statfs_t* st);
+
+// Write back every mounted filesystem
+// Returns: 0 on success, -1 on error
+int vfs_sync(void);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include <stdint.h>
+
+// virtio-blk paravirtual disk driver (legacy/transitional PCI interface)
+// Used under QEMU with: -drive file=disk.img,if=virtio
+
+// Detect a virtio-blk PCI device
+// Returns: 1 if found, 0 if not available
+int virtio_blk_detect(void);
+
+// Initialize the device and its request virtqueue
+// Registers the disk as block device "vda"
+// Returns: 0 on success, -1 on failure
+int virtio_blk_init(void);
+
+// Read sectors from the disk
+// Large requests are split into several virtio requests which are all
+// placed on the available ring before a single queue notification.
+// buffer: Destination buffer (must be at least count * 512 bytes)
+// Returns: 0 on success, -1 on error
+int virtio_blk_read_sectors(uint32_t lba, uint32_t count, uint8_t* buffer);
+
+// Write sectors to the disk (batched the same way as reads)
+// Returns: 0 on success, -1 on error
+int virtio_blk_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buffer);
+
+#endif
@@ -8,6 +8,8 @@
 #define PAGE_PRESENT    (1ULL << 0)
 #define PAGE_WRITE      (1ULL << 1)
 #define PAGE_USER       (1ULL << 2)
+#define PAGE_WRITE_THROUGH (1ULL << 3)
+#define PAGE_CACHE_DISABLE (1ULL << 4)  // Use for device MMIO
 #define PAGE_HUGE       (1ULL << 7)
 #define PAGE_NO_EXECUTE (1ULL << 63)
 
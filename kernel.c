@@ -10,21 +10,38 @@
 #include "include/keyboard.h"
 #include "include/fdc.h"
 #include "include/ata.h"
+#include "include/virtio_blk.h"
+#include "include/nvme.h"
+#include "include/blkdev.h"
+#include "include/ramdisk.h"
 #include "include/fat12.h"
+#include "include/vfs.h"
+#include "include/santfs.h"
+#include "include/tmpfs.h"
+#include "include/initrd.h"
+#include "include/imgcache.h"
 #include "include/memory.h"
 #include "include/vmm.h"
 #include "include/heap.h"
 #include "include/loader.h"
 
+#define KERNEL_HEAP_ADDR 0x1000000    // 16MB
+#define KERNEL_HEAP_SIZE (1024 * 1024)
+
 // Disk type enumeration
 typedef enum {
     DISK_NONE = 0,
     DISK_FLOPPY,
-    DISK_ATA
+    DISK_VIRTIO,
+    DISK_ATA,
+    DISK_NVME
 } disk_type_t;
 
 static disk_type_t active_disk = DISK_NONE;
 
+// Block device names for each disk type
+static const char* disk_names[] = { "", "fd0", "vda", "ata0", "nvme0" };
+
 void kernel_main(void) {
     // Initialize VGA driver
     vga_init();
@@ -41,8 +58,10 @@ void kernel_main(void) {
     // Parse E820 memory map and initialize memory managers
     const e820_map_t* e820 = e820_parse();
     
+    // Managed memory starts at 8MB: below it are the page tables, kernel,
+    // programs and their stack
     if (!e820) {
-        pmem_init(0x400000, 0x400000);
+        pmem_init(0x800000, 0x800000);
     } else {
         uint64_t mem_start, mem_size;
         if (e820_find_largest_region(&mem_start, &mem_size) == 0) {
@@ -60,12 +79,19 @@ void kernel_main(void) {
             
             pmem_init((uint32_t)pmem_start, (uint32_t)pmem_size);
         } else {
-            pmem_init(0x400000, 0x400000);
+            pmem_init(0x800000, 0x800000);
         }
     }
     
+    // The kernel heap sits inside managed memory: keep the allocator off it
+    pmem_reserve_pages(KERNEL_HEAP_ADDR, KERNEL_HEAP_SIZE / 4096);
+    
+    // Keep the boot archive's pages before anything else allocates
+    initrd_init();
+    imgcache_init();
+    
     vmm_init();
-    heap_init((void*)0x1000000, 1024 * 1024);
+    heap_init((void*)KERNEL_HEAP_ADDR, KERNEL_HEAP_SIZE);
     
     // Test heap allocation
     printf("Testing heap allocation...\n");
@@ -99,12 +125,41 @@ void kernel_main(void) {
         printf("No floppy disk detected\n");
     }
     
-    // Try ATA if no floppy
-    if (active_disk == DISK_NONE && ata_detect()) {
+    // Try NVMe next (multiple deep hardware queues)
+    if (nvme_detect()) {
+        printf("NVMe controller detected\n");
+        if (nvme_init() == 0) {
+            if (active_disk == DISK_NONE) {
+                active_disk = DISK_NVME;
+                printf("Using NVMe disk\n\n");
+            }
+        } else {
+            printf("NVMe initialization failed\n");
+        }
+    }
+    
+    // Try virtio-blk next (paravirtual disk, much faster than emulated IDE)
+    if (virtio_blk_detect()) {
+        printf("virtio-blk disk detected\n");
+        if (virtio_blk_init() == 0) {
+            if (active_disk == DISK_NONE) {
+                active_disk = DISK_VIRTIO;
+                printf("Using virtio disk\n\n");
+            }
+        } else {
+            printf("virtio-blk initialization failed\n");
+        }
+    }
+    
+    // Try ATA (also probed next to the floppy, virtio and NVMe: a second disk
+    // can carry a data volume, and disks are compared for throughput)
+    if (ata_detect()) {
         printf("ATA hard disk detected\n");
         if (ata_init() == 0) {
-            active_disk = DISK_ATA;
-            printf("Using ATA hard disk\n\n");
+            if (active_disk == DISK_NONE) {
+                active_disk = DISK_ATA;
+                printf("Using ATA hard disk\n\n");
+            }
         } else {
             printf("ATA initialization failed\n");
         }
@@ -112,6 +167,22 @@ void kernel_main(void) {
         printf("No ATA disk detected\n");
     }
     
+    // With more than one hard disk attached, compare sequential read throughput
+    blkdev_t* vda = blkdev_find("vda");
+    blkdev_t* ata0 = blkdev_find("ata0");
+    blkdev_t* nvme0 = blkdev_find("nvme0");
+    if ((vda != NULL) + (ata0 != NULL) + (nvme0 != NULL) >= 2) {
+        uint8_t* bench_buf = (uint8_t*)malloc(256 * 512);
+        if (bench_buf) {
+            printf("Disk throughput (128KB sequential read):\n");
+            if (ata0) blkdev_benchmark(ata0, 0, 256, bench_buf);
+            if (vda) blkdev_benchmark(vda, 0, 256, bench_buf);
+            if (nvme0) blkdev_benchmark(nvme0, 0, 256, bench_buf);
+            printf("\n");
+            free(bench_buf);
+        }
+    }
+    
     // Check if we have any disk
     if (active_disk == DISK_NONE) {
         printf("\nERROR: No disk drives available!\n");
@@ -120,15 +191,73 @@ void kernel_main(void) {
         __asm__ volatile("1: hlt; jmp 1b");
     }
     
+    // Serve the boot floppy from memory; writes reach the disk on sync or when idle
+    blkdev_t* fs_disk = blkdev_find(disk_names[active_disk]);
+    blkdev_t* rd = NULL;
+    if (active_disk == DISK_FLOPPY) {
+        rd = ramdisk_create(fs_disk, FDC_SECTORS_PER_CYLINDER);
+        if (rd) {
+            fs_disk = rd;
+        }
+    }
+    
+    // Any other disk gets a sector cache for FAT12 readahead and write merging
+    if (fs_disk != rd && !fs_disk->cache) {
+        blkdev_enable_cache(fs_disk, 256);
+    }
+    
     // Initialize FAT12 filesystem
     printf("Initializing FAT12 filesystem...\n");
-    if (fat12_init() != 0) {
+    if (fat12_init(fs_disk) != 0) {
         printf("FAT12 initialization failed!\n\n");
         printf("Halting.\n");
         __asm__ volatile("1: hlt; jmp 1b");
     }
     printf("FAT12 initialized successfully!\n\n");
     
+    // The boot volume is the root of the file tree; any other disk with a
+    // santfs or FAT volume on it is mounted beside it as /<device>
+    vfs_init();
+    vfs_mount("/", &fat12_vfs_ops, fat12_boot_volume());
+    for (int i = 0; i < blkdev_count(); i++) {
+        blkdev_t* dev = blkdev_get(i);
+        if (dev == fs_disk || (rd && dev == blkdev_find(disk_names[active_disk]))) {
+            continue;  // The boot volume, or the floppy behind its RAM disk
+        }
+        char path[16] = "/";
+        strcat(path, dev->name);
+        if (santfs_probe(dev)) {
+            santfs_volume_t* svol = (santfs_volume_t*)calloc(1, sizeof(santfs_volume_t));
+            if (!svol || santfs_mount(svol, dev) != 0) {
+                free(svol);
+                continue;
+            }
+            if (vfs_mount(path, &santfs_vfs_ops, svol) == 0) {
+                printf("Mounted santfs volume on %s at %s (%d KB free)\n", dev->name, path,
+                       svol->super.free_blocks * (svol->super.block_size / 1024));
+            }
+            continue;
+        }
+        fat_volume_t* vol = (fat_volume_t*)calloc(1, sizeof(fat_volume_t));
+        if (!vol) {
+            break;
+        }
+        if (fat12_mount(vol, dev) != 0) {
+            free(vol);
+            continue;
+        }
+        if (vfs_mount(path, &fat12_vfs_ops, vol) != 0) {
+            continue;  // Stays registered with the FAT layer, so it is never freed
+        }
+        printf("Mounted FAT%d volume on %s at %s\n", vol->type, dev->name, path);
+    }
+    
+    // Scratch files in memory, allowed up to a quarter of the free pages
+    tmpfs_t* tmp = tmpfs_create(pmem_get_free_pages() / 4);
+    if (tmp && vfs_mount("/tmp", &tmpfs_vfs_ops, tmp) == 0) {
+        printf("Mounted tmpfs at /tmp (%d KB)\n", tmp->page_limit * 4);
+    }
+    
     // Load and execute shell program
     void* shell_addr = (void*)0x100000;  // Load at 1MB
     uint64_t entry_point = load_program("SHELL.ELF", shell_addr);
@@ -140,6 +269,8 @@ void kernel_main(void) {
     }
 
     //if we get here, notify user to power off computer
+    vfs_sync();
+    blkdev_sync_all();
     printf("It is now safe to turn off your computer.\n");
     __asm__ volatile("hlt");
 }
\ No newline at end of file
@@ -43,8 +43,8 @@ void set_cursor_pos(unsigned char x, unsigned char y) {
     do_syscall(SYSCALL_SET_CURSOR, (uint64_t)x, (uint64_t)y, 0);
 }
 
-int list_dir(void) {
-    return (int)do_syscall(SYSCALL_LIST_DIR, 0, 0, 0);
+int list_dir(const char* path) {
+    return (int)do_syscall(SYSCALL_LIST_DIR, (uint64_t)path, 0, 0);
 }
 
 int list_dir_cluster(unsigned short cluster) {
@@ -55,6 +55,22 @@ unsigned short find_entry(unsigned short dir_cluster, const char* name, int* is_
     return (unsigned short)do_syscall(SYSCALL_FIND_ENTRY, (uint64_t)dir_cluster, (uint64_t)name, (uint64_t)is_directory);
 }
 
+int chdir(const char* path) {
+    return (int)do_syscall(SYSCALL_CHDIR, (uint64_t)path, 0, 0);
+}
+
+int getcwd(char* buffer, int size) {
+    return (int)do_syscall(SYSCALL_GETCWD, (uint64_t)buffer, (uint64_t)size, 0);
+}
+
+int unlink(const char* path) {
+    return (int)do_syscall(SYSCALL_UNLINK, (uint64_t)path, 0, 0);
+}
+
+int getdents(int fd, dirent_t* buffer, int size) {
+    return (int)do_syscall(SYSCALL_GETDENTS, (uint64_t)fd, (uint64_t)buffer, (uint64_t)size);
+}
+
 int read_file(const char* filename, char* buffer, int buffer_size) {
     return (int)do_syscall(SYSCALL_READ_FILE, (uint64_t)filename, (uint64_t)buffer, (uint64_t)buffer_size);
 }
@@ -67,24 +83,77 @@ int write_file(const char* filename, const char* buffer, int size) {
     return (int)do_syscall(SYSCALL_WRITE_FILE, (uint64_t)filename, (uint64_t)buffer, (uint64_t)size);
 }
 
+int sync(void) {
+    return (int)do_syscall(SYSCALL_SYNC, 0, 0, 0);
+}
+
+int iostat(int device, iostat_t* stats, int reset) {
+    return (int)do_syscall(SYSCALL_IOSTAT, (uint64_t)device, (uint64_t)stats, (uint64_t)reset);
+}
+
+int statfs(int mount, statfs_t* st) {
+    return (int)do_syscall(SYSCALL_STATFS, (uint64_t)mount, (uint64_t)st, 0);
+}
+
+int defrag(const char* path, defrag_stat_t* reports, int max) {
+    return (int)do_syscall(SYSCALL_DEFRAG, (uint64_t)path, (uint64_t)reports, (uint64_t)max);
+}
+
+int open(const char* filename, int flags) {
+    return (int)do_syscall(SYSCALL_OPEN, (uint64_t)filename, (uint64_t)flags, 0);
+}
+
+int read(int fd, void* buffer, int size) {
+    return (int)do_syscall(SYSCALL_READ, (uint64_t)fd, (uint64_t)buffer, (uint64_t)size);
+}
+
+int write(int fd, const void* buffer, int size) {
+    return (int)do_syscall(SYSCALL_WRITE, (uint64_t)fd, (uint64_t)buffer, (uint64_t)size);
+}
+
+long lseek(int fd, long offset, int whence) {
+    return (long)do_syscall(SYSCALL_LSEEK, (uint64_t)fd, (uint64_t)offset, (uint64_t)whence);
+}
+
+int close(int fd) {
+    return (int)do_syscall(SYSCALL_CLOSE, (uint64_t)fd, 0, 0);
+}
+
+int fstat(int fd, stat_t* st) {
+    return (int)do_syscall(SYSCALL_FSTAT, (uint64_t)fd, (uint64_t)st, 0);
+}
+
+int ftruncate(int fd, long size) {
+    return (int)do_syscall(SYSCALL_FTRUNCATE, (uint64_t)fd, (uint64_t)size, 0);
+}
+
 // Call program with a dedicated stack at a fixed memory address
 // Memory layout:
 //   0x100000 (1MB)  - Shell code
 //   0x200000 (2MB)  - Kernel code/data
-//   0x500000 (5MB)  - Program code
+//   0x500000 (5MB)  - Program code (position-independent programs go in allocator pages)
 //   0x700000 (7MB)  - Program stack top (grows down toward 6MB)
-//   0x800000 (8MB)  - Physical memory manager
-//   0x1000000 (16MB) - Kernel heap
+//   0x800000 (8MB)  - Page allocator pool (up to 1GB; tmpfs, caches, PIE programs)
+//   0x1000000 (16MB) - Kernel heap (reserved in the pool)
+// A program launched by another program (both position-independent, so
+// both resident) continues below its parent's stack instead of reusing it
 static void call_with_new_stack(uint64_t entry_point, int argc, char** argv) {
+    uint64_t sp;
+    __asm__ volatile("mov %%rsp, %0" : "=r"(sp));
+    uint64_t stack_top = 0x700000;
+    if (sp > 0x600000 && sp <= 0x700000) {
+        stack_top = (sp - 256) & ~0xFULL;  // Already on the program stack: nested launch
+    }
+    
     __asm__ volatile(
         "mov %%rsp, %%r15\n"            // Save current stack in r15
-        "movabs $0x700000, %%rsp\n"     // Switch to program stack at 7MB
+        "mov %3, %%rsp\n"              // Switch to program stack (7MB, or below the parent's)
         "mov %1, %%rdi\n"              // argc in rdi (1st arg)
         "mov %2, %%rsi\n"              // argv in rsi (2nd arg)
         "call *%0\n"                    // Call program
         "mov %%r15, %%rsp\n"            // Restore original stack
         :
-        : "r"(entry_point), "r"((uint64_t)argc), "r"((uint64_t)argv)
+        : "r"(entry_point), "r"((uint64_t)argc), "r"((uint64_t)argv), "r"(stack_top)
         : "r15", "rax", "rcx", "rdx", "rsi", "rdi", "r8", "r9", "r10", "r11", "memory"
     );
 }
@@ -121,6 +190,9 @@ int exec_program(const char* filename, int argc, char** argv) {
     // Call program with dedicated stack, passing argc and argv
     call_with_new_stack(entry_point, argc, argv);
     
+    // Let the kernel close whatever the program left open
+    do_syscall(SYSCALL_EXIT_PROGRAM, 0, 0, 0);
+    
     // Restore VGA buffer after program exits
     restore_vga();
     
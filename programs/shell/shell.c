@@ -11,13 +11,18 @@ char* variables[32];
 char* values[32];
 int variable_count = 0;
 
-char current_directory[256] = "/";  // Current directory path
-unsigned short current_cluster = 0;  // Current directory cluster (0 = root)
+char current_directory[256] = "/";  // Working directory path (kept by the kernel, cached for the prompt)
 
 // Stream buffer for piping between commands (e.g. cat FILE > read > find "text")
+// A stream that outgrows the buffer spills to a file in /tmp; the buffer then
+// holds a window of that file for the commands reading the stream
 #define STREAM_BUF_SIZE 32768
+#define STREAM_SPILL_PATH "/tmp/.stream"
 static char* stream_buffer = NULL;   // Shared stream buffer (malloc'd on first use)
 static int stream_length = 0;        // Current length of data in stream
+static int stream_fd = -1;           // Spill file (-1 = the stream is all in stream_buffer)
+static int window_start = 0;         // Spilled: stream offset of stream_buffer[0]
+static int window_length = 0;        // Spilled: bytes of the file in stream_buffer
 static int piping = 0;               // 1 if currently executing a pipeline
 static int pipe_remaining = 0;       // How many pipe segments remain after current one
 static char find_term[256] = "";     // Active search term for highlighting (set by find, used by read)
@@ -56,6 +61,91 @@ const char* resolve_value(const char* token, int* is_alloc);
 int evaluate_condition(const char* val1_raw, const char* op, const char* val2_raw);
 int cmd_read(void);
 void cmd_find(const char* search_term);
+void cmd_iostat(int reset);
+int cmd_ls(const char* path);
+void cmd_defrag(const char* path);
+void cmd_df(void);
+
+// Empty the stream and drop its spill file
+// Returns: 0, or -1 if the stream buffer could not be allocated
+static int stream_reset(void) {
+    if (stream_fd >= 0) {
+        close(stream_fd);
+        unlink(STREAM_SPILL_PATH);
+        stream_fd = -1;
+    }
+    stream_length = 0;
+    window_start = 0;
+    window_length = 0;
+    if (!stream_buffer) {
+        stream_buffer = (char*)malloc(STREAM_BUF_SIZE);
+        if (!stream_buffer) {
+            return -1;
+        }
+    }
+    stream_buffer[0] = '\0';
+    return 0;
+}
+
+// Append to the stream; once it no longer fits in stream_buffer, the whole
+// stream moves to the spill file
+// Returns: 0, or -1 if data was lost (out of memory, or no /tmp)
+static int stream_append(const char* data, int len) {
+    if (!stream_buffer && stream_reset() != 0) {
+        return -1;
+    }
+    if (stream_fd < 0 && stream_length + len < STREAM_BUF_SIZE) {
+        memcpy(stream_buffer + stream_length, data, len);
+        stream_length += len;
+        stream_buffer[stream_length] = '\0';
+        return 0;
+    }
+    
+    if (stream_fd < 0) {
+        stream_fd = open(STREAM_SPILL_PATH, O_RDWR | O_CREAT | O_TRUNC);
+        if (stream_fd < 0) {
+            return -1;
+        }
+        if (write(stream_fd, stream_buffer, stream_length) != stream_length) {
+            close(stream_fd);
+            unlink(STREAM_SPILL_PATH);
+            stream_fd = -1;
+            return -1;
+        }
+        window_length = 0;
+    }
+    
+    // Reading the stream moves the file offset
+    if (lseek(stream_fd, stream_length, SEEK_SET) != stream_length) {
+        return -1;
+    }
+    int written = write(stream_fd, data, len);
+    if (written > 0) {
+        stream_length += written;
+    }
+    return written == len ? 0 : -1;
+}
+
+// Byte 'i' (< stream_length) of the stream
+static char stream_at(int i) {
+    if (stream_fd < 0) {
+        return stream_buffer[i];
+    }
+    if (i < window_start || i >= window_start + window_length) {
+        window_start = i;
+        window_length = 0;
+        if (lseek(stream_fd, i, SEEK_SET) == i) {
+            int got = read(stream_fd, stream_buffer, STREAM_BUF_SIZE);
+            if (got > 0) {
+                window_length = got;
+            }
+        }
+        if (window_length == 0) {
+            return '\0';
+        }
+    }
+    return stream_buffer[i - window_start];
+}
 
 void shell_main(void) {
     // Allocate block storage dynamically
@@ -708,17 +798,23 @@ int process_single_command(char* command) {
         printf("Available commands:\n");
         printf("  add      - Add to numeric variable (add $VAR value)\n");
         printf("  cat      - Print file contents (cat <file>)\n");
-        printf("  cd       - Change directory (cd ., cd .., cd <dir>)\n");
+        printf("  cd       - Change directory (cd .., cd <dir>, cd /ata0)\n");
         printf("  clear    - Clear the screen\n");
+        printf("  defrag   - Make files contiguous on disk (defrag [dir])\n");
+        printf("  df       - Show size and usage of mounted filesystems\n");
         printf("  dir      - List directory contents (alias for ls)\n");
         printf("  echo     - Echo text with variable expansion ($VAR)\n");
         printf("  exit     - Exit the shell\n");
         printf("  find     - Highlight text in stream (> find \"text\")\n");
         printf("  help     - Show this help message\n");
+        printf("  iostat   - Show disk I/O statistics (iostat reset to zero them)\n");
         printf("  listvars - List all defined variables\n");
-        printf("  ls       - List directory contents\n");
+        printf("  ls       - List directory contents (ls [path])\n");
+        printf("  pwd      - Print the working directory\n");
         printf("  read     - Paginated text viewer (> read)\n");
+        printf("  rm       - Delete a file (rm <file>)\n");
         printf("  sub      - Subtract from numeric variable (sub $VAR value)\n");
+        printf("  sync     - Write cached disk data to the drive\n");
         printf("  touch    - Create an empty file (touch <file>)\n");
         printf("  unset    - Unset a variable (unset $VAR, unset allvars)\n");
         printf("\nPiping: cmd1 > cmd2 > cmd3\n");
@@ -749,66 +845,15 @@ int process_single_command(char* command) {
             return 0;
         }
         
-        char* target = args[1];
-        
-        if (strcmp(target, ".") == 0) {
-            // Stay in current directory
-            printf("%s\n", current_directory);
-        } else if (strcmp(target, "..") == 0) {
-            // Go up one directory
-            if (strcmp(current_directory, "/") == 0) {
-                set_color(COLOR_LIGHT_RED, COLOR_BLACK);
-                printf("Already at root directory\n");
-                set_color(COLOR_WHITE, COLOR_BLACK);
-            } else {
-                // Use FAT12's ".." entry to find parent cluster
-                int is_dir = 0;
-                unsigned short parent_cluster = find_entry(current_cluster, "..", &is_dir);
-                
-                // Find last slash and truncate path
-                int len = strlen(current_directory);
-                int last_slash = -1;
-                for (int i = len - 1; i >= 0; i--) {
-                    if (current_directory[i] == '/') {
-                        last_slash = i;
-                        break;
-                    }
-                }
-                
-                if (last_slash == 0) {
-                    current_directory[1] = '\0';  // Back to root "/"
-                    current_cluster = 0;  // Root cluster
-                } else if (last_slash > 0) {
-                    current_directory[last_slash] = '\0';
-                    current_cluster = parent_cluster;
-                }
-                printf("%s\n", current_directory);
-            }
+        // The kernel resolves the path (., .., absolute, mount points) and keeps
+        // the working directory for this process
+        if (chdir(args[1]) != 0) {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("Not a directory: %s\n", args[1]);
+            set_color(COLOR_WHITE, COLOR_BLACK);
         } else {
-            // Enter directory - validate it exists
-            int is_dir = 0;
-            unsigned short new_cluster = find_entry(current_cluster, target, &is_dir);
-            
-            if (new_cluster == 0) {
-                set_color(COLOR_LIGHT_RED, COLOR_BLACK);
-                printf("Directory not found: %s\n", target);
-                set_color(COLOR_WHITE, COLOR_BLACK);
-            } else if (!is_dir) {
-                set_color(COLOR_LIGHT_RED, COLOR_BLACK);
-                printf("Not a directory: %s\n", target);
-                set_color(COLOR_WHITE, COLOR_BLACK);
-            } else {
-                // Valid directory, update path and cluster
-                if (strcmp(current_directory, "/") == 0) {
-                    strcpy(current_directory, "/");
-                    strcat(current_directory, target);
-                } else {
-                    strcat(current_directory, "/");
-                    strcat(current_directory, target);
-                }
-                current_cluster = new_cluster;
-                printf("%s\n", current_directory);
-            }
+            getcwd(current_directory, sizeof(current_directory));
+            printf("%s\n", current_directory);
         }
         
         free(command_copy);
@@ -843,9 +888,21 @@ int process_single_command(char* command) {
         return 0;
     }
     
-    //ls or dir - list directory contents
+    //pwd - print the working directory
+    if (strcmp(command_name, "pwd") == 0) {
+        getcwd(current_directory, sizeof(current_directory));
+        printf("%s\n", current_directory);
+        free(command_copy);
+        return 0;
+    }
+    
+    //ls or dir - list directory contents (working directory, or the path given)
     if (strcmp(command_name, "ls") == 0 || strcmp(command_name, "dir") == 0) {
-        list_dir_cluster(current_cluster);
+        if (cmd_ls(argc > 1 ? args[1] : ".") != 0) {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("Not a directory: %s\n", argc > 1 ? args[1] : ".");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        }
         free(command_copy);
         return 0;
     }
@@ -909,14 +966,8 @@ int process_single_command(char* command) {
         
         if (piping) {
             // Store in stream buffer for next command in pipeline
-            if (!stream_buffer) {
-                stream_buffer = (char*)malloc(STREAM_BUF_SIZE);
-            }
-            if (stream_buffer) {
-                int copy_len = out_len < STREAM_BUF_SIZE - 1 ? out_len : STREAM_BUF_SIZE - 1;
-                memcpy(stream_buffer, out_buf, copy_len);
-                stream_buffer[copy_len] = '\0';
-                stream_length = copy_len;
+            if (stream_reset() == 0) {
+                stream_append(out_buf, out_len);
             }
         } else {
             printf("%s\n", out_buf);
@@ -1197,6 +1248,38 @@ int process_single_command(char* command) {
         return 0;
     }
 
+    // iostat - per-device block I/O counters and latency histograms
+    if (strcmp(command_name, "iostat") == 0) {
+        cmd_iostat(argc > 1 && strcmp(args[1], "reset") == 0);
+        free(command_copy);
+        return 0;
+    }
+
+    // df - size and usage of every mounted filesystem
+    if (strcmp(command_name, "df") == 0) {
+        cmd_df();
+        free(command_copy);
+        return 0;
+    }
+
+    // defrag - make every file under a directory contiguous
+    if (strcmp(command_name, "defrag") == 0) {
+        cmd_defrag(argc > 1 ? args[1] : NULL);
+        free(command_copy);
+        return 0;
+    }
+
+    // sync - write back cached disk blocks
+    if (strcmp(command_name, "sync") == 0) {
+        if (sync() != 0) {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("Error: Sync failed\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        }
+        free(command_copy);
+        return 0;
+    }
+
     // touch - create an empty file
     if (strcmp(command_name, "touch") == 0) {
         if (argc < 2) {
@@ -1216,7 +1299,26 @@ int process_single_command(char* command) {
         return 0;
     }
 
-    // cat - read file and print to screen, or put into stream buffer if piped
+    // rm - delete a file
+    if (strcmp(command_name, "rm") == 0) {
+        if (argc < 2) {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("Usage: rm <filename>\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+            free(command_copy);
+            return 0;
+        }
+        if (unlink(args[1]) != 0) {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("Error: Failed to delete %s\n", args[1]);
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        }
+        free(command_copy);
+        return 0;
+    }
+
+    // cat - read file into the stream (spilling to /tmp past the stream
+    // buffer) and print it to screen unless piped
     if (strcmp(command_name, "cat") == 0) {
         if (argc < 2) {
             set_color(COLOR_LIGHT_RED, COLOR_BLACK);
@@ -1226,35 +1328,44 @@ int process_single_command(char* command) {
             return 0;
         }
         
-        // Allocate stream buffer if not already
-        if (!stream_buffer) {
-            stream_buffer = (char*)malloc(STREAM_BUF_SIZE);
-            if (!stream_buffer) {
-                set_color(COLOR_LIGHT_RED, COLOR_BLACK);
-                printf("Error: Memory allocation failed\n");
-                set_color(COLOR_WHITE, COLOR_BLACK);
-                free(command_copy);
-                return 0;
-            }
+        if (stream_reset() != 0) {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("Error: Memory allocation failed\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+            free(command_copy);
+            return 0;
         }
         
-        int bytes = read_file(args[1], stream_buffer, STREAM_BUF_SIZE - 1);
-        if (bytes < 0) {
+        int fd = open(args[1], O_RDONLY);
+        if (fd < 0) {
             set_color(COLOR_LIGHT_RED, COLOR_BLACK);
             printf("Error: Failed to read file %s\n", args[1]);
             set_color(COLOR_WHITE, COLOR_BLACK);
             free(command_copy);
             return 0;
         }
-        stream_buffer[bytes] = '\0';
-        stream_length = bytes;
         
-        // Only print to screen if not in a pipeline
-        if (!piping) {
-            printf("%s", stream_buffer);
-            if (bytes > 0 && stream_buffer[bytes - 1] != '\n') {
-                printf("\n");
+        char chunk[1024];
+        int bytes;
+        char last = '\n';
+        while ((bytes = read(fd, chunk, sizeof(chunk) - 1)) > 0) {
+            if (stream_append(chunk, bytes) != 0 && piping) {
+                set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+                printf("Error: Stream full (no room in /tmp), output cut at %d bytes\n", stream_length);
+                set_color(COLOR_WHITE, COLOR_BLACK);
+                break;
             }
+            
+            // Only print to screen if not in a pipeline
+            if (!piping) {
+                chunk[bytes] = '\0';
+                printf("%s", chunk);
+                last = chunk[bytes - 1];
+            }
+        }
+        close(fd);
+        if (!piping && last != '\n') {
+            printf("\n");
         }
         
         free(command_copy);
@@ -1333,6 +1444,26 @@ int process_single_command(char* command) {
                 found = 1;
             }
         }
+        
+        // Programs live in the root directory; find them from any working directory
+        int has_slash = 0;
+        for (int i = 0; command_name[i]; i++) {
+            if (command_name[i] == '/') has_slash = 1;
+        }
+        if (!found && !has_slash) {
+            for (int i = strlen(elf_name); i >= 0; i--) {
+                elf_name[i + 1] = elf_name[i];
+            }
+            elf_name[0] = '/';
+            if (read_file(elf_name, probe, 4) > 0) {
+                found = 1;
+            } else {
+                elf_name[strlen(elf_name) - 4] = '\0';  // Drop ".ELF" again
+                if (read_file(elf_name, probe, 4) > 0) {
+                    found = 1;
+                }
+            }
+        }
 
         if (found) {
             // Set args[0] to the resolved filename (e.g. "SEDIT" instead of "sedit")
@@ -1513,7 +1644,7 @@ void execute_block(void) {
 }
 
 // Pipeline-aware process_command
-// Splits command line on " > " and chains commands via stream_buffer
+// Splits command line on " > " and chains commands via the stream
 // cat FILE > read > find "text"
 int process_command(char* command) {
     // Check if there's a pipe in the command
@@ -1533,17 +1664,12 @@ int process_command(char* command) {
     }
     
     // Allocate stream buffer if needed
-    if (!stream_buffer) {
-        stream_buffer = (char*)malloc(STREAM_BUF_SIZE);
-        if (!stream_buffer) {
-            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
-            printf("Error: Memory allocation failed for stream\n");
-            set_color(COLOR_WHITE, COLOR_BLACK);
-            return -1;
-        }
+    if (stream_reset() != 0) {
+        set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+        printf("Error: Memory allocation failed for stream\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return -1;
     }
-    stream_length = 0;
-    stream_buffer[0] = '\0';
     find_term[0] = '\0';
     piping = 1;
     
@@ -1625,11 +1751,11 @@ int process_command(char* command) {
 }
 
 // cmd_read - Paginated text viewer
-// Reads from stream_buffer and displays one page at a time
+// Reads from the stream and displays one page at a time
 // LEFT arrow = next page, RIGHT arrow = previous page, ESC/Q = quit
 // If find_term is set (by a preceding find command), highlights matches
 int cmd_read(void) {
-    if (!stream_buffer || stream_length == 0) {
+    if (stream_length == 0) {
         set_color(COLOR_LIGHT_RED, COLOR_BLACK);
         printf("Error: No data in stream. Use cat <file> > read\n");
         set_color(COLOR_WHITE, COLOR_BLACK);
@@ -1648,7 +1774,7 @@ int cmd_read(void) {
     int row = 0;
     
     for (int i = 0; i < stream_length && total_pages < 1024; i++) {
-        if (stream_buffer[i] == '\n') {
+        if (stream_at(i) == '\n') {
             col = 0;
             row++;
         } else {
@@ -1687,7 +1813,7 @@ int cmd_read(void) {
             if (ft_len > 0 && i + ft_len <= stream_length) {
                 int match = 1;
                 for (int j = 0; j < ft_len; j++) {
-                    if (stream_buffer[i + j] != find_term[j]) {
+                    if (stream_at(i + j) != find_term[j]) {
                         match = 0;
                         break;
                     }
@@ -1695,14 +1821,14 @@ int cmd_read(void) {
                 if (match) {
                     set_color(COLOR_BLACK, COLOR_YELLOW);
                     for (int j = 0; j < ft_len && (i + j) < end; j++) {
-                        putchar(stream_buffer[i + j]);
+                        putchar(stream_at(i + j));
                     }
                     set_color(COLOR_WHITE, COLOR_BLACK);
                     i += ft_len - 1;
                     continue;
                 }
             }
-            putchar(stream_buffer[i]);
+            putchar(stream_at(i));
         }
         
         // Print status bar on last row
@@ -1783,7 +1909,7 @@ int cmd_read(void) {
     
     // Clear find term after display
     find_term[0] = '\0';
-    stream_length = 0;  // Clear stream so nothing leaks to later commands
+    stream_reset();  // Clear stream so nothing leaks to later commands
     clear_screen();
     return -200;  // Signal pipeline to stop
 }
@@ -1791,9 +1917,9 @@ int cmd_read(void) {
 // cmd_find - Highlight matching text in stream buffer
 // Sets the find_term so read can highlight during pagination.
 // If find is the last command in the pipeline, prints highlighted text directly.
-// Stream buffer is NOT modified — highlighting is done at display time.
+// The stream is NOT modified — highlighting is done at display time.
 void cmd_find(const char* search_term) {
-    if (!stream_buffer || stream_length == 0) {
+    if (stream_length == 0) {
         set_color(COLOR_LIGHT_RED, COLOR_BLACK);
         printf("Error: No data in stream. Use cat <file> > find \"text\"\n");
         set_color(COLOR_WHITE, COLOR_BLACK);
@@ -1826,7 +1952,7 @@ void cmd_find(const char* search_term) {
         if (i + term_len <= stream_length) {
             match = 1;
             for (int j = 0; j < term_len; j++) {
-                if (stream_buffer[i + j] != find_term[j]) {
+                if (stream_at(i + j) != find_term[j]) {
                     match = 0;
                     break;
                 }
@@ -1836,18 +1962,234 @@ void cmd_find(const char* search_term) {
         if (match) {
             set_color(COLOR_BLACK, COLOR_YELLOW);
             for (int j = 0; j < term_len; j++) {
-                putchar(stream_buffer[i + j]);
+                putchar(stream_at(i + j));
             }
             set_color(COLOR_WHITE, COLOR_BLACK);
             i += term_len - 1;
         } else {
-            putchar(stream_buffer[i]);
+            putchar(stream_at(i));
         }
     }
-    if (stream_length > 0 && stream_buffer[stream_length - 1] != '\n') {
+    if (stream_length > 0 && stream_at(stream_length - 1) != '\n') {
         printf("\n");
     }
     
     // Clear the find term after use
     find_term[0] = '\0';
 }
+
+// cmd_iostat - Print block device statistics reported by the kernel
+// Latency buckets are labelled with their upper bound (bucket i holds requests
+// that took less than 2^(i+1) microseconds)
+void cmd_iostat(int reset) {
+    iostat_t st;
+    int shown = 0;
+    
+    for (int dev = 0; iostat(dev, &st, reset) == 0; dev++) {
+        shown++;
+        set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+        printf("%s:", st.name);
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        printf("  reads %d (%d KB)  writes %d (%d KB)  busy %d ms\n",
+               st.reads, st.read_sectors / 2, st.writes, st.write_sectors / 2,
+               (int)(st.busy_us / 1000));
+        printf("  merges %d  cache %d hit / %d miss  retries %d  seeks %d  spin-ups %d  errors %d\n",
+               st.merges, st.cache_hits, st.cache_misses, st.retries, st.seeks, st.spinups, st.errors);
+        
+        printf("  latency:");
+        int any = 0;
+        for (int i = 0; i < IOSTAT_HIST_BUCKETS; i++) {
+            if (st.latency[i] == 0) continue;
+            uint32_t bound = 2u << i;
+            if (i == IOSTAT_HIST_BUCKETS - 1) {
+                printf(" >=%dms:%d", (bound / 2) / 1000, st.latency[i]);
+            } else if (bound < 10000) {
+                printf(" <%dus:%d", bound, st.latency[i]);
+            } else {
+                printf(" <%dms:%d", bound / 1000, st.latency[i]);
+            }
+            any = 1;
+        }
+        printf(any ? "\n" : " (no requests)\n");
+    }
+    
+    if (!shown) {
+        printf("No block devices\n");
+    } else if (reset) {
+        printf("Counters reset\n");
+    }
+}
+
+// Format one ls line ("NAME.EXT        1234" or "<DIR>") into 'line'
+static int ls_format(char* line, const dirent_t* e) {
+    int len = 0;
+    for (int i = 0; e->name[i] && len < 31; i++) line[len++] = e->name[i];
+    while (len < 12) line[len++] = ' ';
+    line[len++] = ' ';
+    
+    char num[16];
+    if (e->attributes & DIRENT_DIRECTORY) {
+        strcpy(num, "<DIR>");
+    } else {
+        sprintf(num, "%u", e->size);
+    }
+    for (int pad = 10 - strlen(num); pad > 0; pad--) line[len++] = ' ';
+    for (int i = 0; num[i]; i++) line[len++] = num[i];
+    line[len++] = '\n';
+    line[len] = '\0';
+    return len;
+}
+
+// cmd_ls - List a directory
+// Entries come from getdents in batches; the listing is paged on screen
+// (any key = next page, Q/ESC = stop) or appended to the stream in a pipeline.
+int cmd_ls(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    stat_t st;
+    if (fstat(fd, &st) != 0 || !st.is_directory) {
+        close(fd);
+        return -1;
+    }
+    
+    if (piping) {
+        stream_reset();
+    } else {
+        printf("Name               Size\n");
+        printf("------------------------\n");
+    }
+    
+    dirent_t entries[16];
+    char line[64];
+    int files = 0, dirs = 0, rows = 2;
+    uint32_t bytes = 0;
+    int got;
+    while ((got = getdents(fd, entries, sizeof(entries))) > 0) {
+        for (int i = 0; i < got / (int)sizeof(dirent_t); i++) {
+            if (entries[i].attributes & DIRENT_DIRECTORY) {
+                dirs++;
+            } else {
+                files++;
+                bytes += entries[i].size;
+            }
+            int len = ls_format(line, &entries[i]);
+            
+            if (piping) {
+                stream_append(line, len);
+                continue;
+            }
+            
+            printf("%s", line);
+            if (++rows == PAGE_ROWS) {
+                set_color(COLOR_BLACK, COLOR_LIGHT_GRAY);
+                printf("-- More -- (any key, Q to stop)");
+                set_color(COLOR_WHITE, COLOR_BLACK);
+                char key = getchar();
+                printf("\r                               \r");
+                if (key == 'q' || key == 'Q' || key == 27) {
+                    close(fd);
+                    return 0;
+                }
+                rows = 0;
+            }
+        }
+    }
+    close(fd);
+    
+    if (!piping) {
+        printf("%d file(s), %u bytes, %d dir(s)\n", files, bytes, dirs);
+    }
+    return got < 0 ? -1 : 0;
+}
+
+// cmd_defrag - Defragment the files under a directory and report, per file,
+// the fragment count and uncached read time before and after
+#define DEFRAG_REPORTS 64
+void cmd_defrag(const char* path) {
+    defrag_stat_t* reports = (defrag_stat_t*)malloc(DEFRAG_REPORTS * sizeof(defrag_stat_t));
+    if (!reports) {
+        set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+        printf("Error: Memory allocation failed\n");
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        return;
+    }
+    
+    printf("Defragmenting %s ...\n", path ? path : current_directory);
+    int count = defrag(path, reports, DEFRAG_REPORTS);
+    if (count < 0) {
+        set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+        printf("Not a FAT directory: %s\n", path ? path : current_directory);
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        free(reports);
+        return;
+    }
+    
+    int shown = count < DEFRAG_REPORTS ? count : DEFRAG_REPORTS;
+    int moved = 0;
+    uint32_t before = 0, after = 0;
+    for (int i = 0; i < shown; i++) {
+        defrag_stat_t* r = &reports[i];
+        before += r->fragments_before;
+        after += r->fragments_after;
+        
+        set_color(COLOR_LIGHT_CYAN, COLOR_BLACK);
+        printf("  %s", r->path);
+        set_color(COLOR_WHITE, COLOR_BLACK);
+        printf(": %u clusters, ", r->clusters);
+        if (r->status == DEFRAG_MOVED) {
+            moved++;
+            printf("%u -> %u fragments, read %u -> %u us\n",
+                   r->fragments_before, r->fragments_after, r->read_us_before, r->read_us_after);
+        } else if (r->status == DEFRAG_CONTIGUOUS) {
+            printf("contiguous, read %u us\n", r->read_us_before);
+        } else if (r->status == DEFRAG_NO_ROOM) {
+            printf("%u fragments, no free run large enough\n", r->fragments_before);
+        } else if (r->status == DEFRAG_BUSY) {
+            printf("%u fragments, open - skipped\n", r->fragments_before);
+        } else {
+            set_color(COLOR_LIGHT_RED, COLOR_BLACK);
+            printf("failed, left in place\n");
+            set_color(COLOR_WHITE, COLOR_BLACK);
+        }
+    }
+    
+    if (count > shown) {
+        printf("  (%d more files not listed)\n", count - shown);
+    }
+    printf("%d file(s), %d moved, fragments %u -> %u\n", shown, moved, before, after);
+    free(reports);
+}
+
+// cmd_df - Show size and usage of each mounted filesystem
+void cmd_df(void) {
+    statfs_t st;
+    printf("Mount          Type        Size KB     Used KB     Free KB  Files\n");
+    for (int i = 0; statfs(i, &st) == 0; i++) {
+        uint32_t total_kb = (uint32_t)((uint64_t)st.total_blocks * st.block_size / 1024);
+        uint32_t free_kb = (uint32_t)((uint64_t)st.free_blocks * st.block_size / 1024);
+        char line[80];
+        int len = 0;
+        
+        // Columns by hand: printf has no field widths
+        for (int k = 0; st.path[k] && len < 14; k++) line[len++] = st.path[k];
+        while (len < 15) line[len++] = ' ';
+        for (int k = 0; st.type[k]; k++) line[len++] = st.type[k];
+        while (len < 22) line[len++] = ' ';
+        uint32_t columns[3] = { total_kb, total_kb - free_kb, free_kb };
+        for (int c = 0; c < 3; c++) {
+            char num[12];
+            sprintf(num, "%u", columns[c]);
+            for (int pad = 12 - strlen(num); pad > 0; pad--) line[len++] = ' ';
+            for (int k = 0; num[k]; k++) line[len++] = num[k];
+        }
+        line[len] = '\0';
+        
+        if (st.files > 0 || st.bytes_used > 0) {
+            printf("%s  %u (%u bytes)\n", line, st.files, (uint32_t)st.bytes_used);
+        } else {
+            printf("%s      -\n", line);
+        }
+    }
+}
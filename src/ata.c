@@ -1,4 +1,6 @@
 #include "../include/ata.h"
+#include "../include/blkdev.h"
+#include "../include/printf.h"
 
 // ATA PIO ports (Primary bus)
 #define ATA_PRIMARY_DATA        0x1F0
@@ -14,11 +16,21 @@
 // ATA Commands
 #define ATA_CMD_READ_SECTORS    0x20
 #define ATA_CMD_WRITE_SECTORS   0x30
+#define ATA_CMD_FLUSH_CACHE     0xE7
+#define ATA_CMD_FLUSH_CACHE_EXT 0xEA
+#define ATA_CMD_IDENTIFY        0xEC
 
 // Status bits
 #define ATA_STATUS_BSY  0x80  // Busy
 #define ATA_STATUS_DRQ  0x08  // Data request ready
 #define ATA_STATUS_ERR  0x01  // Error
+#define ATA_STATUS_DF   0x20  // Drive fault
+
+// Write-back cache size in sectors (128KB)
+#define ATA_CACHE_SECTORS 256
+
+// Drive capabilities from IDENTIFY
+static int ata_lba48 = 0;
 
 // I/O functions
 static inline void outb(uint16_t port, uint8_t value) {
@@ -84,6 +96,43 @@ int ata_detect(void) {
     return 1; // ATA drive detected
 }
 
+// Block device adapters (split large requests into uint8_t-sized chunks)
+static int ata_blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    (void)dev;
+    while (count > 0) {
+        uint8_t n = count > 255 ? 255 : (uint8_t)count;
+        if (ata_read_sectors(lba, n, buffer) != 0) return -1;
+        lba += n;
+        count -= n;
+        buffer += n * 512;
+    }
+    return 0;
+}
+
+static int ata_blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    (void)dev;
+    while (count > 0) {
+        uint8_t n = count > 255 ? 255 : (uint8_t)count;
+        if (ata_write_sectors(lba, n, buffer) != 0) return -1;
+        lba += n;
+        count -= n;
+        buffer += n * 512;
+    }
+    return 0;
+}
+
+static int ata_blk_flush(blkdev_t* dev) {
+    (void)dev;
+    return ata_flush_cache();
+}
+
+static blkdev_t ata_blkdev = {
+    .name = "ata0",
+    .read = ata_blk_read,
+    .write = ata_blk_write,
+    .flush = ata_blk_flush,
+};
+
 // Initialize ATA
 int ata_init(void) {
     // Select master drive (drive 0)
@@ -93,6 +142,24 @@ int ata_init(void) {
         return -1; // No drive or timeout
     }
     
+    // IDENTIFY: drive size and whether FLUSH CACHE EXT is available
+    outb(ATA_PRIMARY_COMMAND, ATA_CMD_IDENTIFY);
+    if (inb(ATA_PRIMARY_STATUS) != 0 && ata_wait_ready() == 0 && ata_wait_drq() == 0 &&
+        !(inb(ATA_PRIMARY_STATUS) & ATA_STATUS_ERR)) {
+        uint16_t identify[256];
+        for (int i = 0; i < 256; i++) {
+            identify[i] = inw(ATA_PRIMARY_DATA);
+        }
+        ata_blkdev.total_sectors = identify[60] | ((uint32_t)identify[61] << 16);
+        ata_lba48 = (identify[83] & (1 << 10)) != 0;
+    }
+    
+    blkdev_register(&ata_blkdev);
+    
+    // Small writes (FAT updates, directory entries) are merged and written at sync points
+    if (blkdev_enable_cache(&ata_blkdev, ATA_CACHE_SECTORS) != 0) {
+        printf("ATA: write-back cache disabled\n");
+    }
     return 0;
 }
 
@@ -141,7 +208,9 @@ int ata_read_sectors(uint32_t lba, uint8_t sector_count, uint8_t* buffer) {
 int ata_write_sectors(uint32_t lba, uint8_t sector_count, const uint8_t* buffer) {
     if (sector_count == 0) return -1;
     
-    ata_wait_ready();
+    if (ata_wait_ready() != 0) {
+        return -1; // Timeout waiting for drive
+    }
     
     // Select drive and set LBA mode
     outb(ATA_PRIMARY_DRIVE, 0xE0 | ((lba >> 24) & 0x0F));
@@ -157,10 +226,12 @@ int ata_write_sectors(uint32_t lba, uint8_t sector_count, const uint8_t* buffer)
     
     // Write data
     for (int i = 0; i < sector_count; i++) {
-        ata_wait_drq();
+        if (ata_wait_ready() != 0 || ata_wait_drq() != 0) {
+            return -1; // Timeout waiting for the drive to accept data
+        }
         
         // Check for errors
-        if (inb(ATA_PRIMARY_STATUS) & ATA_STATUS_ERR) {
+        if (inb(ATA_PRIMARY_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
             return -1;
         }
         
@@ -171,5 +242,31 @@ int ata_write_sectors(uint32_t lba, uint8_t sector_count, const uint8_t* buffer)
         }
     }
     
+    // Wait for the last sector to be accepted
+    if (ata_wait_ready() != 0) {
+        return -1;
+    }
+    if (inb(ATA_PRIMARY_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) {
+        return -1;
+    }
+    
     return 0;
 }
+
+// Flush the drive's write cache to the media
+int ata_flush_cache(void) {
+    if (ata_wait_ready() != 0) {
+        return -1;
+    }
+    
+    outb(ATA_PRIMARY_DRIVE, 0xE0);
+    outb(ATA_PRIMARY_COMMAND, ata_lba48 ? ATA_CMD_FLUSH_CACHE_EXT : ATA_CMD_FLUSH_CACHE);
+    
+    // Flushing can take a while on a real drive; poll longer than a normal command
+    for (int attempt = 0; attempt < 100; attempt++) {
+        if (ata_wait_ready() == 0) {
+            return (inb(ATA_PRIMARY_STATUS) & (ATA_STATUS_ERR | ATA_STATUS_DF)) ? -1 : 0;
+        }
+    }
+    return -1;
+}
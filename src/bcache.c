@@ -0,0 +1,303 @@
+#include "../include/bcache.h"
+#include "../include/heap.h"
+#include "../include/memory.h"
+#include "../include/vmm.h"
+#include "../include/string.h"
+#include "../include/printf.h"
+
+#define BCACHE_HASH_SIZE 64
+#define BCACHE_NONE      -1
+
+typedef struct {
+    uint32_t lba;
+    uint32_t last_used;     // LRU stamp
+    int16_t next;           // Hash chain
+    uint8_t valid;
+    uint8_t dirty;
+} bcache_entry_t;
+
+struct bcache {
+    uint32_t capacity;
+    bcache_entry_t* entries;
+    uint8_t* data;          // capacity * 512 bytes, slot i at i * 512
+    int16_t hash[BCACHE_HASH_SIZE];
+    uint32_t clock;
+    uint32_t dirty;
+    int16_t* order;         // Scratch for sorting dirty slots
+    uint8_t* run_buffer;    // BCACHE_MAX_RUN sectors, staging for coalesced writes
+};
+
+static inline uint32_t bcache_hash(uint32_t lba) {
+    return lba % BCACHE_HASH_SIZE;
+}
+
+static inline uint8_t* bcache_slot(bcache_t* cache, int index) {
+    return cache->data + (uint32_t)index * BLKDEV_SECTOR_SIZE;
+}
+
+bcache_t* bcache_create(uint32_t sectors) {
+    uint32_t pages = (sectors * BLKDEV_SECTOR_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t run_pages = BCACHE_MAX_RUN * BLKDEV_SECTOR_SIZE / PAGE_SIZE;
+    sectors = pages * PAGE_SIZE / BLKDEV_SECTOR_SIZE;
+
+    bcache_t* cache = (bcache_t*)malloc(sizeof(bcache_t));
+    if (!cache) return NULL;
+    cache->entries = (bcache_entry_t*)malloc(sectors * sizeof(bcache_entry_t));
+    cache->order = (int16_t*)malloc(sectors * sizeof(int16_t));
+    uint32_t data_addr = pmem_alloc_pages(pages);
+    uint32_t run_addr = pmem_alloc_pages(run_pages);
+    if (!cache->entries || !cache->order || data_addr == 0 || run_addr == 0) {
+        printf("bcache: out of memory\n");
+        if (data_addr != 0) pmem_free_pages(data_addr, pages);
+        if (run_addr != 0) pmem_free_pages(run_addr, run_pages);
+        free(cache->order);
+        free(cache->entries);
+        free(cache);
+        return NULL;
+    }
+
+    cache->capacity = sectors;
+    cache->data = (uint8_t*)(uintptr_t)data_addr;
+    cache->run_buffer = (uint8_t*)(uintptr_t)run_addr;
+    cache->clock = 0;
+    cache->dirty = 0;
+    for (uint32_t i = 0; i < sectors; i++) {
+        cache->entries[i].valid = 0;
+        cache->entries[i].dirty = 0;
+        cache->entries[i].next = BCACHE_NONE;
+    }
+    for (int i = 0; i < BCACHE_HASH_SIZE; i++) {
+        cache->hash[i] = BCACHE_NONE;
+    }
+    return cache;
+}
+
+// Find the slot caching lba
+// Returns: slot index, or BCACHE_NONE
+static int bcache_lookup(bcache_t* cache, uint32_t lba) {
+    for (int i = cache->hash[bcache_hash(lba)]; i != BCACHE_NONE; i = cache->entries[i].next) {
+        if (cache->entries[i].lba == lba) {
+            cache->entries[i].last_used = ++cache->clock;
+            return i;
+        }
+    }
+    return BCACHE_NONE;
+}
+
+static void bcache_unhash(bcache_t* cache, int index) {
+    int16_t* link = &cache->hash[bcache_hash(cache->entries[index].lba)];
+    while (*link != BCACHE_NONE) {
+        if (*link == index) {
+            *link = cache->entries[index].next;
+            return;
+        }
+        link = &cache->entries[*link].next;
+    }
+}
+
+// Sort dirty slots by LBA (insertion sort - the cache is small)
+// Returns: number of dirty slots in cache->order
+static uint32_t bcache_sort_dirty(bcache_t* cache) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < cache->capacity; i++) {
+        if (!cache->entries[i].dirty) continue;
+        uint32_t lba = cache->entries[i].lba;
+        uint32_t j = n++;
+        while (j > 0 && cache->entries[cache->order[j - 1]].lba > lba) {
+            cache->order[j] = cache->order[j - 1];
+            j--;
+        }
+        cache->order[j] = (int16_t)i;
+    }
+    return n;
+}
+
+int bcache_writeback(bcache_t* cache, blkdev_t* dev) {
+    if (cache->dirty == 0) return 0;
+
+    uint32_t n = bcache_sort_dirty(cache);
+    uint32_t i = 0;
+    while (i < n) {
+        // Gather a run of consecutive LBAs into the staging buffer
+        uint32_t start_lba = cache->entries[cache->order[i]].lba;
+        uint32_t run = 0;
+        while (i + run < n && run < BCACHE_MAX_RUN &&
+               cache->entries[cache->order[i + run]].lba == start_lba + run) {
+            memcpy(cache->run_buffer + run * BLKDEV_SECTOR_SIZE,
+                   bcache_slot(cache, cache->order[i + run]), BLKDEV_SECTOR_SIZE);
+            run++;
+        }
+
+        if (blkdev_device_write(dev, start_lba, run, cache->run_buffer) != 0) {
+            printf("bcache: write-back to %s failed at sector %d\n", dev->name, start_lba);
+            return -1;
+        }
+        for (uint32_t k = 0; k < run; k++) {
+            cache->entries[cache->order[i + k]].dirty = 0;
+        }
+        dev->stats.merges += run - 1;
+        cache->dirty -= run;
+        i += run;
+    }
+    return 0;
+}
+
+// Pick a slot for a new sector: an unused slot, else the least recently used clean one
+// Writes everything back first if every slot is dirty
+static int bcache_victim(bcache_t* cache, blkdev_t* dev) {
+    int victim = BCACHE_NONE;
+    for (int pass = 0; pass < 2 && victim == BCACHE_NONE; pass++) {
+        uint32_t oldest = 0xFFFFFFFF;
+        for (uint32_t i = 0; i < cache->capacity; i++) {
+            bcache_entry_t* e = &cache->entries[i];
+            if (!e->valid) return (int)i;
+            if (!e->dirty && e->last_used < oldest) {
+                oldest = e->last_used;
+                victim = (int)i;
+            }
+        }
+        if (victim == BCACHE_NONE && bcache_writeback(cache, dev) != 0) {
+            return BCACHE_NONE;
+        }
+    }
+    if (victim != BCACHE_NONE) {
+        bcache_unhash(cache, victim);
+        cache->entries[victim].valid = 0;
+    }
+    return victim;
+}
+
+// Take a slot for lba (must not already be cached)
+static int bcache_insert(bcache_t* cache, blkdev_t* dev, uint32_t lba) {
+    int index = bcache_victim(cache, dev);
+    if (index == BCACHE_NONE) return BCACHE_NONE;
+
+    bcache_entry_t* e = &cache->entries[index];
+    e->lba = lba;
+    e->valid = 1;
+    e->dirty = 0;
+    e->last_used = ++cache->clock;
+    e->next = cache->hash[bcache_hash(lba)];
+    cache->hash[bcache_hash(lba)] = (int16_t)index;
+    return index;
+}
+
+int bcache_read(bcache_t* cache, blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    if (count >= BCACHE_BYPASS_SECTORS && bcache_lookup(cache, lba) == BCACHE_NONE) {
+        // Large uncached read: straight from the device, then overlay newer dirty data
+        dev->stats.cache_misses += count;
+        if (blkdev_device_read(dev, lba, count, buffer) != 0) return -1;
+        if (cache->dirty == 0) return 0;
+        for (uint32_t i = 0; i < cache->capacity; i++) {
+            bcache_entry_t* e = &cache->entries[i];
+            if (e->dirty && e->lba >= lba && e->lba < lba + count) {
+                memcpy(buffer + (e->lba - lba) * BLKDEV_SECTOR_SIZE, bcache_slot(cache, i), BLKDEV_SECTOR_SIZE);
+            }
+        }
+        return 0;
+    }
+
+    // Serve hits, remembering the span of misses
+    uint32_t first_miss = count;
+    uint32_t last_miss = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        int index = bcache_lookup(cache, lba + i);
+        if (index != BCACHE_NONE) {
+            memcpy(buffer + i * BLKDEV_SECTOR_SIZE, bcache_slot(cache, index), BLKDEV_SECTOR_SIZE);
+            dev->stats.cache_hits++;
+        } else {
+            if (first_miss == count) first_miss = i;
+            last_miss = i;
+            dev->stats.cache_misses++;
+        }
+    }
+    if (first_miss == count) return 0;
+
+    // One device read covers every miss; re-apply cached sectors it overwrote
+    uint32_t span = last_miss - first_miss + 1;
+    uint8_t* dst = buffer + first_miss * BLKDEV_SECTOR_SIZE;
+    if (blkdev_device_read(dev, lba + first_miss, span, dst) != 0) return -1;
+
+    for (uint32_t i = 0; i < span; i++) {
+        int index = bcache_lookup(cache, lba + first_miss + i);
+        if (index != BCACHE_NONE) {
+            memcpy(dst + i * BLKDEV_SECTOR_SIZE, bcache_slot(cache, index), BLKDEV_SECTOR_SIZE);
+        }
+    }
+
+    // Then keep the newly read sectors (inserting may evict, so the buffer is final first)
+    for (uint32_t i = 0; i < span; i++) {
+        if (bcache_lookup(cache, lba + first_miss + i) != BCACHE_NONE) continue;
+        int index = bcache_insert(cache, dev, lba + first_miss + i);
+        if (index != BCACHE_NONE) {
+            memcpy(bcache_slot(cache, index), dst + i * BLKDEV_SECTOR_SIZE, BLKDEV_SECTOR_SIZE);
+        }
+    }
+    return 0;
+}
+
+int bcache_write(bcache_t* cache, blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    if (count >= BCACHE_BYPASS_SECTORS) {
+        // Large write: already contiguous, send it now and refresh cached copies
+        if (blkdev_device_write(dev, lba, count, buffer) != 0) return -1;
+        for (uint32_t i = 0; i < cache->capacity; i++) {
+            bcache_entry_t* e = &cache->entries[i];
+            if (e->valid && e->lba >= lba && e->lba < lba + count) {
+                memcpy(bcache_slot(cache, i), buffer + (e->lba - lba) * BLKDEV_SECTOR_SIZE, BLKDEV_SECTOR_SIZE);
+                if (e->dirty) {
+                    e->dirty = 0;
+                    cache->dirty--;
+                }
+            }
+        }
+        return 0;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        int index = bcache_lookup(cache, lba + i);
+        if (index == BCACHE_NONE) {
+            index = bcache_insert(cache, dev, lba + i);
+            if (index == BCACHE_NONE) return -1;
+        }
+        memcpy(bcache_slot(cache, index), buffer + i * BLKDEV_SECTOR_SIZE, BLKDEV_SECTOR_SIZE);
+        if (!cache->entries[index].dirty) {
+            cache->entries[index].dirty = 1;
+            cache->dirty++;
+        }
+    }
+    return 0;
+}
+
+int bcache_prefetch(bcache_t* cache, blkdev_t* dev, uint32_t lba, uint32_t count) {
+    if (count > BCACHE_MAX_RUN) count = BCACHE_MAX_RUN;
+    if (count > cache->capacity / 2) count = cache->capacity / 2;
+    
+    // Trim sectors that are already cached at either end
+    while (count > 0 && bcache_lookup(cache, lba) != BCACHE_NONE) {
+        lba++;
+        count--;
+    }
+    while (count > 0 && bcache_lookup(cache, lba + count - 1) != BCACHE_NONE) {
+        count--;
+    }
+    if (count == 0) return 0;
+    
+    // Make sure inserting can take clean slots, so write-back never reuses the
+    // staging buffer while it holds the prefetched data
+    if (cache->dirty + count > cache->capacity && bcache_writeback(cache, dev) != 0) {
+        return -1;
+    }
+    if (blkdev_device_read(dev, lba, count, cache->run_buffer) != 0) return -1;
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (bcache_lookup(cache, lba + i) != BCACHE_NONE) continue;
+        int index = bcache_insert(cache, dev, lba + i);
+        if (index == BCACHE_NONE) return -1;
+        memcpy(bcache_slot(cache, index), cache->run_buffer + i * BLKDEV_SECTOR_SIZE, BLKDEV_SECTOR_SIZE);
+    }
+    return 0;
+}
+
+uint32_t bcache_dirty_count(bcache_t* cache) {
+    return cache->dirty;
+}
@@ -0,0 +1,158 @@
+#include "../include/blkdev.h"
+#include "../include/bcache.h"
+#include "../include/string.h"
+#include "../include/timer.h"
+#include "../include/printf.h"
+
+// Registered devices
+static blkdev_t* devices[BLKDEV_MAX_DEVICES];
+static int device_count = 0;
+
+int blkdev_register(blkdev_t* dev) {
+    if (device_count >= BLKDEV_MAX_DEVICES) {
+        return -1;
+    }
+    memset(&dev->stats, 0, sizeof(iostat_t));
+    for (uint32_t i = 0; i < sizeof(dev->stats.name) - 1 && dev->name[i]; i++) {
+        dev->stats.name[i] = dev->name[i];
+    }
+    devices[device_count++] = dev;
+    return 0;
+}
+
+blkdev_t* blkdev_find(const char* name) {
+    for (int i = 0; i < device_count; i++) {
+        if (strcmp(devices[i]->name, name) == 0) {
+            return devices[i];
+        }
+    }
+    return NULL;
+}
+
+int blkdev_count(void) {
+    return device_count;
+}
+
+blkdev_t* blkdev_get(int index) {
+    if (index < 0 || index >= device_count) {
+        return NULL;
+    }
+    return devices[index];
+}
+
+// Account one driver request in the device statistics
+static void blkdev_account(blkdev_t* dev, int is_write, uint32_t count, uint64_t start_us, int result) {
+    uint64_t elapsed = timer_get_us() - start_us;
+    
+    if (is_write) {
+        dev->stats.writes++;
+        dev->stats.write_sectors += count;
+    } else {
+        dev->stats.reads++;
+        dev->stats.read_sectors += count;
+    }
+    if (result != 0) {
+        dev->stats.errors++;
+    }
+    dev->stats.busy_us += elapsed;
+    
+    int bucket = 0;
+    while (elapsed > 1 && bucket < IOSTAT_HIST_BUCKETS - 1) {
+        elapsed >>= 1;
+        bucket++;
+    }
+    dev->stats.latency[bucket]++;
+}
+
+int blkdev_device_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    uint64_t start = timer_get_us();
+    int result = dev->read(dev, lba, count, buffer);
+    blkdev_account(dev, 0, count, start, result);
+    return result;
+}
+
+int blkdev_device_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    uint64_t start = timer_get_us();
+    int result = dev->write(dev, lba, count, buffer);
+    blkdev_account(dev, 1, count, start, result);
+    return result;
+}
+
+int blkdev_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    if (!dev || count == 0) return -1;
+    if (dev->cache) {
+        return bcache_read(dev->cache, dev, lba, count, buffer);
+    }
+    return blkdev_device_read(dev, lba, count, buffer);
+}
+
+int blkdev_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    if (!dev || count == 0 || !dev->write) return -1;
+    if (!dev->unflushed) {
+        dev->unflushed = 1;
+        dev->dirty_since = timer_get_ticks();
+    }
+    if (dev->cache) {
+        return bcache_write(dev->cache, dev, lba, count, buffer);
+    }
+    return blkdev_device_write(dev, lba, count, buffer);
+}
+
+int blkdev_readahead(blkdev_t* dev, uint32_t lba, uint32_t count) {
+    if (!dev || !dev->cache || count == 0) return 0;
+    return bcache_prefetch(dev->cache, dev, lba, count);
+}
+
+int blkdev_enable_cache(blkdev_t* dev, uint32_t sectors) {
+    if (!dev || dev->cache) return -1;
+    dev->cache = bcache_create(sectors);
+    return dev->cache ? 0 : -1;
+}
+
+int blkdev_sync(blkdev_t* dev) {
+    if (!dev || !dev->unflushed) return 0;
+    
+    if (dev->cache && bcache_writeback(dev->cache, dev) != 0) {
+        return -1;
+    }
+    if (dev->flush && dev->flush(dev) != 0) {
+        printf("%s: cache flush failed\n", dev->name);
+        return -1;
+    }
+    dev->unflushed = 0;
+    return 0;
+}
+
+int blkdev_sync_all(void) {
+    int result = 0;
+    for (int i = 0; i < device_count; i++) {
+        if (blkdev_sync(devices[i]) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+void blkdev_idle(void) {
+    uint64_t now = timer_get_ticks();
+    for (int i = 0; i < device_count; i++) {
+        if (devices[i]->unflushed && now - devices[i]->dirty_since >= BLKDEV_WRITEBACK_DELAY_MS) {
+            blkdev_sync(devices[i]);
+        }
+    }
+}
+
+uint32_t blkdev_benchmark(blkdev_t* dev, uint32_t lba, uint32_t sectors, uint8_t* buffer) {
+    uint64_t start = timer_get_ticks();
+    if (blkdev_device_read(dev, lba, sectors, buffer) != 0) {
+        printf("  %s: read failed\n", dev->name);
+        return 0;
+    }
+    uint64_t elapsed_ms = timer_get_ticks() - start;  // Timer runs at 1000 Hz
+    if (elapsed_ms == 0) elapsed_ms = 1;
+    
+    uint32_t kb = (sectors * BLKDEV_SECTOR_SIZE) / 1024;
+    uint32_t kb_per_sec = (uint32_t)((uint64_t)kb * 1000 / elapsed_ms);
+    printf("  %s: %d KB in %d ms (%d KB/s)\n", dev->name, kb, (uint32_t)elapsed_ms, kb_per_sec);
+    return kb_per_sec;
+}
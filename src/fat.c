@@ -0,0 +1,693 @@
+#include "../include/fat.h"
+#include "../include/blkdev.h"
+#include "../include/heap.h"
+#include "../include/memory.h"
+#include "../include/stdio.h"
+#include "../include/string.h"
+#include "../include/timer.h"
+
+// Boot sector with the FAT32 extension (FAT12/16 volumes ignore those fields)
+typedef struct __attribute__((packed)) {
+    uint8_t  jump[3];
+    char     oem_name[8];
+    uint16_t bytes_per_sector;
+    uint8_t  sectors_per_cluster;
+    uint16_t reserved_sectors;
+    uint8_t  num_fats;
+    uint16_t root_entries;          // 0 for FAT32
+    uint16_t total_sectors_16;
+    uint8_t  media_type;
+    uint16_t sectors_per_fat_16;    // 0 for FAT32
+    uint16_t sectors_per_track;
+    uint16_t num_heads;
+    uint32_t hidden_sectors;
+    uint32_t total_sectors_32;
+    // FAT32 extended fields
+    uint32_t sectors_per_fat_32;
+    uint16_t ext_flags;
+    uint16_t fs_version;
+    uint32_t root_cluster;
+    uint16_t fs_info;
+    uint16_t backup_boot_sector;
+} fat_boot_sector_t;
+
+// FSInfo sector layout (FAT32)
+#define FSINFO_LEAD_SIG      0x41615252
+#define FSINFO_STRUCT_SIG    0x61417272
+#define FSINFO_FREE_COUNT    488
+#define FSINFO_NEXT_FREE     492
+#define FAT_UNKNOWN          0xFFFFFFFF
+
+// Clusters a free-run search looks at before giving up on very large volumes
+#define FAT_RUN_SCAN_LIMIT   65536
+
+// Write the dirty sectors of a window to every FAT copy
+static int flush_window(fat_volume_t* vol, fat_window_t* w) {
+    uint32_t i = 0;
+    while (i < FAT_WINDOW_SECTORS) {
+        if (!(w->dirty & (1 << i))) {
+            i++;
+            continue;
+        }
+        uint32_t run = 1;
+        while (i + run < FAT_WINDOW_SECTORS && (w->dirty & (1 << (i + run)))) run++;
+        
+        for (uint32_t copy = 0; copy < vol->num_fats; copy++) {
+            uint32_t lba = vol->fat_start + copy * vol->sectors_per_fat + w->first + i;
+            if (blkdev_write(vol->disk, lba, run, w->data + i * 512) != 0) {
+                return -1;  // Sectors stay dirty for the next attempt
+            }
+        }
+        for (uint32_t k = 0; k < run; k++) w->dirty &= (uint8_t)~(1 << (i + k));
+        i += run;
+    }
+    if (vol->dirty_windows > 0) vol->dirty_windows--;
+    return 0;
+}
+
+// Cached window holding FAT window number 'window' (NULL if not cached)
+static fat_window_t* find_window(fat_volume_t* vol, uint32_t window) {
+    fat_window_t* set = &vol->windows[(window % FAT_CACHE_SETS) * FAT_CACHE_WAYS];
+    for (int way = 0; way < FAT_CACHE_WAYS; way++) {
+        if (set[way].valid && set[way].first == window * FAT_WINDOW_SECTORS) {
+            return &set[way];
+        }
+    }
+    return NULL;
+}
+
+// Pick the way to replace in a window's set (an invalid way, else the LRU one),
+// writing it back first if dirty
+// Returns: the freed way, or NULL if its write-back failed
+static fat_window_t* evict_window(fat_volume_t* vol, uint32_t window) {
+    fat_window_t* set = &vol->windows[(window % FAT_CACHE_SETS) * FAT_CACHE_WAYS];
+    fat_window_t* victim = &set[0];
+    for (int way = 0; way < FAT_CACHE_WAYS; way++) {
+        if (!set[way].valid) {
+            victim = &set[way];
+            break;
+        }
+        if (set[way].last_used < victim->last_used) {
+            victim = &set[way];
+        }
+    }
+    if (victim->valid && victim->dirty && flush_window(vol, victim) != 0) {
+        return NULL;
+    }
+    victim->valid = 0;
+    return victim;
+}
+
+// Load 'count' consecutive windows starting at 'window' with one disk read
+// Windows already cached (possibly dirty) are left alone
+// Returns: 0 on success, -1 on error
+static int load_windows(fat_volume_t* vol, uint32_t window, uint32_t count) {
+    uint32_t total_windows = (vol->sectors_per_fat + FAT_WINDOW_SECTORS - 1) / FAT_WINDOW_SECTORS;
+    if (window >= total_windows) return -1;
+    if (count > total_windows - window) count = total_windows - window;
+    if (count > FAT_PREFETCH_WINDOWS) count = FAT_PREFETCH_WINDOWS;
+    
+    uint32_t first = window * FAT_WINDOW_SECTORS;
+    uint32_t sectors = count * FAT_WINDOW_SECTORS;
+    if (sectors > vol->sectors_per_fat - first) sectors = vol->sectors_per_fat - first;
+    
+    if (count == 1) {
+        // Single window: read straight into its way
+        fat_window_t* w = evict_window(vol, window);
+        if (!w || blkdev_read(vol->disk, vol->fat_start + first, sectors, w->data) != 0) {
+            return -1;
+        }
+        w->first = first;
+        w->dirty = 0;
+        w->valid = 1;
+        w->last_used = ++vol->clock;
+        return 0;
+    }
+    
+    if (blkdev_read(vol->disk, vol->fat_start + first, sectors, vol->staging) != 0) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if (find_window(vol, window + i)) continue;
+        fat_window_t* w = evict_window(vol, window + i);
+        if (!w) return -1;
+        memcpy(w->data, vol->staging + i * FAT_WINDOW_SECTORS * 512, FAT_WINDOW_SECTORS * 512);
+        w->first = first + i * FAT_WINDOW_SECTORS;
+        w->dirty = 0;
+        w->valid = 1;
+        w->last_used = ++vol->clock;
+        if (i > 0) vol->windows_prefetched++;
+    }
+    return 0;
+}
+
+// Get a FAT sector through the window cache, marking it dirty for writes
+// Returns: pointer to the sector's 512 bytes, or NULL on a read error
+static uint8_t* fat_sector(fat_volume_t* vol, uint32_t sector, int for_write) {
+    uint32_t window = sector / FAT_WINDOW_SECTORS;
+    fat_window_t* w = find_window(vol, window);
+    
+    if (w) {
+        vol->window_hits++;
+    } else {
+        // Miss: a walk continuing from the previous miss gets a multi-window read
+        vol->window_misses++;
+        uint32_t count = (window == vol->last_miss + 1) ? FAT_PREFETCH_WINDOWS : 1;
+        vol->last_miss = window;
+        if (load_windows(vol, window, count) != 0) {
+            return NULL;
+        }
+        w = find_window(vol, window);
+    }
+    
+    w->last_used = ++vol->clock;
+    if (for_write) {
+        if (vol->dirty_windows == 0 && !vol->fsinfo_dirty) vol->dirty_since = timer_get_ticks();
+        if (!w->dirty) vol->dirty_windows++;
+        w->dirty |= (uint8_t)(1 << (sector - w->first));
+    }
+    return w->data + (sector - w->first) * 512;
+}
+
+// Byte offset of a cluster's entry in the FAT
+static inline uint32_t entry_offset(const fat_volume_t* vol, uint32_t cluster) {
+    if (vol->type == FAT_TYPE_12) return cluster + cluster / 2;
+    return cluster * (vol->type / 8);
+}
+
+// Chain prefetch: when a chain crosses into the next FAT window and that
+// window is not cached, load it and the windows after it in one read, since
+// a file laid out contiguously will walk through them next
+static void prefetch_chain(fat_volume_t* vol, uint32_t cluster, uint32_t next) {
+    if (fat_is_end(vol, next) || next >= vol->cluster_limit) return;
+    uint32_t here = entry_offset(vol, cluster) / 512 / FAT_WINDOW_SECTORS;
+    uint32_t there = entry_offset(vol, next) / 512 / FAT_WINDOW_SECTORS;
+    if (there == here + 1 && !find_window(vol, there)) {
+        vol->last_miss = there;
+        load_windows(vol, there, FAT_PREFETCH_WINDOWS);
+    }
+}
+
+// Byte of the FAT at a given offset (NULL on a read error)
+static uint8_t* fat_byte(fat_volume_t* vol, uint32_t offset, int for_write) {
+    uint8_t* sector = fat_sector(vol, offset / 512, for_write);
+    return sector ? sector + offset % 512 : NULL;
+}
+
+// Read a FAT entry
+uint32_t fat_get_entry(fat_volume_t* vol, uint32_t cluster) {
+    if (vol->type == FAT_TYPE_12) {
+        // 12-bit entries: 2 entries per 3 bytes, and an entry may straddle sectors
+        uint32_t offset = cluster + cluster / 2;
+        uint8_t* lo = fat_byte(vol, offset, 0);
+        if (!lo) return 0xFFF;
+        uint16_t entry = *lo;
+        uint8_t* hi = fat_byte(vol, offset + 1, 0);
+        if (!hi) return 0xFFF;
+        entry |= (uint16_t)(*hi << 8);
+        return (cluster & 1) ? (entry >> 4) : (entry & 0x0FFF);
+    }
+    if (vol->type == FAT_TYPE_16) {
+        uint8_t* p = fat_byte(vol, cluster * 2, 0);
+        if (!p) return 0xFFFF;
+        uint32_t next = *(uint16_t*)p;
+        prefetch_chain(vol, cluster, next);
+        return next;
+    }
+    uint8_t* p = fat_byte(vol, cluster * 4, 0);
+    if (!p) return 0x0FFFFFFF;
+    uint32_t next = *(uint32_t*)p & 0x0FFFFFFF;
+    prefetch_chain(vol, cluster, next);
+    return next;
+}
+
+// Record a cluster changing between free and used
+static void note_free_change(fat_volume_t* vol, uint32_t cluster, int now_free) {
+    if (vol->free_map) {
+        uint8_t bit = (uint8_t)(1 << (cluster & 7));
+        if (now_free) {
+            vol->free_map[cluster / 8] |= bit;
+        } else {
+            vol->free_map[cluster / 8] &= (uint8_t)~bit;
+        }
+    }
+    if (vol->free_count != FAT_UNKNOWN) {
+        vol->free_count += now_free ? 1 : -1;
+    }
+    if (now_free && cluster < vol->next_free) {
+        vol->next_free = cluster;
+    }
+    if (vol->fsinfo_sector) {
+        if (vol->dirty_windows == 0 && !vol->fsinfo_dirty) vol->dirty_since = timer_get_ticks();
+        vol->fsinfo_dirty = 1;
+    }
+}
+
+// Write a FAT entry
+void fat_set_entry(fat_volume_t* vol, uint32_t cluster, uint32_t value) {
+    if (cluster < 2 || cluster >= vol->cluster_limit) return;
+    uint32_t old = fat_get_entry(vol, cluster);
+    
+    if (vol->type == FAT_TYPE_12) {
+        uint32_t offset = cluster + cluster / 2;
+        uint8_t* lo = fat_byte(vol, offset, 1);
+        if (!lo) return;
+        if (cluster & 1) {
+            *lo = (uint8_t)((*lo & 0x0F) | ((value << 4) & 0xF0));
+        } else {
+            *lo = (uint8_t)value;
+        }
+        uint8_t* hi = fat_byte(vol, offset + 1, 1);
+        if (!hi) return;
+        if (cluster & 1) {
+            *hi = (uint8_t)(value >> 4);
+        } else {
+            *hi = (uint8_t)((*hi & 0xF0) | ((value >> 8) & 0x0F));
+        }
+    } else if (vol->type == FAT_TYPE_16) {
+        uint8_t* p = fat_byte(vol, cluster * 2, 1);
+        if (!p) return;
+        *(uint16_t*)p = (uint16_t)value;
+    } else {
+        uint8_t* p = fat_byte(vol, cluster * 4, 1);
+        if (!p) return;
+        // The top 4 bits of a FAT32 entry are reserved and must be preserved
+        *(uint32_t*)p = (*(uint32_t*)p & 0xF0000000) | (value & 0x0FFFFFFF);
+    }
+    
+    if ((old == 0) != (value == 0)) {
+        note_free_change(vol, cluster, value == 0);
+    }
+}
+
+// Whether a cluster is free
+int fat_cluster_free(fat_volume_t* vol, uint32_t cluster) {
+    if (cluster < 2 || cluster >= vol->cluster_limit) return 0;
+    if (vol->free_map) {
+        return (vol->free_map[cluster / 8] >> (cluster & 7)) & 1;
+    }
+    return fat_get_entry(vol, cluster) == 0;
+}
+
+// Find a free cluster
+uint32_t fat_find_free(fat_volume_t* vol, uint32_t preferred) {
+    if (vol->free_count == 0) {
+        return 0;
+    }
+    if (fat_cluster_free(vol, preferred)) {
+        return preferred;
+    }
+    
+    // Scan from the hint, wrapping once; with a bitmap, used bytes are skipped whole
+    uint32_t span = vol->cluster_limit - 2;
+    uint32_t start = (vol->next_free >= 2 && vol->next_free < vol->cluster_limit) ? vol->next_free : 2;
+    for (uint32_t n = 0; n < span; ) {
+        uint32_t cluster = 2 + (start - 2 + n) % span;
+        if (vol->free_map && (cluster & 7) == 0 && vol->free_map[cluster / 8] == 0 &&
+            cluster + 8 <= vol->cluster_limit) {
+            n += 8;
+            continue;
+        }
+        if (fat_cluster_free(vol, cluster)) {
+            vol->next_free = cluster + 1;
+            return cluster;
+        }
+        n++;
+    }
+    return 0; // No free clusters
+}
+
+// Find a free run of 'count' clusters
+uint32_t fat_find_free_run(fat_volume_t* vol, uint32_t count) {
+    uint32_t span = vol->cluster_limit - 2;
+    uint32_t limit = (vol->free_map || span < FAT_RUN_SCAN_LIMIT) ? span : FAT_RUN_SCAN_LIMIT;
+    uint32_t start = (vol->next_free >= 2 && vol->next_free < vol->cluster_limit) ? vol->next_free : 2;
+    uint32_t run = 0;
+    
+    for (uint32_t n = 0; n < limit; n++) {
+        uint32_t cluster = 2 + (start - 2 + n) % span;
+        if (cluster == 2) run = 0;  // Runs do not wrap around the end of the volume
+        if (fat_cluster_free(vol, cluster)) {
+            if (++run >= count) return cluster - run + 1;
+        } else {
+            run = 0;
+        }
+    }
+    return 0;
+}
+
+// Free a cluster chain
+void fat_free_chain(fat_volume_t* vol, uint32_t cluster) {
+    while (!fat_is_end(vol, cluster) && cluster < vol->cluster_limit) {
+        uint32_t next = fat_get_entry(vol, cluster);
+        fat_set_entry(vol, cluster, 0);
+        cluster = next;
+    }
+}
+
+// Count the runs of a chain
+uint32_t fat_chain_fragments(fat_volume_t* vol, uint32_t first_cluster, uint32_t* clusters) {
+    uint32_t count = 0;
+    uint32_t fragments = 0;
+    uint32_t cluster = first_cluster;
+    uint32_t prev = 0;
+    
+    // The count bound stops a corrupt, looping chain
+    while (!fat_is_end(vol, cluster) && cluster < vol->cluster_limit && count < vol->cluster_limit) {
+        if (cluster != prev + 1) {
+            fragments++;
+        }
+        count++;
+        prev = cluster;
+        cluster = fat_get_entry(vol, cluster);
+    }
+    if (clusters) {
+        *clusters = count;
+    }
+    return fragments;
+}
+
+// Write back dirty FAT sectors and FSInfo
+int fat_flush(fat_volume_t* vol) {
+    for (int i = 0; i < FAT_WINDOWS; i++) {
+        fat_window_t* w = &vol->windows[i];
+        if (w->valid && w->dirty && flush_window(vol, w) != 0) {
+            return -1;
+        }
+    }
+    
+    if (vol->fsinfo_dirty) {
+        uint8_t buffer[512];
+        if (blkdev_read(vol->disk, vol->fsinfo_sector, 1, buffer) != 0) {
+            return -1;
+        }
+        *(uint32_t*)&buffer[FSINFO_FREE_COUNT] = vol->free_count;
+        *(uint32_t*)&buffer[FSINFO_NEXT_FREE] = vol->next_free;
+        if (blkdev_write(vol->disk, vol->fsinfo_sector, 1, buffer) != 0) {
+            return -1;
+        }
+        vol->fsinfo_dirty = 0;
+    }
+    return 0;
+}
+
+// Build the free-cluster bitmap of a FAT12/16 volume
+static int build_free_map(fat_volume_t* vol) {
+    uint32_t bytes = (vol->cluster_limit + 7) / 8;
+    if (!vol->free_map) {
+        vol->free_map = (uint8_t*)malloc(65536 / 8);  // Largest FAT16 volume
+        if (!vol->free_map) return -1;
+    }
+    memset(vol->free_map, 0, bytes);
+    
+    vol->free_count = 0;
+    for (uint32_t cluster = 2; cluster < vol->cluster_limit; cluster++) {
+        if (fat_get_entry(vol, cluster) == 0) {
+            vol->free_map[cluster / 8] |= (uint8_t)(1 << (cluster & 7));
+            vol->free_count++;
+        }
+    }
+    vol->next_free = 2;
+    return 0;
+}
+
+// Mount a FAT volume
+int fat_mount(fat_volume_t* vol, blkdev_t* dev) {
+    uint8_t buffer[512];
+    fat_boot_sector_t bs;
+    
+    if (blkdev_read(dev, 0, 1, buffer) != 0) {
+        printf("Error: Failed to read boot sector\n");
+        return -1;
+    }
+    memcpy(&bs, buffer, sizeof(bs));
+    
+    // Some FAT12 implementations don't set fs_type correctly, so only the BPB is checked
+    if (bs.bytes_per_sector != 512 || bs.sectors_per_cluster == 0 || bs.num_fats == 0) {
+        printf("Error: Invalid boot sector\n");
+        return -1;
+    }
+    
+    // Window buffers and the free map survive a remount
+    uint8_t* window_data = vol->windows[0].data;
+    uint8_t* staging = vol->staging;
+    uint8_t* free_map = vol->free_map;
+    memset(vol, 0, sizeof(*vol));
+    vol->free_map = free_map;
+    if (!window_data) {
+        window_data = (uint8_t*)(uintptr_t)pmem_alloc_pages(FAT_WINDOWS * FAT_WINDOW_SECTORS * 512 / 4096);
+        staging = (uint8_t*)(uintptr_t)pmem_alloc_pages(FAT_PREFETCH_WINDOWS * FAT_WINDOW_SECTORS * 512 / 4096);
+        if (!window_data || !staging) {
+            printf("Error: Out of memory for FAT cache\n");
+            return -1;
+        }
+    }
+    vol->staging = staging;
+    vol->last_miss = 0xFFFFFFFF;
+    for (int i = 0; i < FAT_WINDOWS; i++) {
+        vol->windows[i].data = window_data + i * FAT_WINDOW_SECTORS * 512;
+    }
+    
+    // Geometry
+    vol->disk = dev;
+    vol->sectors_per_cluster = bs.sectors_per_cluster;
+    vol->num_fats = bs.num_fats;
+    vol->sectors_per_fat = bs.sectors_per_fat_16 ? bs.sectors_per_fat_16 : bs.sectors_per_fat_32;
+    vol->fat_start = bs.reserved_sectors;
+    vol->root_dir_start = vol->fat_start + vol->num_fats * vol->sectors_per_fat;
+    vol->root_dir_sectors = (bs.root_entries * 32 + 511) / 512;
+    vol->data_start = vol->root_dir_start + vol->root_dir_sectors;
+    
+    // The FAT type is determined by the cluster count alone
+    uint32_t total = bs.total_sectors_16 ? bs.total_sectors_16 : bs.total_sectors_32;
+    uint32_t clusters = total > vol->data_start ? (total - vol->data_start) / vol->sectors_per_cluster : 0;
+    if (clusters < 4085) {
+        vol->type = FAT_TYPE_12;
+        vol->eoc = 0xFF8;
+    } else if (clusters < 65525) {
+        vol->type = FAT_TYPE_16;
+        vol->eoc = 0xFFF8;
+    } else {
+        vol->type = FAT_TYPE_32;
+        vol->eoc = 0x0FFFFFF8;
+        vol->root_cluster = bs.root_cluster;
+    }
+    
+    // Never address past what the FAT itself can describe
+    vol->cluster_limit = clusters + 2;
+    uint32_t fat_entries = (uint32_t)((uint64_t)vol->sectors_per_fat * 512 * 8 / vol->type);
+    if (vol->cluster_limit > fat_entries) vol->cluster_limit = fat_entries;
+    
+    vol->free_count = FAT_UNKNOWN;
+    vol->next_free = 2;
+    if (vol->type == FAT_TYPE_32) {
+        // FSInfo carries the free count and allocation hint, saving a FAT scan
+        if (bs.fs_info > 0 && bs.fs_info < bs.reserved_sectors &&
+            blkdev_read(dev, bs.fs_info, 1, buffer) == 0 &&
+            *(uint32_t*)&buffer[0] == FSINFO_LEAD_SIG && *(uint32_t*)&buffer[484] == FSINFO_STRUCT_SIG) {
+            vol->fsinfo_sector = bs.fs_info;
+            uint32_t count = *(uint32_t*)&buffer[FSINFO_FREE_COUNT];
+            uint32_t hint = *(uint32_t*)&buffer[FSINFO_NEXT_FREE];
+            if (count <= clusters) vol->free_count = count;
+            if (hint >= 2 && hint < vol->cluster_limit) vol->next_free = hint;
+        }
+    } else if (build_free_map(vol) != 0) {
+        printf("Error: Out of memory for FAT free map\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Walk the sectors of a directory
+int fat_dir_walk(fat_volume_t* vol, uint32_t dir_cluster, fat_dir_fn fn, void* ctx) {
+    uint8_t buffer[512];
+    
+    // FAT12/16 root directory: one fixed run of sectors
+    if (dir_cluster == 0 && vol->type != FAT_TYPE_32) {
+        for (uint32_t s = 0; s < vol->root_dir_sectors; s++) {
+            if (blkdev_read(vol->disk, vol->root_dir_start + s, 1, buffer) != 0) {
+                return -1;
+            }
+            int result = fn(vol, vol->root_dir_start + s, (const fat_dir_entry_t*)buffer, ctx);
+            if (result) return result;
+        }
+        return 0;
+    }
+    
+    // Subdirectories (and the FAT32 root) are cluster chains
+    uint32_t cluster = dir_cluster ? dir_cluster : vol->root_cluster;
+    while (!fat_is_end(vol, cluster)) {
+        uint32_t first = fat_cluster_lba(vol, cluster);
+        for (uint32_t s = 0; s < vol->sectors_per_cluster; s++) {
+            if (blkdev_read(vol->disk, first + s, 1, buffer) != 0) {
+                return -1;
+            }
+            int result = fn(vol, first + s, (const fat_dir_entry_t*)buffer, ctx);
+            if (result) return result;
+        }
+        cluster = fat_get_entry(vol, cluster);
+    }
+    return 0;
+}
+
+typedef struct {
+    const char* name;
+    fat_dir_entry_t* entry;
+    uint32_t* sector;
+    uint16_t* index;
+} dir_find_ctx_t;
+
+#define DIR_WALK_FOUND 1
+#define DIR_WALK_END   2
+
+// fat_dir_walk callback: look for a name in one directory sector
+static int dir_find_sector(fat_volume_t* vol, uint32_t sector, const fat_dir_entry_t* entries, void* ctx) {
+    dir_find_ctx_t* find = (dir_find_ctx_t*)ctx;
+    (void)vol;
+    
+    for (uint16_t idx = 0; idx < 512 / sizeof(fat_dir_entry_t); idx++) {
+        if (entries[idx].filename[0] == 0x00) {
+            return DIR_WALK_END;
+        }
+        if ((uint8_t)entries[idx].filename[0] == 0xE5 || entries[idx].attributes == FAT_ATTR_LFN) {
+            continue;   // Deleted entry or long filename fragment
+        }
+        if (memcmp(entries[idx].filename, find->name, 11) == 0) {
+            if (find->entry) *find->entry = entries[idx];
+            if (find->sector) *find->sector = sector;
+            if (find->index) *find->index = idx;
+            return DIR_WALK_FOUND;
+        }
+    }
+    return 0;
+}
+
+// Find a name in a directory
+int fat_dir_find(fat_volume_t* vol, uint32_t dir_cluster, const char name[11],
+                 fat_dir_entry_t* entry, uint32_t* sector, uint16_t* index) {
+    dir_find_ctx_t ctx = { name, entry, sector, index };
+    int result = fat_dir_walk(vol, dir_cluster, dir_find_sector, &ctx);
+    if (result < 0) return -1;
+    return result == DIR_WALK_FOUND ? 0 : 1;
+}
+
+// Read from the start of a cluster chain
+int fat_read_chain(fat_volume_t* vol, uint32_t first_cluster, uint8_t* buffer, uint32_t size) {
+    uint32_t cluster_bytes = vol->sectors_per_cluster * 512;
+    uint32_t bytes_read = 0;
+    uint32_t cluster = first_cluster;
+    uint8_t sector_buffer[512];
+    
+    while (bytes_read < size && !fat_is_end(vol, cluster)) {
+        // Extend the run over physically consecutive clusters
+        uint32_t run = 1;
+        uint32_t next = fat_get_entry(vol, cluster);
+        while (next == cluster + run && (uint64_t)run * cluster_bytes < size - bytes_read) {
+            run++;
+            next = fat_get_entry(vol, next);
+        }
+        
+        uint32_t lba = fat_cluster_lba(vol, cluster);
+        uint32_t sectors = run * vol->sectors_per_cluster;
+        uint32_t whole = (size - bytes_read) / 512;
+        if (whole > sectors) whole = sectors;
+        if (whole > 0) {
+            if (blkdev_read(vol->disk, lba, whole, buffer + bytes_read) != 0) {
+                return -1;
+            }
+            bytes_read += whole * 512;
+        }
+        if (whole < sectors && bytes_read < size) {
+            // Tail: partial sector through a bounce buffer
+            if (blkdev_read(vol->disk, lba + whole, 1, sector_buffer) != 0) {
+                return -1;
+            }
+            memcpy(buffer + bytes_read, sector_buffer, size - bytes_read);
+            bytes_read = size;
+        }
+        cluster = next;
+    }
+    return bytes_read;
+}
+
+// Convert a filename to the packed 8.3 form
+void fat_pack_name(const char* filename, char out[11]) {
+    int i = 0, j = 0;
+    
+    for (int k = 0; k < 11; k++) out[k] = ' ';
+    
+    while (filename[i] && filename[i] != '.' && j < 8) {
+        char c = filename[i++];
+        if (c >= 'a' && c <= 'z') c -= 32;
+        out[j++] = c;
+    }
+    
+    if (filename[i] == '.') {
+        i++;
+        j = 8;
+        while (filename[i] && j < 11) {
+            char c = filename[i++];
+            if (c >= 'a' && c <= 'z') c -= 32;
+            out[j++] = c;
+        }
+    }
+}
+
+// Convert 8.3 filename to normal format
+void fat_format_name(const fat_dir_entry_t* entry, char* output) {
+    int i, j = 0;
+    
+    // Copy filename (trim spaces)
+    for (i = 0; i < 8 && entry->filename[i] != ' '; i++) {
+        output[j++] = entry->filename[i];
+    }
+    
+    // Add extension if present
+    if (entry->extension[0] != ' ') {
+        output[j++] = '.';
+        for (i = 0; i < 3 && entry->extension[i] != ' '; i++) {
+            output[j++] = entry->extension[i];
+        }
+    }
+    
+    output[j] = '\0';
+}
+
+// fat_dir_walk callback: print the entries of one directory sector
+static int list_sector(fat_volume_t* vol, uint32_t sector, const fat_dir_entry_t* entries, void* ctx) {
+    (void)vol;
+    (void)sector;
+    (void)ctx;
+    
+    for (uint32_t i = 0; i < 512 / sizeof(fat_dir_entry_t); i++) {
+        // End of directory
+        if (entries[i].filename[0] == 0x00) {
+            return DIR_WALK_END;
+        }
+        
+        // Deleted file, volume label, long filename, or . and .. (they exist but are not shown)
+        if ((uint8_t)entries[i].filename[0] == 0xE5 || (entries[i].attributes & FAT_ATTR_VOLUME_ID) ||
+            entries[i].attributes == FAT_ATTR_LFN || entries[i].filename[0] == '.') {
+            continue;
+        }
+        
+        char name[13];
+        fat_format_name(&entries[i], name);
+        
+        if (entries[i].attributes & FAT_ATTR_DIRECTORY) {
+            printf("%-12s %10s\n", name, "<DIR>");
+        } else {
+            printf("%-12s %10d\n", name, entries[i].file_size);
+        }
+    }
+    return 0;
+}
+
+// Print a directory listing
+int fat_list_dir(fat_volume_t* vol, uint32_t dir_cluster) {
+    printf(dir_cluster == 0 ? "Root directory:\n" : "Directory contents:\n");
+    printf("%-12s %10s\n", "Name", "Size");
+    printf("------------------------\n");
+    
+    return fat_dir_walk(vol, dir_cluster, list_sector, NULL) < 0 ? -1 : 0;
+}
@@ -1,822 +1,971 @@
 #include "../include/fat12.h"
-#include "../include/fdc.h"
+#include "../include/fat.h"
+#include "../include/blkdev.h"
+#include "../include/ramdisk.h"
 #include "../include/stdio.h"
 #include "../include/string.h"
+#include "../include/timer.h"
+#include "../include/heap.h"
 
-// FAT12 Boot Sector structure
-typedef struct __attribute__((packed)) {
-    uint8_t  jump[3];
-    char     oem_name[8];
-    uint16_t bytes_per_sector;
-    uint8_t  sectors_per_cluster;
-    uint16_t reserved_sectors;
-    uint8_t  num_fats;
-    uint16_t root_entries;
-    uint16_t total_sectors_16;
-    uint8_t  media_type;
-    uint16_t sectors_per_fat;
-    uint16_t sectors_per_track;
-    uint16_t num_heads;
-    uint32_t hidden_sectors;
-    uint32_t total_sectors_32;
-    uint8_t  drive_number;
-    uint8_t  reserved;
-    uint8_t  boot_signature;
-    uint32_t volume_id;
-    char     volume_label[11];
-    char     fs_type[8];
-} fat12_boot_sector_t;
-
-// FAT12 Directory Entry
-typedef struct __attribute__((packed)) {
-    char     filename[8];
-    char     extension[3];
-    uint8_t  attributes;
-    uint8_t  reserved;
-    uint8_t  creation_time_tenths;
-    uint16_t creation_time;
-    uint16_t creation_date;
-    uint16_t last_access_date;
-    uint16_t first_cluster_high;
-    uint16_t last_write_time;
-    uint16_t last_write_date;
-    uint16_t first_cluster_low;
-    uint32_t file_size;
-} fat12_dir_entry_t;
-
-// Filesystem info
-static fat12_boot_sector_t boot_sector;
-static uint32_t fat_start_sector;
-static uint32_t root_dir_start_sector;
-static uint32_t data_start_sector;
-static uint8_t fat_buffer[512 * 9]; // FAT12 typically uses 9 sectors for FAT
-
-// Read FAT12 entry (12-bit values packed in bytes)
-static uint16_t get_fat_entry(uint16_t cluster) {
-    // FAT12 entries are 12 bits, so 2 entries per 3 bytes
-    uint32_t fat_offset = cluster + (cluster / 2); // cluster * 1.5
-    uint16_t entry;
-    
-    // Read the 16-bit value containing our 12-bit entry
-    entry = *(uint16_t*)&fat_buffer[fat_offset];
-    
-    // Extract the 12-bit value
-    if (cluster & 1) {
-        entry >>= 4; // Odd cluster: high 12 bits
-    } else {
-        entry &= 0x0FFF; // Even cluster: low 12 bits
+// Mounted volumes (FAT12, FAT16 or FAT32; entry width comes from vol->type)
+// The boot volume serves the name-based calls below; further volumes are
+// mounted with fat12_mount and reached through fat12_open_at and friends.
+static fat_volume_t boot_volume;
+static fat_volume_t* volumes[FAT12_MAX_VOLUMES];
+static int volume_count = 0;
+
+// Write the dirty FAT sectors (and FSInfo) of every volume back
+int fat12_flush(void) {
+    int result = 0;
+    for (int i = 0; i < volume_count; i++) {
+        if (fat_flush(volumes[i]) != 0) {
+            result = -1;
+        }
     }
-    
-    return entry;
+    return result;
 }
 
-// Write FAT12 entry (12-bit values packed in bytes)
-static void set_fat_entry(uint16_t cluster, uint16_t value) {
-    uint32_t fat_offset = cluster + (cluster / 2);
-    uint16_t* entry_ptr = (uint16_t*)&fat_buffer[fat_offset];
-    
-    if (cluster & 1) {
-        // Odd cluster: high 12 bits
-        *entry_ptr = (*entry_ptr & 0x000F) | (value << 4);
-    } else {
-        // Even cluster: low 12 bits
-        *entry_ptr = (*entry_ptr & 0xF000) | (value & 0x0FFF);
+// Flush FATs that have been dirty for a while
+void fat12_idle(void) {
+    for (int i = 0; i < volume_count; i++) {
+        fat_volume_t* vol = volumes[i];
+        if ((vol->dirty_windows || vol->fsinfo_dirty) &&
+            timer_get_ticks() - vol->dirty_since >= FAT12_FAT_FLUSH_DELAY_MS) {
+            fat_flush(vol);
+        }
     }
 }
 
-// Find free cluster in FAT
-static uint16_t find_free_cluster(void) {
-    // Start from cluster 2 (0 and 1 are reserved)
-    for (uint16_t cluster = 2; cluster < 0xFF0; cluster++) {
-        if (get_fat_entry(cluster) == 0) {
-            return cluster;
+// Reset the read position, extent map and readahead state of a file
+static void reset_file_state(fat12_file_t* file) {
+    file->position = 0;
+    file->extent_count = 0;
+    file->chain_mapped = 0;
+    file->ra_next = 0;
+    file->ra_window = 0;
+    file->ra_end = 0;
+}
+
+// Clusters covered by the extent map
+static uint32_t mapped_clusters(const fat12_file_t* file) {
+    if (file->extent_count == 0) return 0;
+    const fat12_extent_t* last = &file->extents[file->extent_count - 1];
+    return last->file_cluster + last->length;
+}
+
+// Extend the extent map until it covers chain index 'index', the chain ends,
+// or the map is full
+static void build_extents(fat12_file_t* file, uint32_t index) {
+    fat_volume_t* vol = file->vol;
+    uint32_t cluster;
+    if (file->extent_count == 0) {
+        cluster = file->first_cluster;
+    } else {
+        fat12_extent_t* last = &file->extents[file->extent_count - 1];
+        cluster = fat_get_entry(vol, last->start + last->length - 1);
+    }
+    
+    while (!file->chain_mapped && mapped_clusters(file) <= index && file->extent_count < FAT12_MAX_EXTENTS) {
+        if (fat_is_end(vol, cluster)) {
+            file->chain_mapped = 1;
+            break;
         }
+        
+        // One extent per run of consecutive clusters
+        fat12_extent_t* e = &file->extents[file->extent_count];
+        e->file_cluster = mapped_clusters(file);
+        file->extent_count++;
+        e->start = cluster;
+        e->length = 1;
+        uint32_t next = fat_get_entry(vol, cluster);
+        while (next == cluster + 1) {
+            e->length++;
+            cluster = next;
+            next = fat_get_entry(vol, cluster);
+        }
+        cluster = next;
+    }
+    if (!file->chain_mapped && (fat_is_end(vol, cluster)) && file->extent_count > 0) {
+        file->chain_mapped = 1;
     }
-    return 0; // No free clusters
 }
 
-// Write FAT table back to disk
-static int write_fat_table(void) {
-    for (int i = 0; i < boot_sector.sectors_per_fat; i++) {
-        if (fdc_write_sectors(fat_start_sector + i, 1, fat_buffer + (i * 512)) != 0) {
-            return -1;
+// Record a cluster appended to the end of the chain
+static void note_cluster_appended(fat12_file_t* file, uint32_t cluster) {
+    if (!file->chain_mapped) return;  // Map is a prefix; it will be extended lazily
+    
+    if (file->extent_count > 0) {
+        fat12_extent_t* last = &file->extents[file->extent_count - 1];
+        if (last->start + last->length == cluster) {
+            last->length++;
+            return;
         }
     }
-    return 0;
+    if (file->extent_count == FAT12_MAX_EXTENTS) {
+        file->chain_mapped = 0;
+        return;
+    }
+    fat12_extent_t* e = &file->extents[file->extent_count];
+    e->file_cluster = mapped_clusters(file);
+    e->start = cluster;
+    e->length = 1;
+    file->extent_count++;
 }
 
-// Update directory entry file size
-int fat12_update_size(const char* filename, uint32_t new_size) {
-    uint8_t buffer[512];
-    uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-    uint32_t total_sectors = ((boot_sector.root_entries * 32) + 511) / 512;
-    
-    // Convert filename to 8.3 format (uppercase)
-    char name[9] = "        ";
-    char ext[4] = "   ";
-    int i = 0, j = 0;
-    
-    while (filename[i] && filename[i] != '.' && j < 8) {
-        char c = filename[i++];
-        if (c >= 'a' && c <= 'z') c -= 32;
-        name[j++] = c;
-    }
-    
-    if (filename[i] == '.') {
-        i++;
-        j = 0;
-        while (filename[i] && j < 3) {
-            char c = filename[i++];
-            if (c >= 'a' && c <= 'z') c -= 32;
-            ext[j++] = c;
+// Length of a file's cluster chain
+// tail: receives the last cluster (0 if the file has no clusters)
+static uint32_t chain_length(fat12_file_t* file, uint32_t* tail) {
+    fat_volume_t* vol = file->vol;
+    build_extents(file, 0xFFFFFFFF);
+    *tail = 0;
+    if (file->extent_count == 0) return 0;
+    
+    fat12_extent_t* last = &file->extents[file->extent_count - 1];
+    uint32_t cluster = (last->start + last->length - 1);
+    uint32_t length = mapped_clusters(file);
+    if (!file->chain_mapped) {
+        // Map is full: walk the rest of the chain
+        uint32_t next = fat_get_entry(vol, cluster);
+        while (!fat_is_end(vol, next)) {
+            cluster = next;
+            length++;
+            next = fat_get_entry(vol, cluster);
         }
     }
+    *tail = cluster;
+    return length;
+}
+
+// Link 'count' free clusters to the end of a file's chain (in the in-memory FAT)
+// The clusters right after the tail are used if free, otherwise a free run
+// long enough for the whole request, so the new part of the file is contiguous
+// whenever the disk allows it
+// Returns: clusters added (fewer than count if the disk is full)
+static uint32_t extend_chain(fat12_file_t* file, uint32_t count) {
+    fat_volume_t* vol = file->vol;
+    uint32_t tail;
+    chain_length(file, &tail);
+    
+    uint32_t preferred = tail ? tail + 1 : 0;
+    if (!fat_cluster_free(vol, preferred)) {
+        preferred = fat_find_free_run(vol, count);
+    }
     
-    // Search for file in root directory
-    for (uint32_t sector = 0; sector < total_sectors; sector++) {
-        if (fdc_read_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-            return -1;
+    uint32_t added = 0;
+    while (added < count) {
+        uint32_t cluster = fat_find_free(vol, preferred);
+        if (cluster == 0) {
+            break; // Disk full
         }
         
-        fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-        
-        for (uint32_t idx = 0; idx < entries_per_sector; idx++) {
-            if (entries[idx].filename[0] == 0x00) {
-                return -1; // File not found
-            }
-            
-            if ((uint8_t)entries[idx].filename[0] == 0xE5) {
-                continue;
-            }
-            
-            // Compare filename
-            int match = 1;
-            for (int k = 0; k < 8; k++) {
-                if (name[k] != entries[idx].filename[k]) {
-                    match = 0;
-                    break;
-                }
-            }
-            for (int k = 0; k < 3 && match; k++) {
-                if (ext[k] != entries[idx].extension[k]) {
-                    match = 0;
-                    break;
-                }
-            }
-            
-            if (match) {
-                // Update file size
-                entries[idx].file_size = new_size;
-                
-                // Write directory entry back
-                if (fdc_write_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-                    return -1;
-                }
-                
-                return 0;
-            }
+        fat_set_entry(vol, cluster, fat_end_mark(vol)); // Mark as end of chain
+        if (tail == 0) {
+            file->first_cluster = cluster;
+        } else {
+            fat_set_entry(vol, tail, cluster);
         }
+        note_cluster_appended(file, cluster);
+        tail = cluster;
+        preferred = cluster + 1;
+        added++;
     }
-    
-    return -1; // File not found
+    return added;
 }
 
-// Initialize FAT12
-int fat12_init(void) {
-    // Read boot sector (LBA 0)
-    uint8_t buffer[512];
-    if (fdc_read_sectors(0, 1, buffer) != 0) {
-        printf("Error: Failed to read boot sector\n");
-        return -1;
+// Map a byte offset in a file to its disk sector
+// run_sectors: receives the number of physically contiguous sectors from there on
+// Returns: 0 on success, -1 if the offset is past the cluster chain
+static int map_file_offset(fat12_file_t* file, uint32_t offset, uint32_t* lba, uint32_t* run_sectors) {
+    fat_volume_t* vol = file->vol;
+    uint32_t spc = vol->sectors_per_cluster;
+    uint32_t cluster_bytes = spc * 512;
+    uint32_t index = offset / cluster_bytes;
+    uint32_t cluster;
+    uint32_t run_clusters;
+    
+    if (index >= mapped_clusters(file)) {
+        build_extents(file, index);
     }
     
-    // Copy boot sector
-    for (int i = 0; i < sizeof(fat12_boot_sector_t); i++) {
-        ((uint8_t*)&boot_sector)[i] = buffer[i];
+    if (index < mapped_clusters(file)) {
+        // Binary search for the extent holding this cluster index
+        int lo = 0, hi = file->extent_count - 1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (file->extents[mid].file_cluster <= index) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        fat12_extent_t* e = &file->extents[lo];
+        cluster = (e->start + (index - e->file_cluster));
+        run_clusters = e->length - (index - e->file_cluster);
+    } else {
+        // Map is full (very fragmented file): walk on from its last cluster
+        if (file->chain_mapped || file->extent_count == 0) return -1;
+        fat12_extent_t* last = &file->extents[file->extent_count - 1];
+        cluster = (last->start + last->length - 1);
+        for (uint32_t i = mapped_clusters(file) - 1; i < index; i++) {
+            cluster = fat_get_entry(vol, cluster);
+            if (fat_is_end(vol, cluster)) return -1;
+        }
+        run_clusters = 1;
+        uint32_t current = cluster;
+        uint32_t next = fat_get_entry(vol, current);
+        while (next == current + 1) {
+            run_clusters++;
+            current = next;
+            next = fat_get_entry(vol, current);
+        }
     }
     
-    // Debug: Show fs_type field
-    // printf("Debug: fs_type = '%.8s'\n", boot_sector.fs_type);
-    // printf("Debug: OEM = '%.8s'\n", boot_sector.oem_name);
-    
-    // Verify it's FAT (check is optional since we know it's FAT12)
-    // Some FAT12 implementations don't set fs_type correctly
-    if (boot_sector.bytes_per_sector == 0 || boot_sector.sectors_per_cluster == 0) {
-        printf("Error: Invalid boot sector\n");
-        return -1;
+    uint32_t sector_in_cluster = (offset % cluster_bytes) / 512;
+    *lba = vol->data_start + (cluster - 2) * spc + sector_in_cluster;
+    *run_sectors = run_clusters * spc - sector_in_cluster;
+    return 0;
+}
+
+// Sequential readahead: called with the range a read is about to cover
+// Sequential reads double the window (up to FAT12_READAHEAD_MAX sectors) and
+// keep that much of the file prefetched into the block cache past the read;
+// a seek resets the window
+static void fat12_readahead(fat12_file_t* file, uint32_t offset, uint32_t size) {
+    fat_volume_t* vol = file->vol;
+    if (offset != file->ra_next) {
+        file->ra_window = 0;
+        file->ra_end = 0;
+    } else if (file->ra_window == 0) {
+        file->ra_window = FAT12_READAHEAD_MIN;
+    } else if (file->ra_window < FAT12_READAHEAD_MAX) {
+        file->ra_window *= 2;
     }
-    
-    // Calculate important sectors
-    fat_start_sector = boot_sector.reserved_sectors;
-    root_dir_start_sector = fat_start_sector + (boot_sector.num_fats * boot_sector.sectors_per_fat);
-    uint32_t root_dir_sectors = ((boot_sector.root_entries * 32) + (boot_sector.bytes_per_sector - 1)) / boot_sector.bytes_per_sector;
-    data_start_sector = root_dir_start_sector + root_dir_sectors;
-    
-    // Read FAT table into memory (all sectors at once)
-    if (fdc_read_sectors(fat_start_sector, boot_sector.sectors_per_fat, fat_buffer) != 0) {
-        printf("Error: Failed to read FAT table\n");
-        return -1;
+    file->ra_next = offset + size;
+    if (file->ra_window == 0) return;
+    
+    uint32_t start = offset + size;
+    uint32_t target = start + file->ra_window * 512;
+    if (target > file->size) target = file->size;
+    if (file->ra_end > start) start = file->ra_end;
+    start &= ~511u;
+    
+    // Prefetch [start, target) one contiguous disk run at a time
+    while (start < target) {
+        uint32_t lba, run;
+        if (map_file_offset(file, start, &lba, &run) != 0) break;
+        uint32_t sectors = (target - start + 511) / 512;
+        if (sectors > run) sectors = run;
+        if (blkdev_readahead(vol->disk, lba, sectors) != 0) break;
+        start += sectors * 512;
     }
-    
-    // printf("FAT12 initialized:\n");
-    // printf("  Bytes per sector: %d\n", boot_sector.bytes_per_sector);
-    // printf("  Sectors per cluster: %d\n", boot_sector.sectors_per_cluster);
-    // printf("  Root entries: %d\n", boot_sector.root_entries);
-    // printf("  FAT start: %d\n", fat_start_sector);
-    // printf("  Root dir start: %d\n", root_dir_start_sector);
-    // printf("  Data start: %d\n\n", data_start_sector);
-    
-    return 0;
+    file->ra_end = start;
 }
 
-// Convert 8.3 filename to normal format
-static void format_filename(const fat12_dir_entry_t* entry, char* output) {
-    int i, j = 0;
-    
-    // Copy filename (trim spaces)
-    for (i = 0; i < 8 && entry->filename[i] != ' '; i++) {
-        output[j++] = entry->filename[i];
+// Directory entry cache
+// Lookups by (directory cluster, 8.3 name) are cached in a 4-way set-associative
+// hash table, including misses (negative entries), so repeated opens and path
+// walks do not rescan directory sectors. Entries are updated by create, delete
+// and size changes.
+#define DCACHE_SETS 64
+#define DCACHE_WAYS 4
+
+typedef struct {
+    uint8_t valid;
+    uint8_t negative;           // Name is known not to exist in this directory
+    fat_volume_t* vol;
+    uint32_t dir_cluster;       // 0 = root directory
+    char name[11];
+    uint32_t sector;            // Location of the on-disk entry (positive entries)
+    uint16_t index;
+    fat_dir_entry_t entry;    // Copy of the directory entry
+    uint32_t last_used;
+} dcache_entry_t;
+
+static dcache_entry_t dcache[DCACHE_SETS][DCACHE_WAYS];
+static uint32_t dcache_clock = 0;
+
+static uint32_t dcache_hash(fat_volume_t* vol, uint32_t dir_cluster, const char name[11]) {
+    uint32_t h = 2166136261u ^ dir_cluster ^ (uint32_t)(uintptr_t)vol;  // FNV-1a
+    for (int i = 0; i < 11; i++) {
+        h = (h ^ (uint8_t)name[i]) * 16777619u;
     }
-    
-    // Add extension if present
-    if (entry->extension[0] != ' ') {
-        output[j++] = '.';
-        for (i = 0; i < 3 && entry->extension[i] != ' '; i++) {
-            output[j++] = entry->extension[i];
-        }
+    return h % DCACHE_SETS;
+}
+
+static int names_equal(const char* a, const char* b) {
+    for (int i = 0; i < 11; i++) {
+        if (a[i] != b[i]) return 0;
     }
-    
-    output[j] = '\0';
+    return 1;
 }
 
-// List files in root directory
-int fat12_list_root(void) {
-    uint8_t buffer[512];
-    uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-    uint32_t total_sectors = ((boot_sector.root_entries * 32) + 511) / 512;
-    
-    printf("Root directory:\n");
-    printf("%-12s %10s\n", "Name", "Size");
-    printf("------------------------\n");
-    
-    for (uint32_t sector = 0; sector < total_sectors; sector++) {
-        if (fdc_read_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-            return -1;
+static dcache_entry_t* dcache_lookup(fat_volume_t* vol, uint32_t dir_cluster, const char name[11]) {
+    dcache_entry_t* set = dcache[dcache_hash(vol, dir_cluster, name)];
+    for (int w = 0; w < DCACHE_WAYS; w++) {
+        if (set[w].valid && set[w].vol == vol && set[w].dir_cluster == dir_cluster &&
+            names_equal(set[w].name, name)) {
+            set[w].last_used = ++dcache_clock;
+            return &set[w];
         }
-        
-        fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-        
-        for (uint32_t i = 0; i < entries_per_sector; i++) {
-            // End of directory
-            if (entries[i].filename[0] == 0x00) {
-                return 0;
-            }
-            
-            // Deleted file
-            if (entries[i].filename[0] == 0xE5) {
-                continue;
-            }
-            
-            // Skip volume label and long filenames
-            if (entries[i].attributes & 0x08 || entries[i].attributes == 0x0F) {
-                continue;
-            }
-            
-            char name[13];
-            format_filename(&entries[i], name);
-            
-            if (entries[i].attributes & 0x10) {
-                printf("%-12s %10s\n", name, "<DIR>");
-            } else {
-                printf("%-12s %10d\n", name, entries[i].file_size);
+    }
+    return NULL;
+}
+
+// Record a lookup result (entry == NULL records a negative entry)
+static void dcache_insert(fat_volume_t* vol, uint32_t dir_cluster, const char name[11],
+                          const fat_dir_entry_t* entry, uint32_t sector, uint16_t index) {
+    dcache_entry_t* slot = dcache_lookup(vol, dir_cluster, name);
+    if (!slot) {
+        // Replace the least recently used way
+        dcache_entry_t* set = dcache[dcache_hash(vol, dir_cluster, name)];
+        slot = &set[0];
+        for (int w = 0; w < DCACHE_WAYS; w++) {
+            if (!set[w].valid) {
+                slot = &set[w];
+                break;
             }
+            if (set[w].last_used < slot->last_used) slot = &set[w];
         }
     }
     
-    return 0;
+    slot->valid = 1;
+    slot->vol = vol;
+    slot->dir_cluster = dir_cluster;
+    for (int i = 0; i < 11; i++) slot->name[i] = name[i];
+    slot->last_used = ++dcache_clock;
+    if (entry) {
+        slot->negative = 0;
+        slot->entry = *entry;
+        slot->sector = sector;
+        slot->index = index;
+    } else {
+        slot->negative = 1;
+    }
 }
 
-// List files in a specific directory by cluster
-int fat12_list_dir(uint16_t cluster) {
-    uint8_t buffer[512];
-    
-    // If cluster is 0, list root directory
-    if (cluster == 0) {
-        return fat12_list_root();
+// Find a name in a directory (dir_cluster 0 = root)
+// entry/sector/index: receive a copy of the entry and its on-disk location (may be NULL)
+// Returns: 0 if found, -1 if not found or on a read error
+static int find_dir_entry(fat_volume_t* vol, uint32_t dir_cluster, const char name[11],
+                          fat_dir_entry_t* entry, uint32_t* sector, uint16_t* index) {
+    dcache_entry_t* cached = dcache_lookup(vol, dir_cluster, name);
+    if (cached) {
+        if (cached->negative) return -1;
+        if (entry) *entry = cached->entry;
+        if (sector) *sector = cached->sector;
+        if (index) *index = cached->index;
+        return 0;
     }
     
-    printf("Directory contents:\n");
-    printf("%-12s %10s\n", "Name", "Size");
-    printf("------------------------\n");
-    
-    // Read directory clusters
-    while (cluster >= 2 && cluster < 0xFF8) {
-        uint32_t sector = data_start_sector + ((cluster - 2) * boot_sector.sectors_per_cluster);
-        
-        for (int s = 0; s < boot_sector.sectors_per_cluster; s++) {
-            if (fdc_read_sectors(sector + s, 1, buffer) != 0) {
-                return -1;
-            }
-            
-            fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-            uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-            
-            for (uint32_t i = 0; i < entries_per_sector; i++) {
-                // End of directory
-                if (entries[i].filename[0] == 0x00) {
-                    return 0;
-                }
-                
-                // Deleted file
-                if (entries[i].filename[0] == 0xE5) {
-                    continue;
-                }
-                
-                // Skip volume label and long filenames
-                if (entries[i].attributes & 0x08 || entries[i].attributes == 0x0F) {
-                    continue;
-                }
-                
-                // Skip . and .. entries in display (but they exist)
-                if (entries[i].filename[0] == '.') {
-                    continue;
-                }
-                
-                char name[13];
-                format_filename(&entries[i], name);
-                
-                if (entries[i].attributes & 0x10) {
-                    printf("%-12s %10s\n", name, "<DIR>");
-                } else {
-                    printf("%-12s %10d\n", name, entries[i].file_size);
-                }
-            }
-        }
-        
-        // Get next cluster
-        cluster = get_fat_entry(cluster);
+    fat_dir_entry_t found;
+    uint32_t found_sector;
+    uint16_t found_index;
+    int result = fat_dir_find(vol, dir_cluster, name, &found, &found_sector, &found_index);
+    if (result < 0) {
+        return -1;  // Read errors are not cached
+    }
+    if (result > 0) {
+        dcache_insert(vol, dir_cluster, name, NULL, 0, 0);
+        return -1;
     }
     
+    dcache_insert(vol, dir_cluster, name, &found, found_sector, found_index);
+    if (entry) *entry = found;
+    if (sector) *sector = found_sector;
+    if (index) *index = found_index;
     return 0;
 }
 
-// Find a directory entry by name in current directory (0 = root)
-uint16_t fat12_find_entry(uint16_t dir_cluster, const char* name, int* is_directory) {
+// Rewrite a directory entry in place and keep the cache in sync
+static int write_dir_entry(fat_volume_t* vol, uint32_t dir_cluster, uint32_t sector, uint16_t index,
+                           const fat_dir_entry_t* entry) {
     uint8_t buffer[512];
+    if (blkdev_read(vol->disk, sector, 1, buffer) != 0) {
+        return -1;
+    }
+    ((fat_dir_entry_t*)buffer)[index] = *entry;
+    if (blkdev_write(vol->disk, sector, 1, buffer) != 0) {
+        return -1;
+    }
     
-    // Convert filename to 8.3 format (uppercase)
-    char fname[9] = "        ";
-    char ext[4] = "   ";
-    int i = 0, j = 0;
+    char name[11];
+    for (int i = 0; i < 8; i++) name[i] = entry->filename[i];
+    for (int i = 0; i < 3; i++) name[8 + i] = entry->extension[i];
+    if ((uint8_t)entry->filename[0] == 0xE5) {
+        return 0;  // Caller records the deletion under the original name
+    }
+    dcache_insert(vol, dir_cluster, name, entry, sector, index);
+    return 0;
+}
+
+// Update directory entry file size
+int fat12_update_size(const char* filename, uint32_t new_size) {
+    char name[11];
+    fat_dir_entry_t entry;
+    uint32_t sector;
+    uint16_t index;
+    
+    fat_pack_name(filename, name);
+    if (find_dir_entry(&boot_volume, 0, name, &entry, &sector, &index) != 0) {
+        return -1; // File not found
+    }
     
-    while (name[i] && name[i] != '.' && j < 8) {
-        char c = name[i++];
-        if (c >= 'a' && c <= 'z') c -= 32;
-        fname[j++] = c;
+    entry.file_size = new_size;
+    return write_dir_entry(&boot_volume, 0, sector, index, &entry);
+}
+
+// Mount a volume and add it to the set fat12_flush/fat12_idle write back
+int fat12_mount(fat_volume_t* vol, blkdev_t* dev) {
+    int registered = 0;
+    for (int i = 0; i < volume_count; i++) {
+        if (volumes[i] == vol) registered = 1;
+    }
+    if (!registered && volume_count == FAT12_MAX_VOLUMES) {
+        return -1;
     }
     
-    if (name[i] == '.') {
-        i++;
-        j = 0;
-        while (name[i] && j < 3) {
-            char c = name[i++];
-            if (c >= 'a' && c <= 'z') c -= 32;
-            ext[j++] = c;
+    // Drop cached lookups from an earlier mount of this volume
+    for (int set = 0; set < DCACHE_SETS; set++) {
+        for (int w = 0; w < DCACHE_WAYS; w++) {
+            if (dcache[set][w].vol == vol) dcache[set][w].valid = 0;
         }
     }
     
-    // Search in root directory
-    if (dir_cluster == 0) {
-        uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-        uint32_t total_sectors = ((boot_sector.root_entries * 32) + 511) / 512;
-        
-        for (uint32_t sector = 0; sector < total_sectors; sector++) {
-            if (fdc_read_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-                return 0;
-            }
-            
-            fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-            
-            for (uint32_t idx = 0; idx < entries_per_sector; idx++) {
-                if (entries[idx].filename[0] == 0x00) {
-                    return 0;
-                }
-                
-                if (entries[idx].filename[0] == 0xE5) {
-                    continue;
-                }
-                
-                // Compare filename
-                int match = 1;
-                for (int k = 0; k < 8; k++) {
-                    if (fname[k] != entries[idx].filename[k]) {
-                        match = 0;
-                        break;
-                    }
-                }
-                for (int k = 0; k < 3 && match; k++) {
-                    if (ext[k] != entries[idx].extension[k]) {
-                        match = 0;
-                        break;
-                    }
-                }
-                
-                if (match) {
-                    *is_directory = (entries[idx].attributes & 0x10) ? 1 : 0;
-                    return entries[idx].first_cluster_low;
-                }
-            }
-        }
-    } else {
-        // Search in subdirectory
-        while (dir_cluster >= 2 && dir_cluster < 0xFF8) {
-            uint32_t sector = data_start_sector + ((dir_cluster - 2) * boot_sector.sectors_per_cluster);
-            
-            for (int s = 0; s < boot_sector.sectors_per_cluster; s++) {
-                if (fdc_read_sectors(sector + s, 1, buffer) != 0) {
-                    return 0;
-                }
-                
-                fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-                uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-                
-                for (uint32_t idx = 0; idx < entries_per_sector; idx++) {
-                    if (entries[idx].filename[0] == 0x00) {
-                        return 0;
-                    }
-                    
-                    if (entries[idx].filename[0] == 0xE5) {
-                        continue;
-                    }
-                    
-                    // Compare filename
-                    int match = 1;
-                    for (int k = 0; k < 8; k++) {
-                        if (fname[k] != entries[idx].filename[k]) {
-                            match = 0;
-                            break;
-                        }
-                    }
-                    for (int k = 0; k < 3 && match; k++) {
-                        if (ext[k] != entries[idx].extension[k]) {
-                            match = 0;
-                            break;
-                        }
-                    }
-                    
-                    if (match) {
-                        *is_directory = (entries[idx].attributes & 0x10) ? 1 : 0;
-                        return entries[idx].first_cluster_low;
-                    }
-                }
-            }
-            
-            dir_cluster = get_fat_entry(dir_cluster);
-        }
+    if (fat_mount(vol, dev) != 0) {
+        return -1;
+    }
+    if (!registered) {
+        volumes[volume_count++] = vol;
+    }
+    return 0;
+}
+
+// Initialize the filesystem (FAT12, FAT16 or FAT32)
+int fat12_init(blkdev_t* dev) {
+    if (fat12_mount(&boot_volume, dev) != 0) {
+        return -1;
     }
     
+    // printf("FAT%d initialized:\n", boot_volume.type);
+    // printf("  Sectors per cluster: %d\n", boot_volume.sectors_per_cluster);
+    // printf("  FAT start: %d\n", boot_volume.fat_start);
+    // printf("  Root dir start: %d\n", boot_volume.root_dir_start);
+    // printf("  Data start: %d\n\n", boot_volume.data_start);
+    
     return 0;
 }
 
-// Open a file
-int fat12_open(const char* filename, fat12_file_t* file) {
-    uint8_t buffer[512];
-    uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-    uint32_t total_sectors = ((boot_sector.root_entries * 32) + 511) / 512;
-    
-    // Convert filename to 8.3 format (uppercase)
-    char name[9] = "        ";
-    char ext[4] = "   ";
-    int i = 0, j = 0;
-    
-    while (filename[i] && filename[i] != '.' && j < 8) {
-        char c = filename[i++];
-        if (c >= 'a' && c <= 'z') c -= 32; // Convert to uppercase
-        name[j++] = c;
-    }
-    
-    if (filename[i] == '.') {
-        i++;
-        j = 0;
-        while (filename[i] && j < 3) {
-            char c = filename[i++];
-            if (c >= 'a' && c <= 'z') c -= 32; // Convert to uppercase
-            ext[j++] = c;
-        }
+// List files in root directory
+int fat12_list_root(void) {
+    return fat_list_dir(&boot_volume, 0);
+}
+
+// List files in a specific directory by cluster
+int fat12_list_dir(uint32_t cluster) {
+    return fat_list_dir(&boot_volume, cluster);
+}
+
+// Find a directory entry by name in current directory (0 = root)
+uint16_t fat12_find_entry(uint32_t dir_cluster, const char* name, int* is_directory) {
+    char packed[11];
+    fat_dir_entry_t entry;
+    
+    fat_pack_name(name, packed);
+    if (find_dir_entry(&boot_volume, dir_cluster, packed, &entry, NULL, NULL) != 0) {
+        return 0;
     }
     
-    // Search root directory
-    for (uint32_t sector = 0; sector < total_sectors; sector++) {
-        if (fdc_read_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-            return -1;
-        }
-        
-        fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-        
-        for (uint32_t i = 0; i < entries_per_sector; i++) {
-            if (entries[i].filename[0] == 0x00) {
-                return -1; // File not found
-            }
-            
-            if (entries[i].filename[0] == 0xE5) {
-                continue;
-            }
-            
-            // Compare filename
-            int match = 1;
-            for (int k = 0; k < 8; k++) {
-                if (name[k] != entries[i].filename[k]) {
-                    match = 0;
-                    break;
-                }
-            }
-            for (int k = 0; k < 3 && match; k++) {
-                if (ext[k] != entries[i].extension[k]) {
-                    match = 0;
-                    break;
-                }
-            }
-            
-            if (match) {
-                // Found the file!
-                format_filename(&entries[i], file->name);
-                file->size = entries[i].file_size;
-                file->first_cluster = entries[i].first_cluster_low;
-                file->is_directory = (entries[i].attributes & 0x10) ? 1 : 0;
-                return 0;
-            }
-        }
+    *is_directory = (entry.attributes & 0x10) ? 1 : 0;
+    return (uint16_t)fat_entry_cluster(&boot_volume, &entry);
+}
+
+// Volume the name-based calls work on
+fat_volume_t* fat12_boot_volume(void) {
+    return &boot_volume;
+}
+
+// Open a file in a directory of a volume
+int fat12_open_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, fat12_file_t* file) {
+    char name[11];
+    fat_dir_entry_t entry;
+    
+    uint32_t sector;
+    uint16_t index;
+    
+    fat_pack_name(filename, name);
+    if (find_dir_entry(vol, dir_cluster, name, &entry, &sector, &index) != 0) {
+        return -1; // File not found
     }
     
-    return -1; // File not found
+    fat_format_name(&entry, file->name);
+    file->vol = vol;
+    file->size = entry.file_size;
+    file->first_cluster = fat_entry_cluster(vol, &entry);
+    file->is_directory = (entry.attributes & 0x10) ? 1 : 0;
+    file->dir_cluster = dir_cluster;
+    file->dir_sector = sector;
+    file->dir_index = index;
+    reset_file_state(file);
+    return 0;
+}
+
+// Open a file in the boot volume's root directory
+int fat12_open(const char* filename, fat12_file_t* file) {
+    return fat12_open_at(&boot_volume, 0, filename, file);
 }
 
 // Read from a file
 int fat12_read(fat12_file_t* file, uint8_t* buffer, uint32_t size) {
-    if (size > file->size) {
-        size = file->size;
+    fat_volume_t* vol = file->vol;
+    if (file->position >= file->size) {
+        return 0;
+    }
+    if (size > file->size - file->position) {
+        size = file->size - file->position;
     }
     
+    fat12_readahead(file, file->position, size);
+    
     uint32_t bytes_read = 0;
-    uint16_t cluster = file->first_cluster;
-    uint8_t spc = boot_sector.sectors_per_cluster;
-    
-    while (bytes_read < size && cluster >= 2 && cluster < 0xFF8) {
-        // Find run of consecutive clusters
-        uint16_t run_start = cluster;
-        uint16_t run_len = 1;
-        uint16_t next = get_fat_entry(cluster);
-        uint16_t current = cluster;
-        
-        while (next == current + 1 && next >= 2 && next < 0xFF8 && run_len < 250) {
-            run_len++;
-            current = next;
-            next = get_fat_entry(current);
+    uint8_t sector_buffer[512];
+    
+    while (bytes_read < size) {
+        uint32_t offset = file->position + bytes_read;
+        uint32_t lba, run;
+        if (map_file_offset(file, offset, &lba, &run) != 0) {
+            break;  // Chain shorter than the recorded size
         }
         
-        // Calculate sectors for this consecutive run
-        uint32_t start_sector = data_start_sector + ((run_start - 2) * spc);
-        uint32_t total_sectors = run_len * spc;
-        
-        // Limit sectors to what we need (round up to full sectors)
-        uint32_t bytes_remaining = size - bytes_read;
-        uint32_t needed_sectors = (bytes_remaining + 511) / 512;
-        if (total_sectors > needed_sectors) total_sectors = needed_sectors;
+        uint32_t sector_offset = offset % 512;
+        uint32_t remaining = size - bytes_read;
         
-        if (fdc_read_sectors(start_sector, (uint8_t)total_sectors, buffer + bytes_read) != 0) {
-            return -1;
+        if (sector_offset != 0 || remaining < 512) {
+            // Partial sector: go through a bounce buffer
+            if (blkdev_read(vol->disk, lba, 1, sector_buffer) != 0) {
+                return -1;
+            }
+            uint32_t n = 512 - sector_offset;
+            if (n > remaining) n = remaining;
+            memcpy(buffer + bytes_read, sector_buffer + sector_offset, n);
+            bytes_read += n;
+        } else {
+            // Whole sectors of a contiguous run straight into the caller's buffer
+            uint32_t sectors = remaining / 512;
+            if (sectors > run) sectors = run;
+            if (blkdev_read(vol->disk, lba, sectors, buffer + bytes_read) != 0) {
+                return -1;
+            }
+            bytes_read += sectors * 512;
         }
-        
-        uint32_t read_amount = total_sectors * 512;
-        if (read_amount > bytes_remaining) read_amount = bytes_remaining;
-        bytes_read += read_amount;
-        
-        // Move to next cluster after the run
-        cluster = next;
     }
     
+    file->position += bytes_read;
     return bytes_read;
 }
 
-// Write to a file
+// Set the offset of the next read
+void fat12_seek(fat12_file_t* file, uint32_t offset) {
+    file->position = offset > file->size ? file->size : offset;
+}
+
+// Write to a file at its current position
 int fat12_write(fat12_file_t* file, const uint8_t* buffer, uint32_t size) {
+    fat_volume_t* vol = file->vol;
+    uint32_t cluster_bytes = vol->sectors_per_cluster * 512;
     uint32_t bytes_written = 0;
-    uint16_t cluster = file->first_cluster;
     uint8_t sector_buffer[512];
     
-    while (bytes_written < size && cluster >= 2 && cluster < 0xFF8) {
-        // Calculate sector from cluster
-        uint32_t sector = data_start_sector + ((cluster - 2) * boot_sector.sectors_per_cluster);
+    if (size == 0) {
+        return 0;
+    }
+    
+    // Allocate every missing cluster up front so the data lands in as few runs as possible
+    uint32_t tail;
+    uint32_t have = chain_length(file, &tail);
+    uint32_t need = (uint32_t)(((uint64_t)file->position + size + cluster_bytes - 1) / cluster_bytes);
+    if (need > have) {
+        extend_chain(file, need - have);
+    }
+    
+    while (bytes_written < size) {
+        uint32_t offset = file->position;
+        uint32_t lba, run;
+        if (map_file_offset(file, offset, &lba, &run) != 0) {
+            break;  // Disk full: keep what fit
+        }
         
-        // Write cluster
-        for (int i = 0; i < boot_sector.sectors_per_cluster && bytes_written < size; i++) {
-            // Fill sector buffer
-            uint32_t to_write = (size - bytes_written > 512) ? 512 : (size - bytes_written);
-            for (uint32_t j = 0; j < to_write; j++) {
-                sector_buffer[j] = buffer[bytes_written++];
-            }
-            
-            // Pad rest of sector with zeros if needed
-            for (uint32_t j = to_write; j < 512; j++) {
-                sector_buffer[j] = 0;
-            }
-            
-            // Write sector
-            if (fdc_write_sectors(sector + i, 1, sector_buffer) != 0) {
+        uint32_t sector_offset = offset % 512;
+        uint32_t remaining = size - bytes_written;
+        
+        if (sector_offset == 0 && remaining >= 512) {
+            // Whole sectors of a contiguous run straight from the caller's buffer
+            uint32_t sectors = remaining / 512;
+            if (sectors > run) sectors = run;
+            if (blkdev_write(vol->disk, lba, sectors, buffer + bytes_written) != 0) {
                 return -1;
             }
+            bytes_written += sectors * 512;
+            file->position += sectors * 512;
+            continue;
         }
         
-        // Get next cluster or allocate new one if needed
-        uint16_t next_cluster = get_fat_entry(cluster);
-        if (bytes_written < size && (next_cluster >= 0xFF8 || next_cluster == 0)) {
-            // Need to allocate new cluster
-            next_cluster = find_free_cluster();
-            if (next_cluster == 0) {
-                return -1; // Disk full
-            }
-            
-            // Link clusters
-            set_fat_entry(cluster, next_cluster);
-            set_fat_entry(next_cluster, 0xFFF); // Mark as end of chain
-            
-            // Write FAT table
-            if (write_fat_table() != 0) {
+        // Head or tail sector: keep the bytes around the new data that belong
+        // to the file, and pad the rest with zeros
+        uint32_t n = 512 - sector_offset;
+        if (n > remaining) n = remaining;
+        if (offset - sector_offset < file->size) {
+            if (blkdev_read(vol->disk, lba, 1, sector_buffer) != 0) {
                 return -1;
             }
+        } else {
+            memset(sector_buffer, 0, 512);
         }
-        
-        cluster = next_cluster;
+        memcpy(sector_buffer + sector_offset, buffer + bytes_written, n);
+        if (blkdev_write(vol->disk, lba, 1, sector_buffer) != 0) {
+            return -1;
+        }
+        bytes_written += n;
+        file->position += n;
     }
     
+    if (file->position > file->size) {
+        file->size = file->position;
+    }
+    if (bytes_written == 0) {
+        return -1;
+    }
     return bytes_written;
 }
 
-// Create a new file
-int fat12_create(const char* filename, fat12_file_t* file) {
-    uint8_t buffer[512];
-    uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-    uint32_t total_sectors = ((boot_sector.root_entries * 32) + 511) / 512;
-    
-    // Convert filename to 8.3 format (uppercase)
-    char name[9] = "        ";
-    char ext[4] = "   ";
-    int i = 0, j = 0;
-    
-    while (filename[i] && filename[i] != '.' && j < 8) {
-        char c = filename[i++];
-        if (c >= 'a' && c <= 'z') c -= 32;
-        name[j++] = c;
-    }
-    
-    if (filename[i] == '.') {
-        i++;
-        j = 0;
-        while (filename[i] && j < 3) {
-            char c = filename[i++];
-            if (c >= 'a' && c <= 'z') c -= 32;
-            ext[j++] = c;
-        }
+// Shrink a file and free the clusters past its new end
+int fat12_truncate(fat12_file_t* file, uint32_t new_size) {
+    fat_volume_t* vol = file->vol;
+    if (new_size > file->size) {
+        return -1;
     }
     
-    // Find free directory entry
-    for (uint32_t sector = 0; sector < total_sectors; sector++) {
-        if (fdc_read_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-            return -1;
+    uint32_t cluster_bytes = vol->sectors_per_cluster * 512;
+    uint32_t keep = (new_size + cluster_bytes - 1) / cluster_bytes;
+    uint32_t cluster = file->first_cluster;
+    
+    // Find the last cluster to keep, then free everything after it
+    if (keep == 0) {
+        file->first_cluster = 0;
+    } else {
+        for (uint32_t i = 1; i < keep && !fat_is_end(vol, cluster); i++) {
+            cluster = fat_get_entry(vol, cluster);
         }
-        
-        fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-        
-        for (uint32_t idx = 0; idx < entries_per_sector; idx++) {
-            // Found free entry (0x00 or 0xE5)
-            if (entries[idx].filename[0] == 0x00 || (uint8_t)entries[idx].filename[0] == 0xE5) {
-                // Allocate first cluster
-                uint16_t first_cluster = find_free_cluster();
-                if (first_cluster == 0) {
-                    return -1; // Disk full
-                }
-                
-                // Mark cluster as end of chain
-                set_fat_entry(first_cluster, 0xFFF);
-                
-                // Write FAT table
-                if (write_fat_table() != 0) {
-                    return -1;
-                }
-                
-                // Create directory entry
-                for (int k = 0; k < 8; k++) entries[idx].filename[k] = name[k];
-                for (int k = 0; k < 3; k++) entries[idx].extension[k] = ext[k];
-                entries[idx].attributes = 0x20; // Archive attribute
-                entries[idx].reserved = 0;
-                entries[idx].first_cluster_high = 0;
-                entries[idx].first_cluster_low = first_cluster;
-                entries[idx].file_size = 0;
-                
-                // Write directory entry back
-                if (fdc_write_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-                    return -1;
-                }
-                
-                // Fill file structure
-                for (int k = 0; k < 8; k++) file->name[k] = name[k];
-                file->size = 0;
-                file->first_cluster = first_cluster;
-                file->is_directory = 0;
-                
-                return 0;
+        if (fat_is_end(vol, cluster)) {
+            cluster = 0;  // Chain already shorter than the new size
+        } else {
+            uint32_t last = cluster;
+            cluster = fat_get_entry(vol, last);
+            if (!fat_is_end(vol, cluster)) {
+                fat_set_entry(vol, last, fat_end_mark(vol));
             }
         }
     }
+    while (!fat_is_end(vol, cluster)) {
+        uint32_t next = fat_get_entry(vol, cluster);
+        fat_set_entry(vol, cluster, 0); // Mark as free
+        cluster = next;
+    }
     
-    return -1; // No free directory entries
+    // The extent map may describe freed clusters; rebuild it lazily
+    uint32_t position = file->position > new_size ? new_size : file->position;
+    reset_file_state(file);
+    file->position = position;
+    file->size = new_size;
+    return 0;
 }
 
-// Delete a file
-int fat12_delete(const char* filename) {
+// Write the size and first cluster back to the cached directory entry location
+int fat12_update_entry(fat12_file_t* file) {
+    fat_volume_t* vol = file->vol;
     uint8_t buffer[512];
-    uint32_t entries_per_sector = 512 / sizeof(fat12_dir_entry_t);
-    uint32_t total_sectors = ((boot_sector.root_entries * 32) + 511) / 512;
-    
-    // Convert filename to 8.3 format (uppercase)
-    char name[9] = "        ";
-    char ext[4] = "   ";
-    int i = 0, j = 0;
-    
-    while (filename[i] && filename[i] != '.' && j < 8) {
-        char c = filename[i++];
-        if (c >= 'a' && c <= 'z') c -= 32;
-        name[j++] = c;
-    }
-    
-    if (filename[i] == '.') {
-        i++;
-        j = 0;
-        while (filename[i] && j < 3) {
-            char c = filename[i++];
-            if (c >= 'a' && c <= 'z') c -= 32;
-            ext[j++] = c;
+    if (blkdev_read(vol->disk, file->dir_sector, 1, buffer) != 0) {
+        return -1;
+    }
+    
+    fat_dir_entry_t entry = ((fat_dir_entry_t*)buffer)[file->dir_index];
+    entry.file_size = file->size;
+    entry.first_cluster_low = (uint16_t)file->first_cluster;
+    entry.first_cluster_high = vol->type == FAT_TYPE_32 ? (uint16_t)(file->first_cluster >> 16) : 0;
+    return write_dir_entry(vol, file->dir_cluster, file->dir_sector, file->dir_index, &entry);
+}
+
+typedef struct {
+    uint32_t sector;
+    uint16_t index;
+    fat_dir_entry_t entry;
+} free_slot_t;
+
+// fat_dir_walk callback: find an unused directory entry (0x00 or 0xE5)
+static int find_free_slot(fat_volume_t* vol, uint32_t sector, const fat_dir_entry_t* entries, void* ctx) {
+    free_slot_t* slot = (free_slot_t*)ctx;
+    (void)vol;
+    
+    for (uint16_t idx = 0; idx < 512 / sizeof(fat_dir_entry_t); idx++) {
+        if (entries[idx].filename[0] == 0x00 || (uint8_t)entries[idx].filename[0] == 0xE5) {
+            slot->sector = sector;
+            slot->index = idx;
+            slot->entry = entries[idx];
+            return 1;
         }
     }
+    return 0;
+}
+
+// Create a new file in a directory of a volume
+int fat12_create_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, fat12_file_t* file) {
+    char name[11];
+    fat_pack_name(filename, name);
+    
+    // Find free directory entry
+    free_slot_t slot;
+    if (fat_dir_walk(vol, dir_cluster, find_free_slot, &slot) != 1) {
+        return -1; // No free directory entries
+    }
+    
+    // Allocate first cluster
+    uint32_t first_cluster = fat_find_free(vol, 0);
+    if (first_cluster == 0) {
+        return -1; // Disk full
+    }
+    
+    // Mark cluster as end of chain (written back at the next FAT flush)
+    fat_set_entry(vol, first_cluster, fat_end_mark(vol));
+    
+    // Create directory entry (write_dir_entry replaces any cached negative entry)
+    fat_dir_entry_t entry = slot.entry;
+    for (int k = 0; k < 8; k++) entry.filename[k] = name[k];
+    for (int k = 0; k < 3; k++) entry.extension[k] = name[8 + k];
+    entry.attributes = FAT_ATTR_ARCHIVE;
+    entry.reserved = 0;
+    entry.first_cluster_high = vol->type == FAT_TYPE_32 ? (uint16_t)(first_cluster >> 16) : 0;
+    entry.first_cluster_low = (uint16_t)first_cluster;
+    entry.file_size = 0;
     
-    // Search for file in root directory
-    for (uint32_t sector = 0; sector < total_sectors; sector++) {
-        if (fdc_read_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
+    if (write_dir_entry(vol, dir_cluster, slot.sector, slot.index, &entry) != 0) {
+        return -1;
+    }
+    
+    // Fill file structure
+    fat_format_name(&entry, file->name);
+    file->vol = vol;
+    file->size = 0;
+    file->first_cluster = first_cluster;
+    file->is_directory = 0;
+    file->dir_cluster = dir_cluster;
+    file->dir_sector = slot.sector;
+    file->dir_index = slot.index;
+    reset_file_state(file);
+    
+    return 0;
+}
+
+// Create a new file in the boot volume's root directory
+int fat12_create(const char* filename, fat12_file_t* file) {
+    return fat12_create_at(&boot_volume, 0, filename, file);
+}
+
+// Remove a file's directory entry, freeing its cluster chain if free_chain
+static int delete_entry(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, int free_chain) {
+    char name[11];
+    fat_dir_entry_t entry;
+    uint32_t sector;
+    uint16_t index;
+    
+    fat_pack_name(filename, name);
+    if (find_dir_entry(vol, dir_cluster, name, &entry, &sector, &index) != 0) {
+        return -1; // File not found
+    }
+    if (entry.attributes & FAT_ATTR_DIRECTORY) {
+        return -1; // Directories are not removed here
+    }
+    
+    // Free cluster chain and write the changed FAT sectors
+    if (free_chain) {
+        fat_free_chain(vol, fat_entry_cluster(vol, &entry));
+        if (fat_flush(vol) != 0) {
             return -1;
         }
+    }
+    
+    // Mark directory entry as deleted, and remember that the name is gone
+    entry.filename[0] = (char)0xE5;
+    if (write_dir_entry(vol, dir_cluster, sector, index, &entry) != 0) {
+        return -1;
+    }
+    dcache_insert(vol, dir_cluster, name, NULL, 0, 0);
+    
+    return 0;
+}
+
+// Delete a file from a directory of a volume
+int fat12_delete_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename) {
+    return delete_entry(vol, dir_cluster, filename, 1);
+}
+
+// Remove a file's name but keep its clusters for the open files still using it
+int fat12_remove_entry_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename) {
+    return delete_entry(vol, dir_cluster, filename, 0);
+}
+
+// Delete a file from the boot volume's root directory
+int fat12_delete(const char* filename) {
+    return fat12_delete_at(&boot_volume, 0, filename);
+}
+
+// Time an uncached read of a whole chain, one device request per run (or
+// per FAT12_DEFRAG_CHUNK sectors of a longer run)
+// A volume on a RAM disk is timed on the disk behind it (the data was synced
+// there), since memory copies would not show the seeks defragmenting saves
+// Returns: microseconds, or 0 on a read error
+static uint32_t time_chain_read(fat_volume_t* vol, uint32_t first_cluster, uint8_t* scratch) {
+    blkdev_t* dev = ramdisk_backing(vol->disk);
+    if (!dev) {
+        dev = vol->disk;
+    }
+    uint64_t start = timer_get_us();
+    uint32_t cluster = first_cluster;
+    
+    while (!fat_is_end(vol, cluster) && cluster < vol->cluster_limit) {
+        uint32_t run = 1;
+        uint32_t next = fat_get_entry(vol, cluster);
+        while (next == cluster + run) {
+            run++;
+            next = fat_get_entry(vol, next);
+        }
         
-        fat12_dir_entry_t* entries = (fat12_dir_entry_t*)buffer;
-        
-        for (uint32_t idx = 0; idx < entries_per_sector; idx++) {
-            if (entries[idx].filename[0] == 0x00) {
-                return -1; // File not found
-            }
-            
-            if ((uint8_t)entries[idx].filename[0] == 0xE5) {
-                continue;
-            }
-            
-            // Compare filename
-            int match = 1;
-            for (int k = 0; k < 8; k++) {
-                if (name[k] != entries[idx].filename[k]) {
-                    match = 0;
-                    break;
-                }
-            }
-            for (int k = 0; k < 3 && match; k++) {
-                if (ext[k] != entries[idx].extension[k]) {
-                    match = 0;
-                    break;
-                }
-            }
-            
-            if (match) {
-                // Free cluster chain
-                uint16_t cluster = entries[idx].first_cluster_low;
-                while (cluster >= 2 && cluster < 0xFF8) {
-                    uint16_t next = get_fat_entry(cluster);
-                    set_fat_entry(cluster, 0); // Mark as free
-                    cluster = next;
-                }
-                
-                // Write FAT table
-                if (write_fat_table() != 0) {
-                    return -1;
-                }
-                
-                // Mark directory entry as deleted
-                entries[idx].filename[0] = (char)0xE5;
-                
-                // Write directory entry back
-                if (fdc_write_sectors(root_dir_start_sector + sector, 1, buffer) != 0) {
-                    return -1;
-                }
-                
+        uint32_t lba = fat_cluster_lba(vol, cluster);
+        uint32_t sectors = run * vol->sectors_per_cluster;
+        while (sectors > 0) {
+            uint32_t n = sectors < FAT12_DEFRAG_CHUNK ? sectors : FAT12_DEFRAG_CHUNK;
+            if (blkdev_device_read(dev, lba, n, scratch) != 0) {
                 return 0;
             }
+            lba += n;
+            sectors -= n;
+        }
+        cluster = next;
+    }
+    uint64_t elapsed = timer_get_us() - start;
+    return elapsed > 0 ? (uint32_t)elapsed : 1;
+}
+
+// Copy a chain's data into the consecutive clusters starting at 'target'
+static int copy_chain(fat_volume_t* vol, uint32_t first_cluster, uint32_t target, uint8_t* scratch) {
+    uint32_t dest = fat_cluster_lba(vol, target);
+    uint32_t cluster = first_cluster;
+    
+    while (!fat_is_end(vol, cluster) && cluster < vol->cluster_limit) {
+        uint32_t run = 1;
+        uint32_t next = fat_get_entry(vol, cluster);
+        while (next == cluster + run) {
+            run++;
+            next = fat_get_entry(vol, next);
+        }
+        
+        uint32_t lba = fat_cluster_lba(vol, cluster);
+        uint32_t sectors = run * vol->sectors_per_cluster;
+        while (sectors > 0) {
+            uint32_t n = sectors < FAT12_DEFRAG_CHUNK ? sectors : FAT12_DEFRAG_CHUNK;
+            if (blkdev_read(vol->disk, lba, n, scratch) != 0 ||
+                blkdev_write(vol->disk, dest, n, scratch) != 0) {
+                return -1;
+            }
+            lba += n;
+            dest += n;
+            sectors -= n;
         }
+        cluster = next;
+    }
+    return 0;
+}
+
+// Relocate a file into one contiguous run of clusters
+int fat12_defrag_at(fat_volume_t* vol, uint32_t dir_cluster, const char* filename, defrag_stat_t* st) {
+    char name[11];
+    fat_dir_entry_t entry;
+    uint32_t sector;
+    uint16_t index;
+    
+    memset(st, 0, sizeof(*st));
+    st->status = DEFRAG_FAILED;
+    fat_pack_name(filename, name);
+    if (find_dir_entry(vol, dir_cluster, name, &entry, &sector, &index) != 0 ||
+        (entry.attributes & FAT_ATTR_DIRECTORY)) {
+        return -1;
+    }
+    
+    uint32_t old_first = fat_entry_cluster(vol, &entry);
+    st->fragments_before = fat_chain_fragments(vol, old_first, &st->clusters);
+    st->fragments_after = st->fragments_before;
+    if (st->clusters == 0) {
+        st->status = DEFRAG_CONTIGUOUS;
+        return 0;
     }
     
-    return -1; // File not found
+    uint8_t* scratch = (uint8_t*)malloc(FAT12_DEFRAG_CHUNK * 512);
+    if (!scratch) {
+        return -1;
+    }
+    // Timing may read the disk behind a RAM disk: bring it up to date first
+    if (blkdev_sync(vol->disk) != 0) {
+        free(scratch);
+        return -1;
+    }
+    st->read_us_before = time_chain_read(vol, old_first, scratch);
+    st->read_us_after = st->read_us_before;
+    if (st->fragments_before == 1) {
+        free(scratch);
+        st->status = DEFRAG_CONTIGUOUS;
+        return 0;
+    }
+    
+    uint32_t target = fat_find_free_run(vol, st->clusters);
+    if (target == 0) {
+        free(scratch);
+        st->status = DEFRAG_NO_ROOM;
+        return 0;
+    }
+    
+    // 1. Copy the data and make it durable; nothing points at it yet
+    if (copy_chain(vol, old_first, target, scratch) != 0 || blkdev_sync(vol->disk) != 0) {
+        free(scratch);
+        return -1;
+    }
+    
+    // 2. Allocate the new chain in every FAT copy (an interruption before
+    //    step 3 leaves it allocated but unreferenced, the file untouched)
+    for (uint32_t i = 0; i + 1 < st->clusters; i++) {
+        fat_set_entry(vol, target + i, target + i + 1);
+    }
+    fat_set_entry(vol, target + st->clusters - 1, fat_end_mark(vol));
+    if (fat_flush(vol) != 0 || blkdev_sync(vol->disk) != 0) {
+        free(scratch);
+        return -1;
+    }
+    
+    // 3. Point the directory entry at the new chain
+    entry.first_cluster_low = (uint16_t)target;
+    entry.first_cluster_high = vol->type == FAT_TYPE_32 ? (uint16_t)(target >> 16) : 0;
+    if (write_dir_entry(vol, dir_cluster, sector, index, &entry) != 0 || blkdev_sync(vol->disk) != 0) {
+        free(scratch);
+        return -1;
+    }
+    
+    // 4. Release the old clusters
+    fat_free_chain(vol, old_first);
+    if (fat_flush(vol) != 0 || blkdev_sync(vol->disk) != 0) {
+        free(scratch);
+        return -1;
+    }
+    
+    st->status = DEFRAG_MOVED;
+    st->fragments_after = fat_chain_fragments(vol, target, NULL);
+    st->read_us_after = time_chain_read(vol, target, scratch);
+    free(scratch);
+    return 0;
 }
@@ -0,0 +1,333 @@
+#include "../include/fat12.h"
+#include "../include/vfs.h"
+#include "../include/heap.h"
+#include "../include/string.h"
+
+// VFS driver for FAT volumes: vnode->ino is the first cluster (directories:
+// 0 = root). An open file has one fat12_file_t (size, chain, extent map and
+// readahead state) shared by every descriptor on its vnode, so they all see
+// the same file; it is freed when the last of them closes
+
+typedef struct fat_open_file {
+    fat12_file_t file;
+    vfs_vnode_t* vnode;
+    uint16_t open_count;
+    uint8_t entry_dirty;    // Size or first cluster changed since the last entry write
+    uint8_t unlinked;       // Name removed while open: the chain is freed at the last close
+    struct fat_open_file* next;
+} fat_open_file_t;
+
+static fat_open_file_t* open_files;
+
+static fat_open_file_t* find_open(vfs_vnode_t* v) {
+    for (fat_open_file_t* open = open_files; open; open = open->next) {
+        if (open->vnode == v) {
+            return open;
+        }
+    }
+    return NULL;
+}
+
+// Copy what a FAT open/create found into a vnode
+static void fill_vnode(vfs_vnode_t* v, const fat12_file_t* file) {
+    strcpy(v->name, file->name);
+    v->ino = file->first_cluster;
+    v->is_directory = file->is_directory;
+}
+
+static int fat_vfs_lookup(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child) {
+    fat12_file_t file;
+    if (fat12_open_at((fat_volume_t*)dir->mount->fs, dir->ino, name, &file) != 0) {
+        return -1;
+    }
+    fill_vnode(child, &file);
+    return 0;
+}
+
+static int fat_vfs_create(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child) {
+    fat12_file_t file;
+    if (fat12_create_at((fat_volume_t*)dir->mount->fs, dir->ino, name, &file) != 0) {
+        return -1;
+    }
+    fill_vnode(child, &file);
+    return 0;
+}
+
+static int fat_vfs_unlink(vfs_vnode_t* dir, const char* name) {
+    fat_volume_t* vol = (fat_volume_t*)dir->mount->fs;
+    for (fat_open_file_t* open = open_files; open; open = open->next) {
+        // An earlier file of the same name that is already unlinked is not this one
+        if (!open->unlinked && open->vnode->parent == dir && strcmp(open->vnode->name, name) == 0) {
+            // Open files keep reading and writing the chain; freed at the last close
+            if (fat12_remove_entry_at(vol, dir->ino, name) != 0) {
+                return -1;
+            }
+            open->unlinked = 1;
+            return 0;
+        }
+    }
+    return fat12_delete_at(vol, dir->ino, name);
+}
+
+typedef struct {
+    uint32_t skip;          // Visible entries before the cookie
+    uint32_t seen;
+    vfs_dirent_t* entries;
+    uint32_t count;
+    uint32_t filled;
+} readdir_ctx_t;
+
+// fat_dir_walk callback: collect the visible entries of one directory sector
+static int readdir_sector(fat_volume_t* vol, uint32_t sector, const fat_dir_entry_t* entries, void* ctx) {
+    readdir_ctx_t* rd = (readdir_ctx_t*)ctx;
+    (void)sector;
+    
+    for (uint32_t i = 0; i < 512 / sizeof(fat_dir_entry_t); i++) {
+        if (entries[i].filename[0] == 0x00) {
+            return 1;  // End of directory
+        }
+        // Deleted entries, volume labels, long names, and . and .. (the VFS supplies those)
+        if ((uint8_t)entries[i].filename[0] == 0xE5 || (entries[i].attributes & FAT_ATTR_VOLUME_ID) ||
+            entries[i].attributes == FAT_ATTR_LFN || entries[i].filename[0] == '.') {
+            continue;
+        }
+        if (rd->seen++ < rd->skip) {
+            continue;
+        }
+        
+        vfs_dirent_t* e = &rd->entries[rd->filled++];
+        fat_format_name(&entries[i], e->name);
+        e->size = entries[i].file_size;
+        e->ino = fat_entry_cluster(vol, &entries[i]);
+        e->is_directory = (entries[i].attributes & FAT_ATTR_DIRECTORY) ? 1 : 0;
+        e->attributes = entries[i].attributes & (DIRENT_READ_ONLY | DIRENT_HIDDEN | DIRENT_SYSTEM |
+                                                 DIRENT_DIRECTORY | DIRENT_ARCHIVE);
+        if (rd->filled == rd->count) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int fat_vfs_readdir(vfs_vnode_t* dir, uint32_t* cookie, vfs_dirent_t* entries, uint32_t count) {
+    readdir_ctx_t rd = { *cookie, 0, entries, count, 0 };
+    if (count == 0) {
+        return 0;
+    }
+    if (fat_dir_walk((fat_volume_t*)dir->mount->fs, dir->ino, readdir_sector, &rd) < 0) {
+        return -1;
+    }
+    *cookie += rd.filled;
+    return (int)rd.filled;
+}
+
+static int fat_vfs_open(vfs_file_t* file) {
+    vfs_vnode_t* v = file->vnode;
+    fat_open_file_t* open = find_open(v);
+    if (open) {
+        open->open_count++;
+        file->priv = open;
+        file->size = open->file.size;
+        return 0;
+    }
+    
+    open = (fat_open_file_t*)malloc(sizeof(fat_open_file_t));
+    if (!open) {
+        return -1;
+    }
+    
+    // Files always sit in a directory of their own volume
+    if (fat12_open_at((fat_volume_t*)v->mount->fs, v->parent->ino, v->name, &open->file) != 0) {
+        free(open);
+        return -1;
+    }
+    open->vnode = v;
+    open->open_count = 1;
+    open->entry_dirty = 0;
+    open->unlinked = 0;
+    open->next = open_files;
+    open_files = open;
+    file->priv = open;
+    file->size = open->file.size;
+    return 0;
+}
+
+static int fat_vfs_read(vfs_file_t* file, uint8_t* buffer, uint32_t size) {
+    fat_open_file_t* open = (fat_open_file_t*)file->priv;
+    fat12_seek(&open->file, file->position);
+    return fat12_read(&open->file, buffer, size);
+}
+
+static int fat_vfs_write(vfs_file_t* file, const uint8_t* buffer, uint32_t size) {
+    fat_open_file_t* open = (fat_open_file_t*)file->priv;
+    fat12_seek(&open->file, file->position);
+    
+    uint32_t old_size = open->file.size;
+    uint32_t old_cluster = open->file.first_cluster;
+    int bytes = fat12_write(&open->file, buffer, size);
+    if (open->file.size != old_size || open->file.first_cluster != old_cluster) {
+        open->entry_dirty = 1;  // Directory entry is written once, at close
+    }
+    file->size = open->file.size;
+    file->vnode->ino = open->file.first_cluster;
+    return bytes;
+}
+
+static int fat_vfs_truncate(vfs_file_t* file, uint32_t size) {
+    fat_open_file_t* open = (fat_open_file_t*)file->priv;
+    if (fat12_truncate(&open->file, size) != 0) {
+        return -1;
+    }
+    open->entry_dirty = 1;
+    file->size = size;
+    file->vnode->ino = open->file.first_cluster;
+    return 0;
+}
+
+static int fat_vfs_close(vfs_file_t* file) {
+    fat_open_file_t* open = (fat_open_file_t*)file->priv;
+    file->priv = NULL;
+    if (--open->open_count > 0) {
+        return 0;  // Still open through another descriptor
+    }
+    
+    for (fat_open_file_t** link = &open_files; *link; link = &(*link)->next) {
+        if (*link == open) {
+            *link = open->next;
+            break;
+        }
+    }
+    
+    // Write back the FAT before the entry that points into it; an unlinked
+    // file has no entry any more, only clusters to give back
+    if (open->unlinked) {
+        fat_free_chain(open->file.vol, open->file.first_cluster);
+    }
+    int result = fat_flush(open->file.vol);
+    if (!open->unlinked && open->entry_dirty && fat12_update_entry(&open->file) != 0) {
+        result = -1;
+    }
+    free(open);
+    return result;
+}
+
+static int fat_vfs_sync(vfs_mount_t* mount) {
+    return fat_flush((fat_volume_t*)mount->fs);
+}
+
+static int fat_vfs_statfs(vfs_mount_t* mount, statfs_t* st) {
+    fat_volume_t* vol = (fat_volume_t*)mount->fs;
+    st->block_size = vol->sectors_per_cluster * 512;
+    st->total_blocks = vol->cluster_limit - 2;
+    st->free_blocks = vol->free_count;
+    if (st->free_blocks > st->total_blocks) {
+        // Count unknown (FAT32 without a valid FSInfo): scan the FAT
+        st->free_blocks = 0;
+        for (uint32_t c = 2; c < vol->cluster_limit; c++) {
+            if (fat_cluster_free(vol, c)) st->free_blocks++;
+        }
+    }
+    return 0;
+}
+
+// Subdirectory levels fat12_defrag descends into
+#define DEFRAG_MAX_DEPTH 8
+
+typedef struct {
+    defrag_stat_t* reports;
+    uint32_t max;
+    uint32_t count;
+} defrag_ctx_t;
+
+// Append 'name' to 'path' (64 bytes), truncating if it does not fit
+static void path_append(char* path, const char* name) {
+    uint32_t len = strlen(path);
+    while (*name && len < 63) path[len++] = *name++;
+    path[len] = '\0';
+}
+
+// Defragment the files of a directory and, recursively, its subdirectories
+static void defrag_dir(vfs_vnode_t* dir, const char* prefix, defrag_ctx_t* ctx, int depth) {
+    fat_volume_t* vol = (fat_volume_t*)dir->mount->fs;
+    vfs_dirent_t entries[8];
+    uint32_t cookie = 0;
+    int n;
+    
+    do {
+        n = vfs_readdir(dir, &cookie, entries, 8);
+        for (int i = 0; i < n; i++) {
+            vfs_vnode_t* v = vfs_lookup(dir, entries[i].name);
+            if (!v) {
+                continue;
+            }
+            if (v->mount != dir->mount) {
+                vfs_release(v);  // Another filesystem is mounted here
+                continue;
+            }
+            
+            char path[64];
+            path[0] = '\0';
+            path_append(path, prefix);
+            path_append(path, v->name);
+            
+            if (v->is_directory) {
+                if (depth < DEFRAG_MAX_DEPTH) {
+                    path_append(path, "/");
+                    defrag_dir(v, path, ctx, depth + 1);
+                }
+                vfs_release(v);
+                continue;
+            }
+            
+            // Open files keep an extent map of their clusters, so they stay put
+            defrag_stat_t st;
+            if (v->refcount > 1) {
+                memset(&st, 0, sizeof(st));
+                st.status = DEFRAG_BUSY;
+                st.fragments_before = fat_chain_fragments(vol, v->ino, &st.clusters);
+                st.fragments_after = st.fragments_before;
+            } else if (fat12_defrag_at(vol, dir->ino, v->name, &st) == 0 && st.status == DEFRAG_MOVED) {
+                fat12_file_t file;
+                if (fat12_open_at(vol, dir->ino, v->name, &file) == 0) {
+                    v->ino = file.first_cluster;  // Keep the cached vnode current
+                }
+            }
+            strcpy(st.path, path);
+            if (ctx->count < ctx->max) {
+                ctx->reports[ctx->count] = st;
+            }
+            ctx->count++;
+            vfs_release(v);
+        }
+    } while (n == 8);
+}
+
+// Defragment a directory tree of a FAT volume
+int fat12_defrag(const char* path, defrag_stat_t* reports, uint32_t max) {
+    vfs_vnode_t* dir = vfs_resolve(path);
+    if (!dir || !dir->is_directory || dir->mount->ops != &fat12_vfs_ops) {
+        vfs_release(dir);
+        return -1;
+    }
+    
+    defrag_ctx_t ctx = { reports, max, 0 };
+    defrag_dir(dir, "", &ctx, 0);
+    vfs_release(dir);
+    return (int)ctx.count;
+}
+
+const vfs_ops_t fat12_vfs_ops = {
+    "fat",
+    1,  // 8.3 names are stored in upper case
+    fat_vfs_lookup,
+    fat_vfs_create,
+    fat_vfs_unlink,
+    fat_vfs_readdir,
+    fat_vfs_open,
+    fat_vfs_read,
+    fat_vfs_write,
+    fat_vfs_truncate,
+    fat_vfs_close,
+    fat_vfs_sync,
+    fat_vfs_statfs
+};
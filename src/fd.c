@@ -0,0 +1,185 @@
+#include "../include/fd.h"
+#include "../include/vfs.h"
+#include "../include/string.h"
+
+typedef struct {
+    vfs_file_t* files[FD_MAX_OPEN];     // NULL = descriptor free
+    vfs_vnode_t* cwd;                   // NULL = root
+} process_t;
+
+static process_t processes[FD_MAX_PROCESSES];
+static int current_process = 0;    // Index of the running program's table
+static int process_depth = 0;      // Programs started and not yet exited
+
+// Look up an open descriptor of the current process
+static vfs_file_t* fd_get(int fd) {
+    if (fd < 0 || fd >= FD_MAX_OPEN) return NULL;
+    return processes[current_process].files[fd];
+}
+
+// Open a file
+int fd_open(const char* filename, int flags) {
+    vfs_file_t** table = processes[current_process].files;
+    int fd = -1;
+    for (int i = 0; i < FD_MAX_OPEN; i++) {
+        if (!table[i]) {
+            fd = i;
+            break;
+        }
+    }
+    if (fd < 0 || !filename) {
+        return -1;
+    }
+    
+    table[fd] = vfs_open(filename, flags);
+    return table[fd] ? fd : -1;
+}
+
+// Read from a descriptor
+int fd_read(int fd, uint8_t* buffer, uint32_t size) {
+    return vfs_read(fd_get(fd), buffer, size);
+}
+
+// Write to a descriptor
+int fd_write(int fd, const uint8_t* buffer, uint32_t size) {
+    return vfs_write(fd_get(fd), buffer, size);
+}
+
+// Shrink the file behind a descriptor
+int fd_truncate(int fd, uint32_t size) {
+    return vfs_truncate(fd_get(fd), size);
+}
+
+// Reposition a descriptor
+int64_t fd_lseek(int fd, int64_t offset, int whence) {
+    vfs_file_t* file = fd_get(fd);
+    if (!file) {
+        return -1;
+    }
+    
+    // A directory's offset is a readdir cookie: it can only be rewound
+    if (file->vnode->is_directory) {
+        if (whence != SEEK_SET || offset != 0) {
+            return -1;
+        }
+        file->position = 0;
+        return 0;
+    }
+    
+    int64_t base;
+    switch (whence) {
+        case SEEK_SET: base = 0; break;
+        case SEEK_CUR: base = file->position; break;
+        case SEEK_END: base = file->size; break;
+        default: return -1;
+    }
+    
+    int64_t target = base + offset;
+    if (target < 0) {
+        return -1;
+    }
+    file->position = target > file->size ? file->size : (uint32_t)target;
+    return file->position;
+}
+
+// Close a descriptor
+int fd_close(int fd) {
+    vfs_file_t* file = fd_get(fd);
+    if (!file) {
+        return -1;
+    }
+    processes[current_process].files[fd] = NULL;
+    return vfs_close(file);
+}
+
+// Get the state of a descriptor
+int fd_fstat(int fd, stat_t* st) {
+    vfs_file_t* file = fd_get(fd);
+    if (!file || !st) {
+        return -1;
+    }
+    
+    st->size = file->size;
+    st->position = file->position;
+    st->first_cluster = file->vnode->ino;
+    st->is_directory = file->vnode->is_directory;
+    st->flags = (uint8_t)file->flags;
+    return 0;
+}
+
+// Read directory entries as packed records
+int fd_getdents(int fd, dirent_t* buffer, uint32_t size) {
+    vfs_file_t* file = fd_get(fd);
+    if (!file || !buffer) {
+        return -1;
+    }
+    
+    // Fetch in batches so one call costs a single directory walk per batch
+    // rather than one per entry
+    uint32_t room = size / sizeof(dirent_t);
+    uint32_t filled = 0;
+    vfs_dirent_t batch[8];
+    while (filled < room) {
+        uint32_t want = room - filled < 8 ? room - filled : 8;
+        int n = vfs_getdents(file, batch, want);
+        if (n < 0) {
+            return filled > 0 ? (int)(filled * sizeof(dirent_t)) : -1;
+        }
+        for (int i = 0; i < n; i++) {
+            dirent_t* d = &buffer[filled++];
+            memset(d, 0, sizeof(*d));
+            strcpy(d->name, batch[i].name);
+            d->size = batch[i].is_directory ? 0 : batch[i].size;
+            d->first_cluster = batch[i].ino;
+            d->attributes = batch[i].attributes | (batch[i].is_directory ? DIRENT_DIRECTORY : 0);
+        }
+        if ((uint32_t)n < want) {
+            break;  // End of directory
+        }
+    }
+    return (int)(filled * sizeof(dirent_t));
+}
+
+// Give a starting program an empty descriptor table and its parent's working directory
+void fd_process_enter(void) {
+    process_depth++;
+    if (process_depth >= FD_MAX_PROCESSES) {
+        return;  // Nested too deep: share the parent's table
+    }
+    process_t* parent = &processes[current_process];
+    current_process = process_depth;
+    process_t* child = &processes[current_process];
+    memset(child, 0, sizeof(*child));
+    child->cwd = parent->cwd;
+    if (child->cwd) {
+        vfs_retain(child->cwd);
+    }
+}
+
+// Close whatever the exiting program left open and return to the parent's table
+void fd_process_exit(void) {
+    if (process_depth == 0) {
+        return;
+    }
+    if (process_depth < FD_MAX_PROCESSES) {
+        for (int fd = 0; fd < FD_MAX_OPEN; fd++) {
+            if (processes[current_process].files[fd]) {
+                fd_close(fd);
+            }
+        }
+        vfs_release(processes[current_process].cwd);
+        processes[current_process].cwd = NULL;
+    }
+    process_depth--;
+    current_process = process_depth < FD_MAX_PROCESSES ? process_depth : FD_MAX_PROCESSES - 1;
+}
+
+// Working directory of the running program
+vfs_vnode_t* fd_cwd(void) {
+    return processes[current_process].cwd;
+}
+
+// Replace the working directory (the caller releases the old one)
+void fd_set_cwd(vfs_vnode_t* dir) {
+    processes[current_process].cwd = dir;
+}
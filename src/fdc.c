@@ -1,5 +1,6 @@
 #include "../include/fdc.h"
 #include "../include/idt.h"
+#include "../include/blkdev.h"
 #include "../include/stdio.h"
 
 // FDC I/O Ports
@@ -70,6 +71,14 @@ static uint8_t* dma_buffer = (uint8_t*)DMA_BUFFER_ADDR;
 // FDC interrupt flag
 static volatile int fdc_irq_received = 0;
 
+// Drive state (for skipping redundant seeks and counting spin-ups)
+#define FDC_UNKNOWN_CYLINDER 0xFF
+#define FDC_MAX_RETRIES 3
+static uint8_t current_cylinder = FDC_UNKNOWN_CYLINDER;
+static int motor_running = 0;
+
+static blkdev_t fdc_blkdev;
+
 // FDC interrupt handler (called from fdc_handler_asm in idt_asm.asm)
 void fdc_irq_handler(void) {
     fdc_irq_received = 1;
@@ -173,11 +182,16 @@ static int fdc_read_byte(uint8_t* byte) {
 
 // Motor control
 static void fdc_motor_on(void) {
+    if (!motor_running) {
+        fdc_blkdev.stats.spinups++;
+        motor_running = 1;
+    }
     outb(FDC_DOR, DOR_MOTOR_A | DOR_IRQ | DOR_RESET | 0); // Drive 0
     // Wait for motor to spin up (500ms in real hardware, we'll skip for emulation)
 }
 
 static void fdc_motor_off(void) {
+    motor_running = 0;
     outb(FDC_DOR, DOR_IRQ | DOR_RESET | 0);
 }
 
@@ -185,6 +199,8 @@ static void fdc_motor_off(void) {
 static int fdc_reset(void) {
     // Disable controller
     outb(FDC_DOR, 0);
+    motor_running = 0;
+    current_cylinder = FDC_UNKNOWN_CYLINDER;
     
     // Clear any stale IRQ flag and re-enable controller
     fdc_irq_received = 0;
@@ -229,11 +245,17 @@ static int fdc_recalibrate(void) {
     if (fdc_read_byte(&st0) != 0) return -1;
     if (fdc_read_byte(&cyl) != 0) return -1;
     
+    current_cylinder = cyl;
     return (cyl == 0) ? 0 : -1;
 }
 
-// Seek to a specific cylinder
+// Seek to a specific cylinder (no-op if the heads are already there)
 static int fdc_seek(uint8_t cylinder, uint8_t head) {
+    if (cylinder == current_cylinder) {
+        return 0;
+    }
+    fdc_blkdev.stats.seeks++;
+    
     fdc_irq_received = 0;
     if (fdc_write_byte(FDC_CMD_SEEK) != 0) return -1;
     if (fdc_write_byte((head << 2) | 0) != 0) return -1; // Drive 0
@@ -248,6 +270,7 @@ static int fdc_seek(uint8_t cylinder, uint8_t head) {
     if (fdc_read_byte(&st0) != 0) return -1;
     if (fdc_read_byte(&cyl) != 0) return -1;
     
+    current_cylinder = cylinder;
     return 0;
 }
 
@@ -272,6 +295,38 @@ int fdc_detect(void) {
     return 1; // FDC detected
 }
 
+// Block device adapters (split large requests into uint8_t-sized chunks)
+static int fdc_blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    (void)dev;
+    while (count > 0) {
+        uint8_t n = count > 255 ? 255 : (uint8_t)count;
+        if (fdc_read_sectors(lba, n, buffer) != 0) return -1;
+        lba += n;
+        count -= n;
+        buffer += n * 512;
+    }
+    return 0;
+}
+
+static int fdc_blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    (void)dev;
+    while (count > 0) {
+        uint8_t n = count > 255 ? 255 : (uint8_t)count;
+        if (fdc_write_sectors(lba, n, buffer) != 0) return -1;
+        lba += n;
+        count -= n;
+        buffer += n * 512;
+    }
+    return 0;
+}
+
+static blkdev_t fdc_blkdev = {
+    .name = "fd0",
+    .total_sectors = SECTORS_PER_TRACK * HEADS * TRACKS,
+    .read = fdc_blk_read,
+    .write = fdc_blk_write,
+};
+
 // Initialize FDC
 int fdc_init(void) {
     printf("Initializing FDC...\n");
@@ -295,54 +350,93 @@ int fdc_init(void) {
         return -1;
     }
     
+    blkdev_register(&fdc_blkdev);
+    
     printf("FDC initialized successfully\n");
     return 0;
 }
 
-// Read sectors with DMA (optimized for multi-sector reads)
+// Sectors to move in one command starting at (head, sector): the rest of the
+// track, or the rest of the cylinder (multi-track) when starting on head 0
+// and the request covers both tracks
+static uint8_t fdc_burst_length(uint8_t head, uint8_t sector, uint32_t remaining, int* multi_track) {
+    uint32_t track_rest = SECTORS_PER_TRACK - sector + 1;
+    *multi_track = 0;
+    if (head == 0 && remaining >= track_rest + SECTORS_PER_TRACK) {
+        *multi_track = 1;
+        return (uint8_t)(track_rest + SECTORS_PER_TRACK);
+    }
+    return (uint8_t)(remaining < track_rest ? remaining : track_rest);
+}
+
+// Issue one READ DATA / WRITE DATA command through the DMA buffer and check the result
+static int fdc_transfer_burst(uint8_t command, uint8_t c, uint8_t h, uint8_t s, uint8_t n, int multi_track) {
+    if (fdc_seek(c, h) != 0) return -1;
+    
+    if (command == FDC_CMD_READ_DATA) {
+        dma_setup_read(n);
+    } else {
+        dma_setup_write(n);
+    }
+    fdc_irq_received = 0;
+    
+    // MT=0x80 continues onto head 1 after the last sector of head 0; MFM=0x40
+    uint8_t eot = multi_track ? SECTORS_PER_TRACK : (uint8_t)(s + n - 1);
+    if (fdc_write_byte(command | 0x40 | (multi_track ? 0x80 : 0)) != 0 ||
+        fdc_write_byte((h << 2)) != 0 ||
+        fdc_write_byte(c) != 0 ||
+        fdc_write_byte(h) != 0 ||
+        fdc_write_byte(s) != 0 ||
+        fdc_write_byte(2) != 0 ||
+        fdc_write_byte(eot) != 0 ||
+        fdc_write_byte(0x1B) != 0 ||
+        fdc_write_byte(0xFF) != 0) {
+        return -1;
+    }
+    
+    // Wait for the DMA transfer to complete (IRQ6 fires when done)
+    if (fdc_wait_irq() != 0) return -1;
+    
+    uint8_t st0, st1, st2, r[4];
+    if (fdc_read_byte(&st0) | fdc_read_byte(&st1) | fdc_read_byte(&st2) |
+        fdc_read_byte(&r[0]) | fdc_read_byte(&r[1]) | fdc_read_byte(&r[2]) | fdc_read_byte(&r[3])) {
+        return -1;
+    }
+    
+    return (st0 & 0xC0) ? -1 : 0;
+}
+
+// Run a burst, recalibrating and retrying on failure
+static int fdc_transfer_retry(uint8_t command, uint8_t c, uint8_t h, uint8_t s, uint8_t n, int multi_track) {
+    for (int attempt = 0; attempt <= FDC_MAX_RETRIES; attempt++) {
+        if (attempt > 0) {
+            fdc_blkdev.stats.retries++;
+            fdc_recalibrate();
+        }
+        if (fdc_transfer_burst(command, c, h, s, n, multi_track) == 0) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Read sectors with DMA (one command per track, or per cylinder when possible)
 int fdc_read_sectors(uint32_t lba, uint8_t count, uint8_t* buffer) {
-    uint8_t done = 0;
+    uint32_t done = 0;
     
     fdc_motor_on();
     
     while (done < count) {
         uint8_t c, h, s;
+        int multi_track;
         lba_to_chs(lba + done, &c, &h, &s);
+        uint8_t n = fdc_burst_length(h, s, count - done, &multi_track);
         
-        // Read up to end of track
-        uint8_t n = SECTORS_PER_TRACK - s + 1;
-        if (n > count - done) n = count - done;
-        
-        if (fdc_seek(c, h) != 0) { fdc_motor_off(); return -1; }
-        
-        dma_setup_read(n);
-        fdc_irq_received = 0;
-        
-        if (fdc_write_byte(FDC_CMD_READ_DATA | 0x40) != 0 ||
-            fdc_write_byte((h << 2)) != 0 ||
-            fdc_write_byte(c) != 0 ||
-            fdc_write_byte(h) != 0 ||
-            fdc_write_byte(s) != 0 ||
-            fdc_write_byte(2) != 0 ||
-            fdc_write_byte(s + n - 1) != 0 ||
-            fdc_write_byte(0x1B) != 0 ||
-            fdc_write_byte(0xFF) != 0) {
+        if (fdc_transfer_retry(FDC_CMD_READ_DATA, c, h, s, n, multi_track) != 0) {
             fdc_motor_off();
             return -1;
         }
         
-        // Wait for DMA read to complete (IRQ6 fires when done)
-        if (fdc_wait_irq() != 0) { fdc_motor_off(); return -1; }
-        
-        uint8_t st0, st1, st2, r[4];
-        if (fdc_read_byte(&st0) | fdc_read_byte(&st1) | fdc_read_byte(&st2) |
-            fdc_read_byte(&r[0]) | fdc_read_byte(&r[1]) | fdc_read_byte(&r[2]) | fdc_read_byte(&r[3])) {
-            fdc_motor_off();
-            return -1;
-        }
-        
-        if (st0 & 0xC0) { fdc_motor_off(); return -1; }
-        
         for (int j = 0; j < n * 512; j++) buffer[done * 512 + j] = dma_buffer[j];
         done += n;
     }
@@ -351,66 +445,26 @@ int fdc_read_sectors(uint32_t lba, uint8_t count, uint8_t* buffer) {
     return 0;
 }
 
-// Write sectors with DMA
+// Write sectors with DMA (one command per track, or per cylinder when possible)
 int fdc_write_sectors(uint32_t lba, uint8_t count, const uint8_t* buffer) {
-    for (uint8_t i = 0; i < count; i++) {
-        uint8_t cylinder, head, sector;
-        lba_to_chs(lba + i, &cylinder, &head, &sector);
-        
-        fdc_motor_on();
-        
-        // Seek to cylinder
-        if (fdc_seek(cylinder, head) != 0) {
-            fdc_motor_off();
-            return -1;
-        }
+    uint32_t done = 0;
+    
+    fdc_motor_on();
+    
+    while (done < count) {
+        uint8_t c, h, s;
+        int multi_track;
+        lba_to_chs(lba + done, &c, &h, &s);
+        uint8_t n = fdc_burst_length(h, s, count - done, &multi_track);
         
         // Copy user data to DMA buffer
-        for (int j = 0; j < 512; j++) {
-            dma_buffer[j] = buffer[i * 512 + j];
-        }
+        for (int j = 0; j < n * 512; j++) dma_buffer[j] = buffer[done * 512 + j];
         
-        // Setup DMA for write
-        dma_setup_write(1);
-        
-        // Reset IRQ flag
-        fdc_irq_received = 0;
-        
-        // Write command (MT=0, MFM=1, SK=0)
-        if (fdc_write_byte(FDC_CMD_WRITE_DATA | 0x40) != 0) {
-            fdc_motor_off();
-            return -1;
-        }
-        if (fdc_write_byte((head << 2) | 0) != 0) return -1; // Drive 0
-        if (fdc_write_byte(cylinder) != 0) return -1;
-        if (fdc_write_byte(head) != 0) return -1;
-        if (fdc_write_byte(sector) != 0) return -1;
-        if (fdc_write_byte(2) != 0) return -1; // 512 bytes per sector
-        if (fdc_write_byte(SECTORS_PER_TRACK) != 0) return -1;
-        if (fdc_write_byte(0x1B) != 0) return -1; // GAP3 length
-        if (fdc_write_byte(0xFF) != 0) return -1; // Data length
-        
-        // Wait for DMA write to complete (IRQ6 fires when done)
-        if (fdc_wait_irq() != 0) {
-            fdc_motor_off();
-            return -1;
-        }
-        
-        // Read result bytes (7 bytes)
-        uint8_t st0, st1, st2, cyl, h, sec, bps;
-        if (fdc_read_byte(&st0) != 0) return -1;
-        if (fdc_read_byte(&st1) != 0) return -1;
-        if (fdc_read_byte(&st2) != 0) return -1;
-        if (fdc_read_byte(&cyl) != 0) return -1;
-        if (fdc_read_byte(&h) != 0) return -1;
-        if (fdc_read_byte(&sec) != 0) return -1;
-        if (fdc_read_byte(&bps) != 0) return -1;
-        
-        // Check for errors in ST0
-        if ((st0 & 0xC0) != 0) {
+        if (fdc_transfer_retry(FDC_CMD_WRITE_DATA, c, h, s, n, multi_track) != 0) {
             fdc_motor_off();
             return -1;
         }
+        done += n;
     }
     
     fdc_motor_off();
@@ -145,6 +145,54 @@ fdc_handler_asm:
     
     iretq
 
+; virtio-blk interrupt handler (PCI INTx, usually IRQ 10/11 on the slave PIC)
+global virtio_blk_handler_asm
+extern virtio_blk_irq_handler
+virtio_blk_handler_asm:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+    
+    call virtio_blk_irq_handler
+    
+    ; EOI to the slave PIC if the line is on it (IRQ 8-15), then the master
+    cmp rax, 8
+    mov al, 0x20
+    jb .master_eoi
+    out 0xA0, al
+.master_eoi:
+    out 0x20, al
+    
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    
+    iretq
+
 ; Spurious IRQ handler (IRQ7 = vector 39)
 ; The 8259A PIC generates spurious IRQ7 when an IRQ is raised then
 ; de-asserted before the CPU acknowledges it. Do NOT send EOI for
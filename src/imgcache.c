@@ -0,0 +1,184 @@
+#include "../include/imgcache.h"
+#include "../include/memory.h"
+#include "../include/string.h"
+#include "../include/ctype.h"
+#include "../include/printf.h"
+
+static imgcache_image_t images[IMGCACHE_MAX_IMAGES];
+static uint32_t cached_pages;
+static uint32_t use_clock;
+
+// Segments are stored back to back, each starting 8-byte aligned for the copy
+static uint64_t stored_size(uint64_t filesz) {
+    return (filesz + 7) & ~7ULL;
+}
+
+static int name_equal(const vfs_mount_t* mount, const char* a, const char* b) {
+    if (!mount->ops->case_insensitive) {
+        return strcmp(a, b) == 0;
+    }
+    while (*a && toupper(*a) == toupper(*b)) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+static imgcache_image_t* find_image(vfs_vnode_t* file) {
+    uint32_t dir = file->parent ? file->parent->ino : 0;
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        imgcache_image_t* img = &images[i];
+        if (img->used && img->mount == file->mount && img->dir == dir &&
+            name_equal(file->mount, img->name, file->name)) {
+            return img;
+        }
+    }
+    return NULL;
+}
+
+static void drop_image(imgcache_image_t* img) {
+    pmem_free_pages(img->addr, img->pages);
+    cached_pages -= img->pages;
+    img->used = 0;
+}
+
+static imgcache_image_t* least_recently_used(void) {
+    imgcache_image_t* oldest = NULL;
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES; i++) {
+        if (images[i].used && (!oldest || images[i].last_used < oldest->last_used)) {
+            oldest = &images[i];
+        }
+    }
+    return oldest;
+}
+
+// Let the page allocator take images back under memory pressure
+void imgcache_init(void) {
+    memset(images, 0, sizeof(images));
+    cached_pages = 0;
+    pmem_set_reclaim(imgcache_reclaim);
+}
+
+// Find a file's image, dropping it if the file changed size
+static imgcache_image_t* find_current(vfs_vnode_t* file, uint32_t size) {
+    imgcache_image_t* img = find_image(file);
+    if (img && img->size != size) {
+        drop_image(img);  // Changed behind our back (e.g. on another system)
+        return NULL;
+    }
+    return img;
+}
+
+// Find the cached image of a file, to see where it has to go
+const imgcache_layout_t* imgcache_layout(vfs_vnode_t* file, uint32_t size) {
+    imgcache_image_t* img = find_current(file, size);
+    if (!img) {
+        return NULL;
+    }
+    img->last_used = ++use_clock;
+    return &img->layout;
+}
+
+// Copy the cached image of a file to base + its addresses and clear its BSS
+int imgcache_load(vfs_vnode_t* file, uint32_t size, uint64_t base) {
+    imgcache_image_t* img = find_current(file, size);
+    if (!img) {
+        return -1;
+    }
+    
+    const uint8_t* data = (const uint8_t*)(uintptr_t)img->addr;
+    for (uint32_t i = 0; i < img->layout.segment_count; i++) {
+        imgcache_segment_t* seg = &img->layout.segments[i];
+        uint8_t* dest = (uint8_t*)(base + seg->vaddr);
+        memcpy(dest, data, seg->filesz);
+        memset(dest + seg->filesz, 0, seg->memsz - seg->filesz);
+        data += stored_size(seg->filesz);
+    }
+    img->last_used = ++use_clock;
+    return 0;
+}
+
+// Keep the image of a program that was just loaded from disk at 'base'
+void imgcache_store(vfs_vnode_t* file, uint32_t size, const imgcache_layout_t* layout, uint64_t base) {
+    uint32_t count = layout->segment_count;
+    if (count == 0 || count > IMGCACHE_MAX_SEGMENTS) {
+        return;
+    }
+    uint64_t bytes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        bytes += stored_size(layout->segments[i].filesz);
+    }
+    uint32_t pages = (uint32_t)((bytes + 4095) / 4096);
+    if (pages == 0) {
+        return;
+    }
+    
+    imgcache_forget(file);
+    
+    // Stay within a quarter of the memory the cache could have, oldest out first
+    while (cached_pages + pages > (pmem_get_free_pages() + cached_pages) / 4) {
+        imgcache_image_t* oldest = least_recently_used();
+        if (!oldest) {
+            return;  // Too large to cache at all
+        }
+        drop_image(oldest);
+    }
+    
+    imgcache_image_t* img = NULL;
+    for (int i = 0; i < IMGCACHE_MAX_IMAGES && !img; i++) {
+        if (!images[i].used) {
+            img = &images[i];
+        }
+    }
+    if (!img) {
+        img = least_recently_used();
+        drop_image(img);
+    }
+    
+    uint32_t addr = pmem_alloc_pages(pages);
+    if (!addr) {
+        return;
+    }
+    uint8_t* data = (uint8_t*)(uintptr_t)addr;
+    for (uint32_t i = 0; i < count; i++) {
+        const imgcache_segment_t* seg = &layout->segments[i];
+        memcpy(data, (const void*)(base + seg->vaddr), seg->filesz);
+        data += stored_size(seg->filesz);
+    }
+    
+    img->used = 1;
+    img->mount = file->mount;
+    img->dir = file->parent ? file->parent->ino : 0;
+    strcpy(img->name, file->name);
+    img->size = size;
+    img->addr = addr;
+    img->pages = pages;
+    img->last_used = ++use_clock;
+    img->layout = *layout;
+    cached_pages += pages;
+}
+
+// Drop the image of a file that is about to change
+void imgcache_forget(vfs_vnode_t* file) {
+    imgcache_image_t* img = find_image(file);
+    if (img) {
+        drop_image(img);
+    }
+}
+
+// Free the least recently used images until 'pages' pages came back
+uint32_t imgcache_reclaim(uint32_t pages) {
+    uint32_t freed = 0;
+    while (freed < pages) {
+        imgcache_image_t* oldest = least_recently_used();
+        if (!oldest) {
+            break;
+        }
+        freed += oldest->pages;
+        drop_image(oldest);
+    }
+    if (freed > 0) {
+        printf("Image cache: gave back %d pages under memory pressure\n", freed);
+    }
+    return freed;
+}
@@ -0,0 +1,116 @@
+#include "../include/initrd.h"
+#include "../include/memory.h"
+#include "../include/vfs.h"
+#include "../include/string.h"
+#include "../include/ctype.h"
+#include "../include/printf.h"
+
+static initrd_header_t* archive = NULL;
+static initrd_entry_t* table = NULL;
+
+// Names on the boot volume are case-insensitive, like FAT
+static int name_equal(const char* a, const char* b) {
+    while (*a && toupper(*a) == toupper(*b)) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+// Check the archive boot2 left in memory and keep its pages from the allocator
+int initrd_init(void) {
+    uint32_t addr = ((volatile uint32_t*)INITRD_INFO_ADDR)[0];
+    uint32_t size = ((volatile uint32_t*)INITRD_INFO_ADDR)[1];
+    if (size == 0) {
+        return -1;  // boot2 found no INITRD.IMG
+    }
+    
+    initrd_header_t* header = (initrd_header_t*)(uintptr_t)addr;
+    if (addr != INITRD_LOAD_ADDR || size < sizeof(initrd_header_t) ||
+        memcmp(header->magic, INITRD_MAGIC, sizeof(header->magic)) != 0 ||
+        header->size > size || header->count > INITRD_MAX_FILES ||
+        sizeof(initrd_header_t) + header->count * sizeof(initrd_entry_t) > header->size) {
+        printf("Boot archive: bad header, programs load from disk\n");
+        return -1;
+    }
+    
+    // A file on disk that was not contiguous would have been loaded as garbage
+    uint32_t sum = 0;
+    const uint8_t* bytes = (const uint8_t*)header;
+    for (uint32_t i = sizeof(initrd_header_t); i < header->size; i++) {
+        sum += bytes[i];
+    }
+    if (sum != header->checksum) {
+        printf("Boot archive: checksum mismatch, programs load from disk\n");
+        return -1;
+    }
+    
+    initrd_entry_t* entries = (initrd_entry_t*)(header + 1);
+    for (uint32_t i = 0; i < header->count; i++) {
+        if (entries[i].offset > header->size || entries[i].size > header->size - entries[i].offset) {
+            printf("Boot archive: entry %d out of range, programs load from disk\n", i);
+            return -1;
+        }
+        entries[i].name[INITRD_NAME_MAX - 1] = '\0';
+    }
+    
+    if (pmem_reserve_pages(addr, (header->size + 4095) / 4096) != 0) {
+        printf("Boot archive: memory at 0x%x already in use, programs load from disk\n", addr);
+        return -1;
+    }
+    
+    archive = header;
+    table = entries;
+    printf("Boot archive: %d programs, %d KB at 0x%x\n", header->count, (header->size + 1023) / 1024, addr);
+    return (int)header->count;
+}
+
+// Match a path to a root-directory entry of the archive
+static initrd_entry_t* find_entry(const char* path) {
+    if (!archive || !path) {
+        return NULL;
+    }
+    
+    const char* name = path;
+    if (name[0] == '/') {
+        name++;
+    } else {
+        char cwd[VFS_PATH_MAX];
+        if (vfs_getcwd(cwd, sizeof(cwd)) != 0 || strcmp(cwd, "/") != 0) {
+            return NULL;
+        }
+    }
+    if (name[0] == '\0' || strchr(name, '/')) {
+        return NULL;
+    }
+    
+    for (uint32_t i = 0; i < archive->count; i++) {
+        if (table[i].name[0] && name_equal(table[i].name, name)) {
+            return &table[i];
+        }
+    }
+    return NULL;
+}
+
+// Find the archive copy of a program
+int initrd_find(const char* path, const uint8_t** data, uint32_t* size) {
+    initrd_entry_t* e = find_entry(path);
+    if (!e) {
+        return -1;
+    }
+    *data = (const uint8_t*)archive + e->offset;
+    *size = e->size;
+    return 0;
+}
+
+// Drop the archive copy of a root-directory file that is being changed on disk
+void initrd_forget(const char* name) {
+    if (!archive) {
+        return;
+    }
+    for (uint32_t i = 0; i < archive->count; i++) {
+        if (table[i].name[0] && name_equal(table[i].name, name)) {
+            table[i].name[0] = '\0';
+        }
+    }
+}
@@ -1,7 +1,12 @@
 #include "../include/loader.h"
-#include "../include/fat12.h"
+#include "../include/vfs.h"
 #include "../include/printf.h"
-#include "../include/heap.h"
+#include "../include/string.h"
+#include "../include/initrd.h"
+#include "../include/imgcache.h"
+#include "../include/lz4.h"
+#include "../include/memory.h"
+#include "../include/timer.h"
 #include <stdint.h>
 
 // ELF64 header structure (minimal fields we need)
@@ -34,83 +39,492 @@ typedef struct {
     uint64_t p_align;         // Alignment
 } __attribute__((packed)) elf64_program_header_t;
 
-#define PT_LOAD 1  // Loadable segment
+// ELF64 dynamic section entry
+typedef struct {
+    int64_t  d_tag;           // Entry type
+    uint64_t d_val;           // Value or address
+} __attribute__((packed)) elf64_dyn_t;
 
-// Load a program from disk into memory
-// Returns entry point address on success, 0 on failure
-uint64_t load_program(const char* filename, void* load_addr) {
-    fat12_file_t file;
+// ELF64 relocation with addend
+typedef struct {
+    uint64_t r_offset;        // Address to patch
+    uint64_t r_info;          // Symbol index (high 32 bits) and type (low 32 bits)
+    int64_t  r_addend;        // Constant added to the result
+} __attribute__((packed)) elf64_rela_t;
+
+// ELF64 symbol
+typedef struct {
+    uint32_t st_name;         // Name (string table offset)
+    uint8_t  st_info;         // Type and binding
+    uint8_t  st_other;        // Visibility
+    uint16_t st_shndx;        // Section index (0 = undefined)
+    uint64_t st_value;        // Address
+    uint64_t st_size;         // Size
+} __attribute__((packed)) elf64_sym_t;
+
+#define ET_EXEC    2  // Linked at fixed addresses
+#define ET_DYN     3  // Position-independent (PIE)
+
+#define PT_LOAD    1  // Loadable segment
+#define PT_DYNAMIC 2  // Dynamic section (relocations of a PIE)
+
+#define DT_NULL     0
+#define DT_PLTRELSZ 2
+#define DT_SYMTAB   6
+#define DT_RELA     7
+#define DT_RELASZ   8
+#define DT_RELAENT  9
+#define DT_JMPREL   23
+
+#define R_X86_64_NONE      0
+#define R_X86_64_64        1  // Symbol + addend
+#define R_X86_64_GLOB_DAT  6  // GOT entry: symbol
+#define R_X86_64_JUMP_SLOT 7  // PLT GOT entry: symbol
+#define R_X86_64_RELATIVE  8  // Base + addend
+
+#define ELF_MAX_PHDRS 16  // Program headers are read onto the (small) kernel stack
+#define LOADER_MAX_DEPTH 8  // Nested launches whose PIE pages are tracked
+
+// Compressed segment bytes read and what they unpacked to, for the launch report
+static uint32_t packed_bytes;
+static uint32_t unpacked_bytes;
+
+// Pages given to the PIE running at each nesting level (pages == 0: the
+// program was linked at a fixed address), freed when it exits
+typedef struct {
+    uint32_t addr;
+    uint32_t pages;
+} placement_t;
+
+static placement_t resident[LOADER_MAX_DEPTH];
+static int resident_depth;
+
+static int is_loadable(const elf64_program_header_t* ph) {
+    return ph->p_type == PT_LOAD || ph->p_type == PT_SANTOS_LZ4;
+}
+
+// Bytes of a segment that come from the file (the rest of p_memsz is BSS)
+static uint64_t segment_data_size(const elf64_program_header_t* ph) {
+    return ph->p_type == PT_SANTOS_LZ4 ? ph->p_paddr : ph->p_filesz;
+}
+
+// Check the ELF header of a file of 'size' bytes
+// Returns 0 if its program headers can be read, -1 otherwise
+static int check_elf_header(const elf64_header_t* elf_header, uint32_t size) {
+    // Verify ELF magic number
+    if (size < sizeof(elf64_header_t) ||
+        elf_header->e_ident[0] != 0x7F || 
+        elf_header->e_ident[1] != 'E' || 
+        elf_header->e_ident[2] != 'L' || 
+        elf_header->e_ident[3] != 'F') {
+        printf("ERROR: Not a valid ELF file\n");
+        return -1;
+    }
+    if (elf_header->e_type != ET_EXEC && elf_header->e_type != ET_DYN) {
+        printf("ERROR: Not an executable (ELF type %d)\n", elf_header->e_type);
+        return -1;
+    }
+    if (elf_header->e_phentsize != sizeof(elf64_program_header_t) || elf_header->e_phnum > ELF_MAX_PHDRS) {
+        printf("ERROR: Unsupported program headers (%d of %d bytes)\n", elf_header->e_phnum, elf_header->e_phentsize);
+        return -1;
+    }
+    if (elf_header->e_phoff + (uint64_t)elf_header->e_phnum * sizeof(elf64_program_header_t) > size) {
+        printf("ERROR: Program headers past the end of the file\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Check that every loadable segment lies inside the file and fits its memory size
+static int check_segments(const elf64_program_header_t* ph, int count, uint32_t size) {
+    for (int i = 0; i < count; i++) {
+        if (is_loadable(&ph[i]) &&
+            (ph[i].p_offset + ph[i].p_filesz > size || segment_data_size(&ph[i]) > ph[i].p_memsz)) {
+            printf("ERROR: Segment %d past the end of the file\n", i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Work out where a program's pieces go as linked: entry, segments and, for a
+// PIE, the span of pages it needs and its dynamic section
+static void read_layout(const elf64_header_t* elf_header, const elf64_program_header_t* ph,
+                        imgcache_layout_t* layout) {
+    uint64_t low = UINT64_MAX, high = 0;
+    uint32_t loaded = 0;
     
-    printf("Loading program: %s\n", filename);
+    memset(layout, 0, sizeof(*layout));
+    layout->entry = elf_header->e_entry;
+    for (int i = 0; i < elf_header->e_phnum; i++) {
+        if (ph[i].p_type == PT_DYNAMIC) {
+            layout->dynamic = ph[i].p_vaddr;
+        }
+        if (!is_loadable(&ph[i])) {
+            continue;
+        }
+        if (ph[i].p_vaddr < low) {
+            low = ph[i].p_vaddr;
+        }
+        if (ph[i].p_vaddr + ph[i].p_memsz > high) {
+            high = ph[i].p_vaddr + ph[i].p_memsz;
+        }
+        if (loaded < IMGCACHE_MAX_SEGMENTS) {
+            layout->segments[loaded].vaddr = ph[i].p_vaddr;
+            layout->segments[loaded].filesz = segment_data_size(&ph[i]);
+            layout->segments[loaded].memsz = ph[i].p_memsz;
+        }
+        loaded++;
+    }
+    layout->segment_count = loaded <= IMGCACHE_MAX_SEGMENTS ? loaded : 0;
     
-    // Open the file
-    if (fat12_open(filename, &file) != 0) {
-        printf("ERROR: Failed to open %s\n", filename);
+    if (elf_header->e_type == ET_DYN && loaded > 0) {
+        layout->low = low & ~0xFFFULL;
+        layout->span = (high - layout->low + 4095) & ~0xFFFULL;
+    }
+}
+
+// Find room for a program: a PIE gets pages wherever the allocator has them,
+// anything else goes where it was linked
+// Returns 0 and sets *base (added to every address of the program), or -1
+static int place_program(const imgcache_layout_t* layout, uint64_t* base, placement_t* placement) {
+    placement->addr = 0;
+    placement->pages = 0;
+    *base = 0;
+    if (layout->span == 0) {
         return 0;
     }
-    
-    printf("  File size: %d bytes\n", file.size);
-    
-    // Read the entire ELF file into a temporary buffer (round up to sector boundary)
-    uint32_t alloc_size = (file.size + 511) & ~511;
-    uint8_t* elf_buffer = (uint8_t*)malloc(alloc_size);
-    if (!elf_buffer) {
-        printf("ERROR: Failed to allocate memory for ELF file\n");
+    if (layout->span > 0x40000000) {
+        printf("ERROR: Program too large (%d MB)\n", (uint32_t)(layout->span >> 20));
+        return -1;
+    }
+    placement->pages = (uint32_t)(layout->span / 4096);
+    placement->addr = pmem_alloc_pages(placement->pages);
+    if (!placement->addr) {
+        printf("ERROR: No room for program (%d pages)\n", placement->pages);
+        placement->pages = 0;
+        return -1;
+    }
+    *base = placement->addr - layout->low;
+    return 0;
+}
+
+// Apply one table of relocations of a PIE loaded at 'base'
+// Returns 0 on success, -1 on a relocation the loader can't do
+static int apply_relocations(const imgcache_layout_t* layout, uint64_t base, uint64_t table,
+                             uint64_t size, uint64_t entry_size, uint64_t symtab) {
+    uint64_t end = layout->low + layout->span;
+    if (size == 0) {
         return 0;
     }
+    if (entry_size < sizeof(elf64_rela_t) || table < layout->low || table + size > end) {
+        printf("ERROR: Bad relocation table\n");
+        return -1;
+    }
     
-    int bytes_read = fat12_read(&file, elf_buffer, file.size);
-    if (bytes_read < 0 || (uint32_t)bytes_read != file.size) {
-        printf("ERROR: Failed to read %s (read %d of %d bytes)\n", filename, bytes_read, file.size);
-        free(elf_buffer);
+    for (uint64_t offset = 0; offset + entry_size <= size; offset += entry_size) {
+        const elf64_rela_t* rela = (const elf64_rela_t*)(base + table + offset);
+        uint32_t type = (uint32_t)rela->r_info;
+        uint32_t symbol = (uint32_t)(rela->r_info >> 32);
+        if (type == R_X86_64_NONE) {
+            continue;
+        }
+        if (rela->r_offset < layout->low || rela->r_offset + sizeof(uint64_t) > end) {
+            printf("ERROR: Relocation outside the program (0x%x)\n", (uint32_t)rela->r_offset);
+            return -1;
+        }
+        uint64_t* target = (uint64_t*)(base + rela->r_offset);
+        
+        if (type == R_X86_64_RELATIVE) {
+            *target = base + rela->r_addend;
+            continue;
+        }
+        if (type != R_X86_64_64 && type != R_X86_64_GLOB_DAT && type != R_X86_64_JUMP_SLOT) {
+            printf("ERROR: Unsupported relocation type %d\n", type);
+            return -1;
+        }
+        
+        // Symbol relocations: the program has no shared libraries, so the
+        // symbol has to be its own
+        uint64_t sym_addr = symtab + (uint64_t)symbol * sizeof(elf64_sym_t);
+        if (symtab == 0 || sym_addr < layout->low || sym_addr + sizeof(elf64_sym_t) > end) {
+            printf("ERROR: Bad relocation symbol %d\n", symbol);
+            return -1;
+        }
+        const elf64_sym_t* sym = (const elf64_sym_t*)(base + sym_addr);
+        if (sym->st_shndx == 0) {
+            printf("ERROR: Program needs a shared library (undefined symbol %d)\n", symbol);
+            return -1;
+        }
+        *target = base + sym->st_value + (type == R_X86_64_64 ? rela->r_addend : 0);
+    }
+    return 0;
+}
+
+// Patch a PIE loaded at 'base' for where it is: walks its dynamic section
+// (already in memory) for the RELA and PLT relocation tables
+// Returns 0 on success, -1 on failure
+static int relocate(const imgcache_layout_t* layout, uint64_t base) {
+    if (layout->span == 0 || layout->dynamic == 0) {
         return 0;
     }
+    uint64_t end = layout->low + layout->span;
+    uint64_t rela = 0, rela_size = 0, rela_entry = sizeof(elf64_rela_t);
+    uint64_t plt = 0, plt_size = 0, symtab = 0;
     
-    // Parse ELF header
-    elf64_header_t* elf_header = (elf64_header_t*)elf_buffer;
+    for (uint64_t addr = layout->dynamic; addr + sizeof(elf64_dyn_t) <= end; addr += sizeof(elf64_dyn_t)) {
+        const elf64_dyn_t* dyn = (const elf64_dyn_t*)(base + addr);
+        if (dyn->d_tag == DT_NULL) {
+            break;
+        }
+        switch (dyn->d_tag) {
+            case DT_RELA:     rela = dyn->d_val; break;
+            case DT_RELASZ:   rela_size = dyn->d_val; break;
+            case DT_RELAENT:  rela_entry = dyn->d_val; break;
+            case DT_JMPREL:   plt = dyn->d_val; break;
+            case DT_PLTRELSZ: plt_size = dyn->d_val; break;
+            case DT_SYMTAB:   symtab = dyn->d_val; break;
+        }
+    }
     
-    // Verify ELF magic number
-    if (elf_header->e_ident[0] != 0x7F || 
-        elf_header->e_ident[1] != 'E' || 
-        elf_header->e_ident[2] != 'L' || 
-        elf_header->e_ident[3] != 'F') {
-        printf("ERROR: Not a valid ELF file\n");
-        free(elf_buffer);
+    if (apply_relocations(layout, base, rela, rela_size, rela_entry, symtab) != 0 ||
+        apply_relocations(layout, base, plt, plt_size, sizeof(elf64_rela_t), symtab) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Decompress an LZ4 segment to base + its address
+// Returns 0 on success, -1 if the block is damaged
+static int unpack_segment(const elf64_program_header_t* ph, const uint8_t* packed, uint64_t base, int index) {
+    if (lz4_decompress(packed, (uint32_t)ph->p_filesz, (uint8_t*)(base + ph->p_vaddr), (uint32_t)ph->p_paddr) != (int)ph->p_paddr) {
+        printf("ERROR: Compressed segment %d is damaged\n", index);
+        return -1;
+    }
+    packed_bytes += (uint32_t)ph->p_filesz;
+    unpacked_bytes += (uint32_t)ph->p_paddr;
+    return 0;
+}
+
+// Give back the pages of a program that failed to load
+static void unplace_program(const placement_t* placement) {
+    if (placement->pages > 0) {
+        pmem_free_pages(placement->addr, placement->pages);
+    }
+}
+
+// Relocate a program whose segments are in place and record its pages until
+// it exits
+// Returns entry point address on success, 0 on failure
+static uint64_t finish_load(const imgcache_layout_t* layout, uint64_t base, const placement_t* placement) {
+    if (relocate(layout, base) != 0) {
+        unplace_program(placement);
+        return 0;
+    }
+    if (placement->pages > 0) {
+        printf("  Position-independent: placed at 0x%x (%d pages)\n", placement->addr, placement->pages);
+    }
+    if (resident_depth < LOADER_MAX_DEPTH) {
+        resident[resident_depth] = *placement;
+    }
+    resident_depth++;
+    return base + layout->entry;
+}
+
+// Copy the loadable segments of an ELF image in memory to their addresses
+// Returns entry point address on success, 0 on failure
+static uint64_t load_elf_image(const uint8_t* image, uint32_t size) {
+    const elf64_header_t* elf_header = (const elf64_header_t*)image;
+    if (check_elf_header(elf_header, size) != 0) {
+        return 0;
+    }
+    const elf64_program_header_t* ph = (const elf64_program_header_t*)(image + elf_header->e_phoff);
+    if (check_segments(ph, elf_header->e_phnum, size) != 0) {
         return 0;
     }
     
-    //printf("  Entry point: 0x%x\n", (uint32_t)elf_header->e_entry);
-    //printf("  Program headers: %d\n", elf_header->e_phnum);
+    imgcache_layout_t layout;
+    placement_t placement;
+    uint64_t base;
+    read_layout(elf_header, ph, &layout);
+    if (place_program(&layout, &base, &placement) != 0) {
+        return 0;
+    }
     
-    // Load each PT_LOAD segment at its virtual address
-    elf64_program_header_t* ph = (elf64_program_header_t*)(elf_buffer + elf_header->e_phoff);
+    // Load each segment at its virtual address, zeroing the BSS after it
     for (int i = 0; i < elf_header->e_phnum; i++) {
-        if (ph[i].p_type == PT_LOAD) {
-            //printf("  Loading segment %d: vaddr=0x%x size=%d\n", 
-            //       i, (uint32_t)ph[i].p_vaddr, (uint32_t)ph[i].p_filesz);
-            
-            // Copy segment from ELF file to its virtual address
-            uint8_t* dest = (uint8_t*)ph[i].p_vaddr;
-            uint8_t* src = elf_buffer + ph[i].p_offset;
-            
-            for (uint64_t j = 0; j < ph[i].p_filesz; j++) {
-                dest[j] = src[j];
+        if (!is_loadable(&ph[i])) {
+            continue;
+        }
+        uint8_t* dest = (uint8_t*)(base + ph[i].p_vaddr);
+        if (ph[i].p_type == PT_SANTOS_LZ4) {
+            if (unpack_segment(&ph[i], image + ph[i].p_offset, base, i) != 0) {
+                unplace_program(&placement);
+                return 0;
+            }
+        } else {
+            memcpy(dest, image + ph[i].p_offset, ph[i].p_filesz);
+        }
+        uint64_t data_size = segment_data_size(&ph[i]);
+        memset(dest + data_size, 0, ph[i].p_memsz - data_size);
+    }
+    
+    return finish_load(&layout, base, &placement);
+}
+
+// Read 'size' bytes at 'offset' of an open file
+// Returns 0 on success, -1 on a read error or short read
+static int read_at(vfs_file_t* file, uint64_t offset, void* buffer, uint64_t size) {
+    file->position = (uint32_t)offset;
+    int bytes_read = vfs_read(file, (uint8_t*)buffer, (uint32_t)size);
+    return bytes_read >= 0 && (uint64_t)bytes_read == size ? 0 : -1;
+}
+
+// Load an ELF file by reading its headers, then each segment's file range
+// straight to its address: nothing is staged on the heap, so program size is
+// bounded by the memory at the load address, not by free heap (compressed
+// segments are read into pages of their own and decompressed into place)
+// layout/base/placement: filled in with what was loaded where
+// Returns 0 on success (segments in place, not yet relocated), -1 on failure
+static int load_elf_file(vfs_file_t* file, imgcache_layout_t* layout, uint64_t* base, placement_t* placement) {
+    uint32_t file_size = file->size;
+    elf64_header_t elf_header;
+    elf64_program_header_t ph[ELF_MAX_PHDRS];
+    
+    if (read_at(file, 0, &elf_header, file_size < sizeof(elf_header) ? file_size : sizeof(elf_header)) != 0 ||
+        check_elf_header(&elf_header, file_size) != 0) {
+        return -1;
+    }
+    if (read_at(file, elf_header.e_phoff, ph, elf_header.e_phnum * sizeof(elf64_program_header_t)) != 0) {
+        printf("ERROR: Failed to read program headers\n");
+        return -1;
+    }
+    if (check_segments(ph, elf_header.e_phnum, file_size) != 0) {
+        return -1;
+    }
+    read_layout(&elf_header, ph, layout);
+    if (place_program(layout, base, placement) != 0) {
+        return -1;
+    }
+    
+    for (int i = 0; i < elf_header.e_phnum; i++) {
+        if (!is_loadable(&ph[i])) {
+            continue;
+        }
+        uint8_t* dest = (uint8_t*)(*base + ph[i].p_vaddr);
+        int result = 0;
+        if (ph[i].p_type == PT_SANTOS_LZ4) {
+            uint32_t pages = (uint32_t)((ph[i].p_filesz + 4095) / 4096);
+            uint8_t* packed = (uint8_t*)(uintptr_t)pmem_alloc_pages(pages);
+            if (!packed) {
+                printf("ERROR: No memory for compressed segment %d\n", i);
+                result = -1;
+            } else {
+                result = read_at(file, ph[i].p_offset, packed, ph[i].p_filesz);
+                if (result != 0) {
+                    printf("ERROR: Failed to read segment %d\n", i);
+                } else {
+                    result = unpack_segment(&ph[i], packed, *base, i);
+                }
+                pmem_free_pages((uint32_t)(uintptr_t)packed, pages);
             }
-            
-            // Zero out any remaining memory (p_memsz > p_filesz for BSS)
-            for (uint64_t j = ph[i].p_filesz; j < ph[i].p_memsz; j++) {
-                dest[j] = 0;
+        } else if (ph[i].p_filesz > 0 && read_at(file, ph[i].p_offset, dest, ph[i].p_filesz) != 0) {
+            printf("ERROR: Failed to read segment %d\n", i);
+            result = -1;
+        }
+        if (result != 0) {
+            unplace_program(placement);
+            return -1;
+        }
+        uint64_t data_size = segment_data_size(&ph[i]);
+        memset(dest + data_size, 0, ph[i].p_memsz - data_size);
+    }
+    
+    return 0;
+}
+
+// Load a program from the boot archive if it has a copy, otherwise from disk
+// Returns entry point address on success, 0 on failure
+static uint64_t load_from_archive_or_disk(const char* filename) {
+    // Programs packed into the boot archive are already in memory
+    const uint8_t* image;
+    uint32_t image_size;
+    if (initrd_find(filename, &image, &image_size) == 0) {
+        printf("  File size: %d bytes (boot archive)\n", image_size);
+        return load_elf_image(image, image_size);
+    }
+    
+    // Open the file
+    vfs_file_t* file = vfs_open(filename, O_RDONLY);
+    if (!file || file->vnode->is_directory) {
+        printf("ERROR: Failed to open %s\n", filename);
+        vfs_close(file);
+        return 0;
+    }
+    
+    printf("  File size: %d bytes\n", file->size);
+    
+    imgcache_layout_t layout;
+    placement_t placement;
+    uint64_t base;
+    uint64_t entry_point = 0;
+    
+    // Launched before: copy the resident image instead of reading the disk
+    // (placing a PIE may evict its image, in which case it is read after all)
+    const imgcache_layout_t* cached = imgcache_layout(file->vnode, file->size);
+    if (cached) {
+        layout = *cached;
+        if (place_program(&layout, &base, &placement) == 0) {
+            if (imgcache_load(file->vnode, file->size, base) == 0) {
+                printf("  Image cache: hit\n");
+                vfs_close(file);
+                return finish_load(&layout, base, &placement);
             }
+            unplace_program(&placement);
         }
     }
     
-    uint64_t entry_point = elf_header->e_entry;
-    free(elf_buffer);
+    if (load_elf_file(file, &layout, &base, &placement) == 0) {
+        printf("  Image cache: miss\n");
+        imgcache_store(file->vnode, file->size, &layout, base);  // Cached unrelocated
+        entry_point = finish_load(&layout, base, &placement);
+    }
+    vfs_close(file);
     
     //printf("  Program loaded successfully!\n");
     return entry_point;
 }
 
+// Load a program into memory, reporting how long it took
+// Returns entry point address on success, 0 on failure
+uint64_t load_program(const char* filename, void* load_addr) {
+    printf("Loading program: %s\n", filename);
+    packed_bytes = 0;
+    unpacked_bytes = 0;
+    uint64_t start_us = timer_get_us();
+    
+    uint64_t entry_point = load_from_archive_or_disk(filename);
+    if (entry_point != 0) {
+        if (packed_bytes > 0) {
+            printf("  LZ4 segments: %d bytes -> %d bytes\n", packed_bytes, unpacked_bytes);
+        }
+        printf("  Loaded in %d us\n", (uint32_t)(timer_get_us() - start_us));
+    }
+    return entry_point;
+}
+
+// Free the pages of the most recently launched program, which has exited
+void unload_program(void) {
+    if (resident_depth == 0) {
+        return;
+    }
+    resident_depth--;
+    if (resident_depth < LOADER_MAX_DEPTH) {
+        unplace_program(&resident[resident_depth]);
+        resident[resident_depth].pages = 0;
+    }
+}
+
 // Execute a loaded program (only used by kernel to launch initial program like shell)
 void execute_program(uint64_t entry_point, const char* program_name, int kernel_mode) {
     if (program_name) {
@@ -0,0 +1,90 @@
+#include "../include/lz4.h"
+
+// Unaligned 8-byte word (x86 handles the misalignment)
+typedef uint64_t __attribute__((may_alias, aligned(1))) lz4_word_t;
+
+// Copy in 8-byte words; may read and write up to 7 bytes past 'length', so
+// callers check there is that much room in both buffers
+static void wild_copy(uint8_t* dst, const uint8_t* src, uint32_t length) {
+    uint8_t* end = dst + length;
+    do {
+        *(lz4_word_t*)dst = *(const lz4_word_t*)src;
+        dst += 8;
+        src += 8;
+    } while (dst < end);
+}
+
+// Read the extra length bytes that follow a field of 15
+// Returns: 0, or -1 if the block ends inside them
+static int read_length(const uint8_t** ip, const uint8_t* iend, uint32_t* length) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) {
+            return -1;
+        }
+        b = *(*ip)++;
+        *length += b;
+    } while (b == 255);
+    return 0;
+}
+
+// Decompress one block
+int lz4_decompress(const uint8_t* src, uint32_t src_size, uint8_t* dst, uint32_t dst_size) {
+    const uint8_t* ip = src;
+    const uint8_t* iend = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* oend = dst + dst_size;
+    
+    while (ip < iend) {
+        uint32_t token = *ip++;
+        
+        // Literals
+        uint32_t length = token >> 4;
+        if (length == 15 && read_length(&ip, iend, &length) != 0) {
+            return -1;
+        }
+        if (length > (uint32_t)(iend - ip) || length > (uint32_t)(oend - op)) {
+            return -1;
+        }
+        if ((uint32_t)(iend - ip) >= length + 8 && (uint32_t)(oend - op) >= length + 8) {
+            wild_copy(op, ip, length);
+        } else {
+            for (uint32_t i = 0; i < length; i++) {
+                op[i] = ip[i];
+            }
+        }
+        op += length;
+        ip += length;
+        if (ip == iend) {
+            break;  // The last sequence is literals only
+        }
+        
+        // Match
+        if (iend - ip < 2) {
+            return -1;
+        }
+        uint32_t offset = ip[0] | (uint32_t)ip[1] << 8;
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) {
+            return -1;
+        }
+        length = token & 15;
+        if (length == 15 && read_length(&ip, iend, &length) != 0) {
+            return -1;
+        }
+        length += 4;
+        if (length > (uint32_t)(oend - op)) {
+            return -1;
+        }
+        const uint8_t* match = op - offset;
+        if (offset >= 8 && (uint32_t)(oend - op) >= length + 8) {
+            wild_copy(op, match, length);  // Each word reads output already written
+        } else {
+            for (uint32_t i = 0; i < length; i++) {
+                op[i] = match[i];  // Overlapping: repeats the last 'offset' bytes
+            }
+        }
+        op += length;
+    }
+    return (int)(op - dst);
+}
@@ -8,6 +8,7 @@
 
 static physical_memory_t pmem;
 static e820_map_t e820_map;
+static uint32_t (*reclaim_hook)(uint32_t pages);  // Gives cached pages back under memory pressure
 
 // Parse E820 memory map from bootloader
 const e820_map_t* e820_parse(void) {
@@ -126,6 +127,12 @@ static uint32_t find_free_page(uint32_t start) {
 
 // Initialize physical memory manager
 int pmem_init(uint32_t memory_start, uint32_t memory_size) {
+    // Pages are numbered from the (page-aligned) start of managed memory, so
+    // nothing below it (page tables, kernel, stack, DMA buffers) is handed out
+    uint32_t aligned_start = (memory_start + 4095) & ~0xFFFu;
+    memory_size -= aligned_start - memory_start;
+    pmem.base = aligned_start;
+    
     // Calculate number of pages (4KB each)
     pmem.total_pages = memory_size / 4096;
     
@@ -133,7 +140,7 @@ int pmem_init(uint32_t memory_start, uint32_t memory_size) {
     pmem.bitmap_size = (pmem.total_pages + 7) / 8;
     
     // Bitmap is stored at the beginning of available memory
-    pmem.bitmap = (uint8_t*)(uintptr_t)memory_start;
+    pmem.bitmap = (uint8_t*)(uintptr_t)pmem.base;
     
     // Clear bitmap (all pages free)
     for (uint32_t i = 0; i < pmem.bitmap_size; i++) {
@@ -159,6 +166,7 @@ int pmem_init(uint32_t memory_start, uint32_t memory_size) {
     uint32_t free_mb_frac = (free_kb % 1024) * 10 / 1024;
     
     printf("Physical memory manager initialized:\n");
+    printf("  Base: 0x%x\n", pmem.base);
     printf("  Total pages: %d (%d.%d MB)\n", pmem.total_pages, total_mb_int, total_mb_frac);
     printf("  Free pages: %d (%d.%d MB)\n", pmem.free_pages, free_mb_int, free_mb_frac);
     printf("  Bitmap size: %d bytes\n\n", pmem.bitmap_size);
@@ -166,51 +174,44 @@ int pmem_init(uint32_t memory_start, uint32_t memory_size) {
     return 0;
 }
 
-// Allocate a single physical page
-uint32_t pmem_alloc_page(void) {
-    if (pmem.free_pages == 0) {
-        printf("ERROR: Out of physical memory!\n");
-        return 0;
-    }
-    
+// Find 'count' contiguous free pages
+// Returns: first page, or 0xFFFFFFFF if no run is long enough
+static uint32_t find_free_run(uint32_t count) {
     uint32_t page = find_free_page(0);
-    if (page == 0xFFFFFFFF) {
-        printf("ERROR: No free pages found!\n");
-        return 0;
+    while (page != 0xFFFFFFFF) {
+        uint32_t length = 1;
+        while (length < count && page + length < pmem.total_pages && !bitmap_is_set(page + length)) {
+            length++;
+        }
+        if (length == count) {
+            return page;
+        }
+        page = find_free_page(page + length);
     }
-    
-    bitmap_set(page);
-    pmem.free_pages--;
-    
-    return (page * 4096);
+    return 0xFFFFFFFF;
 }
 
-// Allocate multiple contiguous physical pages
+// Allocate a single physical page
+uint32_t pmem_alloc_page(void) {
+    return pmem_alloc_pages(1);
+}
+
+// Allocate multiple contiguous physical pages; when there is no room, caches
+// registered with pmem_set_reclaim are asked for pages once before failing
 uint32_t pmem_alloc_pages(uint32_t count) {
     if (count == 0) {
         return 0;
     }
     
-    if (pmem.free_pages < count) {
-        printf("ERROR: Not enough free pages! Need %d, have %d\n", count, pmem.free_pages);
-        return 0;
+    uint32_t start_page = pmem.free_pages >= count ? find_free_run(count) : 0xFFFFFFFF;
+    if (start_page == 0xFFFFFFFF && reclaim_hook && reclaim_hook(count) > 0) {
+        start_page = pmem.free_pages >= count ? find_free_run(count) : 0xFFFFFFFF;
     }
-    
-    // Find first free page
-    uint32_t start_page = find_free_page(0);
     if (start_page == 0xFFFFFFFF) {
-        printf("ERROR: No free pages found!\n");
+        printf("ERROR: Not enough free pages! Need %d contiguous, have %d free\n", count, pmem.free_pages);
         return 0;
     }
     
-    // Check if we have 'count' contiguous free pages
-    for (uint32_t i = 0; i < count; i++) {
-        if (bitmap_is_set(start_page + i)) {
-            // Not contiguous, try again from next page
-            return pmem_alloc_pages(count);
-        }
-    }
-    
     // Mark all pages as used
     for (uint32_t i = 0; i < count; i++) {
         bitmap_set(start_page + i);
@@ -218,7 +219,12 @@ uint32_t pmem_alloc_pages(uint32_t count) {
     
     pmem.free_pages -= count;
     
-    return (start_page * 4096);
+    return pmem.base + start_page * 4096;
+}
+
+// Register the function the allocator calls when it runs out of pages
+void pmem_set_reclaim(uint32_t (*reclaim)(uint32_t pages)) {
+    reclaim_hook = reclaim;
 }
 
 // Free a single physical page
@@ -228,9 +234,9 @@ void pmem_free_page(uint32_t addr) {
         return;
     }
     
-    uint32_t page = addr / 4096;
+    uint32_t page = (addr - pmem.base) / 4096;
     
-    if (page >= pmem.total_pages) {
+    if (addr < pmem.base || page >= pmem.total_pages) {
         printf("ERROR: Invalid page address: 0x%x\n", addr);
         return;
     }
@@ -255,6 +261,28 @@ void pmem_free_pages(uint32_t addr, uint32_t count) {
     }
 }
 
+// Mark pages that are already in use (handed over by the bootloader) as allocated
+int pmem_reserve_pages(uint32_t addr, uint32_t count) {
+    if (addr < pmem.base) {
+        return -1;
+    }
+    uint32_t first = (addr - pmem.base) / 4096;
+    if (first + count > pmem.total_pages) {
+        return -1;
+    }
+    
+    for (uint32_t i = 0; i < count; i++) {
+        if (bitmap_is_set(first + i)) {
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        bitmap_set(first + i);
+    }
+    pmem.free_pages -= count;
+    return 0;
+}
+
 // Get number of free pages
 uint32_t pmem_get_free_pages(void) {
     return pmem.free_pages;
@@ -0,0 +1,587 @@
+#include "../include/nvme.h"
+#include "../include/pci.h"
+#include "../include/memory.h"
+#include "../include/vmm.h"
+#include "../include/blkdev.h"
+#include "../include/stdio.h"
+
+// PCI class code for NVM Express controllers
+#define NVME_CLASS      0x01
+#define NVME_SUBCLASS   0x08
+#define NVME_PROG_IF    0x02
+
+// Controller registers (offsets into BAR0 MMIO)
+#define NVME_REG_CAP    0x00  // Capabilities (64-bit)
+#define NVME_REG_VS     0x08  // Version
+#define NVME_REG_INTMS  0x0C  // Interrupt mask set
+#define NVME_REG_CC     0x14  // Controller configuration
+#define NVME_REG_CSTS   0x1C  // Controller status
+#define NVME_REG_AQA    0x24  // Admin queue attributes
+#define NVME_REG_ASQ    0x28  // Admin submission queue base (64-bit)
+#define NVME_REG_ACQ    0x30  // Admin completion queue base (64-bit)
+#define NVME_REG_DOORBELL 0x1000
+
+// CC / CSTS bits
+#define NVME_CC_EN          (1 << 0)
+#define NVME_CC_IOSQES      (6 << 16)  // 64-byte submission entries
+#define NVME_CC_IOCQES      (4 << 20)  // 16-byte completion entries
+#define NVME_CSTS_RDY       (1 << 0)
+#define NVME_CSTS_CFS       (1 << 1)
+
+// Admin opcodes
+#define NVME_ADMIN_CREATE_SQ    0x01
+#define NVME_ADMIN_CREATE_CQ    0x05
+#define NVME_ADMIN_IDENTIFY     0x06
+#define NVME_ADMIN_SET_FEATURES 0x09
+#define NVME_FEAT_NUM_QUEUES    0x07
+
+// NVM opcodes
+#define NVME_CMD_FLUSH  0x00
+#define NVME_CMD_WRITE  0x01
+#define NVME_CMD_READ   0x02
+
+// Queue sizing
+#define NVME_ADMIN_DEPTH        16
+#define NVME_IO_DEPTH           64   // Entries per I/O queue (capped by CAP.MQES)
+#define NVME_SLOTS_PER_QUEUE    16   // Commands in flight per I/O queue
+#define NVME_MAX_REQ_SECTORS    256  // 128KB per command (capped by MDTS)
+#define NVME_PRP_LIST_ENTRIES   64   // 512-byte PRP list per slot, 8 per page
+
+#define NVME_PAGE_SIZE  4096
+
+// Submission queue entry (naturally aligned, 64 bytes)
+typedef struct {
+    uint32_t cdw0;      // Opcode [7:0], command identifier [31:16]
+    uint32_t nsid;
+    uint64_t reserved;
+    uint64_t mptr;
+    uint64_t prp1;
+    uint64_t prp2;
+    uint32_t cdw10;
+    uint32_t cdw11;
+    uint32_t cdw12;
+    uint32_t cdw13;
+    uint32_t cdw14;
+    uint32_t cdw15;
+} nvme_sqe_t;
+
+// Completion queue entry (16 bytes)
+typedef struct {
+    uint32_t dw0;       // Command specific result
+    uint32_t dw1;
+    uint16_t sq_head;
+    uint16_t sq_id;
+    uint16_t cid;
+    uint16_t status;    // Phase tag [0], status field [15:1]
+} nvme_cqe_t;
+
+// One submission/completion queue pair
+typedef struct {
+    uint16_t qid;
+    uint16_t depth;
+    volatile nvme_sqe_t* sq;
+    volatile nvme_cqe_t* cq;
+    volatile uint32_t* sq_doorbell;
+    volatile uint32_t* cq_doorbell;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    uint16_t phase;
+    uint16_t pending;           // Submitted, not yet completed
+    uint16_t queued;            // Written to the SQ since the last doorbell
+    uint64_t* prp_lists;        // NVME_SLOTS_PER_QUEUE lists (I/O queues only)
+} nvme_queue_t;
+
+// Controller state
+static pci_device_t pci_dev;
+static volatile uint8_t* regs = NULL;
+static uint32_t doorbell_stride = 4;
+static uint32_t max_req_sectors = NVME_MAX_REQ_SECTORS;
+static nvme_queue_t admin_queue;
+static nvme_queue_t io_queues[NVME_IO_QUEUES];
+static uint32_t io_queue_count = 0;
+static uint32_t next_queue = 0;     // Round-robin start for the next batch
+static uint8_t* identify_buffer = NULL;
+static uint8_t* bounce_buffer = NULL;
+
+// Keep the compiler (and CPU) from reordering queue memory around doorbell writes
+#define nvme_barrier() __asm__ volatile("mfence" : : : "memory")
+
+static inline uint32_t nvme_read32(uint32_t offset) {
+    return *(volatile uint32_t*)(regs + offset);
+}
+
+static inline void nvme_write32(uint32_t offset, uint32_t value) {
+    *(volatile uint32_t*)(regs + offset) = value;
+}
+
+static inline uint64_t nvme_read64(uint32_t offset) {
+    return (uint64_t)nvme_read32(offset) | ((uint64_t)nvme_read32(offset + 4) << 32);
+}
+
+static inline void nvme_write64(uint32_t offset, uint64_t value) {
+    nvme_write32(offset, (uint32_t)value);
+    nvme_write32(offset + 4, (uint32_t)(value >> 32));
+}
+
+static void* nvme_alloc_zeroed(uint32_t pages) {
+    uint32_t addr = pmem_alloc_pages(pages);
+    if (addr == 0) return NULL;
+    uint8_t* p = (uint8_t*)(uintptr_t)addr;
+    for (uint32_t i = 0; i < pages * NVME_PAGE_SIZE; i++) p[i] = 0;
+    return p;
+}
+
+// Identity-map register pages uncached, skipping any that boot already covers
+static int nvme_map_registers(uint64_t base, uint32_t pages) {
+    for (uint32_t i = 0; i < pages; i++) {
+        uint64_t addr = base + (uint64_t)i * NVME_PAGE_SIZE;
+        if (vmm_get_physical(addr) != addr &&
+            vmm_map_page(addr, addr, PAGE_WRITE | PAGE_WRITE_THROUGH | PAGE_CACHE_DISABLE) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Allocate the rings for a queue pair and locate its doorbells
+static int nvme_queue_alloc(nvme_queue_t* q, uint16_t qid, uint16_t depth) {
+    uint32_t sq_pages = (depth * sizeof(nvme_sqe_t) + NVME_PAGE_SIZE - 1) / NVME_PAGE_SIZE;
+    uint32_t cq_pages = (depth * sizeof(nvme_cqe_t) + NVME_PAGE_SIZE - 1) / NVME_PAGE_SIZE;
+
+    q->qid = qid;
+    q->depth = depth;
+    q->sq = nvme_alloc_zeroed(sq_pages);
+    q->cq = nvme_alloc_zeroed(cq_pages);
+    if (!q->sq || !q->cq) return -1;
+
+    q->sq_doorbell = (volatile uint32_t*)(regs + NVME_REG_DOORBELL + (2 * qid) * doorbell_stride);
+    q->cq_doorbell = (volatile uint32_t*)(regs + NVME_REG_DOORBELL + (2 * qid + 1) * doorbell_stride);
+    q->sq_tail = 0;
+    q->cq_head = 0;
+    q->phase = 1;
+    q->pending = 0;
+    q->queued = 0;
+    q->prp_lists = NULL;
+    return 0;
+}
+
+// Copy a command into the next submission slot (doorbell is rung separately)
+static void nvme_queue_push(nvme_queue_t* q, const nvme_sqe_t* cmd) {
+    volatile uint32_t* dst = (volatile uint32_t*)&q->sq[q->sq_tail];
+    const uint32_t* src = (const uint32_t*)cmd;
+    for (uint32_t i = 0; i < sizeof(nvme_sqe_t) / 4; i++) dst[i] = src[i];
+
+    q->sq_tail = (uint16_t)((q->sq_tail + 1) % q->depth);
+    q->pending++;
+    q->queued++;
+}
+
+// Publish every queued command with a single tail doorbell write
+static void nvme_queue_ring(nvme_queue_t* q) {
+    if (q->queued == 0) return;
+    nvme_barrier();
+    *q->sq_doorbell = q->sq_tail;
+    q->queued = 0;
+}
+
+// Consume all posted completions, then acknowledge them with one head doorbell write
+// result: receives dw0 of the last completion (may be NULL)
+// Returns: number of completions consumed, or -1 if any completed with an error
+static int nvme_queue_reap(nvme_queue_t* q, uint32_t* result) {
+    int reaped = 0;
+    int failed = 0;
+
+    for (;;) {
+        nvme_barrier();
+        volatile nvme_cqe_t* cqe = &q->cq[q->cq_head];
+        uint16_t status = cqe->status;
+        if ((status & 1) != q->phase) break;
+
+        if (status >> 1) {
+            printf("NVMe: queue %d command %d failed (status %x)\n", q->qid, cqe->cid, status >> 1);
+            failed = 1;
+        }
+        if (result) *result = cqe->dw0;
+
+        q->cq_head++;
+        if (q->cq_head == q->depth) {
+            q->cq_head = 0;
+            q->phase ^= 1;
+        }
+        q->pending--;
+        reaped++;
+    }
+
+    if (reaped > 0) {
+        *q->cq_doorbell = q->cq_head;
+    }
+    return failed ? -1 : reaped;
+}
+
+// Poll until the given queues have no commands outstanding
+// Spins briefly first (completions usually land within microseconds), then
+// sleeps on the 1ms timer between polls
+static int nvme_wait_queues(nvme_queue_t* queues, uint32_t count, uint32_t* result) {
+    int failed = 0;
+    uint32_t spins = 0;
+
+    for (uint32_t timeout = 10000; timeout > 0; ) {
+        uint32_t outstanding = 0;
+        for (uint32_t i = 0; i < count; i++) {
+            if (queues[i].pending == 0) continue;
+            if (nvme_queue_reap(&queues[i], result) < 0) failed = 1;
+            outstanding += queues[i].pending;
+        }
+        if (outstanding == 0) {
+            return failed ? -1 : 0;
+        }
+
+        if (++spins < 2000) {
+            __asm__ volatile("pause");
+        } else {
+            __asm__ volatile("sti; hlt");  // Timer tick wakes us
+            timeout--;
+        }
+    }
+    printf("NVMe: command timeout\n");
+    return -1;
+}
+
+// Run one admin command synchronously
+// Returns: 0 on success, -1 on error
+static int nvme_admin(nvme_sqe_t* cmd, uint32_t* result) {
+    cmd->cdw0 = (cmd->cdw0 & 0xFF) | ((uint32_t)admin_queue.sq_tail << 16);
+    nvme_queue_push(&admin_queue, cmd);
+    nvme_queue_ring(&admin_queue);
+    return nvme_wait_queues(&admin_queue, 1, result);
+}
+
+static int nvme_identify(uint32_t cns, uint32_t nsid) {
+    nvme_sqe_t cmd = {0};
+    cmd.cdw0 = NVME_ADMIN_IDENTIFY;
+    cmd.nsid = nsid;
+    cmd.prp1 = (uint64_t)(uintptr_t)identify_buffer;
+    cmd.cdw10 = cns;
+    return nvme_admin(&cmd, NULL);
+}
+
+// Fill PRP1/PRP2 for a transfer; uses the slot's PRP list when it spans more than two pages
+static void nvme_build_prps(nvme_sqe_t* cmd, uint64_t* prp_list, uint8_t* buffer, uint32_t bytes) {
+    uint64_t addr = (uint64_t)(uintptr_t)buffer;
+    uint32_t first = NVME_PAGE_SIZE - (uint32_t)(addr & (NVME_PAGE_SIZE - 1));
+
+    cmd->prp1 = addr;
+    cmd->prp2 = 0;
+    if (bytes <= first) return;
+
+    uint64_t next = (addr + first) & ~(uint64_t)(NVME_PAGE_SIZE - 1);
+    uint32_t remaining = bytes - first;
+    if (remaining <= NVME_PAGE_SIZE) {
+        cmd->prp2 = next;
+        return;
+    }
+
+    uint32_t n = 0;
+    while (remaining > 0) {
+        prp_list[n++] = next;
+        next += NVME_PAGE_SIZE;
+        remaining = remaining > NVME_PAGE_SIZE ? remaining - NVME_PAGE_SIZE : 0;
+    }
+    cmd->prp2 = (uint64_t)(uintptr_t)prp_list;
+}
+
+// Spread [lba, lba + count) across the I/O queues, ring each queue once and wait
+// Returns: number of sectors transferred, or -1 on error
+static int nvme_batch(uint8_t opcode, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    uint32_t done = 0;
+    uint32_t slot[NVME_IO_QUEUES] = {0};
+    uint32_t full = 0;
+    uint32_t qi = next_queue;
+
+    while (done < count && full < io_queue_count) {
+        nvme_queue_t* q = &io_queues[qi];
+        if (slot[qi] >= NVME_SLOTS_PER_QUEUE || slot[qi] >= (uint32_t)(q->depth - 1)) {
+            full++;
+        } else {
+            uint32_t n = count - done;
+            if (n > max_req_sectors) n = max_req_sectors;
+
+            nvme_sqe_t cmd = {0};
+            cmd.cdw0 = opcode | (slot[qi] << 16);
+            cmd.nsid = 1;
+            nvme_build_prps(&cmd, q->prp_lists + slot[qi] * NVME_PRP_LIST_ENTRIES,
+                            buffer + done * 512, n * 512);
+            cmd.cdw10 = lba + done;       // Starting LBA (low)
+            cmd.cdw11 = 0;                // Starting LBA (high)
+            cmd.cdw12 = n - 1;            // Number of blocks, 0-based
+            nvme_queue_push(q, &cmd);
+
+            slot[qi]++;
+            done += n;
+        }
+        qi = (qi + 1) % io_queue_count;
+    }
+    next_queue = qi;
+
+    // One doorbell write per queue for the whole batch
+    for (uint32_t i = 0; i < io_queue_count; i++) {
+        nvme_queue_ring(&io_queues[i]);
+    }
+
+    if (nvme_wait_queues(io_queues, io_queue_count, NULL) != 0) {
+        return -1;
+    }
+    return (int)done;
+}
+
+static int nvme_transfer(uint8_t opcode, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    if (regs == NULL || io_queue_count == 0 || count == 0) return -1;
+
+    // PRP entries must be dword aligned; stage odd buffers through a bounce page
+    if ((uintptr_t)buffer & 3) {
+        while (count > 0) {
+            uint32_t n = count > 8 ? 8 : count;
+            if (opcode == NVME_CMD_WRITE) {
+                for (uint32_t i = 0; i < n * 512; i++) bounce_buffer[i] = buffer[i];
+            }
+            if (nvme_batch(opcode, lba, n, bounce_buffer) != (int)n) return -1;
+            if (opcode == NVME_CMD_READ) {
+                for (uint32_t i = 0; i < n * 512; i++) buffer[i] = bounce_buffer[i];
+            }
+            lba += n;
+            count -= n;
+            buffer += n * 512;
+        }
+        return 0;
+    }
+
+    while (count > 0) {
+        int n = nvme_batch(opcode, lba, count, buffer);
+        if (n <= 0) return -1;
+        lba += n;
+        count -= n;
+        buffer += n * 512;
+    }
+    return 0;
+}
+
+int nvme_read_sectors(uint32_t lba, uint32_t count, uint8_t* buffer) {
+    return nvme_transfer(NVME_CMD_READ, lba, count, buffer);
+}
+
+int nvme_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    return nvme_transfer(NVME_CMD_WRITE, lba, count, (uint8_t*)buffer);
+}
+
+int nvme_flush(void) {
+    if (regs == NULL || io_queue_count == 0) return -1;
+
+    nvme_sqe_t cmd = {0};
+    cmd.cdw0 = NVME_CMD_FLUSH;
+    cmd.nsid = 1;
+    nvme_queue_push(&io_queues[0], &cmd);
+    nvme_queue_ring(&io_queues[0]);
+    return nvme_wait_queues(io_queues, 1, NULL);
+}
+
+// Block device adapters
+static int nvme_blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    (void)dev;
+    return nvme_read_sectors(lba, count, buffer);
+}
+
+static int nvme_blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    (void)dev;
+    return nvme_write_sectors(lba, count, buffer);
+}
+
+static int nvme_blk_flush(blkdev_t* dev) {
+    (void)dev;
+    return nvme_flush();
+}
+
+static blkdev_t nvme_blkdev = {
+    .name = "nvme0",
+    .read = nvme_blk_read,
+    .write = nvme_blk_write,
+    .flush = nvme_blk_flush,
+};
+
+// Detect an NVMe controller on the PCI bus
+int nvme_detect(void) {
+    return pci_find_class(NVME_CLASS, NVME_SUBCLASS, NVME_PROG_IF, &pci_dev) == 0;
+}
+
+// Wait for CSTS.RDY to reach the given value (timeout in 500ms units from CAP.TO)
+static int nvme_wait_ready(uint32_t ready, uint32_t timeout_units) {
+    for (uint32_t ms = (timeout_units + 1) * 500; ms > 0; ms--) {
+        uint32_t csts = nvme_read32(NVME_REG_CSTS);
+        if (csts & NVME_CSTS_CFS) return -1;
+        if ((csts & NVME_CSTS_RDY) == ready) return 0;
+        __asm__ volatile("sti; hlt");
+    }
+    return -1;
+}
+
+// Copy an identify string field, trimming trailing spaces
+static void nvme_copy_string(char* dst, const uint8_t* src, uint32_t len) {
+    uint32_t end = len;
+    while (end > 0 && (src[end - 1] == ' ' || src[end - 1] == 0)) end--;
+    for (uint32_t i = 0; i < end; i++) dst[i] = (char)src[i];
+    dst[end] = '\0';
+}
+
+// Create I/O completion/submission queue pairs 1..count
+static int nvme_create_io_queues(uint32_t count, uint16_t depth) {
+    for (uint32_t i = 0; i < count; i++) {
+        nvme_queue_t* q = &io_queues[i];
+        uint16_t qid = (uint16_t)(i + 1);
+        if (nvme_queue_alloc(q, qid, depth) != 0) return -1;
+
+        uint32_t list_pages = NVME_SLOTS_PER_QUEUE * NVME_PRP_LIST_ENTRIES * 8 / NVME_PAGE_SIZE;
+        q->prp_lists = nvme_alloc_zeroed(list_pages);
+        if (!q->prp_lists) return -1;
+
+        // Completion queue first: physically contiguous, polled (no interrupt vector)
+        nvme_sqe_t cmd = {0};
+        cmd.cdw0 = NVME_ADMIN_CREATE_CQ;
+        cmd.prp1 = (uint64_t)(uintptr_t)q->cq;
+        cmd.cdw10 = ((uint32_t)(depth - 1) << 16) | qid;
+        cmd.cdw11 = 1;
+        if (nvme_admin(&cmd, NULL) != 0) return -1;
+
+        nvme_sqe_t sq_cmd = {0};
+        sq_cmd.cdw0 = NVME_ADMIN_CREATE_SQ;
+        sq_cmd.prp1 = (uint64_t)(uintptr_t)q->sq;
+        sq_cmd.cdw10 = ((uint32_t)(depth - 1) << 16) | qid;
+        sq_cmd.cdw11 = ((uint32_t)qid << 16) | 1;  // Bound to CQ qid, contiguous
+        if (nvme_admin(&sq_cmd, NULL) != 0) return -1;
+
+        io_queue_count = i + 1;
+    }
+    return 0;
+}
+
+// Initialize the controller
+int nvme_init(void) {
+    printf("Initializing NVMe...\n");
+
+    int is_io = 0;
+    uint64_t bar0 = pci_read_bar(pci_dev, 0, &is_io);
+    if (is_io || bar0 == 0) {
+        printf("NVMe: memory BAR not available\n");
+        return -1;
+    }
+
+    // Map the register page first: CAP says how far apart the doorbells are
+    if (nvme_map_registers(bar0, 1) != 0) {
+        printf("NVMe: failed to map registers\n");
+        return -1;
+    }
+    regs = (volatile uint8_t*)(uintptr_t)bar0;
+    pci_enable_device(pci_dev);
+
+    uint64_t cap = nvme_read64(NVME_REG_CAP);
+    uint32_t mqes = (uint32_t)(cap & 0xFFFF) + 1;      // Max queue entries
+    uint32_t timeout = (uint32_t)((cap >> 24) & 0xFF);  // 500ms units
+    doorbell_stride = 4u << ((cap >> 32) & 0xF);
+
+    // Then the doorbells of the admin queue and every I/O queue pair
+    uint32_t window = NVME_REG_DOORBELL + 2 * (NVME_IO_QUEUES + 1) * doorbell_stride;
+    if (nvme_map_registers(bar0, (window + NVME_PAGE_SIZE - 1) / NVME_PAGE_SIZE) != 0) {
+        printf("NVMe: failed to map doorbells\n");
+        regs = NULL;
+        return -1;
+    }
+
+    // Reset: disable and wait for the controller to go idle
+    nvme_write32(NVME_REG_CC, 0);
+    if (nvme_wait_ready(0, timeout) != 0) {
+        printf("NVMe: controller did not reset\n");
+        regs = NULL;
+        return -1;
+    }
+
+    identify_buffer = nvme_alloc_zeroed(1);
+    bounce_buffer = nvme_alloc_zeroed(1);
+    uint16_t admin_depth = mqes < NVME_ADMIN_DEPTH ? (uint16_t)mqes : NVME_ADMIN_DEPTH;
+    if (!identify_buffer || !bounce_buffer || nvme_queue_alloc(&admin_queue, 0, admin_depth) != 0) {
+        printf("NVMe: out of memory\n");
+        regs = NULL;
+        return -1;
+    }
+
+    nvme_write32(NVME_REG_AQA, ((uint32_t)(admin_depth - 1) << 16) | (admin_depth - 1));
+    nvme_write64(NVME_REG_ASQ, (uint64_t)(uintptr_t)admin_queue.sq);
+    nvme_write64(NVME_REG_ACQ, (uint64_t)(uintptr_t)admin_queue.cq);
+    nvme_write32(NVME_REG_INTMS, 0xFFFFFFFF);  // Completions are polled
+
+    // Enable: NVM command set, 4KB memory pages, standard entry sizes
+    nvme_write32(NVME_REG_CC, NVME_CC_EN | NVME_CC_IOSQES | NVME_CC_IOCQES);
+    if (nvme_wait_ready(NVME_CSTS_RDY, timeout) != 0) {
+        printf("NVMe: controller failed to become ready\n");
+        regs = NULL;
+        return -1;
+    }
+
+    // Identify controller: model, serial, maximum data transfer size
+    if (nvme_identify(1, 0) != 0) {
+        printf("NVMe: identify controller failed\n");
+        regs = NULL;
+        return -1;
+    }
+    char model[41];
+    char serial[21];
+    nvme_copy_string(model, identify_buffer + 24, 40);
+    nvme_copy_string(serial, identify_buffer + 4, 20);
+    uint8_t mdts = identify_buffer[77];
+    if (mdts != 0 && mdts < 6 && ((1u << mdts) * 8) < max_req_sectors) {
+        max_req_sectors = (1u << mdts) * 8;  // 2^MDTS pages of 4KB
+    }
+
+    // Identify namespace 1: size and LBA format
+    if (nvme_identify(0, 1) != 0) {
+        printf("NVMe: identify namespace failed\n");
+        regs = NULL;
+        return -1;
+    }
+    uint64_t nsze = *(uint64_t*)identify_buffer;
+    uint8_t flbas = identify_buffer[26] & 0x0F;
+    uint8_t lbads = identify_buffer[128 + flbas * 4 + 2];
+    if (lbads != 9) {
+        printf("NVMe: namespace uses %d-byte blocks (512 required)\n", 1 << lbads);
+        regs = NULL;
+        return -1;
+    }
+
+    // Ask for NVME_IO_QUEUES queue pairs; the controller reports how many it granted
+    nvme_sqe_t cmd = {0};
+    uint32_t granted = 0;
+    cmd.cdw0 = NVME_ADMIN_SET_FEATURES;
+    cmd.cdw10 = NVME_FEAT_NUM_QUEUES;
+    cmd.cdw11 = ((NVME_IO_QUEUES - 1) << 16) | (NVME_IO_QUEUES - 1);
+    uint32_t queues = NVME_IO_QUEUES;
+    if (nvme_admin(&cmd, &granted) == 0) {
+        uint32_t nsq = (granted & 0xFFFF) + 1;
+        uint32_t ncq = (granted >> 16) + 1;
+        if (nsq < queues) queues = nsq;
+        if (ncq < queues) queues = ncq;
+    } else {
+        queues = 1;
+    }
+
+    uint16_t io_depth = mqes < NVME_IO_DEPTH ? (uint16_t)mqes : NVME_IO_DEPTH;
+    if (nvme_create_io_queues(queues, io_depth) != 0 && io_queue_count == 0) {
+        printf("NVMe: failed to create I/O queues\n");
+        regs = NULL;
+        return -1;
+    }
+
+    nvme_blkdev.total_sectors = nsze > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)nsze;
+    blkdev_register(&nvme_blkdev);
+
+    printf("NVMe: %s (SN %s)\n", model, serial);
+    printf("NVMe: %d sectors, %d I/O queues x %d entries, %d KB max transfer\n",
+           nvme_blkdev.total_sectors, io_queue_count, io_depth, max_req_sectors / 2);
+    return 0;
+}
@@ -0,0 +1,125 @@
+#include "../include/pci.h"
+
+// PCI configuration ports
+#define PCI_CONFIG_ADDRESS  0xCF8
+#define PCI_CONFIG_DATA     0xCFC
+
+// I/O functions
+static inline void outl(uint16_t port, uint32_t value) {
+    __asm__ volatile("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t value;
+    __asm__ volatile("inl %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+// Build a configuration address (enable bit + bus/slot/func/register)
+static uint32_t pci_address(pci_device_t dev, uint8_t offset) {
+    return 0x80000000u | ((uint32_t)dev.bus << 16) | ((uint32_t)(dev.slot & 0x1F) << 11) |
+           ((uint32_t)(dev.func & 0x07) << 8) | (offset & 0xFC);
+}
+
+uint32_t pci_config_read32(pci_device_t dev, uint8_t offset) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(dev, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+uint16_t pci_config_read16(pci_device_t dev, uint8_t offset) {
+    uint32_t value = pci_config_read32(dev, offset);
+    return (uint16_t)(value >> ((offset & 2) * 8));
+}
+
+uint8_t pci_config_read8(pci_device_t dev, uint8_t offset) {
+    uint32_t value = pci_config_read32(dev, offset);
+    return (uint8_t)(value >> ((offset & 3) * 8));
+}
+
+void pci_config_write32(pci_device_t dev, uint8_t offset, uint32_t value) {
+    outl(PCI_CONFIG_ADDRESS, pci_address(dev, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+void pci_config_write16(pci_device_t dev, uint8_t offset, uint16_t value) {
+    uint32_t old = pci_config_read32(dev, offset);
+    int shift = (offset & 2) * 8;
+    old = (old & ~(0xFFFFu << shift)) | ((uint32_t)value << shift);
+    pci_config_write32(dev, offset, old);
+}
+
+// Walk every bus/slot/function and call match() on each present function
+// Returns: 0 and fills *out on the first match, -1 if nothing matched
+static int pci_scan(int (*match)(pci_device_t, const void*), const void* ctx, pci_device_t* out) {
+    for (int bus = 0; bus < 256; bus++) {
+        for (int slot = 0; slot < 32; slot++) {
+            pci_device_t dev = { (uint8_t)bus, (uint8_t)slot, 0 };
+            if (pci_config_read16(dev, PCI_VENDOR_ID) == 0xFFFF) {
+                continue;  // No device in this slot
+            }
+            
+            // Multi-function devices have bit 7 of the header type set
+            int functions = (pci_config_read8(dev, PCI_HEADER_TYPE) & 0x80) ? 8 : 1;
+            for (int func = 0; func < functions; func++) {
+                dev.func = (uint8_t)func;
+                if (pci_config_read16(dev, PCI_VENDOR_ID) == 0xFFFF) {
+                    continue;
+                }
+                if (match(dev, ctx)) {
+                    *out = dev;
+                    return 0;
+                }
+            }
+        }
+    }
+    return -1;
+}
+
+static int match_id(pci_device_t dev, const void* ctx) {
+    const uint16_t* ids = (const uint16_t*)ctx;
+    return pci_config_read16(dev, PCI_VENDOR_ID) == ids[0] &&
+           pci_config_read16(dev, PCI_DEVICE_ID) == ids[1];
+}
+
+static int match_class(pci_device_t dev, const void* ctx) {
+    const uint8_t* cls = (const uint8_t*)ctx;
+    if (pci_config_read8(dev, PCI_CLASS) != cls[0]) return 0;
+    if (pci_config_read8(dev, PCI_SUBCLASS) != cls[1]) return 0;
+    return cls[2] == 0xFF || pci_config_read8(dev, PCI_PROG_IF) == cls[2];
+}
+
+int pci_find_device(uint16_t vendor, uint16_t device, pci_device_t* dev) {
+    uint16_t ids[2] = { vendor, device };
+    return pci_scan(match_id, ids, dev);
+}
+
+int pci_find_class(uint8_t class_code, uint8_t subclass, uint8_t prog_if, pci_device_t* dev) {
+    uint8_t cls[3] = { class_code, subclass, prog_if };
+    return pci_scan(match_class, cls, dev);
+}
+
+uint64_t pci_read_bar(pci_device_t dev, int index, int* is_io) {
+    uint8_t offset = PCI_BAR0 + index * 4;
+    uint32_t bar = pci_config_read32(dev, offset);
+    
+    if (bar & 1) {
+        // I/O space BAR
+        if (is_io) *is_io = 1;
+        return bar & ~0x3u;
+    }
+    
+    if (is_io) *is_io = 0;
+    uint64_t base = bar & ~0xFu;
+    
+    // Type 2 = 64-bit BAR, high half lives in the next register
+    if (((bar >> 1) & 0x3) == 2 && index < 5) {
+        base |= (uint64_t)pci_config_read32(dev, offset + 4) << 32;
+    }
+    return base;
+}
+
+void pci_enable_device(pci_device_t dev) {
+    uint16_t command = pci_config_read16(dev, PCI_COMMAND);
+    command |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_BUS_MASTER;
+    pci_config_write16(dev, PCI_COMMAND, command);
+}
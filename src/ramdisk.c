@@ -0,0 +1,116 @@
+#include "../include/ramdisk.h"
+#include "../include/memory.h"
+#include "../include/vmm.h"
+#include "../include/heap.h"
+#include "../include/string.h"
+#include "../include/timer.h"
+#include "../include/printf.h"
+
+// Largest write-back run handed to the backing device in one call
+#define RAMDISK_MAX_WRITE 252
+
+typedef struct {
+    blkdev_t* backing;
+    uint8_t* data;          // total_sectors * 512 bytes
+    uint32_t burst;         // Sectors per dirty unit
+    uint32_t burst_count;
+    uint8_t* dirty;         // One flag per burst
+} ramdisk_t;
+
+static ramdisk_t ramdisk;
+
+static int ramdisk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    if (lba + count > dev->total_sectors) return -1;
+    memcpy(buffer, ramdisk.data + lba * BLKDEV_SECTOR_SIZE, count * BLKDEV_SECTOR_SIZE);
+    return 0;
+}
+
+static int ramdisk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    if (lba + count > dev->total_sectors) return -1;
+    memcpy(ramdisk.data + lba * BLKDEV_SECTOR_SIZE, buffer, count * BLKDEV_SECTOR_SIZE);
+    for (uint32_t b = lba / ramdisk.burst; b <= (lba + count - 1) / ramdisk.burst; b++) {
+        ramdisk.dirty[b] = 1;
+    }
+    return 0;
+}
+
+// Write dirty bursts back to the backing device, merging neighbours
+static int ramdisk_flush(blkdev_t* dev) {
+    uint32_t b = 0;
+    while (b < ramdisk.burst_count) {
+        if (!ramdisk.dirty[b]) {
+            b++;
+            continue;
+        }
+        
+        uint32_t first = b;
+        while (b < ramdisk.burst_count && ramdisk.dirty[b] &&
+               (b - first + 1) * ramdisk.burst <= RAMDISK_MAX_WRITE) {
+            b++;
+        }
+        
+        uint32_t lba = first * ramdisk.burst;
+        uint32_t count = (b - first) * ramdisk.burst;
+        if (lba + count > dev->total_sectors) count = dev->total_sectors - lba;
+        if (blkdev_write(ramdisk.backing, lba, count, ramdisk.data + lba * BLKDEV_SECTOR_SIZE) != 0) {
+            printf("%s: write-back to %s failed at sector %d\n", dev->name, ramdisk.backing->name, lba);
+            return -1;
+        }
+        for (uint32_t i = first; i < b; i++) {
+            ramdisk.dirty[i] = 0;
+        }
+        dev->stats.merges += b - first - 1;
+    }
+    return blkdev_sync(ramdisk.backing);
+}
+
+static blkdev_t ramdisk_blkdev = {
+    .name = "rd0",
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .flush = ramdisk_flush,
+};
+
+blkdev_t* ramdisk_create(blkdev_t* backing, uint32_t burst) {
+    if (!backing || backing->total_sectors == 0 || burst == 0) return NULL;
+    
+    uint32_t total = backing->total_sectors;
+    uint32_t pages = (total * BLKDEV_SECTOR_SIZE + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t addr = pmem_alloc_pages(pages);
+    if (addr == 0) {
+        printf("RAM disk: not enough memory for %d KB\n", total / 2);
+        return NULL;
+    }
+    
+    ramdisk.backing = backing;
+    ramdisk.data = (uint8_t*)(uintptr_t)addr;
+    ramdisk.burst = burst;
+    ramdisk.burst_count = (total + burst - 1) / burst;
+    ramdisk.dirty = (uint8_t*)calloc(ramdisk.burst_count, 1);
+    if (!ramdisk.dirty) {
+        pmem_free_pages(addr, pages);
+        return NULL;
+    }
+    
+    // Pull the whole device in, one burst (floppy cylinder) per request
+    uint64_t start = timer_get_ticks();
+    for (uint32_t lba = 0; lba < total; lba += burst) {
+        uint32_t n = total - lba < burst ? total - lba : burst;
+        if (blkdev_device_read(backing, lba, n, ramdisk.data + lba * BLKDEV_SECTOR_SIZE) != 0) {
+            printf("RAM disk: read of %s failed at sector %d\n", backing->name, lba);
+            free(ramdisk.dirty);
+            pmem_free_pages(addr, pages);
+            return NULL;
+        }
+    }
+    uint32_t elapsed_ms = (uint32_t)(timer_get_ticks() - start);
+    
+    ramdisk_blkdev.total_sectors = total;
+    blkdev_register(&ramdisk_blkdev);
+    printf("RAM disk: loaded %d KB from %s in %d ms\n", total / 2, backing->name, elapsed_ms);
+    return &ramdisk_blkdev;
+}
+
+blkdev_t* ramdisk_backing(blkdev_t* dev) {
+    return dev == &ramdisk_blkdev ? ramdisk.backing : NULL;
+}
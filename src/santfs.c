@@ -0,0 +1,1131 @@
+#include "../include/santfs.h"
+#include "../include/memory.h"
+#include "../include/heap.h"
+#include "../include/string.h"
+#include "../include/printf.h"
+
+// readdir cookies are (leaf block << 7 | record index); this one means "done"
+#define COOKIE_SLOT_BITS 7
+#define COOKIE_END       0x7FFFFFFFu
+
+// ---- Block I/O ----
+
+static int read_blocks(santfs_volume_t* vol, uint32_t block, uint32_t count, uint8_t* buffer) {
+    return blkdev_read(vol->dev, block * vol->sectors_per_block, count * vol->sectors_per_block, buffer);
+}
+
+static int write_blocks(santfs_volume_t* vol, uint32_t block, uint32_t count, const uint8_t* buffer) {
+    return blkdev_write(vol->dev, block * vol->sectors_per_block, count * vol->sectors_per_block, buffer);
+}
+
+// The root directory is vnode ino 0 (the VFS's mount root)
+static uint32_t vnode_ino(const vfs_vnode_t* v) {
+    return v->ino ? v->ino : SANTFS_ROOT_INO;
+}
+
+// ---- Superblock and bitmaps ----
+
+static int write_super(santfs_volume_t* vol) {
+    uint8_t sector[512];
+    memset(sector, 0, sizeof(sector));
+    memcpy(sector, &vol->super, sizeof(santfs_super_t));
+    vol->super_dirty = 0;
+    return blkdev_write(vol->dev, 0, 1, sector);
+}
+
+// Record in the superblock that the volume is being changed (once per sync)
+static int begin_change(santfs_volume_t* vol) {
+    if (vol->read_only) {
+        return -1;
+    }
+    if (vol->super.state != SANTFS_STATE_DIRTY) {
+        vol->super.state = SANTFS_STATE_DIRTY;
+        return write_super(vol);
+    }
+    return 0;
+}
+
+static int bit_test(const uint8_t* map, uint32_t bit) {
+    return (map[bit / 8] >> (bit % 8)) & 1;
+}
+
+// Set or clear a bit of the block bitmap ('inodes' = 0) or inode bitmap
+static void bit_change(santfs_volume_t* vol, int inodes, uint32_t bit, int used) {
+    uint8_t* map = inodes ? vol->inode_bitmap : vol->block_bitmap;
+    if (used) {
+        map[bit / 8] |= (uint8_t)(1 << (bit % 8));
+    } else {
+        map[bit / 8] &= (uint8_t)~(1 << (bit % 8));
+    }
+    uint32_t flag = bit / 8 / vol->super.block_size;
+    vol->bitmap_dirty[inodes ? vol->super.bitmap_blocks + flag : flag] = 1;
+    vol->super_dirty = 1;
+}
+
+// Write the dirty bitmap blocks (consecutive ones in one request), then the
+// superblock counts
+static int flush_metadata(santfs_volume_t* vol) {
+    uint32_t bs = vol->super.block_size;
+    uint32_t flags = vol->super.bitmap_blocks + vol->super.inode_bitmap_blocks;
+    int result = 0;
+    
+    uint32_t i = 0;
+    while (i < flags) {
+        if (!vol->bitmap_dirty[i]) {
+            i++;
+            continue;
+        }
+        // Runs stay inside one bitmap (the two are not adjacent in memory)
+        uint32_t end = i + 1;
+        uint32_t limit = i < vol->super.bitmap_blocks ? vol->super.bitmap_blocks : flags;
+        while (end < limit && vol->bitmap_dirty[end]) {
+            end++;
+        }
+        uint32_t block;
+        const uint8_t* data;
+        if (i < vol->super.bitmap_blocks) {
+            block = vol->super.bitmap_start + i;
+            data = vol->block_bitmap + i * bs;
+        } else {
+            block = vol->super.inode_bitmap_start + (i - vol->super.bitmap_blocks);
+            data = vol->inode_bitmap + (i - vol->super.bitmap_blocks) * bs;
+        }
+        if (write_blocks(vol, block, end - i, data) != 0) {
+            result = -1;
+        } else {
+            memset(&vol->bitmap_dirty[i], 0, end - i);
+        }
+        i = end;
+    }
+    
+    if (vol->super_dirty && write_super(vol) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// First free block at or after 'from', wrapping around to data_start
+// Returns: block number, or 0 if none is free
+static uint32_t find_free_block(santfs_volume_t* vol, uint32_t from) {
+    uint32_t total = vol->super.total_blocks;
+    if (from < vol->super.data_start || from >= total) {
+        from = vol->super.data_start;
+    }
+    for (int pass = 0; pass < 2; pass++) {
+        uint32_t b = pass == 0 ? from : vol->super.data_start;
+        uint32_t end = pass == 0 ? total : from;
+        while (b < end) {
+            if ((b & 7) == 0 && vol->block_bitmap[b / 8] == 0xFF) {
+                b += 8;  // Skip full bytes
+                continue;
+            }
+            if (!bit_test(vol->block_bitmap, b)) {
+                return b;
+            }
+            b++;
+        }
+    }
+    return 0;
+}
+
+// Allocate up to 'want' consecutive blocks: at 'goal' if it is free (so a
+// file grows in place), otherwise at the next free block after the hint
+// Returns: first block with *got set, or 0 if the volume is full
+static uint32_t alloc_run(santfs_volume_t* vol, uint32_t goal, uint32_t want, uint32_t* got) {
+    uint32_t total = vol->super.total_blocks;
+    uint32_t start;
+    if (goal >= vol->super.data_start && goal < total && !bit_test(vol->block_bitmap, goal)) {
+        start = goal;
+    } else {
+        start = find_free_block(vol, vol->block_hint);
+        if (!start) {
+            return 0;
+        }
+    }
+    
+    uint32_t length = 0;
+    while (length < want && start + length < total && !bit_test(vol->block_bitmap, start + length)) {
+        bit_change(vol, 0, start + length, 1);
+        length++;
+    }
+    vol->super.free_blocks -= length;
+    vol->block_hint = start + length;
+    *got = length;
+    return start;
+}
+
+static void free_run(santfs_volume_t* vol, uint32_t start, uint32_t length) {
+    for (uint32_t i = 0; i < length; i++) {
+        bit_change(vol, 0, start + i, 0);
+    }
+    vol->super.free_blocks += length;
+}
+
+// Allocate a block for a file's extent list away from where the file grows
+// next ('growth'): the last free block of the volume, so overflow blocks
+// collect at the end instead of splitting data runs
+// Returns: the block (now marked used), or 0 if there is none
+static uint32_t alloc_extent_block(santfs_volume_t* vol, uint32_t growth) {
+    for (uint32_t b = vol->super.total_blocks - 1; b >= vol->super.data_start; b--) {
+        if ((b & 7) == 7 && vol->block_bitmap[b / 8] == 0xFF) {
+            b -= 7;  // Skip full bytes
+            continue;
+        }
+        if (b != growth && !bit_test(vol->block_bitmap, b)) {
+            bit_change(vol, 0, b, 1);
+            vol->super.free_blocks--;
+            return b;
+        }
+    }
+    return 0;
+}
+
+// Returns: a free inode number (now marked used), or 0 if there is none
+static uint32_t alloc_inode(santfs_volume_t* vol) {
+    uint32_t count = vol->super.inode_count;
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t ino = (vol->inode_hint + n) % count;
+        if (ino > SANTFS_ROOT_INO && !bit_test(vol->inode_bitmap, ino)) {
+            bit_change(vol, 1, ino, 1);
+            vol->super.free_inodes--;
+            vol->inode_hint = ino + 1;
+            return ino;
+        }
+    }
+    return 0;
+}
+
+// ---- Inodes ----
+
+// Sector of the inode table holding an inode, and the inode's offset in it
+static uint32_t inode_sector(santfs_volume_t* vol, uint32_t ino, uint32_t* offset) {
+    uint32_t byte = ino * SANTFS_INODE_SIZE;
+    *offset = byte % 512;
+    return vol->super.inode_start * vol->sectors_per_block + byte / 512;
+}
+
+static int read_inode(santfs_volume_t* vol, uint32_t ino, santfs_inode_t* inode) {
+    uint8_t sector[512];
+    uint32_t offset;
+    if (ino == 0 || ino >= vol->super.inode_count ||
+        blkdev_read(vol->dev, inode_sector(vol, ino, &offset), 1, sector) != 0) {
+        return -1;
+    }
+    memcpy(inode, sector + offset, sizeof(santfs_inode_t));
+    return 0;
+}
+
+static int write_inode(santfs_volume_t* vol, uint32_t ino, const santfs_inode_t* inode) {
+    uint8_t sector[512];
+    uint32_t offset;
+    uint32_t lba = inode_sector(vol, ino, &offset);
+    if (blkdev_read(vol->dev, lba, 1, sector) != 0) {
+        return -1;
+    }
+    memcpy(sector + offset, inode, sizeof(santfs_inode_t));
+    return blkdev_write(vol->dev, lba, 1, sector);
+}
+
+static santfs_extent_t* extent_at(santfs_open_inode_t* oi, uint32_t i) {
+    return i < SANTFS_INLINE_EXTENTS ? &oi->inode.extents[i] : &oi->overflow[i - SANTFS_INLINE_EXTENTS];
+}
+
+static void free_overflow(santfs_open_inode_t* oi) {
+    free(oi->overflow);
+    free(oi->chain);
+    oi->overflow = NULL;
+    oi->chain = NULL;
+    oi->chain_length = 0;
+}
+
+// Make room in memory for one more overflow block's extents
+static int grow_overflow(santfs_volume_t* vol, santfs_open_inode_t* oi) {
+    uint32_t per_block = vol->extents_per_block;
+    uint32_t length = oi->chain_length + 1;
+    santfs_extent_t* overflow = (santfs_extent_t*)calloc(length * per_block, sizeof(santfs_extent_t));
+    uint32_t* chain = (uint32_t*)malloc(length * sizeof(uint32_t));
+    if (!overflow || !chain) {
+        free(overflow);
+        free(chain);
+        return -1;
+    }
+    if (oi->chain_length > 0) {
+        memcpy(overflow, oi->overflow, oi->chain_length * per_block * sizeof(santfs_extent_t));
+        memcpy(chain, oi->chain, oi->chain_length * sizeof(uint32_t));
+    }
+    free(oi->overflow);
+    free(oi->chain);
+    oi->overflow = overflow;
+    oi->chain = chain;
+    return 0;
+}
+
+// Read the overflow chain of an inode (oi->inode) into memory
+static int read_overflow(santfs_volume_t* vol, santfs_open_inode_t* oi) {
+    uint32_t per_block = vol->extents_per_block;
+    uint32_t bs = vol->super.block_size;
+    uint32_t extra = oi->inode.extent_count > SANTFS_INLINE_EXTENTS ? oi->inode.extent_count - SANTFS_INLINE_EXTENTS : 0;
+    uint32_t blocks = (extra + per_block - 1) / per_block;
+    uint32_t block = oi->inode.extent_block;
+    
+    oi->overflow = NULL;
+    oi->chain = NULL;
+    oi->chain_length = 0;
+    if (block && blocks == 0) {
+        blocks = 1;  // Allocated but (after a truncate) empty
+    }
+    while (oi->chain_length < blocks) {
+        if (!block || block >= vol->super.total_blocks || grow_overflow(vol, oi) != 0 ||
+            read_blocks(vol, block, 1, vol->block_buf) != 0) {
+            free_overflow(oi);
+            return -1;
+        }
+        memcpy(oi->overflow + oi->chain_length * per_block, vol->block_buf, per_block * sizeof(santfs_extent_t));
+        oi->chain[oi->chain_length++] = block;
+        memcpy(&block, vol->block_buf + SANTFS_EXTENT_LINK(bs), sizeof(block));
+    }
+    return 0;
+}
+
+// Write the overflow chain of an open inode
+static int write_overflow(santfs_volume_t* vol, santfs_open_inode_t* oi) {
+    uint32_t per_block = vol->extents_per_block;
+    uint32_t bs = vol->super.block_size;
+    for (uint32_t i = 0; i < oi->chain_length; i++) {
+        uint32_t next = i + 1 < oi->chain_length ? oi->chain[i + 1] : 0;
+        memset(vol->block_buf, 0, bs);
+        memcpy(vol->block_buf, oi->overflow + i * per_block, per_block * sizeof(santfs_extent_t));
+        memcpy(vol->block_buf + SANTFS_EXTENT_LINK(bs), &next, sizeof(next));
+        if (write_blocks(vol, oi->chain[i], 1, vol->block_buf) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Write an open inode and its overflow extents back if they changed
+static int write_open_inode(santfs_volume_t* vol, santfs_open_inode_t* oi) {
+    if (!oi->dirty) {
+        return 0;
+    }
+    if (write_overflow(vol, oi) != 0 || write_inode(vol, oi->ino, &oi->inode) != 0) {
+        return -1;
+    }
+    oi->dirty = 0;
+    return 0;
+}
+
+// Free every block of a file (extents in memory, see read_overflow) and its inode
+static int release_inode(santfs_volume_t* vol, santfs_open_inode_t* oi) {
+    for (uint32_t i = 0; i < oi->inode.extent_count; i++) {
+        santfs_extent_t* e = extent_at(oi, i);
+        free_run(vol, e->start, e->length);
+    }
+    for (uint32_t i = 0; i < oi->chain_length; i++) {
+        free_run(vol, oi->chain[i], 1);
+    }
+    
+    memset(&oi->inode, 0, sizeof(oi->inode));
+    bit_change(vol, 1, oi->ino, 0);
+    vol->super.free_inodes++;
+    return write_inode(vol, oi->ino, &oi->inode);
+}
+
+static santfs_open_inode_t* find_open(santfs_volume_t* vol, uint32_t ino) {
+    for (int i = 0; i < VFS_MAX_FILES; i++) {
+        if (vol->open[i].ino == ino) {
+            return &vol->open[i];
+        }
+    }
+    return NULL;
+}
+
+// Take a reference on the in-memory copy of an inode, loading it if needed
+static santfs_open_inode_t* get_open_inode(santfs_volume_t* vol, uint32_t ino) {
+    santfs_open_inode_t* oi = find_open(vol, ino);
+    if (oi) {
+        oi->refs++;
+        return oi;
+    }
+    
+    oi = find_open(vol, 0);
+    if (!oi || read_inode(vol, ino, &oi->inode) != 0 || oi->inode.mode != SANTFS_MODE_FILE) {
+        return NULL;
+    }
+    if (read_overflow(vol, oi) != 0) {
+        return NULL;
+    }
+    oi->ino = ino;
+    oi->refs = 1;
+    oi->dirty = 0;
+    oi->orphan = 0;
+    return oi;
+}
+
+static int put_open_inode(santfs_volume_t* vol, santfs_open_inode_t* oi) {
+    if (--oi->refs > 0) {
+        return 0;
+    }
+    int result = oi->orphan ? release_inode(vol, oi) : write_open_inode(vol, oi);
+    free_overflow(oi);
+    oi->ino = 0;
+    return result;
+}
+
+// ---- Extent maps ----
+
+// Map a file block to a disk block
+// Returns: disk block (0 for a hole), with *run set to the blocks left in
+// the extent (for a hole: until the next extent)
+static uint32_t map_block(santfs_open_inode_t* oi, uint32_t lblk, uint32_t* run) {
+    // Last extent starting at or before lblk
+    uint32_t lo = 0, hi = oi->inode.extent_count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (extent_at(oi, mid)->logical <= lblk) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo > 0) {
+        santfs_extent_t* e = extent_at(oi, lo - 1);
+        if (lblk < e->logical + e->length) {
+            *run = e->logical + e->length - lblk;
+            return e->start + (lblk - e->logical);
+        }
+    }
+    *run = lo < oi->inode.extent_count ? extent_at(oi, lo)->logical - lblk : 0xFFFFFFFFu;
+    return 0;
+}
+
+// Map 'length' blocks from file block lblk (a hole) to disk block 'start',
+// growing the previous extent when the two are contiguous
+static int add_mapping(santfs_volume_t* vol, santfs_open_inode_t* oi, uint32_t lblk, uint32_t start, uint32_t length) {
+    uint32_t count = oi->inode.extent_count;
+    uint32_t pos = 0;
+    while (pos < count && extent_at(oi, pos)->logical < lblk) {
+        pos++;
+    }
+    
+    if (pos > 0) {
+        santfs_extent_t* prev = extent_at(oi, pos - 1);
+        if (prev->logical + prev->length == lblk && prev->start + prev->length == start) {
+            prev->length += length;
+            oi->dirty = 1;
+            return 0;
+        }
+    }
+    
+    // Extent lists past the inline ones grow a block at a time, chained
+    if (count >= SANTFS_INLINE_EXTENTS + oi->chain_length * vol->extents_per_block) {
+        uint32_t block = alloc_extent_block(vol, start + length);
+        if (!block || grow_overflow(vol, oi) != 0) {
+            if (block) {
+                free_run(vol, block, 1);
+            }
+            return -1;
+        }
+        if (oi->chain_length == 0) {
+            oi->inode.extent_block = block;
+        }
+        oi->chain[oi->chain_length++] = block;
+        oi->inode.blocks++;
+    }
+    
+    for (uint32_t i = count; i > pos; i--) {
+        *extent_at(oi, i) = *extent_at(oi, i - 1);
+    }
+    santfs_extent_t* e = extent_at(oi, pos);
+    e->logical = lblk;
+    e->start = start;
+    e->length = length;
+    oi->inode.extent_count++;
+    oi->dirty = 1;
+    return 0;
+}
+
+// ---- Directory B+trees ----
+
+static santfs_record_t* records(santfs_node_t* node) {
+    return (santfs_record_t*)(node + 1);
+}
+
+// Read a node into scratch buffer 'which' and check it
+static santfs_node_t* read_node(santfs_volume_t* vol, uint32_t block, int which) {
+    santfs_node_t* node = (santfs_node_t*)vol->node_buf[which];
+    if (read_blocks(vol, block, 1, vol->node_buf[which]) != 0 ||
+        node->magic != SANTFS_NODE_MAGIC || node->count > vol->records_per_node) {
+        return NULL;
+    }
+    return node;
+}
+
+// Internal node: index of the child that covers 'name' (the last record whose
+// name is <= name; record 0 covers everything below record 1)
+static uint32_t child_index(santfs_node_t* node, const char* name) {
+    santfs_record_t* r = records(node);
+    uint32_t lo = 1, hi = node->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (strcmp(r[mid].name, name) <= 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo - 1;
+}
+
+// Leaf: index of the first record whose name is >= name
+static uint32_t leaf_index(santfs_node_t* node, const char* name, int* found) {
+    santfs_record_t* r = records(node);
+    uint32_t lo = 0, hi = node->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        if (strcmp(r[mid].name, name) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    *found = lo < node->count && strcmp(r[lo].name, name) == 0;
+    return lo;
+}
+
+// Walk from the root to the leaf that holds (or would hold) 'name'
+// path[0] is the root and path[dir->depth] the leaf
+// Returns: the leaf (in node_buf[0]), or NULL on a damaged tree or read error
+static santfs_node_t* find_leaf(santfs_volume_t* vol, const santfs_inode_t* dir, const char* name, uint32_t* path) {
+    if (dir->mode != SANTFS_MODE_DIR || dir->depth > SANTFS_BTREE_MAX_DEPTH) {
+        return NULL;
+    }
+    uint32_t block = dir->root;
+    for (uint32_t i = 0; ; i++) {
+        path[i] = block;
+        santfs_node_t* node = read_node(vol, block, 0);
+        if (!node || node->level != dir->depth - i) {
+            return NULL;
+        }
+        if (node->level == 0) {
+            return node;
+        }
+        if (node->count == 0) {
+            return NULL;
+        }
+        block = records(node)[child_index(node, name)].ino;
+    }
+}
+
+static void insert_record(santfs_node_t* node, uint32_t pos, const santfs_record_t* rec) {
+    santfs_record_t* r = records(node);
+    memmove(&r[pos + 1], &r[pos], (node->count - pos) * sizeof(santfs_record_t));
+    r[pos] = *rec;
+    node->count++;
+}
+
+// Add an entry to a directory; full nodes split in half, pushing a record
+// for the new right half into the parent, and a root split grows the tree
+// Returns: 0 on success, -1 if the name exists or on error (dir is updated
+// in memory; the caller writes it)
+static int dir_insert(santfs_volume_t* vol, santfs_inode_t* dir, const santfs_record_t* rec) {
+    uint32_t path[SANTFS_BTREE_MAX_DEPTH + 1];
+    santfs_node_t* node = find_leaf(vol, dir, rec->name, path);
+    if (!node) {
+        return -1;
+    }
+    
+    santfs_record_t pending = *rec;
+    for (uint32_t level = 0; ; level++) {
+        uint32_t block = path[dir->depth - level];
+        uint32_t pos;
+        if (level == 0) {
+            int found;
+            pos = leaf_index(node, pending.name, &found);
+            if (found) {
+                return -1;
+            }
+        } else {
+            pos = child_index(node, pending.name) + 1;
+        }
+        
+        if (node->count < vol->records_per_node) {
+            insert_record(node, pos, &pending);
+            return write_blocks(vol, block, 1, (const uint8_t*)node);
+        }
+        if (level == dir->depth && dir->depth == SANTFS_BTREE_MAX_DEPTH) {
+            return -1;
+        }
+        
+        // Move the upper half into a new node and insert into the right half
+        uint32_t got;
+        uint32_t right_block = alloc_run(vol, block + 1, 1, &got);
+        if (!right_block) {
+            return -1;
+        }
+        santfs_node_t* right = (santfs_node_t*)vol->node_buf[1];
+        memset(right, 0, vol->super.block_size);
+        right->magic = SANTFS_NODE_MAGIC;
+        right->level = node->level;
+        uint32_t mid = node->count / 2;
+        memcpy(records(right), &records(node)[mid], (node->count - mid) * sizeof(santfs_record_t));
+        right->count = node->count - mid;
+        node->count = mid;
+        if (level == 0) {
+            right->next = node->next;
+            node->next = right_block;
+        }
+        if (pos <= mid) {
+            insert_record(node, pos, &pending);
+        } else {
+            insert_record(right, pos - mid, &pending);
+        }
+        dir->blocks++;
+        
+        // New node first, so the old one never points at an unwritten block
+        if (write_blocks(vol, right_block, 1, (const uint8_t*)right) != 0 ||
+            write_blocks(vol, block, 1, (const uint8_t*)node) != 0) {
+            return -1;
+        }
+        
+        memset(&pending, 0, sizeof(pending));
+        pending.ino = right_block;
+        pending.name_len = records(right)[0].name_len;
+        memcpy(pending.name, records(right)[0].name, sizeof(pending.name));
+        
+        if (level == dir->depth) {
+            // The root split: a new root holds both halves
+            uint32_t root = alloc_run(vol, right_block + 1, 1, &got);
+            if (!root) {
+                return -1;
+            }
+            memset(node, 0, vol->super.block_size);
+            node->magic = SANTFS_NODE_MAGIC;
+            node->level = (uint16_t)(level + 1);
+            node->count = 2;
+            records(node)[0].ino = block;
+            records(node)[1] = pending;
+            if (write_blocks(vol, root, 1, (const uint8_t*)node) != 0) {
+                return -1;
+            }
+            dir->root = root;
+            dir->depth++;
+            dir->blocks++;
+            return 0;
+        }
+        
+        node = read_node(vol, path[dir->depth - level - 1], 0);
+        if (!node) {
+            return -1;
+        }
+    }
+}
+
+// Remove a file's entry from a directory (nodes are not merged: an emptied
+// leaf stays in the tree, and separators stay valid lower bounds)
+// Returns: 0 with *removed filled in, or -1 if there is no such file
+static int dir_remove(santfs_volume_t* vol, santfs_inode_t* dir, const char* name, santfs_record_t* removed) {
+    uint32_t path[SANTFS_BTREE_MAX_DEPTH + 1];
+    santfs_node_t* node = find_leaf(vol, dir, name, path);
+    int found;
+    uint32_t pos = node ? leaf_index(node, name, &found) : 0;
+    if (!node || !found || records(node)[pos].type != SANTFS_MODE_FILE) {
+        return -1;
+    }
+    
+    santfs_record_t* r = records(node);
+    *removed = r[pos];
+    memmove(&r[pos], &r[pos + 1], (node->count - pos - 1) * sizeof(santfs_record_t));
+    node->count--;
+    return write_blocks(vol, path[dir->depth], 1, (const uint8_t*)node);
+}
+
+// ---- VFS operations ----
+
+static int santfs_lookup(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child) {
+    santfs_volume_t* vol = (santfs_volume_t*)dir->mount->fs;
+    santfs_inode_t dinode;
+    uint32_t path[SANTFS_BTREE_MAX_DEPTH + 1];
+    if (read_inode(vol, vnode_ino(dir), &dinode) != 0) {
+        return -1;
+    }
+    santfs_node_t* leaf = find_leaf(vol, &dinode, name, path);
+    int found;
+    uint32_t pos = leaf ? leaf_index(leaf, name, &found) : 0;
+    if (!leaf || !found) {
+        return -1;
+    }
+    child->ino = records(leaf)[pos].ino;
+    child->is_directory = records(leaf)[pos].type == SANTFS_MODE_DIR;
+    return 0;
+}
+
+static int santfs_create(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child) {
+    santfs_volume_t* vol = (santfs_volume_t*)dir->mount->fs;
+    uint32_t dir_ino = vnode_ino(dir);
+    santfs_inode_t dinode;
+    if (strlen(name) > SANTFS_NAME_MAX || begin_change(vol) != 0 ||
+        read_inode(vol, dir_ino, &dinode) != 0) {
+        return -1;
+    }
+    
+    uint32_t ino = alloc_inode(vol);
+    if (!ino) {
+        return -1;
+    }
+    santfs_inode_t inode;
+    memset(&inode, 0, sizeof(inode));
+    inode.mode = SANTFS_MODE_FILE;
+    inode.links = 1;
+    
+    santfs_record_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.ino = ino;
+    rec.type = SANTFS_MODE_FILE;
+    rec.name_len = (uint8_t)strlen(name);
+    strcpy(rec.name, name);
+    
+    if (write_inode(vol, ino, &inode) != 0 || dir_insert(vol, &dinode, &rec) != 0) {
+        bit_change(vol, 1, ino, 0);
+        vol->super.free_inodes++;
+        flush_metadata(vol);
+        return -1;
+    }
+    dinode.size++;
+    if (write_inode(vol, dir_ino, &dinode) != 0 || flush_metadata(vol) != 0) {
+        return -1;
+    }
+    
+    child->ino = ino;
+    child->is_directory = 0;
+    return 0;
+}
+
+static int santfs_unlink(vfs_vnode_t* dir, const char* name) {
+    santfs_volume_t* vol = (santfs_volume_t*)dir->mount->fs;
+    uint32_t dir_ino = vnode_ino(dir);
+    santfs_inode_t dinode;
+    santfs_record_t removed;
+    if (begin_change(vol) != 0 || read_inode(vol, dir_ino, &dinode) != 0 ||
+        dir_remove(vol, &dinode, name, &removed) != 0) {
+        return -1;
+    }
+    dinode.size--;
+    int result = write_inode(vol, dir_ino, &dinode);
+    
+    santfs_open_inode_t* oi = find_open(vol, removed.ino);
+    if (oi) {
+        oi->orphan = 1;  // Open files keep reading it; freed at the last close
+    } else {
+        santfs_open_inode_t closed;
+        memset(&closed, 0, sizeof(closed));
+        closed.ino = removed.ino;
+        if (read_inode(vol, removed.ino, &closed.inode) != 0 || read_overflow(vol, &closed) != 0 ||
+            release_inode(vol, &closed) != 0) {
+            result = -1;
+        }
+        free_overflow(&closed);
+    }
+    if (flush_metadata(vol) != 0) {
+        result = -1;
+    }
+    return result;
+}
+
+// Directory entries in name order, following the leaf chain
+static int santfs_readdir(vfs_vnode_t* dir, uint32_t* cookie, vfs_dirent_t* entries, uint32_t count) {
+    santfs_volume_t* vol = (santfs_volume_t*)dir->mount->fs;
+    if (*cookie == COOKIE_END) {
+        return 0;
+    }
+    
+    uint32_t block, slot;
+    if (*cookie == 0) {
+        // Leftmost leaf
+        santfs_inode_t dinode;
+        if (read_inode(vol, vnode_ino(dir), &dinode) != 0 || dinode.mode != SANTFS_MODE_DIR) {
+            return -1;
+        }
+        block = dinode.root;
+        for (uint32_t level = dinode.depth; level > 0; level--) {
+            santfs_node_t* node = read_node(vol, block, 0);
+            if (!node || node->count == 0) {
+                return -1;
+            }
+            block = records(node)[0].ino;
+        }
+        slot = 0;
+    } else {
+        block = *cookie >> COOKIE_SLOT_BITS;
+        slot = *cookie & ((1u << COOKIE_SLOT_BITS) - 1);
+    }
+    
+    uint32_t filled = 0;
+    while (filled < count) {
+        santfs_node_t* node = read_node(vol, block, 0);
+        if (!node || node->level != 0) {
+            return -1;
+        }
+        while (slot < node->count && filled < count) {
+            santfs_record_t* r = &records(node)[slot++];
+            vfs_dirent_t* e = &entries[filled++];
+            memset(e, 0, sizeof(*e));
+            memcpy(e->name, r->name, VFS_NAME_MAX - 1);
+            e->ino = r->ino;
+            e->is_directory = r->type == SANTFS_MODE_DIR;
+            if (e->is_directory) {
+                e->attributes = DIRENT_DIRECTORY;
+            } else {
+                santfs_inode_t inode;
+                if (read_inode(vol, r->ino, &inode) == 0) {
+                    e->size = inode.size;
+                }
+            }
+        }
+        if (slot < node->count) {
+            break;
+        }
+        if (!node->next) {
+            block = 0;
+            break;
+        }
+        block = node->next;
+        slot = 0;
+    }
+    *cookie = block ? (block << COOKIE_SLOT_BITS) | slot : COOKIE_END;
+    return (int)filled;
+}
+
+static int santfs_open(vfs_file_t* file) {
+    santfs_volume_t* vol = (santfs_volume_t*)file->vnode->mount->fs;
+    santfs_open_inode_t* oi = get_open_inode(vol, file->vnode->ino);
+    if (!oi) {
+        return -1;
+    }
+    file->priv = oi;
+    file->size = oi->inode.size;
+    return 0;
+}
+
+// Whole blocks go straight between the disk and the caller's buffer, as many
+// per request as an extent holds; only partial blocks use the scratch block
+static int santfs_read(vfs_file_t* file, uint8_t* buffer, uint32_t size) {
+    santfs_volume_t* vol = (santfs_volume_t*)file->vnode->mount->fs;
+    santfs_open_inode_t* oi = (santfs_open_inode_t*)file->priv;
+    uint32_t bs = vol->super.block_size;
+    if (file->position >= oi->inode.size) {
+        return 0;
+    }
+    if (size > oi->inode.size - file->position) {
+        size = oi->inode.size - file->position;
+    }
+    
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t offset = file->position + done;
+        uint32_t in_block = offset % bs;
+        uint32_t run;
+        uint32_t phys = map_block(oi, offset / bs, &run);
+        
+        if (in_block == 0 && size - done >= bs) {
+            uint32_t n = (size - done) / bs;
+            if (n > run) n = run;
+            if (!phys) {
+                memset(buffer + done, 0, n * bs);  // Hole
+            } else if (read_blocks(vol, phys, n, buffer + done) != 0) {
+                break;
+            }
+            done += n * bs;
+        } else {
+            uint32_t n = bs - in_block;
+            if (n > size - done) n = size - done;
+            if (!phys) {
+                memset(buffer + done, 0, n);
+            } else if (read_blocks(vol, phys, 1, vol->block_buf) != 0) {
+                break;
+            } else {
+                memcpy(buffer + done, vol->block_buf + in_block, n);
+            }
+            done += n;
+        }
+    }
+    return done > 0 ? (int)done : -1;
+}
+
+// Blocks a write reaches that are not mapped yet are allocated for the rest
+// of the write in one go, next to the block before them when that is free
+static int santfs_write(vfs_file_t* file, const uint8_t* buffer, uint32_t size) {
+    santfs_volume_t* vol = (santfs_volume_t*)file->vnode->mount->fs;
+    santfs_open_inode_t* oi = (santfs_open_inode_t*)file->priv;
+    uint32_t bs = vol->super.block_size;
+    if (begin_change(vol) != 0) {
+        return -1;
+    }
+    if (size > 0xFFFFFFFFu - file->position) {
+        size = 0xFFFFFFFFu - file->position;
+    }
+    
+    // Blocks allocated by this call: partial writes into them start from zeros
+    uint32_t fresh_start = 0, fresh_end = 0;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t offset = file->position + done;
+        uint32_t lblk = offset / bs;
+        uint32_t in_block = offset % bs;
+        uint32_t run;
+        uint32_t phys = map_block(oi, lblk, &run);
+        
+        if (!phys) {
+            uint32_t want = (file->position + size - 1) / bs - lblk + 1;
+            if (want > run) want = run;  // Up to the next extent
+            uint32_t prev_run;
+            uint32_t goal = lblk > 0 ? map_block(oi, lblk - 1, &prev_run) : 0;
+            phys = alloc_run(vol, goal ? goal + 1 : 0, want, &run);
+            if (!phys) {
+                break;  // Volume full
+            }
+            if (add_mapping(vol, oi, lblk, phys, run) != 0) {
+                free_run(vol, phys, run);
+                break;
+            }
+            oi->inode.blocks += run;
+            fresh_start = phys;
+            fresh_end = phys + run;
+        }
+        
+        if (in_block == 0 && size - done >= bs) {
+            uint32_t n = (size - done) / bs;
+            if (n > run) n = run;
+            if (write_blocks(vol, phys, n, buffer + done) != 0) {
+                break;
+            }
+            done += n * bs;
+        } else {
+            uint32_t n = bs - in_block;
+            if (n > size - done) n = size - done;
+            if (phys >= fresh_start && phys < fresh_end) {
+                memset(vol->block_buf, 0, bs);
+            } else if (read_blocks(vol, phys, 1, vol->block_buf) != 0) {
+                break;
+            }
+            memcpy(vol->block_buf + in_block, buffer + done, n);
+            if (write_blocks(vol, phys, 1, vol->block_buf) != 0) {
+                break;
+            }
+            done += n;
+        }
+    }
+    
+    if (file->position + done > oi->inode.size) {
+        oi->inode.size = file->position + done;
+        oi->dirty = 1;
+    }
+    file->size = oi->inode.size;
+    return done > 0 || size == 0 ? (int)done : -1;
+}
+
+static int santfs_truncate(vfs_file_t* file, uint32_t size) {
+    santfs_volume_t* vol = (santfs_volume_t*)file->vnode->mount->fs;
+    santfs_open_inode_t* oi = (santfs_open_inode_t*)file->priv;
+    uint32_t bs = vol->super.block_size;
+    if (size > oi->inode.size || begin_change(vol) != 0) {
+        return -1;
+    }
+    
+    // Drop or shorten the extents past the new last block, last first
+    uint32_t keep_blocks = (size + bs - 1) / bs;
+    while (oi->inode.extent_count > 0) {
+        santfs_extent_t* e = extent_at(oi, oi->inode.extent_count - 1);
+        if (e->logical >= keep_blocks) {
+            free_run(vol, e->start, e->length);
+            oi->inode.blocks -= e->length;
+            oi->inode.extent_count--;
+            continue;
+        }
+        if (e->logical + e->length > keep_blocks) {
+            uint32_t keep = keep_blocks - e->logical;
+            free_run(vol, e->start + keep, e->length - keep);
+            oi->inode.blocks -= e->length - keep;
+            e->length = keep;
+        }
+        break;
+    }
+    // Give back the overflow blocks the shorter extent list no longer reaches
+    uint32_t extra = oi->inode.extent_count > SANTFS_INLINE_EXTENTS ? oi->inode.extent_count - SANTFS_INLINE_EXTENTS : 0;
+    uint32_t chain_needed = (extra + vol->extents_per_block - 1) / vol->extents_per_block;
+    while (oi->chain_length > chain_needed) {
+        free_run(vol, oi->chain[--oi->chain_length], 1);
+        oi->inode.blocks--;
+    }
+    if (oi->chain_length == 0) {
+        oi->inode.extent_block = 0;
+        free_overflow(oi);
+    }
+    
+    // Zero the rest of the last block, so growing the file again reads zeros
+    uint32_t run;
+    uint32_t phys = size % bs ? map_block(oi, size / bs, &run) : 0;
+    if (phys) {
+        if (read_blocks(vol, phys, 1, vol->block_buf) != 0) {
+            return -1;
+        }
+        memset(vol->block_buf + size % bs, 0, bs - size % bs);
+        if (write_blocks(vol, phys, 1, vol->block_buf) != 0) {
+            return -1;
+        }
+    }
+    
+    oi->inode.size = size;
+    oi->dirty = 1;
+    file->size = size;
+    return 0;
+}
+
+// Bitmaps go out before the inode, so after a crash a block a file points at
+// is never marked free
+static int santfs_close(vfs_file_t* file) {
+    santfs_volume_t* vol = (santfs_volume_t*)file->vnode->mount->fs;
+    int result = flush_metadata(vol);
+    if (put_open_inode(vol, (santfs_open_inode_t*)file->priv) != 0) {
+        result = -1;
+    }
+    if (flush_metadata(vol) != 0) {
+        result = -1;
+    }
+    file->priv = NULL;
+    return result;
+}
+
+static int santfs_sync(vfs_mount_t* mount) {
+    santfs_volume_t* vol = (santfs_volume_t*)mount->fs;
+    if (vol->read_only) {
+        return 0;
+    }
+    int result = flush_metadata(vol);
+    for (int i = 0; i < VFS_MAX_FILES; i++) {
+        if (vol->open[i].ino && write_open_inode(vol, &vol->open[i]) != 0) {
+            result = -1;
+        }
+    }
+    if (result == 0 && vol->super.state != SANTFS_STATE_CLEAN) {
+        vol->super.state = SANTFS_STATE_CLEAN;
+        result = write_super(vol);
+    }
+    return result;
+}
+
+static int santfs_statfs(vfs_mount_t* mount, statfs_t* st) {
+    santfs_volume_t* vol = (santfs_volume_t*)mount->fs;
+    st->block_size = vol->super.block_size;
+    st->total_blocks = vol->super.total_blocks - vol->super.data_start;
+    st->free_blocks = vol->super.free_blocks;
+    st->files = vol->super.inode_count - vol->super.free_inodes - 2;  // Not inode 0 or the root
+    return 0;
+}
+
+// ---- Mounting ----
+
+// Check a block device for a santfs superblock
+int santfs_probe(blkdev_t* dev) {
+    uint8_t sector[512];
+    if (blkdev_read(dev, 0, 1, sector) != 0) {
+        return 0;
+    }
+    return ((santfs_super_t*)sector)->magic == SANTFS_MAGIC;
+}
+
+static void unmount_buffers(santfs_volume_t* vol) {
+    if (vol->block_bitmap) {
+        pmem_free_pages((uint32_t)(uintptr_t)vol->block_bitmap, (vol->super.bitmap_blocks * vol->super.block_size + 4095) / 4096);
+    }
+    if (vol->inode_bitmap) {
+        pmem_free_pages((uint32_t)(uintptr_t)vol->inode_bitmap, (vol->super.inode_bitmap_blocks * vol->super.block_size + 4095) / 4096);
+    }
+    free(vol->bitmap_dirty);
+    free(vol->node_buf[0]);
+    free(vol->node_buf[1]);
+    free(vol->block_buf);
+}
+
+// Mount the volume on a device
+int santfs_mount(santfs_volume_t* vol, blkdev_t* dev) {
+    uint8_t sector[512];
+    memset(vol, 0, sizeof(*vol));
+    if (blkdev_read(dev, 0, 1, sector) != 0) {
+        return -1;
+    }
+    memcpy(&vol->super, sector, sizeof(santfs_super_t));
+    santfs_super_t* sb = &vol->super;
+    if (sb->magic != SANTFS_MAGIC) {
+        return -1;
+    }
+    
+    uint32_t bs = sb->block_size;
+    if (sb->version != SANTFS_VERSION || bs < SANTFS_MIN_BLOCK_SIZE || bs > SANTFS_MAX_BLOCK_SIZE ||
+        (bs & (bs - 1)) != 0 || sb->total_blocks > SANTFS_MAX_BLOCKS ||
+        (dev->total_sectors && sb->total_blocks > dev->total_sectors / (bs / 512)) ||
+        sb->bitmap_blocks * bs * 8 < sb->total_blocks ||
+        sb->inode_bitmap_blocks * bs * 8 < sb->inode_count || sb->inode_count <= SANTFS_ROOT_INO ||
+        sb->data_start >= sb->total_blocks) {
+        printf("santfs: %s: bad superblock\n", dev->name);
+        return -1;
+    }
+    if (sb->feature_incompat & ~SANTFS_SUPPORTED_INCOMPAT) {
+        printf("santfs: %s: unsupported features 0x%x\n", dev->name, sb->feature_incompat & ~SANTFS_SUPPORTED_INCOMPAT);
+        return -1;
+    }
+    if (sb->feature_ro_compat & ~SANTFS_SUPPORTED_RO_COMPAT) {
+        printf("santfs: %s: unknown read-only features 0x%x, mounting read-only\n", dev->name,
+               sb->feature_ro_compat & ~SANTFS_SUPPORTED_RO_COMPAT);
+        vol->read_only = 1;
+    }
+    if (sb->state != SANTFS_STATE_CLEAN) {
+        printf("santfs: %s: not synced before shutdown, free counts may be off\n", dev->name);
+    }
+    
+    vol->dev = dev;
+    vol->sectors_per_block = bs / 512;
+    vol->records_per_node = SANTFS_RECORDS_PER_NODE(bs);
+    vol->extents_per_block = SANTFS_EXTENTS_PER_BLOCK(bs);
+    vol->block_hint = sb->data_start;
+    vol->inode_hint = SANTFS_ROOT_INO + 1;
+    
+    // The bitmaps can be large: they come from the page allocator, not the heap
+    vol->block_bitmap = (uint8_t*)(uintptr_t)pmem_alloc_pages((sb->bitmap_blocks * bs + 4095) / 4096);
+    vol->inode_bitmap = (uint8_t*)(uintptr_t)pmem_alloc_pages((sb->inode_bitmap_blocks * bs + 4095) / 4096);
+    vol->bitmap_dirty = (uint8_t*)calloc(1, sb->bitmap_blocks + sb->inode_bitmap_blocks);
+    vol->node_buf[0] = (uint8_t*)malloc(bs);
+    vol->node_buf[1] = (uint8_t*)malloc(bs);
+    vol->block_buf = (uint8_t*)malloc(bs);
+    if (!vol->block_bitmap || !vol->inode_bitmap || !vol->bitmap_dirty ||
+        !vol->node_buf[0] || !vol->node_buf[1] || !vol->block_buf ||
+        read_blocks(vol, sb->bitmap_start, sb->bitmap_blocks, vol->block_bitmap) != 0 ||
+        read_blocks(vol, sb->inode_bitmap_start, sb->inode_bitmap_blocks, vol->inode_bitmap) != 0) {
+        unmount_buffers(vol);
+        return -1;
+    }
+    
+    santfs_inode_t root;
+    if (read_inode(vol, SANTFS_ROOT_INO, &root) != 0 || root.mode != SANTFS_MODE_DIR) {
+        printf("santfs: %s: no root directory\n", dev->name);
+        unmount_buffers(vol);
+        return -1;
+    }
+    return 0;
+}
+
+const vfs_ops_t santfs_vfs_ops = {
+    "santfs",
+    0,  // Names are case-sensitive
+    santfs_lookup,
+    santfs_create,
+    santfs_unlink,
+    santfs_readdir,
+    santfs_open,
+    santfs_read,
+    santfs_write,
+    santfs_truncate,
+    santfs_close,
+    santfs_sync,
+    santfs_statfs
+};
@@ -41,17 +41,38 @@ char* strchr(const char* str, int c) {
     return NULL;
 }
 
+// Large copies (program images, cached blocks) move 8 bytes at a time with rep movsq
 void* memcpy(void* dest, const void* src, size_t n) {
     uint8_t* d = (uint8_t*)dest;
     const uint8_t* s = (const uint8_t*)src;
+    if (n >= 64) {
+        while ((uintptr_t)d & 7) {
+            *d++ = *s++;
+            n--;
+        }
+        size_t words = n / 8;
+        __asm__ volatile("rep movsq" : "+D"(d), "+S"(s), "+c"(words) : : "memory");
+        n %= 8;
+    }
     for (size_t i = 0; i < n; i++) {
         d[i] = s[i];
     }
     return dest;
 }
 
+// Large fills (BSS, fresh buffers) store 8 bytes at a time with rep stosq
 void* memset(void* ptr, int value, size_t n) {
     uint8_t* p = (uint8_t*)ptr;
+    if (n >= 64) {
+        while ((uintptr_t)p & 7) {
+            *p++ = (uint8_t)value;
+            n--;
+        }
+        uint64_t pattern = (uint8_t)value * 0x0101010101010101ULL;
+        size_t words = n / 8;
+        __asm__ volatile("rep stosq" : "+D"(p), "+c"(words) : "a"(pattern) : "memory");
+        n %= 8;
+    }
     for (size_t i = 0; i < n; i++) {
         p[i] = (uint8_t)value;
     }
@@ -4,7 +4,12 @@
 #include "../include/string.h"
 #include "../include/vga.h"
 #include "../include/fat12.h"
+#include "../include/blkdev.h"
+#include "../include/keyboard.h"
 #include "../include/loader.h"
+#include "../include/fd.h"
+#include "../include/vfs.h"
+#include "../include/initrd.h"
 #include <stdarg.h>
 
 // I/O port helpers for VGA cursor position
@@ -52,6 +57,12 @@ uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_t arg2, uin
         case SYSCALL_GETCHAR:
             // Re-enable interrupts so keyboard IRQ can fire
             __asm__ volatile("sti");
+            // While the user is idle, write back disk data that has been dirty for a while
+            while (!keyboard_available()) {
+                fat12_idle();
+                blkdev_idle();
+                __asm__ volatile("hlt");
+            }
             result = (uint64_t)getchar();
             break;
             
@@ -120,10 +131,12 @@ uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_t arg2, uin
             break;
         
         // Filesystem syscalls
+        // arg1 = path (NULL = working directory)
         case SYSCALL_LIST_DIR:
-            result = (uint64_t)fat12_list_root();
+            result = (uint64_t)(int64_t)vfs_list(arg1 ? (const char*)arg1 : ".");
             break;
             
+        // Cluster-based calls on the boot volume, kept for older programs
         case SYSCALL_LIST_DIR_CLUSTER:
             result = (uint64_t)fat12_list_dir((uint16_t)arg1);
             break;
@@ -133,107 +146,198 @@ uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_t arg2, uin
             break;
             
         // File read syscall - reads entire file into buffer
-        // arg1 = filename, arg2 = buffer, arg3 = buffer size
-        // Returns bytes read, or 0 on error
+        // arg1 = path, arg2 = buffer, arg3 = buffer size
+        // Returns bytes read, or -1 on error
         case SYSCALL_READ_FILE: {
-            const char* fname = (const char*)arg1;
             uint8_t* buf = (uint8_t*)arg2;
             uint32_t buf_size = (uint32_t)arg3;
             
-            fat12_file_t file;
-            if (fat12_open(fname, &file) != 0) {
+            vfs_file_t* file = vfs_open((const char*)arg1, O_RDONLY);
+            if (!file) {
                 result = (uint64_t)(int64_t)-1;  // Return -1 on error (file not found)
                 break;
             }
             
-            uint32_t to_read = file.size < buf_size ? file.size : buf_size;
-            int bytes = fat12_read(&file, buf, to_read);
+            uint32_t to_read = file->size < buf_size ? file->size : buf_size;
+            int bytes = file->vnode->is_directory ? -1 : vfs_read(file, buf, to_read);
+            vfs_close(file);
             result = (uint64_t)(int64_t)(bytes >= 0 ? bytes : -1);  // Return actual bytes read (including 0 for empty files) or -1 on read error
             break;
         }
         
         // File create syscall - creates an empty file
-        // arg1 = filename
+        // arg1 = path
         // Returns 0 on success, -1 on error
         case SYSCALL_CREATE_FILE: {
-            const char* fname = (const char*)arg1;
-            fat12_file_t file;
-            result = (uint64_t)(int64_t)fat12_create(fname, &file);
+            vfs_file_t* file = vfs_open((const char*)arg1, O_WRONLY | O_CREAT);
+            result = (uint64_t)(int64_t)(file && vfs_close(file) == 0 ? 0 : -1);
             break;
         }
         
-        // File write syscall - writes buffer to existing file
-        // arg1 = filename, arg2 = buffer, arg3 = size
+        // File write syscall - replaces the contents of a file
+        // arg1 = path, arg2 = buffer, arg3 = size
+        // Clusters past the new end are freed; use open(O_APPEND) to add to a file
         // Returns bytes written, or 0 on error
         case SYSCALL_WRITE_FILE: {
-            const char* fname = (const char*)arg1;
             const uint8_t* buf = (const uint8_t*)arg2;
             uint32_t size = (uint32_t)arg3;
             
-            fat12_file_t file;
-            if (fat12_open(fname, &file) != 0) {
-                // File doesn't exist - try to create it
-                if (fat12_create(fname, &file) != 0) {
-                    result = 0;
-                    break;
-                }
+            vfs_file_t* file = vfs_open((const char*)arg1, O_WRONLY | O_CREAT);
+            if (!file) {
+                result = 0;
+                break;
+            }
+            if (size < file->size) {
+                vfs_truncate(file, size);
             }
             
-            int bytes = fat12_write(&file, buf, size);
-            if (bytes > 0) {
-                // Update directory entry with new file size
-                if (fat12_update_size(fname, (uint32_t)bytes) != 0) {
-                    result = 0;
-                    break;
-                }
+            // Only the FAT sectors and directory entry that changed are written back, at close
+            int bytes = size > 0 ? vfs_write(file, buf, size) : 0;
+            if (vfs_close(file) != 0 || bytes < 0) {
+                result = 0;
+                break;
             }
-            result = (uint64_t)(bytes > 0 ? bytes : 0);
+            result = (uint64_t)bytes;
             break;
         }
         
-        // Program load syscall - loads ELF and returns entry point
-        // Does NOT execute - caller must invoke the entry point from userspace
-        case SYSCALL_EXEC_PROGRAM: {
-            const char* filename = (const char*)arg1;
-            
-            // Prevent shell from executing itself (would overwrite its own code)
-            if (strcmp(filename, "SHELL.ELF") == 0 || strcmp(filename, "shell.elf") == 0) {
-                printf("Error: Cannot execute shell from within shell\n");
-                result = 0;
+        // Sync syscall - write back cached blocks and flush drive caches
+        // Returns 0 on success, -1 on error
+        case SYSCALL_SYNC:
+            result = (uint64_t)(int64_t)(vfs_sync() | blkdev_sync_all());
+            break;
+        
+        // Working directory syscalls
+        // arg1 = path; returns 0 or -1 if it is not a directory
+        case SYSCALL_CHDIR:
+            result = (uint64_t)(int64_t)vfs_chdir((const char*)arg1);
+            break;
+        
+        // arg1 = buffer, arg2 = buffer size; returns 0 or -1 if it does not fit
+        case SYSCALL_GETCWD:
+            result = (uint64_t)(int64_t)vfs_getcwd((char*)arg1, (uint32_t)arg2);
+            break;
+        
+        // arg1 = path; returns 0 or -1
+        case SYSCALL_UNLINK:
+            result = (uint64_t)(int64_t)vfs_unlink((const char*)arg1);
+            break;
+        
+        // arg1 = directory fd, arg2 = dirent_t buffer, arg3 = buffer size in bytes
+        // Returns bytes filled (0 at the end of the directory), or -1
+        case SYSCALL_GETDENTS:
+            result = (uint64_t)(int64_t)fd_getdents((int)arg1, (dirent_t*)arg2, (uint32_t)arg3);
+            break;
+        
+        // Defragment syscall - makes every file under a directory contiguous
+        // arg1 = directory path (NULL = working directory), arg2 = defrag_stat_t array, arg3 = its length
+        // Returns files examined (only the first arg3 are reported), or -1 if not a FAT directory
+        case SYSCALL_DEFRAG:
+            result = (uint64_t)(int64_t)fat12_defrag(arg1 ? (const char*)arg1 : ".", (defrag_stat_t*)arg2, (uint32_t)arg3);
+            break;
+        
+        // Filesystem usage syscall
+        // arg1 = mount index, arg2 = statfs_t* to fill
+        // Returns 0 on success, -1 if there is no mount at that index
+        case SYSCALL_STATFS:
+            result = (uint64_t)(int64_t)vfs_statfs((int)arg1, (statfs_t*)arg2);
+            break;
+        
+        // Block I/O statistics syscall
+        // arg1 = device index, arg2 = iostat_t* to fill, arg3 = 1 to reset the counters afterwards
+        // Returns 0 on success, -1 if there is no device at that index
+        case SYSCALL_IOSTAT: {
+            blkdev_t* dev = blkdev_get((int)arg1);
+            if (!dev) {
+                result = (uint64_t)(int64_t)-1;
                 break;
             }
-            
-            // First, open the file and check if it's a valid executable
-            fat12_file_t file;
-            if (fat12_open(filename, &file) != 0) {
-                printf("Error: Failed to open %s\n", filename);
-                result = 0;
-                break;
+            iostat_t* out = (iostat_t*)arg2;
+            if (out) {
+                *out = dev->stats;
             }
-            
-            // Read first sector to check for ELF magic number (0x7F 'E' 'L' 'F')
-            // Must be 512 bytes because fdc_read_sectors copies full sectors
-            uint8_t header[512];
-            if (fat12_read(&file, header, 4) != 4) {
-                printf("Error: Failed to read file header\n");
-                result = 0;
-                break;
+            if (arg3) {
+                char name[8];
+                memcpy(name, dev->stats.name, sizeof(name));
+                memset(&dev->stats, 0, sizeof(iostat_t));
+                memcpy(dev->stats.name, name, sizeof(name));
             }
+            result = 0;
+            break;
+        }
+        
+        // Program load syscall - loads ELF and returns entry point
+        // Does NOT execute - caller must invoke the entry point from userspace
+        case SYSCALL_EXEC_PROGRAM: {
+            const char* filename = (const char*)arg1;
             
-            // Check for ELF magic bytes
-            if (header[0] != 0x7F || header[1] != 'E' || header[2] != 'L' || header[3] != 'F') {
-                printf("Error: %s is not a valid executable (not ELF format)\n", filename);
-                result = 0;
-                break;
+            // Programs in the boot archive are checked in memory (load_program
+            // verifies the ELF header); anything else is probed on disk first
+            const uint8_t* image;
+            uint32_t image_size;
+            if (initrd_find(filename, &image, &image_size) == 0) {
+                const char* base = filename;
+                for (const char* c = filename; *c; c++) {
+                    if (*c == '/') base = c + 1;
+                }
+                if (strcmp(base, "SHELL.ELF") == 0 || strcmp(base, "shell.elf") == 0) {
+                    printf("Error: Cannot execute shell from within shell\n");
+                    result = 0;
+                    break;
+                }
+            } else {
+                // First, open the file and check if it's a valid executable
+                vfs_file_t* file = vfs_open(filename, O_RDONLY);
+                if (!file) {
+                    printf("Error: Failed to open %s\n", filename);
+                    result = 0;
+                    break;
+                }
+                
+                // Prevent shell from executing itself (would overwrite its own code)
+                if (strcmp(file->vnode->name, "SHELL.ELF") == 0 || strcmp(file->vnode->name, "shell.elf") == 0) {
+                    printf("Error: Cannot execute shell from within shell\n");
+                    vfs_close(file);
+                    result = 0;
+                    break;
+                }
+                
+                // Read the start of the file to check for the ELF magic number (0x7F 'E' 'L' 'F')
+                uint8_t header[4];
+                int got = file->vnode->is_directory ? -1 : vfs_read(file, header, 4);
+                vfs_close(file);
+                if (got != 4) {
+                    printf("Error: Failed to read file header\n");
+                    result = 0;
+                    break;
+                }
+                
+                // Check for ELF magic bytes
+                if (header[0] != 0x7F || header[1] != 'E' || header[2] != 'L' || header[3] != 'F') {
+                    printf("Error: %s is not a valid executable (not ELF format)\n", filename);
+                    result = 0;
+                    break;
+                }
             }
             
-            void* load_addr = (void*)0x500000;  // Load at 5MB (after kernel at 2MB)
+            void* load_addr = (void*)0x500000;  // Load at 5MB (after kernel at 2MB) unless position-independent
             
             // Load the program and return the entry point to userspace
             result = load_program(filename, load_addr);
+            if (result != 0) {
+                fd_process_enter();  // Program starts with no open files
+            }
             break;
         }
         
+        // Program exit syscall - called by exec_program once the program returns
+        // Closes the descriptors the program left open and frees its pages
+        case SYSCALL_EXIT_PROGRAM:
+            fd_process_exit();
+            unload_program();
+            result = 0;
+            break;
+        
         // VGA buffer save/restore syscalls
         case SYSCALL_SAVE_VGA: {
             uint16_t* vga = (uint16_t*)0xB8000;
@@ -256,6 +360,41 @@ uint64_t syscall_handler(uint64_t syscall_num, uint64_t arg1, uint64_t arg2, uin
             result = 0;
             break;
         }
+        
+        // File descriptor syscalls (see fd.h)
+        // arg1 = filename, arg2 = O_* flags; returns descriptor or -1
+        case SYSCALL_OPEN:
+            result = (uint64_t)(int64_t)fd_open((const char*)arg1, (int)arg2);
+            break;
+        
+        // arg1 = fd, arg2 = buffer, arg3 = size; returns bytes transferred or -1
+        case SYSCALL_READ:
+            result = (uint64_t)(int64_t)fd_read((int)arg1, (uint8_t*)arg2, (uint32_t)arg3);
+            break;
+        
+        case SYSCALL_WRITE:
+            result = (uint64_t)(int64_t)fd_write((int)arg1, (const uint8_t*)arg2, (uint32_t)arg3);
+            break;
+        
+        // arg1 = fd, arg2 = offset, arg3 = SEEK_SET/SEEK_CUR/SEEK_END; returns new offset or -1
+        case SYSCALL_LSEEK:
+            result = (uint64_t)fd_lseek((int)arg1, (int64_t)arg2, (int)arg3);
+            break;
+        
+        // arg1 = fd; returns 0 or -1
+        case SYSCALL_CLOSE:
+            result = (uint64_t)(int64_t)fd_close((int)arg1);
+            break;
+        
+        // arg1 = fd, arg2 = stat_t* to fill; returns 0 or -1
+        case SYSCALL_FSTAT:
+            result = (uint64_t)(int64_t)fd_fstat((int)arg1, (stat_t*)arg2);
+            break;
+        
+        // arg1 = fd, arg2 = new size (not larger than the file); returns 0 or -1
+        case SYSCALL_FTRUNCATE:
+            result = (uint64_t)(int64_t)fd_truncate((int)arg1, (uint32_t)arg2);
+            break;
             
         default:
             result = (uint64_t)-1;  // Invalid syscall
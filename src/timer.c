@@ -22,6 +22,15 @@ static inline void outb(uint16_t port, uint8_t value) {
 static volatile uint64_t timer_ticks = 0;
 static uint32_t timer_frequency = 0;
 
+// TSC cycles per microsecond (0 until calibrated)
+static uint64_t tsc_per_us = 0;
+
+static inline uint64_t rdtsc(void) {
+    uint32_t lo, hi;
+    __asm__ volatile("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
 // Timer interrupt handler (called from assembly)
 void timer_handler(void) {
     timer_ticks++;
@@ -74,7 +83,25 @@ void timer_init(uint32_t frequency) {
     // Enable interrupts
     __asm__ volatile("sti");
     
-    printf("Timer initialized at %d Hz\n", frequency);
+    // Calibrate the TSC over 10 ticks (starting on a tick edge)
+    uint64_t tick = timer_ticks;
+    while (timer_ticks == tick) __asm__ volatile("hlt");
+    uint64_t tsc_start = rdtsc();
+    tick = timer_ticks;
+    while (timer_ticks < tick + 10) __asm__ volatile("hlt");
+    uint64_t cycles = rdtsc() - tsc_start;
+    tsc_per_us = cycles * frequency / (10 * 1000000ULL);
+    
+    printf("Timer initialized at %d Hz (TSC %d MHz)\n", frequency, (uint32_t)tsc_per_us);
+}
+
+// Microseconds since boot; falls back to tick resolution without a usable TSC
+uint64_t timer_get_us(void) {
+    if (timer_frequency == 0) return 0;
+    if (tsc_per_us == 0) {
+        return timer_ticks * (1000000 / timer_frequency);
+    }
+    return rdtsc() / tsc_per_us;
 }
 
 // Get current tick count
@@ -0,0 +1,275 @@
+#include "../include/tmpfs.h"
+#include "../include/memory.h"
+#include "../include/heap.h"
+#include "../include/string.h"
+
+// vnode->ino is the node's slot + 1 (0 = the root directory)
+
+// Take a page from the physical allocator within the instance's limit
+// Returns: page address, or 0 if the limit is reached or memory is out
+static uint32_t take_page(tmpfs_t* fs) {
+    if (fs->pages_used >= fs->page_limit) {
+        return 0;
+    }
+    uint32_t page = pmem_alloc_page();
+    if (page) {
+        fs->pages_used++;
+    }
+    return page;
+}
+
+static void put_page(tmpfs_t* fs, uint32_t page) {
+    pmem_free_page(page);
+    fs->pages_used--;
+}
+
+// Slot holding the address of data page 'n' of a node, allocating the index
+// page if 'alloc' is set
+// Returns: slot, or NULL past the largest file size or if out of pages
+static uint32_t* data_slot(tmpfs_t* fs, tmpfs_node_t* node, uint32_t n, int alloc) {
+    uint32_t i = n / TMPFS_PAGES_PER_INDEX;
+    if (i >= TMPFS_INDEX_PAGES) {
+        return NULL;
+    }
+    if (!node->index[i]) {
+        if (!alloc || !(node->index[i] = take_page(fs))) {
+            return NULL;
+        }
+        memset((void*)(uintptr_t)node->index[i], 0, TMPFS_PAGE_SIZE);
+    }
+    return &((uint32_t*)(uintptr_t)node->index[i])[n % TMPFS_PAGES_PER_INDEX];
+}
+
+// Free data pages from page 'first' on, and index pages left empty
+static void free_pages_from(tmpfs_t* fs, tmpfs_node_t* node, uint32_t first) {
+    for (uint32_t i = first / TMPFS_PAGES_PER_INDEX; i < TMPFS_INDEX_PAGES; i++) {
+        if (!node->index[i]) {
+            continue;
+        }
+        uint32_t* slots = (uint32_t*)(uintptr_t)node->index[i];
+        uint32_t from = i == first / TMPFS_PAGES_PER_INDEX ? first % TMPFS_PAGES_PER_INDEX : 0;
+        for (uint32_t k = from; k < TMPFS_PAGES_PER_INDEX; k++) {
+            if (slots[k]) {
+                put_page(fs, slots[k]);
+                slots[k] = 0;
+                node->pages--;
+            }
+        }
+        if (from == 0) {
+            put_page(fs, node->index[i]);
+            node->index[i] = 0;
+        }
+    }
+}
+
+// Drop a node and its pages
+static void release_node(tmpfs_t* fs, tmpfs_node_t* node) {
+    free_pages_from(fs, node, 0);
+    fs->bytes -= node->size;
+    node->used = 0;
+}
+
+static tmpfs_node_t* find_node(tmpfs_t* fs, const char* name) {
+    for (int i = 0; i < TMPFS_MAX_FILES; i++) {
+        tmpfs_node_t* node = &fs->nodes[i];
+        if (node->used && !node->unlinked && strcmp(node->name, name) == 0) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+// Create an instance
+tmpfs_t* tmpfs_create(uint32_t page_limit) {
+    tmpfs_t* fs = (tmpfs_t*)calloc(1, sizeof(tmpfs_t));
+    if (fs) {
+        fs->page_limit = page_limit;
+    }
+    return fs;
+}
+
+static int tmpfs_lookup(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child) {
+    tmpfs_t* fs = (tmpfs_t*)dir->mount->fs;
+    tmpfs_node_t* node = find_node(fs, name);
+    if (!node) {
+        return -1;
+    }
+    child->ino = (uint32_t)(node - fs->nodes) + 1;
+    child->is_directory = 0;
+    return 0;
+}
+
+static int tmpfs_create_file(vfs_vnode_t* dir, const char* name, vfs_vnode_t* child) {
+    tmpfs_t* fs = (tmpfs_t*)dir->mount->fs;
+    for (int i = 0; i < TMPFS_MAX_FILES; i++) {
+        tmpfs_node_t* node = &fs->nodes[i];
+        if (!node->used) {
+            memset(node, 0, sizeof(*node));
+            node->used = 1;
+            strcpy(node->name, name);
+            fs->files++;
+            child->ino = (uint32_t)i + 1;
+            child->is_directory = 0;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static int tmpfs_unlink(vfs_vnode_t* dir, const char* name) {
+    tmpfs_t* fs = (tmpfs_t*)dir->mount->fs;
+    tmpfs_node_t* node = find_node(fs, name);
+    if (!node) {
+        return -1;
+    }
+    fs->files--;
+    if (node->open_count > 0) {
+        node->unlinked = 1;  // Open files keep reading it; freed at the last close
+    } else {
+        release_node(fs, node);
+    }
+    return 0;
+}
+
+// The cookie is the next node slot to look at
+static int tmpfs_readdir(vfs_vnode_t* dir, uint32_t* cookie, vfs_dirent_t* entries, uint32_t count) {
+    tmpfs_t* fs = (tmpfs_t*)dir->mount->fs;
+    uint32_t filled = 0;
+    while (*cookie < TMPFS_MAX_FILES && filled < count) {
+        tmpfs_node_t* node = &fs->nodes[(*cookie)++];
+        if (!node->used || node->unlinked) {
+            continue;
+        }
+        vfs_dirent_t* e = &entries[filled++];
+        memset(e, 0, sizeof(*e));
+        strcpy(e->name, node->name);
+        e->size = node->size;
+        e->ino = *cookie;
+    }
+    return (int)filled;
+}
+
+static int tmpfs_open(vfs_file_t* file) {
+    tmpfs_t* fs = (tmpfs_t*)file->vnode->mount->fs;
+    tmpfs_node_t* node = &fs->nodes[file->vnode->ino - 1];
+    node->open_count++;
+    file->priv = node;
+    file->size = node->size;
+    return 0;
+}
+
+static int tmpfs_read(vfs_file_t* file, uint8_t* buffer, uint32_t size) {
+    tmpfs_t* fs = (tmpfs_t*)file->vnode->mount->fs;
+    tmpfs_node_t* node = (tmpfs_node_t*)file->priv;
+    if (file->position >= node->size) {
+        return 0;
+    }
+    if (size > node->size - file->position) {
+        size = node->size - file->position;
+    }
+    
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t offset = file->position + done;
+        uint32_t in_page = offset % TMPFS_PAGE_SIZE;
+        uint32_t n = TMPFS_PAGE_SIZE - in_page;
+        if (n > size - done) n = size - done;
+        
+        uint32_t* slot = data_slot(fs, node, offset / TMPFS_PAGE_SIZE, 0);
+        if (slot && *slot) {
+            memcpy(buffer + done, (uint8_t*)(uintptr_t)*slot + in_page, n);
+        } else {
+            memset(buffer + done, 0, n);
+        }
+        done += n;
+    }
+    return (int)done;
+}
+
+static int tmpfs_write(vfs_file_t* file, const uint8_t* buffer, uint32_t size) {
+    tmpfs_t* fs = (tmpfs_t*)file->vnode->mount->fs;
+    tmpfs_node_t* node = (tmpfs_node_t*)file->priv;
+    
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t offset = file->position + done;
+        uint32_t in_page = offset % TMPFS_PAGE_SIZE;
+        uint32_t n = TMPFS_PAGE_SIZE - in_page;
+        if (n > size - done) n = size - done;
+        
+        uint32_t* slot = data_slot(fs, node, offset / TMPFS_PAGE_SIZE, 1);
+        if (slot && !*slot && (*slot = take_page(fs)) != 0) {
+            node->pages++;
+        }
+        if (!slot || !*slot) {
+            break;  // File too large or out of pages
+        }
+        memcpy((uint8_t*)(uintptr_t)*slot + in_page, buffer + done, n);
+        done += n;
+    }
+    
+    if (file->position + done > node->size) {
+        fs->bytes += file->position + done - node->size;
+        node->size = file->position + done;
+    }
+    file->size = node->size;
+    return done > 0 || size == 0 ? (int)done : -1;
+}
+
+static int tmpfs_truncate(vfs_file_t* file, uint32_t size) {
+    tmpfs_t* fs = (tmpfs_t*)file->vnode->mount->fs;
+    tmpfs_node_t* node = (tmpfs_node_t*)file->priv;
+    if (size > node->size) {
+        return -1;
+    }
+    free_pages_from(fs, node, (size + TMPFS_PAGE_SIZE - 1) / TMPFS_PAGE_SIZE);
+    fs->bytes -= node->size - size;
+    node->size = size;
+    file->size = size;
+    return 0;
+}
+
+static int tmpfs_close(vfs_file_t* file) {
+    tmpfs_t* fs = (tmpfs_t*)file->vnode->mount->fs;
+    tmpfs_node_t* node = (tmpfs_node_t*)file->priv;
+    if (--node->open_count == 0 && node->unlinked) {
+        release_node(fs, node);
+    }
+    file->priv = NULL;
+    return 0;
+}
+
+static int tmpfs_sync(vfs_mount_t* mount) {
+    (void)mount;
+    return 0;  // Nothing to write back
+}
+
+static int tmpfs_statfs(vfs_mount_t* mount, statfs_t* st) {
+    tmpfs_t* fs = (tmpfs_t*)mount->fs;
+    uint32_t free_pages = fs->page_limit - fs->pages_used;
+    if (free_pages > pmem_get_free_pages()) {
+        free_pages = pmem_get_free_pages();
+    }
+    st->block_size = TMPFS_PAGE_SIZE;
+    st->total_blocks = fs->page_limit;
+    st->free_blocks = free_pages;
+    st->files = fs->files;
+    st->bytes_used = fs->bytes;
+    return 0;
+}
+
+const vfs_ops_t tmpfs_vfs_ops = {
+    "tmpfs",
+    0,  // Names are case-sensitive
+    tmpfs_lookup,
+    tmpfs_create_file,
+    tmpfs_unlink,
+    tmpfs_readdir,
+    tmpfs_open,
+    tmpfs_read,
+    tmpfs_write,
+    tmpfs_truncate,
+    tmpfs_close,
+    tmpfs_sync,
+    tmpfs_statfs
+};
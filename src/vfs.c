@@ -0,0 +1,640 @@
+#include "../include/vfs.h"
+#include "../include/fd.h"
+#include "../include/stdio.h"
+#include "../include/string.h"
+#include "../include/ctype.h"
+#include "../include/initrd.h"
+#include "../include/imgcache.h"
+
+static vfs_mount_t mounts[VFS_MAX_MOUNTS];
+static vfs_vnode_t vnodes[VFS_MAX_VNODES];
+static vfs_vnode_t* hash_table[VFS_HASH_BUCKETS];
+static vfs_file_t files[VFS_MAX_FILES];
+static uint32_t vnode_clock = 0;
+
+// readdir cookies at or above this walk the mount points of a directory
+#define COOKIE_MOUNTS 0x80000000u
+
+// Reset the mount table and caches
+void vfs_init(void) {
+    memset(mounts, 0, sizeof(mounts));
+    memset(vnodes, 0, sizeof(vnodes));
+    memset(hash_table, 0, sizeof(hash_table));
+    memset(files, 0, sizeof(files));
+    vnode_clock = 0;
+}
+
+// Hash of (parent, name); case is folded so every filesystem can share it
+static uint32_t name_hash(const vfs_vnode_t* parent, const char* name) {
+    uint32_t h = 2166136261u ^ (uint32_t)(uintptr_t)parent;  // FNV-1a
+    while (*name) {
+        h = (h ^ (uint8_t)toupper(*name++)) * 16777619u;
+    }
+    return h % VFS_HASH_BUCKETS;
+}
+
+// Compare two names by the rules of the filesystem holding directory 'dir'
+static int names_match(const vfs_vnode_t* dir, const char* a, const char* b) {
+    if (!dir->mount->ops->case_insensitive) {
+        return strcmp(a, b) == 0;
+    }
+    while (*a && toupper(*a) == toupper(*b)) {
+        a++;
+        b++;
+    }
+    return toupper(*a) == toupper(*b);
+}
+
+static vfs_vnode_t* hash_find(vfs_vnode_t* parent, const char* name) {
+    for (vfs_vnode_t* v = hash_table[name_hash(parent, name)]; v; v = v->hash_next) {
+        if (v->parent == parent && names_match(parent, v->name, name)) {
+            return v;
+        }
+    }
+    return NULL;
+}
+
+static void hash_insert(vfs_vnode_t* v) {
+    uint32_t bucket = name_hash(v->parent, v->name);
+    v->hash_next = hash_table[bucket];
+    hash_table[bucket] = v;
+    v->hashed = 1;
+}
+
+static void hash_remove(vfs_vnode_t* v) {
+    vfs_vnode_t** link = &hash_table[name_hash(v->parent, v->name)];
+    while (*link && *link != v) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = v->hash_next;
+    }
+    v->hash_next = NULL;
+    v->hashed = 0;
+}
+
+// Take an extra reference
+void vfs_retain(vfs_vnode_t* vnode) {
+    vnode->refcount++;
+}
+
+// Return a vnode slot, dropping its reference on the parent
+static void vnode_free(vfs_vnode_t* v) {
+    vfs_vnode_t* parent = v->parent;
+    if (v->hashed) {
+        hash_remove(v);
+    }
+    memset(v, 0, sizeof(*v));
+    if (parent && parent != v) {
+        vfs_release(parent);
+    }
+}
+
+// Drop a reference; unreferenced vnodes stay cached until evicted, unless
+// they were unlinked
+void vfs_release(vfs_vnode_t* vnode) {
+    if (!vnode || vnode->refcount == 0) {
+        return;
+    }
+    vnode->refcount--;
+    if (vnode->refcount == 0 && !vnode->hashed) {
+        vnode_free(vnode);
+    }
+}
+
+// Get a free vnode slot, evicting the least recently used unreferenced one
+static vfs_vnode_t* vnode_alloc(void) {
+    vfs_vnode_t* victim = NULL;
+    for (int i = 0; i < VFS_MAX_VNODES; i++) {
+        if (!vnodes[i].used) {
+            return &vnodes[i];
+        }
+        if (vnodes[i].refcount == 0 && (!victim || vnodes[i].last_used < victim->last_used)) {
+            victim = &vnodes[i];
+        }
+    }
+    if (victim) {
+        vnode_free(victim);
+    }
+    return victim;
+}
+
+// Set up a cached child of 'dir' (the new vnode holds a reference on dir,
+// the caller gets one on the child)
+static vfs_vnode_t* add_child(vfs_vnode_t* dir, const vfs_vnode_t* found) {
+    vfs_vnode_t* v = vnode_alloc();
+    if (!v) {
+        return NULL;
+    }
+    *v = *found;
+    v->used = 1;
+    v->refcount = 1;
+    v->mount = dir->mount;
+    v->parent = dir;
+    v->last_used = ++vnode_clock;
+    vfs_retain(dir);
+    hash_insert(v);
+    return v;
+}
+
+// Find one component in a directory
+// Returns: referenced vnode, or NULL if it does not exist
+static vfs_vnode_t* lookup_child(vfs_vnode_t* dir, const char* name) {
+    if (strcmp(name, ".") == 0) {
+        vfs_retain(dir);
+        return dir;
+    }
+    if (strcmp(name, "..") == 0) {
+        vfs_retain(dir->parent);
+        return dir->parent;
+    }
+    if (strlen(name) >= VFS_NAME_MAX) {
+        return NULL;
+    }
+    
+    // Path-walk cache (mount roots are hashed under their mount point)
+    vfs_vnode_t* v = hash_find(dir, name);
+    if (v) {
+        v->last_used = ++vnode_clock;
+        vfs_retain(v);
+        return v;
+    }
+    
+    // Ask the filesystem; it may replace the name with its own spelling
+    vfs_vnode_t found;
+    memset(&found, 0, sizeof(found));
+    strcpy(found.name, name);
+    if (dir->mount->ops->lookup(dir, name, &found) != 0) {
+        return NULL;
+    }
+    return add_child(dir, &found);
+}
+
+// Look up a name in a directory
+vfs_vnode_t* vfs_lookup(vfs_vnode_t* dir, const char* name) {
+    if (!dir || !dir->is_directory || !name || !name[0]) {
+        return NULL;
+    }
+    return lookup_child(dir, name);
+}
+
+// Referenced vnode a relative path starts from
+static vfs_vnode_t* start_vnode(const char* path) {
+    vfs_vnode_t* start = path[0] == '/' ? NULL : fd_cwd();
+    if (!start) {
+        start = mounts[0].root;
+    }
+    if (start) {
+        vfs_retain(start);
+    }
+    return start;
+}
+
+// Copy the next component of *path into name, advancing *path past it
+// Returns: 1 if a component was found, 0 at the end, -1 if it is too long
+static int next_component(const char** path, char name[VFS_NAME_MAX]) {
+    const char* p = *path;
+    while (*p == '/') p++;
+    if (!*p) {
+        *path = p;
+        return 0;
+    }
+    
+    int len = 0;
+    while (p[len] && p[len] != '/') {
+        if (len == VFS_NAME_MAX - 1) return -1;
+        name[len] = p[len];
+        len++;
+    }
+    name[len] = '\0';
+    *path = p + len;
+    return 1;
+}
+
+// Walk a path; with 'leaf' set the last component is not looked up but copied
+// into leaf (empty if the path has no components, like "/")
+// Returns: referenced vnode, or NULL on error
+static vfs_vnode_t* walk(const char* path, char* leaf) {
+    if (!path) return NULL;
+    vfs_vnode_t* cur = start_vnode(path);
+    if (!cur) return NULL;
+    
+    char name[VFS_NAME_MAX];
+    if (leaf) leaf[0] = '\0';
+    for (;;) {
+        int found = next_component(&path, name);
+        if (found < 0) {
+            vfs_release(cur);
+            return NULL;
+        }
+        if (found == 0) {
+            return cur;
+        }
+        if (leaf) {
+            // Stop before the last component
+            const char* rest = path;
+            while (*rest == '/') rest++;
+            if (!*rest) {
+                strcpy(leaf, name);
+                return cur;
+            }
+        }
+        if (!cur->is_directory) {
+            vfs_release(cur);
+            return NULL;
+        }
+        
+        vfs_vnode_t* next = lookup_child(cur, name);
+        vfs_release(cur);
+        if (!next) {
+            return NULL;
+        }
+        cur = next;
+    }
+}
+
+// Resolve a path to a vnode
+vfs_vnode_t* vfs_resolve(const char* path) {
+    return walk(path, NULL);
+}
+
+// Mount a filesystem
+int vfs_mount(const char* path, const vfs_ops_t* ops, void* fs) {
+    if (!path || !ops || strlen(path) >= VFS_PATH_MAX) {
+        return -1;
+    }
+    
+    vfs_mount_t* m = NULL;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (!mounts[i].used) {
+            m = &mounts[i];
+            break;
+        }
+    }
+    // The root has to be mounts[0], and only the root may be mounted at "/"
+    int is_root = strcmp(path, "/") == 0;
+    if (!m || is_root != (m == &mounts[0])) {
+        return -1;
+    }
+    
+    vfs_vnode_t* dir = NULL;
+    char leaf[VFS_NAME_MAX];
+    if (!is_root) {
+        dir = walk(path, leaf);
+        if (!dir || !dir->is_directory || leaf[0] == '\0' ||
+            strcmp(leaf, ".") == 0 || strcmp(leaf, "..") == 0) {
+            vfs_release(dir);
+            return -1;
+        }
+        // Hide whatever the parent filesystem has under that name
+        vfs_vnode_t* shadowed = hash_find(dir, leaf);
+        if (shadowed) {
+            if (shadowed->mount != dir->mount) {
+                vfs_release(dir);
+                return -1;  // Already a mount point
+            }
+            hash_remove(shadowed);
+            if (shadowed->refcount == 0) {
+                vnode_free(shadowed);
+            }
+        }
+    }
+    
+    vfs_vnode_t* root = vnode_alloc();
+    if (!root) {
+        vfs_release(dir);
+        return -1;
+    }
+    
+    m->used = 1;
+    strcpy(m->path, path);
+    m->ops = ops;
+    m->fs = fs;
+    m->root = root;
+    m->covered = dir;  // Keeps the reference taken by walk
+    
+    root->used = 1;
+    root->is_directory = 1;
+    root->refcount = 1;  // Held by the mount
+    root->mount = m;
+    root->last_used = ++vnode_clock;
+    if (is_root) {
+        root->parent = root;
+    } else {
+        strcpy(root->name, leaf);
+        root->parent = dir;
+        vfs_retain(dir);
+        hash_insert(root);
+    }
+    return 0;
+}
+
+// Enumerate mounts
+vfs_mount_t* vfs_get_mount(int index) {
+    if (index < 0 || index >= VFS_MAX_MOUNTS || !mounts[index].used) {
+        return NULL;
+    }
+    return &mounts[index];
+}
+
+// Open a file
+vfs_file_t* vfs_open(const char* path, int flags) {
+    int mode = flags & O_ACCMODE;
+    if (mode != O_RDONLY && mode != O_WRONLY && mode != O_RDWR) {
+        return NULL;
+    }
+    
+    vfs_file_t* file = NULL;
+    for (int i = 0; i < VFS_MAX_FILES; i++) {
+        if (!files[i].used) {
+            file = &files[i];
+            break;
+        }
+    }
+    if (!file) {
+        return NULL;
+    }
+    
+    char leaf[VFS_NAME_MAX];
+    vfs_vnode_t* dir = walk(path, leaf);
+    if (!dir) {
+        return NULL;
+    }
+    
+    vfs_vnode_t* v;
+    if (leaf[0] == '\0') {
+        v = dir;  // Path names a directory
+    } else if (!dir->is_directory) {
+        vfs_release(dir);
+        return NULL;
+    } else {
+        v = lookup_child(dir, leaf);
+        if (!v && (flags & O_CREAT) && mode != O_RDONLY && dir->mount->ops->create &&
+            strlen(leaf) < VFS_NAME_MAX && strcmp(leaf, ".") != 0 && strcmp(leaf, "..") != 0) {
+            vfs_vnode_t created;
+            memset(&created, 0, sizeof(created));
+            strcpy(created.name, leaf);
+            if (dir->mount->ops->create(dir, leaf, &created) == 0) {
+                v = add_child(dir, &created);
+            }
+        }
+        vfs_release(dir);
+    }
+    if (!v) {
+        return NULL;
+    }
+    if (v->is_directory && mode != O_RDONLY) {
+        vfs_release(v);
+        return NULL;
+    }
+    if (mode != O_RDONLY) {
+        imgcache_forget(v);  // A cached program image is about to go stale
+    }
+    if (mode != O_RDONLY && v->parent == mounts[0].root) {
+        initrd_forget(v->name);  // The boot archive copy is about to go stale
+    }
+    
+    memset(file, 0, sizeof(*file));
+    file->vnode = v;
+    file->flags = (uint16_t)(flags & (O_ACCMODE | O_APPEND));
+    if (!v->is_directory && v->mount->ops->open(file) != 0) {
+        vfs_release(v);
+        return NULL;
+    }
+    file->used = 1;
+    
+    if ((flags & O_TRUNC) && mode != O_RDONLY && file->size > 0) {
+        vfs_truncate(file, 0);
+    }
+    return file;
+}
+
+// Let every open file of a vnode see a size change made through one of them
+static void share_size(vfs_file_t* file) {
+    for (int i = 0; i < VFS_MAX_FILES; i++) {
+        if (files[i].used && files[i].vnode == file->vnode) {
+            files[i].size = file->size;
+        }
+    }
+}
+
+// Read from a file
+int vfs_read(vfs_file_t* file, uint8_t* buffer, uint32_t size) {
+    if (!file || !file->used || file->vnode->is_directory ||
+        (file->flags & O_ACCMODE) == O_WRONLY || !buffer) {
+        return -1;
+    }
+    int bytes = file->vnode->mount->ops->read(file, buffer, size);
+    if (bytes > 0) {
+        file->position += bytes;
+    }
+    return bytes;
+}
+
+// Write to a file
+int vfs_write(vfs_file_t* file, const uint8_t* buffer, uint32_t size) {
+    if (!file || !file->used || (file->flags & O_ACCMODE) == O_RDONLY || !buffer) {
+        return -1;
+    }
+    if (file->flags & O_APPEND) {
+        file->position = file->size;
+    }
+    int bytes = file->vnode->mount->ops->write(file, buffer, size);
+    if (bytes > 0) {
+        file->position += bytes;
+        share_size(file);
+    }
+    return bytes;
+}
+
+// Shrink a file
+int vfs_truncate(vfs_file_t* file, uint32_t size) {
+    if (!file || !file->used || (file->flags & O_ACCMODE) == O_RDONLY || size > file->size) {
+        return -1;
+    }
+    if (size == file->size) {
+        return 0;
+    }
+    if (file->vnode->mount->ops->truncate(file, size) != 0) {
+        return -1;
+    }
+    share_size(file);
+    if (file->position > size) {
+        file->position = size;
+    }
+    return 0;
+}
+
+// Close a file
+int vfs_close(vfs_file_t* file) {
+    if (!file || !file->used) {
+        return -1;
+    }
+    int result = 0;
+    if (!file->vnode->is_directory) {
+        result = file->vnode->mount->ops->close(file);
+    }
+    vfs_release(file->vnode);
+    file->used = 0;
+    return result;
+}
+
+// Remove a file
+int vfs_unlink(const char* path) {
+    char leaf[VFS_NAME_MAX];
+    vfs_vnode_t* dir = walk(path, leaf);
+    if (!dir) {
+        return -1;
+    }
+    
+    int result = -1;
+    vfs_vnode_t* v = (leaf[0] && dir->is_directory) ? lookup_child(dir, leaf) : NULL;
+    if (v && !v->is_directory && v->mount->ops->unlink &&
+        v->mount->ops->unlink(dir, v->name) == 0) {
+        // Open files keep the vnode alive, but the name no longer resolves
+        hash_remove(v);
+        imgcache_forget(v);
+        if (dir == mounts[0].root) {
+            initrd_forget(v->name);
+        }
+        result = 0;
+    }
+    vfs_release(v);
+    vfs_release(dir);
+    return result;
+}
+
+// Read directory entries, then the mount points inside the directory
+int vfs_readdir(vfs_vnode_t* dir, uint32_t* cookie, vfs_dirent_t* entries, uint32_t count) {
+    if (!dir || !dir->is_directory) {
+        return -1;
+    }
+    
+    uint32_t filled = 0;
+    if (*cookie < COOKIE_MOUNTS) {
+        int n = dir->mount->ops->readdir(dir, cookie, entries, count);
+        if (n < 0) {
+            return -1;
+        }
+        filled = (uint32_t)n;
+        if (filled == count) {
+            return filled;
+        }
+        *cookie = COOKIE_MOUNTS;
+    }
+    
+    for (uint32_t i = *cookie - COOKIE_MOUNTS; i < VFS_MAX_MOUNTS && filled < count; i++) {
+        *cookie = COOKIE_MOUNTS + i + 1;
+        if (!mounts[i].used || mounts[i].covered != dir) {
+            continue;
+        }
+        vfs_dirent_t* e = &entries[filled++];
+        memset(e, 0, sizeof(*e));
+        strcpy(e->name, mounts[i].root->name);
+        e->ino = mounts[i].root->ino;
+        e->is_directory = 1;
+        e->attributes = DIRENT_DIRECTORY;
+    }
+    return filled;
+}
+
+// Read the next batch of a directory opened as a file
+int vfs_getdents(vfs_file_t* file, vfs_dirent_t* entries, uint32_t count) {
+    if (!file || !file->used || !file->vnode->is_directory || !entries) {
+        return -1;
+    }
+    return vfs_readdir(file->vnode, &file->position, entries, count);
+}
+
+// Print a directory listing
+int vfs_list(const char* path) {
+    vfs_vnode_t* dir = vfs_resolve(path);
+    if (!dir || !dir->is_directory) {
+        vfs_release(dir);
+        return -1;
+    }
+    
+    printf(dir == mounts[0].root ? "Root directory:\n" : "Directory contents:\n");
+    printf("%-12s %10s\n", "Name", "Size");
+    printf("------------------------\n");
+    
+    vfs_dirent_t entries[8];
+    uint32_t cookie = 0;
+    int n;
+    do {
+        n = vfs_readdir(dir, &cookie, entries, 8);
+        for (int i = 0; i < n; i++) {
+            if (entries[i].is_directory) {
+                printf("%-12s %10s\n", entries[i].name, "<DIR>");
+            } else {
+                printf("%-12s %10d\n", entries[i].name, entries[i].size);
+            }
+        }
+    } while (n == 8);
+    
+    vfs_release(dir);
+    return n < 0 ? -1 : 0;
+}
+
+// Change the working directory
+int vfs_chdir(const char* path) {
+    vfs_vnode_t* dir = vfs_resolve(path);
+    if (!dir || !dir->is_directory) {
+        vfs_release(dir);
+        return -1;
+    }
+    vfs_vnode_t* old = fd_cwd();
+    fd_set_cwd(dir);
+    vfs_release(old);
+    return 0;
+}
+
+// Build the working directory's path from the vnode parents
+int vfs_getcwd(char* buffer, uint32_t size) {
+    vfs_vnode_t* chain[VFS_PATH_MAX / 2];
+    int depth = 0;
+    vfs_vnode_t* v = fd_cwd();
+    while (v && v != v->parent && depth < VFS_PATH_MAX / 2) {
+        chain[depth++] = v;
+        v = v->parent;
+    }
+    
+    uint32_t len = 0;
+    for (int i = depth - 1; i >= 0; i--) {
+        uint32_t n = strlen(chain[i]->name);
+        if (len + 1 + n + 1 > size) return -1;
+        buffer[len++] = '/';
+        memcpy(buffer + len, chain[i]->name, n);
+        len += n;
+    }
+    if (len == 0) {
+        if (size < 2) return -1;
+        buffer[len++] = '/';
+    }
+    buffer[len] = '\0';
+    return 0;
+}
+
+// Report a mount's size and usage
+int vfs_statfs(int index, statfs_t* st) {
+    vfs_mount_t* m = vfs_get_mount(index);
+    if (!m || !st) {
+        return -1;
+    }
+    memset(st, 0, sizeof(*st));
+    uint32_t i;
+    for (i = 0; m->path[i] && i < sizeof(st->path) - 1; i++) st->path[i] = m->path[i];
+    for (i = 0; m->ops->name[i] && i < sizeof(st->type) - 1; i++) st->type[i] = m->ops->name[i];
+    return m->ops->statfs ? m->ops->statfs(m, st) : 0;
+}
+
+// Write back every mounted filesystem
+int vfs_sync(void) {
+    int result = 0;
+    for (int i = 0; i < VFS_MAX_MOUNTS; i++) {
+        if (mounts[i].used && mounts[i].ops->sync && mounts[i].ops->sync(&mounts[i]) != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,355 @@
+#include "../include/virtio_blk.h"
+#include "../include/pci.h"
+#include "../include/idt.h"
+#include "../include/memory.h"
+#include "../include/blkdev.h"
+#include "../include/stdio.h"
+
+// PCI IDs (transitional virtio-blk device exposes the legacy I/O interface)
+#define VIRTIO_VENDOR_ID        0x1AF4
+#define VIRTIO_BLK_DEVICE_ID    0x1001
+
+// Legacy virtio PCI registers (offsets into BAR0 I/O space)
+#define VIRTIO_REG_DEVICE_FEATURES  0x00
+#define VIRTIO_REG_GUEST_FEATURES   0x04
+#define VIRTIO_REG_QUEUE_ADDRESS    0x08
+#define VIRTIO_REG_QUEUE_SIZE       0x0C
+#define VIRTIO_REG_QUEUE_SELECT     0x0E
+#define VIRTIO_REG_QUEUE_NOTIFY     0x10
+#define VIRTIO_REG_DEVICE_STATUS    0x12
+#define VIRTIO_REG_ISR_STATUS       0x13
+#define VIRTIO_REG_BLK_CAPACITY     0x14  // Device config (no MSI-X): 64-bit sector count
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FAILED        0x80
+
+// Descriptor flags
+#define VIRTQ_DESC_F_NEXT   1  // Buffer continues in the 'next' field
+#define VIRTQ_DESC_F_WRITE  2  // Buffer is device write-only
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 1
+#define VIRTQ_USED_F_NO_NOTIFY     1
+
+// Block request types and status
+#define VIRTIO_BLK_T_IN     0
+#define VIRTIO_BLK_T_OUT    1
+#define VIRTIO_BLK_S_OK     0
+
+// Request limits
+#define VIRTIO_BLK_MAX_BATCH      64   // Requests in flight per notification
+#define VIRTIO_BLK_MAX_REQ_SECTORS 128 // 64KB of data per request
+
+// Split virtqueue layout (legacy: 4KB aligned, used ring on its own page)
+typedef struct __attribute__((packed)) {
+    uint64_t addr;   // Physical address of buffer
+    uint32_t len;    // Buffer length
+    uint16_t flags;  // VIRTQ_DESC_F_*
+    uint16_t next;   // Next descriptor in chain
+} virtq_desc_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} virtq_avail_t;
+
+typedef struct __attribute__((packed)) {
+    uint32_t id;     // Head descriptor of the completed chain
+    uint32_t len;    // Bytes written by the device
+} virtq_used_elem_t;
+
+typedef struct __attribute__((packed)) {
+    uint16_t flags;
+    uint16_t idx;
+    virtq_used_elem_t ring[];
+} virtq_used_t;
+
+// Request header (device-readable)
+typedef struct __attribute__((packed)) {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} virtio_blk_req_t;
+
+// I/O functions
+static inline void outb(uint16_t port, uint8_t value) {
+    __asm__ volatile("outb %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint8_t inb(uint16_t port) {
+    uint8_t value;
+    __asm__ volatile("inb %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outw(uint16_t port, uint16_t value) {
+    __asm__ volatile("outw %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint16_t inw(uint16_t port) {
+    uint16_t value;
+    __asm__ volatile("inw %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+static inline void outl(uint16_t port, uint32_t value) {
+    __asm__ volatile("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+static inline uint32_t inl(uint16_t port) {
+    uint32_t value;
+    __asm__ volatile("inl %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
+// Keep the compiler from reordering ring updates around device accesses
+#define virtio_barrier() __asm__ volatile("mfence" : : : "memory")
+
+// Device state
+static pci_device_t pci_dev;
+static uint16_t io_base = 0;
+static uint8_t irq_line = 0;
+static uint16_t queue_size = 0;
+static uint32_t batch_limit = 0;
+
+static virtq_desc_t* desc = NULL;
+static volatile virtq_avail_t* avail = NULL;
+static volatile virtq_used_t* used = NULL;
+static uint16_t last_used_idx = 0;
+
+// Per-slot request headers and status bytes (one page, DMA-visible)
+static virtio_blk_req_t* req_headers = NULL;
+static volatile uint8_t* req_status = NULL;
+
+// Interrupt flag (set by virtio_blk_irq_handler)
+static volatile int virtio_irq_received = 0;
+
+// IRQ handler (called from virtio_blk_handler_asm in idt_asm.asm)
+// Returns: the IRQ line, so the stub only sends the slave PIC an EOI for 8-15
+uint64_t virtio_blk_irq_handler(void) {
+    // Reading ISR status acknowledges the interrupt and de-asserts the line
+    if (inb(io_base + VIRTIO_REG_ISR_STATUS) & 1) {
+        virtio_irq_received = 1;
+    }
+    return irq_line;
+}
+
+// Wait until the device has consumed every submitted request
+static int virtio_wait_used(uint16_t target) {
+    for (uint32_t timeout = 10000; timeout > 0; timeout--) {
+        virtio_barrier();
+        if (used->idx == target) {
+            virtio_irq_received = 0;
+            return 0;
+        }
+        if (virtio_irq_received) {
+            virtio_irq_received = 0;
+            continue;
+        }
+        __asm__ volatile("sti; hlt");  // Completion IRQ (or the 1ms timer) wakes us
+    }
+    return -1;  // Timeout (~10 seconds)
+}
+
+// Submit up to batch_limit requests covering [lba, lba + count) and wait for them
+// Returns: number of sectors transferred, or -1 on error
+static int virtio_blk_batch(uint32_t type, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    uint32_t done = 0;
+    uint32_t slots = 0;
+    uint16_t avail_idx = avail->idx;
+    
+    while (done < count && slots < batch_limit) {
+        uint32_t n = count - done;
+        if (n > VIRTIO_BLK_MAX_REQ_SECTORS) n = VIRTIO_BLK_MAX_REQ_SECTORS;
+        
+        // Slot i owns descriptors 3i (header), 3i+1 (data), 3i+2 (status)
+        uint16_t head = (uint16_t)(slots * 3);
+        req_headers[slots].type = type;
+        req_headers[slots].reserved = 0;
+        req_headers[slots].sector = lba + done;
+        req_status[slots] = 0xFF;
+        
+        desc[head].addr = (uint64_t)(uintptr_t)&req_headers[slots];
+        desc[head].len = sizeof(virtio_blk_req_t);
+        desc[head].flags = VIRTQ_DESC_F_NEXT;
+        desc[head].next = head + 1;
+        
+        desc[head + 1].addr = (uint64_t)(uintptr_t)(buffer + done * 512);
+        desc[head + 1].len = n * 512;
+        desc[head + 1].flags = VIRTQ_DESC_F_NEXT | (type == VIRTIO_BLK_T_IN ? VIRTQ_DESC_F_WRITE : 0);
+        desc[head + 1].next = head + 2;
+        
+        desc[head + 2].addr = (uint64_t)(uintptr_t)&req_status[slots];
+        desc[head + 2].len = 1;
+        desc[head + 2].flags = VIRTQ_DESC_F_WRITE;
+        desc[head + 2].next = 0;
+        
+        avail->ring[avail_idx % queue_size] = head;
+        avail_idx++;
+        done += n;
+        slots++;
+    }
+    
+    // Publish the whole batch, then notify the device once
+    virtio_barrier();
+    avail->idx = avail_idx;
+    virtio_barrier();
+    if (!(used->flags & VIRTQ_USED_F_NO_NOTIFY)) {
+        outw(io_base + VIRTIO_REG_QUEUE_NOTIFY, 0);
+    }
+    
+    uint16_t target = (uint16_t)(last_used_idx + slots);
+    if (virtio_wait_used(target) != 0) {
+        printf("virtio-blk: request timeout\n");
+        return -1;
+    }
+    last_used_idx = target;
+    
+    for (uint32_t i = 0; i < slots; i++) {
+        if (req_status[i] != VIRTIO_BLK_S_OK) {
+            return -1;
+        }
+    }
+    return (int)done;
+}
+
+static int virtio_blk_transfer(uint32_t type, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    if (io_base == 0 || count == 0) return -1;
+    
+    while (count > 0) {
+        int n = virtio_blk_batch(type, lba, count, buffer);
+        if (n <= 0) return -1;
+        lba += n;
+        count -= n;
+        buffer += n * 512;
+    }
+    return 0;
+}
+
+int virtio_blk_read_sectors(uint32_t lba, uint32_t count, uint8_t* buffer) {
+    return virtio_blk_transfer(VIRTIO_BLK_T_IN, lba, count, buffer);
+}
+
+int virtio_blk_write_sectors(uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    return virtio_blk_transfer(VIRTIO_BLK_T_OUT, lba, count, (uint8_t*)buffer);
+}
+
+// Block device adapters
+static int virtio_blk_read(blkdev_t* dev, uint32_t lba, uint32_t count, uint8_t* buffer) {
+    (void)dev;
+    return virtio_blk_read_sectors(lba, count, buffer);
+}
+
+static int virtio_blk_write(blkdev_t* dev, uint32_t lba, uint32_t count, const uint8_t* buffer) {
+    (void)dev;
+    return virtio_blk_write_sectors(lba, count, buffer);
+}
+
+static blkdev_t virtio_blkdev = {
+    .name = "vda",
+    .read = virtio_blk_read,
+    .write = virtio_blk_write,
+};
+
+// Detect a virtio-blk device on the PCI bus
+int virtio_blk_detect(void) {
+    return pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, &pci_dev) == 0;
+}
+
+// Set up the request queue (queue 0)
+static int virtio_setup_queue(void) {
+    outw(io_base + VIRTIO_REG_QUEUE_SELECT, 0);
+    queue_size = inw(io_base + VIRTIO_REG_QUEUE_SIZE);
+    if (queue_size == 0) {
+        return -1;
+    }
+    
+    // Legacy layout: descriptors + avail ring, then the used ring on the next 4KB boundary
+    uint32_t avail_end = queue_size * sizeof(virtq_desc_t) + 6 + 2 * queue_size;
+    uint32_t used_offset = (avail_end + 4095) & ~4095u;
+    uint32_t used_bytes = (6 + sizeof(virtq_used_elem_t) * queue_size + 4095) & ~4095u;
+    uint32_t pages = (used_offset + used_bytes) / 4096;
+    
+    uint32_t ring_addr = pmem_alloc_pages(pages);
+    uint32_t req_addr = pmem_alloc_page();
+    if (ring_addr == 0 || req_addr == 0) {
+        return -1;
+    }
+    
+    uint8_t* ring = (uint8_t*)(uintptr_t)ring_addr;
+    for (uint32_t i = 0; i < pages * 4096; i++) ring[i] = 0;
+    uint8_t* req_page = (uint8_t*)(uintptr_t)req_addr;
+    for (uint32_t i = 0; i < 4096; i++) req_page[i] = 0;
+    
+    desc = (virtq_desc_t*)ring;
+    avail = (volatile virtq_avail_t*)(ring + queue_size * sizeof(virtq_desc_t));
+    used = (volatile virtq_used_t*)(ring + used_offset);
+    last_used_idx = 0;
+    
+    // Each request needs three descriptors
+    batch_limit = queue_size / 3;
+    if (batch_limit > VIRTIO_BLK_MAX_BATCH) batch_limit = VIRTIO_BLK_MAX_BATCH;
+    req_headers = (virtio_blk_req_t*)req_page;
+    req_status = req_page + VIRTIO_BLK_MAX_BATCH * sizeof(virtio_blk_req_t);
+    
+    // Tell the device where the queue lives (page frame number)
+    outl(io_base + VIRTIO_REG_QUEUE_ADDRESS, ring_addr >> 12);
+    return 0;
+}
+
+// Initialize the device
+int virtio_blk_init(void) {
+    printf("Initializing virtio-blk...\n");
+    
+    int is_io = 0;
+    uint64_t bar0 = pci_read_bar(pci_dev, 0, &is_io);
+    if (!is_io || bar0 == 0) {
+        printf("virtio-blk: legacy I/O BAR not available\n");
+        return -1;
+    }
+    io_base = (uint16_t)bar0;
+    irq_line = pci_config_read8(pci_dev, PCI_INTERRUPT_LINE);
+    pci_enable_device(pci_dev);
+    
+    // Reset, then acknowledge the device
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, 0);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    
+    // No optional features needed
+    (void)inl(io_base + VIRTIO_REG_DEVICE_FEATURES);
+    outl(io_base + VIRTIO_REG_GUEST_FEATURES, 0);
+    
+    if (virtio_setup_queue() != 0) {
+        outb(io_base + VIRTIO_REG_DEVICE_STATUS, VIRTIO_STATUS_FAILED);
+        io_base = 0;
+        printf("virtio-blk: queue setup failed\n");
+        return -1;
+    }
+    
+    // Hook the PCI interrupt line (legacy INTx routed through the 8259A)
+    if (irq_line < 16) {
+        extern void virtio_blk_handler_asm(void);
+        idt_set_gate(32 + irq_line, (uint64_t)virtio_blk_handler_asm, 0x08, 0x8E);
+        if (irq_line >= 8) {
+            outb(0xA1, inb(0xA1) & ~(1 << (irq_line - 8)));
+            outb(0x21, inb(0x21) & ~(1 << 2));  // Cascade line
+        } else {
+            outb(0x21, inb(0x21) & ~(1 << irq_line));
+        }
+    }
+    
+    outb(io_base + VIRTIO_REG_DEVICE_STATUS,
+         VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+    
+    uint64_t capacity = inl(io_base + VIRTIO_REG_BLK_CAPACITY) |
+                        ((uint64_t)inl(io_base + VIRTIO_REG_BLK_CAPACITY + 4) << 32);
+    virtio_blkdev.total_sectors = capacity > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)capacity;
+    blkdev_register(&virtio_blkdev);
+    
+    printf("virtio-blk: %d sectors, queue size %d, IRQ %d\n",
+           virtio_blkdev.total_sectors, queue_size, irq_line);
+    return 0;
+}
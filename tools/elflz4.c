@@ -0,0 +1,227 @@
+// elflz4 - compress the loadable segments of a SantOS program (host tool)
+// Usage: elflz4 <in.elf> <out.elf>   (in and out may be the same file)
+// Each PT_LOAD segment whose file data shrinks becomes a PT_SANTOS_LZ4
+// segment holding one LZ4 block (see include/lz4.h); the others are copied
+// as they are. Section headers are dropped: the result is only for loading.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "../include/lz4.h"
+
+#define PT_LOAD 1
+
+typedef struct {
+    uint8_t  e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} __attribute__((packed)) elf64_header_t;
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_flags;
+    uint64_t p_offset;
+    uint64_t p_vaddr;
+    uint64_t p_paddr;
+    uint64_t p_filesz;
+    uint64_t p_memsz;
+    uint64_t p_align;
+} __attribute__((packed)) elf64_program_header_t;
+
+// LZ4 block format limits
+#define MIN_MATCH     4
+#define LAST_LITERALS 5             // The block ends with at least this many literals
+#define MATCH_LIMIT   12            // No match starts in the last 12 bytes
+#define MAX_OFFSET    65535
+#define HASH_BITS     16
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint8_t* put_length(uint8_t* op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+// Emit a sequence: literals, then (if match_length) a match at 'offset' back
+static uint8_t* put_sequence(uint8_t* op, const uint8_t* literals, size_t literal_length,
+                             size_t offset, size_t match_length) {
+    uint8_t* token = op++;
+    *token = (uint8_t)((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15) {
+        op = put_length(op, literal_length - 15);
+    }
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+    if (match_length == 0) {
+        return op;
+    }
+
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    size_t code = match_length - MIN_MATCH;
+    *token |= (uint8_t)(code >= 15 ? 15 : code);
+    if (code >= 15) {
+        op = put_length(op, code - 15);
+    }
+    return op;
+}
+
+// Greedy LZ4 block compressor with a single-entry hash table
+// dst must hold size + size / 255 + 16 bytes
+// Returns: compressed size
+static size_t lz4_compress(const uint8_t* src, size_t size, uint8_t* dst) {
+    static uint32_t table[1 << HASH_BITS];
+    memset(table, 0xFF, sizeof(table));
+    uint8_t* op = dst;
+    size_t ip = 0, anchor = 0;
+
+    if (size > MATCH_LIMIT) {
+        size_t limit = size - MATCH_LIMIT;
+        while (ip < limit) {
+            uint32_t sequence = read32(src + ip);
+            uint32_t hash = (sequence * 2654435761u) >> (32 - HASH_BITS);
+            uint32_t candidate = table[hash];
+            table[hash] = (uint32_t)ip;
+            if (candidate == 0xFFFFFFFF || ip - candidate > MAX_OFFSET || read32(src + candidate) != sequence) {
+                ip++;
+                continue;
+            }
+            size_t length = MIN_MATCH;
+            while (ip + length < size - LAST_LITERALS && src[candidate + length] == src[ip + length]) {
+                length++;
+            }
+            op = put_sequence(op, src + anchor, ip - anchor, ip - candidate, length);
+            ip += length;
+            anchor = ip;
+        }
+    }
+    op = put_sequence(op, src + anchor, size - anchor, 0, 0);
+    return (size_t)(op - dst);
+}
+
+static void fail(const char* message, const char* detail) {
+    fprintf(stderr, "elflz4: %s: %s\n", detail, message);
+    exit(1);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: %s <in.elf> <out.elf>\n", argv[0]);
+        return 1;
+    }
+
+    FILE* f = fopen(argv[1], "rb");
+    if (!f) {
+        fail("cannot open", argv[1]);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* in = malloc(size > 0 ? (size_t)size : 1);
+    if (!in || fread(in, 1, (size_t)size, f) != (size_t)size) {
+        fail("cannot read", argv[1]);
+    }
+    fclose(f);
+
+    elf64_header_t header;
+    if ((size_t)size < sizeof(header)) {
+        fail("not an ELF file", argv[1]);
+    }
+    memcpy(&header, in, sizeof(header));
+    if (memcmp(header.e_ident, "\x7F" "ELF", 4) != 0 || header.e_ident[4] != 2 ||
+        header.e_phentsize != sizeof(elf64_program_header_t) ||
+        header.e_phoff + (uint64_t)header.e_phnum * sizeof(elf64_program_header_t) > (uint64_t)size) {
+        fail("not a 64-bit ELF file", argv[1]);
+    }
+    elf64_program_header_t* ph = calloc(header.e_phnum ? header.e_phnum : 1, sizeof(*ph));
+    if (!ph) {
+        fail("out of memory", argv[1]);
+    }
+    memcpy(ph, in + header.e_phoff, header.e_phnum * sizeof(*ph));
+
+    // Header, program headers, then each segment's data, 16-byte aligned
+    size_t capacity = sizeof(header) + header.e_phnum * sizeof(*ph) + 16;
+    for (int i = 0; i < header.e_phnum; i++) {
+        if (ph[i].p_offset + ph[i].p_filesz > (uint64_t)size) {
+            fail("segment past the end of the file", argv[1]);
+        }
+        capacity += ph[i].p_filesz + ph[i].p_filesz / 255 + 32;
+    }
+    uint8_t* out = calloc(1, capacity);
+    uint8_t* check = malloc((size_t)size + 1);
+    if (!out || !check) {
+        fail("out of memory", argv[1]);
+    }
+
+    size_t offset = (sizeof(header) + header.e_phnum * sizeof(*ph) + 15) & ~(size_t)15;
+    uint64_t raw_total = 0, packed_total = 0;
+    for (int i = 0; i < header.e_phnum; i++) {
+        const uint8_t* data = in + ph[i].p_offset;
+        size_t length = ph[i].p_filesz;
+        if (length == 0) {
+            ph[i].p_offset = 0;
+            continue;
+        }
+        if (ph[i].p_type == PT_LOAD) {
+            size_t packed = lz4_compress(data, length, out + offset);
+            raw_total += length;
+
+            // Only keep blocks the kernel's decoder gives back exactly
+            if (packed < length &&
+                lz4_decompress(out + offset, (uint32_t)packed, check, (uint32_t)length) == (int)length &&
+                memcmp(check, data, length) == 0) {
+                ph[i].p_type = PT_SANTOS_LZ4;
+                ph[i].p_paddr = length;
+                length = packed;
+            } else {
+                memcpy(out + offset, data, length);
+            }
+            packed_total += length;
+        } else {
+            memcpy(out + offset, data, length);
+        }
+        ph[i].p_offset = offset;
+        ph[i].p_filesz = length;
+        offset = (offset + length + 15) & ~(size_t)15;
+    }
+
+    header.e_phoff = sizeof(header);
+    header.e_shoff = 0;
+    header.e_shnum = 0;
+    header.e_shstrndx = 0;
+    memcpy(out, &header, sizeof(header));
+    memcpy(out + sizeof(header), ph, header.e_phnum * sizeof(*ph));
+
+    f = fopen(argv[2], "wb");
+    if (!f || fwrite(out, 1, offset, f) != offset || fclose(f) != 0) {
+        fail("cannot write", argv[2]);
+    }
+    printf("  %s: segments %llu -> %llu bytes (%llu%%), file %ld -> %zu bytes\n", argv[2],
+           (unsigned long long)raw_total, (unsigned long long)packed_total,
+           (unsigned long long)(raw_total ? packed_total * 100 / raw_total : 100), size, offset);
+    free(in);
+    free(out);
+    free(check);
+    free(ph);
+    return 0;
+}
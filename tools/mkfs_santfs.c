@@ -0,0 +1,374 @@
+// mkfs_santfs - make a santfs volume and fill it with files (host tool)
+// Usage: mkfs_santfs [-b block_size] [-s size_kb] [-L label] <image> [PATH=file ...]
+// PATH is where the file goes on the volume (e.g. BIN/HELLO.ELF=programs/hello.elf);
+// directories on the way are created. Without -s the image keeps its size.
+// Every file is written as one extent and every directory as a packed B+tree,
+// so a fresh volume needs no overflow blocks and no splits until it changes.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "../include/santfs.h"
+
+#define COMPONENT_MAX 31        // The kernel's VFS limits path components to this
+
+typedef struct entry {
+    char name[SANTFS_NAME_MAX + 1];
+    uint32_t ino;
+    int is_dir;
+    const char* source;         // Files: host path
+    struct entry* children;     // Directories
+    struct entry* next;
+} entry_t;
+
+static FILE* out;
+static santfs_super_t sb;
+static uint8_t* block_bitmap;
+static uint8_t* inode_bitmap;
+static santfs_inode_t* inodes;
+static uint32_t next_block;
+static uint32_t next_ino = SANTFS_ROOT_INO + 1;
+
+static void fail(const char* message, const char* detail) {
+    fprintf(stderr, "mkfs_santfs: %s%s%s\n", message, detail ? ": " : "", detail ? detail : "");
+    exit(1);
+}
+
+static void write_at(uint32_t block, const void* data, size_t length) {
+    if (fseeko(out, (off_t)block * sb.block_size, SEEK_SET) != 0 || fwrite(data, 1, length, out) != length) {
+        fail("write failed", NULL);
+    }
+}
+
+static void set_bit(uint8_t* map, uint32_t bit) {
+    map[bit / 8] |= (uint8_t)(1 << (bit % 8));
+}
+
+static uint32_t alloc_blocks(uint32_t count) {
+    if (count > sb.total_blocks - next_block) {
+        fail("volume too small for these files", NULL);
+    }
+    uint32_t start = next_block;
+    next_block += count;
+    return start;
+}
+
+static uint32_t alloc_ino(void) {
+    if (next_ino >= sb.inode_count) {
+        fail("out of inodes", NULL);
+    }
+    return next_ino++;
+}
+
+// Find or add a child of a directory
+static entry_t* child(entry_t* dir, const char* name, int is_dir) {
+    for (entry_t* e = dir->children; e; e = e->next) {
+        if (strcmp(e->name, name) == 0) {
+            if (e->is_dir != is_dir) {
+                fail("file and directory with the same name", name);
+            }
+            return e;
+        }
+    }
+    entry_t* e = calloc(1, sizeof(entry_t));
+    if (!e) {
+        fail("out of memory", NULL);
+    }
+    strcpy(e->name, name);
+    e->is_dir = is_dir;
+    e->ino = alloc_ino();
+    e->next = dir->children;
+    dir->children = e;
+    return e;
+}
+
+// Add PATH=file under the root, creating the directories on the way
+static void add_file(entry_t* root, const char* arg) {
+    const char* eq = strchr(arg, '=');
+    if (!eq || eq == arg) {
+        fail("bad entry (want PATH=file)", arg);
+    }
+    entry_t* dir = root;
+    const char* p = arg;
+    while (p < eq) {
+        const char* end = p;
+        while (end < eq && *end != '/') {
+            end++;
+        }
+        size_t length = (size_t)(end - p);
+        if (length == 0 || length > COMPONENT_MAX) {
+            fail("bad path component (1 to 31 characters)", arg);
+        }
+        char name[SANTFS_NAME_MAX + 1];
+        memcpy(name, p, length);
+        name[length] = '\0';
+        if (end == eq) {
+            child(dir, name, 0)->source = eq + 1;
+        } else {
+            dir = child(dir, name, 1);
+        }
+        p = end + 1;
+    }
+}
+
+// Copy a host file into consecutive blocks
+static void write_file(entry_t* e) {
+    FILE* f = fopen(e->source, "rb");
+    if (!f) {
+        fail("cannot read", e->source);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint32_t blocks = (uint32_t)((size + sb.block_size - 1) / sb.block_size);
+    
+    santfs_inode_t* inode = &inodes[e->ino];
+    inode->mode = SANTFS_MODE_FILE;
+    inode->links = 1;
+    inode->size = (uint32_t)size;
+    if (blocks > 0) {
+        uint8_t* data = calloc(blocks, sb.block_size);
+        if (!data || fread(data, 1, (size_t)size, f) != (size_t)size) {
+            fail("cannot read", e->source);
+        }
+        uint32_t start = alloc_blocks(blocks);
+        write_at(start, data, (size_t)blocks * sb.block_size);
+        free(data);
+        inode->blocks = blocks;
+        inode->extent_count = 1;
+        inode->extents[0].logical = 0;
+        inode->extents[0].start = start;
+        inode->extents[0].length = blocks;
+    }
+    fclose(f);
+}
+
+static int compare_records(const void* a, const void* b) {
+    return strcmp(((const santfs_record_t*)a)->name, ((const santfs_record_t*)b)->name);
+}
+
+// Write one level of a B+tree, packing the records into full nodes
+// Returns: number of nodes, with a record per node (its first name) in *up
+static uint32_t write_level(santfs_record_t* records, uint32_t count, uint16_t level, santfs_record_t** up) {
+    uint32_t per_node = SANTFS_RECORDS_PER_NODE(sb.block_size);
+    uint32_t nodes = count ? (count + per_node - 1) / per_node : 1;
+    uint32_t first = alloc_blocks(nodes);
+    uint8_t* block = malloc(sb.block_size);
+    *up = calloc(nodes, sizeof(santfs_record_t));
+    if (!block || !*up) {
+        fail("out of memory", NULL);
+    }
+    
+    for (uint32_t n = 0; n < nodes; n++) {
+        uint32_t start = n * per_node;
+        uint32_t in_node = count - start < per_node ? count - start : per_node;
+        if (count == 0) {
+            in_node = 0;
+        }
+        memset(block, 0, sb.block_size);
+        santfs_node_t* node = (santfs_node_t*)block;
+        node->magic = SANTFS_NODE_MAGIC;
+        node->level = level;
+        node->count = (uint16_t)in_node;
+        node->next = level == 0 && n + 1 < nodes ? first + n + 1 : 0;
+        memcpy(node + 1, &records[start], in_node * sizeof(santfs_record_t));
+        write_at(first + n, block, sb.block_size);
+        
+        (*up)[n].ino = first + n;
+        if (in_node > 0) {
+            memcpy((*up)[n].name, records[start].name, sizeof(records[start].name));
+            (*up)[n].name_len = records[start].name_len;
+        }
+    }
+    free(block);
+    return nodes;
+}
+
+// Write a directory's children, then the directory as a B+tree
+static void write_dir(entry_t* dir) {
+    uint32_t count = 0;
+    for (entry_t* e = dir->children; e; e = e->next) {
+        if (e->is_dir) {
+            write_dir(e);
+        } else {
+            write_file(e);
+        }
+        count++;
+    }
+    
+    santfs_record_t* records = calloc(count ? count : 1, sizeof(santfs_record_t));
+    if (!records) {
+        fail("out of memory", NULL);
+    }
+    uint32_t i = 0;
+    for (entry_t* e = dir->children; e; e = e->next, i++) {
+        records[i].ino = e->ino;
+        records[i].type = e->is_dir ? SANTFS_MODE_DIR : SANTFS_MODE_FILE;
+        records[i].name_len = (uint8_t)strlen(e->name);
+        strcpy(records[i].name, e->name);
+    }
+    qsort(records, count, sizeof(santfs_record_t), compare_records);
+    
+    santfs_inode_t* inode = &inodes[dir->ino];
+    inode->mode = SANTFS_MODE_DIR;
+    inode->links = 1;
+    inode->size = count;
+    
+    // Leaves, then a level of internal nodes over them until one node is left
+    uint16_t level = 0;
+    santfs_record_t* up;
+    uint32_t nodes = write_level(records, count, level, &up);
+    inode->blocks = nodes;
+    while (nodes > 1) {
+        free(records);
+        records = up;
+        nodes = write_level(records, nodes, ++level, &up);
+        inode->blocks += nodes;
+    }
+    if (level > SANTFS_BTREE_MAX_DEPTH) {
+        fail("directory too large", dir->name);
+    }
+    inode->root = up[0].ino;
+    inode->depth = level;
+    free(records);
+    free(up);
+}
+
+static uint32_t blocks_for_bits(uint32_t bits) {
+    return (bits + sb.block_size * 8 - 1) / (sb.block_size * 8);
+}
+
+int main(int argc, char** argv) {
+    uint32_t block_size = 1024;
+    uint32_t size_kb = 0;
+    const char* label = NULL;
+    int arg = 1;
+    for (; arg < argc && argv[arg][0] == '-'; arg++) {
+        if (arg + 1 >= argc) {
+            break;
+        }
+        if (strcmp(argv[arg], "-b") == 0) {
+            block_size = (uint32_t)strtoul(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-s") == 0) {
+            size_kb = (uint32_t)strtoul(argv[++arg], NULL, 0);
+        } else if (strcmp(argv[arg], "-L") == 0) {
+            label = argv[++arg];
+        } else {
+            break;
+        }
+    }
+    if (arg >= argc || argv[arg][0] == '-') {
+        fprintf(stderr, "usage: %s [-b block_size] [-s size_kb] [-L label] <image> [PATH=file ...]\n", argv[0]);
+        return 1;
+    }
+    if (block_size < SANTFS_MIN_BLOCK_SIZE || block_size > SANTFS_MAX_BLOCK_SIZE ||
+        (block_size & (block_size - 1)) != 0) {
+        fail("block size must be 1024, 2048 or 4096", NULL);
+    }
+    if (label && strlen(label) >= sizeof(sb.label)) {
+        fail("label too long (15 characters at most)", label);
+    }
+    
+    const char* image = argv[arg++];
+    out = fopen(image, "r+b");
+    if (!out) {
+        out = fopen(image, "w+b");
+    }
+    if (!out) {
+        fail("cannot open", image);
+    }
+    if (size_kb) {
+        if (ftruncate(fileno(out), (off_t)size_kb * 1024) != 0) {
+            fail("cannot size", image);
+        }
+    } else {
+        struct stat st;
+        if (fstat(fileno(out), &st) != 0 || st.st_size == 0) {
+            fail("no -s given and the image is empty", image);
+        }
+        size_kb = (uint32_t)(st.st_size / 1024);
+    }
+    
+    // Layout: one inode per 4 blocks, rounded up to whole inode-table blocks
+    sb.magic = SANTFS_MAGIC;
+    sb.version = SANTFS_VERSION;
+    sb.state = SANTFS_STATE_CLEAN;
+    sb.block_size = block_size;
+    uint64_t total = (uint64_t)size_kb * 1024 / block_size;
+    sb.total_blocks = total > SANTFS_MAX_BLOCKS ? SANTFS_MAX_BLOCKS : (uint32_t)total;
+    uint32_t per_block = block_size / SANTFS_INODE_SIZE;
+    sb.inode_blocks = (sb.total_blocks / 4 + per_block - 1) / per_block;
+    if (sb.inode_blocks == 0) {
+        sb.inode_blocks = 1;
+    }
+    sb.inode_count = sb.inode_blocks * per_block;
+    sb.bitmap_start = 1;
+    sb.bitmap_blocks = blocks_for_bits(sb.total_blocks);
+    sb.inode_bitmap_start = sb.bitmap_start + sb.bitmap_blocks;
+    sb.inode_bitmap_blocks = blocks_for_bits(sb.inode_count);
+    sb.inode_start = sb.inode_bitmap_start + sb.inode_bitmap_blocks;
+    sb.data_start = sb.inode_start + sb.inode_blocks;
+    if (sb.data_start + 1 >= sb.total_blocks) {
+        fail("image too small", image);
+    }
+    sb.feature_incompat = SANTFS_FEATURE_INCOMPAT_EXTENTS | SANTFS_FEATURE_INCOMPAT_BTREE_DIRS;
+    sb.feature_ro_compat = SANTFS_FEATURE_RO_COMPAT_SPARSE;
+    if (label) {
+        sb.feature_compat = SANTFS_FEATURE_COMPAT_LABEL;
+        strcpy(sb.label, label);
+    }
+    
+    block_bitmap = calloc(sb.bitmap_blocks, block_size);
+    inode_bitmap = calloc(sb.inode_bitmap_blocks, block_size);
+    inodes = calloc(sb.inode_count, sizeof(santfs_inode_t));
+    if (!block_bitmap || !inode_bitmap || !inodes) {
+        fail("out of memory", NULL);
+    }
+    next_block = sb.data_start;
+    
+    entry_t root;
+    memset(&root, 0, sizeof(root));
+    strcpy(root.name, "/");
+    root.is_dir = 1;
+    root.ino = SANTFS_ROOT_INO;
+    for (; arg < argc; arg++) {
+        add_file(&root, argv[arg]);
+    }
+    write_dir(&root);
+    
+    // Used: everything allocated so far, plus the bits past the end of each
+    // map so the driver never hands them out
+    for (uint32_t b = 0; b < next_block; b++) {
+        set_bit(block_bitmap, b);
+    }
+    for (uint32_t b = sb.total_blocks; b < sb.bitmap_blocks * block_size * 8; b++) {
+        set_bit(block_bitmap, b);
+    }
+    for (uint32_t i = 0; i < next_ino; i++) {
+        set_bit(inode_bitmap, i);
+    }
+    for (uint32_t i = sb.inode_count; i < sb.inode_bitmap_blocks * block_size * 8; i++) {
+        set_bit(inode_bitmap, i);
+    }
+    sb.free_blocks = sb.total_blocks - next_block;
+    sb.free_inodes = sb.inode_count - next_ino;
+    
+    uint8_t* super = calloc(1, block_size);
+    if (!super) {
+        fail("out of memory", NULL);
+    }
+    memcpy(super, &sb, sizeof(sb));
+    write_at(0, super, block_size);
+    write_at(sb.bitmap_start, block_bitmap, (size_t)sb.bitmap_blocks * block_size);
+    write_at(sb.inode_bitmap_start, inode_bitmap, (size_t)sb.inode_bitmap_blocks * block_size);
+    write_at(sb.inode_start, inodes, (size_t)sb.inode_count * sizeof(santfs_inode_t));
+    if (fclose(out) != 0) {
+        fail("cannot write", image);
+    }
+    
+    printf("%s: santfs, %u blocks of %u bytes, %u inodes, %u files and directories, %u blocks free\n",
+           image, sb.total_blocks, block_size, sb.inode_count, next_ino - SANTFS_ROOT_INO - 1, sb.free_blocks);
+    return 0;
+}
@@ -0,0 +1,101 @@
+// mkinitrd - pack programs into a SantOS boot archive (host tool)
+// Usage: mkinitrd <archive> NAME=file [NAME=file ...]
+// NAME is the file's name on the boot volume (e.g. SHELL.ELF=programs/shell.elf);
+// the kernel serves launches of /NAME from the archive.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../include/initrd.h"
+
+static uint32_t align_up(uint32_t value) {
+    return (value + INITRD_ALIGN - 1) & ~(uint32_t)(INITRD_ALIGN - 1);
+}
+
+// Read a whole file into memory
+// Returns: malloc'd contents, or NULL on error
+static uint8_t* read_file(const char* path, uint32_t* size) {
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        return NULL;
+    }
+    fseek(f, 0, SEEK_END);
+    long length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    uint8_t* data = malloc(length > 0 ? (size_t)length : 1);
+    if (data && fread(data, 1, (size_t)length, f) != (size_t)length) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *size = (uint32_t)length;
+    return data;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <archive> NAME=file [NAME=file ...]\n", argv[0]);
+        return 1;
+    }
+    uint32_t count = (uint32_t)(argc - 2);
+    if (count > INITRD_MAX_FILES) {
+        fprintf(stderr, "mkinitrd: at most %d files\n", INITRD_MAX_FILES);
+        return 1;
+    }
+    
+    initrd_entry_t entries[INITRD_MAX_FILES];
+    uint8_t* contents[INITRD_MAX_FILES];
+    memset(entries, 0, sizeof(entries));
+    
+    uint32_t offset = align_up(sizeof(initrd_header_t) + count * sizeof(initrd_entry_t));
+    for (uint32_t i = 0; i < count; i++) {
+        const char* arg = argv[i + 2];
+        const char* eq = strchr(arg, '=');
+        if (!eq || eq == arg || (size_t)(eq - arg) >= INITRD_NAME_MAX) {
+            fprintf(stderr, "mkinitrd: bad entry '%s' (want NAME=file, NAME under %d chars)\n",
+                    arg, INITRD_NAME_MAX);
+            return 1;
+        }
+        memcpy(entries[i].name, arg, (size_t)(eq - arg));
+        uint32_t size;
+        contents[i] = read_file(eq + 1, &size);
+        if (!contents[i]) {
+            fprintf(stderr, "mkinitrd: cannot read %s\n", eq + 1);
+            return 1;
+        }
+        entries[i].offset = offset;
+        entries[i].size = size;
+        offset = align_up(offset + entries[i].size);
+    }
+    
+    // Lay the archive out in memory so the checksum covers exactly what is written
+    uint8_t* image = calloc(1, offset);
+    if (!image) {
+        fprintf(stderr, "mkinitrd: out of memory\n");
+        return 1;
+    }
+    initrd_header_t* header = (initrd_header_t*)image;
+    memcpy(header->magic, INITRD_MAGIC, sizeof(header->magic));
+    header->count = count;
+    header->size = offset;
+    memcpy(image + sizeof(initrd_header_t), entries, count * sizeof(initrd_entry_t));
+    for (uint32_t i = 0; i < count; i++) {
+        memcpy(image + entries[i].offset, contents[i], entries[i].size);
+        free(contents[i]);
+    }
+    for (uint32_t i = sizeof(initrd_header_t); i < offset; i++) {
+        header->checksum += image[i];
+    }
+    
+    FILE* out = fopen(argv[1], "wb");
+    if (!out || fwrite(image, 1, offset, out) != offset || fclose(out) != 0) {
+        fprintf(stderr, "mkinitrd: cannot write %s\n", argv[1]);
+        return 1;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        printf("  %-15s %7u bytes\n", entries[i].name, entries[i].size);
+    }
+    printf("%s: %u files, %u bytes\n", argv[1], count, offset);
+    free(image);
+    return 0;
+}